@@ -14,12 +14,25 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "etm_profile.h"
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+/* input decoded by one job of --jobs, the output is about 20 times larger */
+#define SEGMENT_SIZE (256 << 10)
 
 #define false (0)
 #define true (1)
@@ -36,6 +49,7 @@ struct state {
 	int branch_count;
 	int mode; // 2 ARM, 1 Thumb, 0 Jazelle
 	int sync;
+	uint32_t daddr;
 	uint8_t formatter_packet[16];
 	int formatter_index;
 	int sourceid;
@@ -47,6 +61,20 @@ struct state {
 	bool program_flow_only;
 	bool print_input;
 	bool formatter;
+	bool print_stats;
+
+	/* the whole trace, mapped or read in at startup */
+	const uint8_t *input;
+	size_t input_size;
+	size_t input_pos;
+	struct timespec start;
+
+	FILE *out;
+	jmp_buf *eof;
+
+	/* --profile: instructions are counted instead of printed */
+	struct etm_profile *profile;
+	uint32_t cycles;	/* last PFT cycle count, for the next atom */
 };
 
 struct packet_type {
@@ -57,6 +85,76 @@ struct packet_type {
 	const char *name;
 };
 
+static inline int input_getc(struct state *state)
+{
+	if (state->input_pos >= state->input_size)
+		return -1;
+	return state->input[state->input_pos++];
+}
+
+static int load_input(struct state *state, const char *filename)
+{
+	struct stat st;
+	uint8_t *buf = NULL;
+	size_t size = 0, alloc = 0;
+	ssize_t n;
+	int fd = STDIN_FILENO;
+
+	if (filename) {
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			perror(filename);
+			return -1;
+		}
+	}
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			state->input = map;
+			state->input_size = st.st_size;
+			return 0;
+		}
+	}
+
+	/* pipes and anything else that can't be mapped */
+	do {
+		if (size == alloc) {
+			alloc = alloc ? alloc * 2 : 1 << 20;
+			buf = realloc(buf, alloc);
+			if (!buf) {
+				perror("realloc");
+				return -1;
+			}
+		}
+		n = read(fd, buf + size, alloc - size);
+		if (n > 0)
+			size += n;
+	} while (n > 0);
+	if (n < 0) {
+		perror("read");
+		return -1;
+	}
+
+	state->input = buf;
+	state->input_size = size;
+	return 0;
+}
+
+static void print_stats(struct state *state)
+{
+	struct timespec end;
+	double seconds;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - state->start.tv_sec) +
+		  (end.tv_nsec - state->start.tv_nsec) / 1e9;
+	fprintf(stderr, "%zu bytes in %.3f s, %.1f MB/s\n", state->input_size,
+		seconds, seconds > 0 ? state->input_size / seconds / 1e6 : 0.0);
+}
+
 static int get_byte_from_formatter(struct state *state)
 {
 	int ch;
@@ -67,17 +165,17 @@ static int get_byte_from_formatter(struct state *state)
 	while (1) {
 		if (!state->formatter_index) {
 			if (state->print_input)
-				printf("raw:");
+				fprintf(state->out, "raw:");
 			for (i = 0; i < 16; i++) {
-				ch = getchar();
+				ch = input_getc(state);
 				if (ch < 0)
 					return ch;
 				if (state->print_input)
-					printf(" %02x%s", ch, (!(i & 1) && (ch & 1)) ? "(ID)" : "");
+					fprintf(state->out, " %02x%s", ch, (!(i & 1) && (ch & 1)) ? "(ID)" : "");
 				state->formatter_packet[i] = ch;
 			}
 			if (state->print_input)
-				printf("\n");
+				fprintf(state->out, "\n");
 		}
 		i = state->formatter_index;
 		ch = state->formatter_packet[i];
@@ -87,7 +185,7 @@ static int get_byte_from_formatter(struct state *state)
 			if (ch & 1) {
 				ch >>= 1;
 				if (state->sourceid != ch) {
-					printf("New ID %x %d\n", ch, ebit);
+					fprintf(state->out, "New ID %x %d\n", ch, ebit);
 					state->sourceid = ch;
 					if (!ebit)
 						sourceid = ch;
@@ -99,7 +197,7 @@ static int get_byte_from_formatter(struct state *state)
 		if ((1 << sourceid) & state->sourceid_match)
 			return ch;
 		if (state->print_input)
-			printf("%02x ignored source %x\n", ch, sourceid);
+			fprintf(state->out, "%02x ignored source %x\n", ch, sourceid);
 		sourceid = state->sourceid;
 	}
 }
@@ -112,12 +210,9 @@ static int get_byte(struct state *state)
 	if (state->formatter)
 		ch = get_byte_from_formatter(state);
 	else
-		ch = getchar();
-	if (ch < 0) {
-		if (state->wait_count)
-			printf(" Waited %d", state->wait_count);
-		exit(0);
-	}
+		ch = input_getc(state);
+	if (ch < 0)
+		longjmp(*state->eof, 1);
 	state->data = ch;
 	if (!ch && state->sync <= 0) {
 		if (state->sync == -4)
@@ -126,10 +221,10 @@ static int get_byte(struct state *state)
 			state->sync--;
 	}
 	if (state->print_input) {
-		printf("%02x (", ch);
+		fprintf(state->out, "%02x (", ch);
 		for (i = 0; i < 8; i++)
-			printf("%d", (ch >> (7 - i)) & 1);
-		printf(")\n");
+			fprintf(state->out, "%d", (ch >> (7 - i)) & 1);
+		fprintf(state->out, ")\n");
 	}
 	return ch;
 }
@@ -149,24 +244,81 @@ static uint32_t next_pc(struct state *state)
 	return ret;
 }
 
+static char *put_str(char *p, const char *str)
+{
+	while (*str)
+		*p++ = *str++;
+	return p;
+}
+
+static char *put_hex32(char *p, uint32_t val)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 28; i >= 0; i -= 4)
+		*p++ = digits[(val >> i) & 0xf];
+	return p;
+}
+
+static char *put_dec(char *p, int val)
+{
+	char tmp[12];
+	unsigned int u = val < 0 ? -(unsigned int)val : val;
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (val < 0)
+		*p++ = '-';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/* the bulk of the output, formatted by hand instead of printf */
 static void print_instruction(struct state *state, bool execute)
 {
 	int waited = state->wait_count;
 	uint32_t pc = next_pc(state);
+	char line[96];
+	char *p = line;
+
 	if (waited) {
-		//printf("  Wait %d\n", state->wait_count);
+		//fprintf(state->out, "  Wait %d\n", state->wait_count);
 		state->wait_count = 0;
 	}
+	if (state->profile) {
+		profile_instruction(state->profile, pc, execute,
+				    waited + state->cycles);
+		state->cycles = 0;
+		return;
+	}
 	if (waited > state->long_wait)
-		printf("  ==== Long wait ====\n");
-	printf("%c %c(%08x)", in_sync_char(state), execute ? 'E' : 'N', pc);
-	if (state->program_flow_only)
-		printf(" +%d branch points", state->branch_count);
-	if (state->iaddr_valid != 0xffffffff)
-		printf(" valid %08x", state->iaddr_valid);
-	if (waited)
-		printf(" Waited %d", waited);
-	printf("\n");
+		fprintf(state->out, "  ==== Long wait ====\n");
+	*p++ = in_sync_char(state);
+	*p++ = ' ';
+	*p++ = execute ? 'E' : 'N';
+	*p++ = '(';
+	p = put_hex32(p, pc);
+	*p++ = ')';
+	if (state->program_flow_only) {
+		p = put_str(p, " +");
+		p = put_dec(p, state->branch_count);
+		p = put_str(p, " branch points");
+	}
+	if (state->iaddr_valid != 0xffffffff) {
+		p = put_str(p, " valid ");
+		p = put_hex32(p, state->iaddr_valid);
+	}
+	if (waited) {
+		p = put_str(p, " Waited ");
+		p = put_dec(p, waited);
+	}
+	*p++ = '\n';
+	fwrite(line, 1, p - line, state->out);
 }
 
 static int get_branch_addr(struct state *state)
@@ -179,7 +331,7 @@ static int get_branch_addr(struct state *state)
 
 	addr = (addr & ~0x3f) | ((state->data >> 1) & 0x3f);
 	if (state->print_input)
-		printf("  v %x a %x\n", valid_mask << state->mode, addr << state->mode);
+		fprintf(state->out, "  v %x a %x\n", valid_mask << state->mode, addr << state->mode);
 	while (state->data & 0x80 && count < 5) {
 		get_byte(state);
 		if (state->alt_branch && !(state->data & 0x80))
@@ -190,7 +342,7 @@ static int get_branch_addr(struct state *state)
 		valid_mask ^= mask << (7 * count - 1);
 		count++;
 		if (state->print_input)
-			printf("  v %x a %x\n", valid_mask << state->mode, addr << state->mode);
+			fprintf(state->out, "  v %x a %x\n", valid_mask << state->mode, addr << state->mode);
 	}
 	ret = (count == 5 || (state->alt_branch && count > 1)) && state->data & 0x40;
 	if (!ret && state->program_flow_only) {
@@ -212,6 +364,8 @@ static int get_branch_addr(struct state *state)
 	state->iaddr = addr;
 	state->pc = addr;
 	state->branch_count = 0;
+	if (state->profile)
+		profile_branch(state->profile, addr);
 	return ret;
 }
 
@@ -228,12 +382,12 @@ static int branch(struct state *state)
 			exception_data |= get_byte(state);
 	}
 
-	printf("%c   Branch %08x", in_sync_char(state), state->iaddr);
+	fprintf(state->out, "%c   Branch %08x", in_sync_char(state), state->iaddr);
 	if (ret)
-		printf(" Exception data %04x", exception_data);
+		fprintf(state->out, " Exception data %04x", exception_data);
 	if (state->iaddr_valid != 0xffffffff)
-		printf(" (valid %08x)", state->iaddr_valid);
-	printf(" %s\n",	mode_name[state->mode]);
+		fprintf(state->out, " (valid %08x)", state->iaddr_valid);
+	fprintf(state->out, " %s\n",	mode_name[state->mode]);
 	return 0;
 }
 
@@ -253,7 +407,7 @@ static int timestamp(struct state *state)
 			break;
 	}
 	// TODO: Convert from gray-code to binary if ETMCCER[28] is not set
-	printf("%c   Timestamp %"PRIu64" (%+"PRIi64"), R %d\n",
+	fprintf(state->out, "%c   Timestamp %"PRIu64" (%+"PRIi64"), R %d\n",
 		in_sync_char(state), timestamp, timestamp - state->timestamp, r);
 	state->timestamp = timestamp;
 	return 0;
@@ -280,8 +434,8 @@ static int ccount(struct state *state)
 			break;
 	}
 	if (count > state->long_wait)
-		printf("    ==== Long wait ====\n");
-	printf("%c   Cycle count %d\n", in_sync_char(state), count);
+		fprintf(state->out, "    ==== Long wait ====\n");
+	fprintf(state->out, "%c   Cycle count %d\n", in_sync_char(state), count);
 	return 0;
 }
 
@@ -333,7 +487,7 @@ static int isync(struct state *state)
 	ib = get_byte(state);
 	addr = get_addr(state);
 	update_addr(state, ib, addr);
-	printf("%c I-sync Context %08x, IB %02x, Addr %08x\n", in_sync_char(state), contextid, ib, state->iaddr);
+	fprintf(state->out, "%c I-sync Context %08x, IB %02x, Addr %08x\n", in_sync_char(state), contextid, ib, state->iaddr);
 	return 0;
 }
 
@@ -348,7 +502,7 @@ static int contextid(struct state *state)
 	uint32_t contextid;
 
 	contextid = get_contextid(state);
-	printf("%c ContextID %08x\n", in_sync_char(state), contextid);
+	fprintf(state->out, "%c ContextID %08x\n", in_sync_char(state), contextid);
 	return 0;
 }
 
@@ -357,7 +511,7 @@ static int vmid(struct state *state)
 	uint8_t vmid;
 
 	vmid = get_byte(state);
-	printf("%c VMID %08x\n", in_sync_char(state), vmid);
+	fprintf(state->out, "%c VMID %08x\n", in_sync_char(state), vmid);
 	return 0;
 }
 
@@ -366,12 +520,11 @@ static int ndata(struct state *state)
 	uint8_t h = state->data;
 	int size = (h >> 2) & 3;
 	int i;
-	static uint32_t daddr = 0;
 	uint32_t data = 0;
 	if (h & 0x20) {
 		for (i = 0; i < 5; i++) {
 			get_byte(state);
-			daddr = (daddr & ~(0x7f << (7 * i))) | (state->data & 0x7f) << (7 * i);
+			state->daddr = (state->daddr & ~(0x7f << (7 * i))) | (state->data & 0x7f) << (7 * i);
 			if (!(state->data & 0x80))
 				break;
 		}
@@ -382,14 +535,14 @@ static int ndata(struct state *state)
 	}
 	if (size) {
 		if (h & 0x20)
-			printf("%c   Normal data %08x addr %08x\n", in_sync_char(state), data, daddr);
+			fprintf(state->out, "%c   Normal data %08x addr %08x\n", in_sync_char(state), data, state->daddr);
 		else
-			printf("%c   Normal data %08x\n", in_sync_char(state), data);
+			fprintf(state->out, "%c   Normal data %08x\n", in_sync_char(state), data);
 	} else {
 		if (h & 0x20)
-			printf("%c   Normal data addr %08x\n", in_sync_char(state), daddr);
+			fprintf(state->out, "%c   Normal data addr %08x\n", in_sync_char(state), state->daddr);
 		else
-			printf("%c   Normal data\n", in_sync_char(state));
+			fprintf(state->out, "%c   Normal data\n", in_sync_char(state));
 	}
 	return 0;
 }
@@ -397,25 +550,25 @@ static int ndata(struct state *state)
 static int pheader_cycle_accurate(struct state *state)
 {
 	int i;
-	//printf("  ");
+	//fprintf(state->out, "  ");
 	if (state->data == 0x80) {
-		//printf("W");
+		//fprintf(state->out, "W");
 		state->wait_count++;
 	} else if ((state->data & 0xa3) == 0x80) {
 		i = (state->data >> 2) & 0x7;
 		while (i--) {
-			//printf("WE(%08x)", next_pc(state));
+			//fprintf(state->out, "WE(%08x)", next_pc(state));
 			state->wait_count++;
 			print_instruction(state, true);
 		}
 		i = (state->data >> 6) & 0x1;
 		while (i--) {
-			//printf("WN(%08x)", next_pc(state));
+			//fprintf(state->out, "WN(%08x)", next_pc(state));
 			state->wait_count++;
 			print_instruction(state, false);
 		}
 	} else if ((state->data & 0xf3) == 0x82) {
-		//printf("W%c(%08x)%c(%08x)",
+		//fprintf(state->out, "W%c(%08x)%c(%08x)",
 		//	(state->data & 0x08) ? 'N' : 'E', next_pc(state),
 		//	(state->data & 0x04) ? 'N' : 'E', next_pc(state));
 		state->wait_count++;
@@ -424,21 +577,21 @@ static int pheader_cycle_accurate(struct state *state)
 	} else if ((state->data & 0xa3) == 0xa0) {
 		i = ((state->data >> 2) & 0x7) + 1;
 		//while (i--)
-		//	printf("W");
+		//	fprintf(state->out, "W");
 		state->wait_count += i;
 		i = (state->data >> 6) & 0x1;
 		while (i--) {
-			//printf("E(%08x)", next_pc(state));
+			//fprintf(state->out, "E(%08x)", next_pc(state));
 			print_instruction(state, true);
 		}
 	} else if ((state->data & 0xfb) == 0x92) {
-		//printf("%c(%08x)", (state->data & 0x04) ? 'N' : 'E', next_pc(state));
+		//fprintf(state->out, "%c(%08x)", (state->data & 0x04) ? 'N' : 'E', next_pc(state));
 		print_instruction(state, !(state->data & 0x04));
 	} else {
 		state->sync = 0;
-		printf("  ?\n");
+		fprintf(state->out, "  ?\n");
 	}
-	//printf("\n");
+	//fprintf(state->out, "\n");
 	return 0;
 }
 
@@ -448,22 +601,22 @@ static int pheader_non_cycle_accurate(struct state *state)
 	if ((state->data & 0x83) == 0x80) {
 		i = (state->data >> 2) & 0x0f;
 		while (i--) {
-			//printf("E(%08x)", next_pc(state));
+			//fprintf(state->out, "E(%08x)", next_pc(state));
 			print_instruction(state, true);
 		}
 		if (state->data & 0x40) {
-			//printf("N(%08x)", next_pc(state));
+			//fprintf(state->out, "N(%08x)", next_pc(state));
 			print_instruction(state, false);
 		}
 	} else if ((state->data & 0xf3) == 0x82) {
-		//printf("%c(%08x)%c(%08x)",
+		//fprintf(state->out, "%c(%08x)%c(%08x)",
 		//	(state->data & 0x08) ? 'N' : 'E', next_pc(state),
 		//	(state->data & 0x04) ? 'N' : 'E', next_pc(state));
 		print_instruction(state, !(state->data & 0x08));
 		print_instruction(state, !(state->data & 0x04));
 	} else {
 		state->sync = 0;
-		printf("  ?\n");
+		fprintf(state->out, "  ?\n");
 	}
 	return 0;
 }
@@ -492,8 +645,9 @@ static int cycle_count_pft(struct state *state)
 		}
 	}
 	if (count > state->long_wait)
-		printf("    ==== Long wait ====\n");
-	printf("%c   Cycle count %d\n", in_sync_char(state), count);
+		fprintf(state->out, "    ==== Long wait ====\n");
+	fprintf(state->out, "%c   Cycle count %d\n", in_sync_char(state), count);
+	state->cycles = count;
 	return 0;
 }
 
@@ -513,7 +667,7 @@ static int isync_pft(struct state *state)
 	}
 
 	contextid = get_contextid(state);
-	printf("%c I-sync Context %08x, IB %02x, Addr %08x\n", in_sync_char(state), contextid, ib, state->iaddr);
+	fprintf(state->out, "%c I-sync Context %08x, IB %02x, Addr %08x\n", in_sync_char(state), contextid, ib, state->iaddr);
 	return 0;
 }
 
@@ -528,12 +682,12 @@ static int waypoint(struct state *state)
 	if (ret)
 		ib = get_byte(state);
 
-	printf("%c   Waypoint %08x", in_sync_char(state), state->iaddr);
+	fprintf(state->out, "%c   Waypoint %08x", in_sync_char(state), state->iaddr);
 	if (ret)
-		printf(" ib %02x", ib);
+		fprintf(state->out, " ib %02x", ib);
 	if (state->iaddr_valid != 0xffffffff)
-		printf(" (valid %08x)", state->iaddr_valid);
-	printf(" %s\n", mode_name[state->mode]);
+		fprintf(state->out, " (valid %08x)", state->iaddr_valid);
+	fprintf(state->out, " %s\n", mode_name[state->mode]);
 
 	return 0;
 }
@@ -592,13 +746,13 @@ static int atom(struct state *state)
 
 static int trigger(struct state *state)
 {
-	printf("%c   Trigger\n", in_sync_char(state));
+	fprintf(state->out, "%c   Trigger\n", in_sync_char(state));
 	return 0;
 }
 
 static int except_ret(struct state *state)
 {
-	printf("%c   Exception return\n", in_sync_char(state));
+	fprintf(state->out, "%c   Exception return\n", in_sync_char(state));
 	return 0;
 }
 
@@ -666,6 +820,8 @@ struct packet_type packet_types_pft[] = {
 };
 
 struct packet_type *packet_types;
+/* packet_types[] entry of each header byte */
+static struct packet_type *dispatch[256];
 
 int is_match(int i, int ch)
 {
@@ -674,12 +830,236 @@ int is_match(int i, int ch)
 		 (packet_types[i].nonzero_mask & ch));
 }
 
+/* decode packets until one starts at or after stop, or the input ends */
+static void decode_range(struct state *state, size_t stop)
+{
+	struct packet_type *type;
+	int ch;
+
+	while (state->input_pos < stop) {
+		ch = get_byte(state);
+		type = dispatch[ch];
+		if (state->print_input)
+			fprintf(state->out, "  %s\n", type->name);
+		if (type->decode) {
+			type->decode(state);
+		} else {
+			state->sync = 0;
+			fprintf(state->out, "  %02x: not handled (%s)\n", ch, type->name);
+		}
+	}
+}
+
+static void end_of_trace(struct state *state)
+{
+	if (state->wait_count)
+		fprintf(state->out, " Waited %d", state->wait_count);
+}
+
+/*
+ * --jobs: the trace is cut in segments at the I-sync packets that follow
+ * an A-sync (five or more 0x00, then 0x80), every segment is decoded by
+ * a worker into its own buffer, and the buffers are written in order.
+ * A segment ends at the first packet starting in the next segment, so
+ * each byte is decoded once. The first segment is decoded like the
+ * serial decoder does; the others start from their I-sync with a new,
+ * in-sync state, so a timestamp delta or wait count carried over a
+ * segment boundary is not printed the same as with --jobs=1.
+ */
+struct segment {
+	size_t start;
+	size_t stop;
+	char *output;
+	size_t output_size;
+	bool done;
+};
+
+struct decoder_pool {
+	const struct state *config;
+	struct segment *segments;
+	size_t count;
+	size_t next;	/* next segment to decode */
+	size_t written;	/* segments written to stdout */
+	size_t window;	/* at most this many decoded but not written */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static size_t find_sync(const uint8_t *buf, size_t size, size_t pos)
+{
+	const uint8_t *p;
+
+	if (pos < 5)
+		pos = 5;
+	while (pos + 1 < size) {
+		p = memchr(buf + pos, 0x80, size - pos - 1);
+		if (!p)
+			break;
+		pos = p - buf;
+		if (buf[pos + 1] == 0x08 && !buf[pos - 1] && !buf[pos - 2] &&
+		    !buf[pos - 3] && !buf[pos - 4] && !buf[pos - 5])
+			return pos + 1;
+		pos++;
+	}
+	return size;
+}
+
+static size_t split_segments(const uint8_t *buf, size_t size,
+			     struct segment **segments)
+{
+	size_t count = 0, alloc = size / SEGMENT_SIZE + 2;
+	size_t pos = 0, next;
+	struct segment *seg;
+
+	seg = calloc(alloc, sizeof(*seg));
+	if (!seg)
+		return 0;
+	while (pos < size) {
+		next = find_sync(buf, size, pos + SEGMENT_SIZE < size ?
+				 pos + SEGMENT_SIZE : size);
+		seg[count].start = pos;
+		seg[count].stop = next;
+		count++;
+		pos = next;
+	}
+	*segments = seg;
+	return count;
+}
+
+static void decode_segment(const struct state *config, struct segment *seg,
+			   bool first, struct etm_profile *profile)
+{
+	struct state state = *config;
+	jmp_buf eof;
+	bool at_end = false;
+
+	if (!first) {
+		state.sync = 1;
+		state.input_pos = seg->start;
+	}
+	state.profile = profile;
+	if (profile)
+		state.out = fopen("/dev/null", "w");
+	else
+		state.out = open_memstream(&seg->output, &seg->output_size);
+	if (!state.out) {
+		perror("open_memstream");
+		exit(1);
+	}
+	state.eof = &eof;
+	if (!setjmp(eof))
+		decode_range(&state, seg->stop);
+	else
+		at_end = true;
+	if (at_end || state.input_pos >= state.input_size)
+		end_of_trace(&state);
+	fclose(state.out);
+}
+
+static void *decode_worker(void *arg)
+{
+	struct decoder_pool *pool = arg;
+	struct etm_profile *profile = NULL;
+	size_t i;
+
+	if (pool->config->profile) {
+		profile = profile_new();
+		if (!profile) {
+			perror("profile_new");
+			exit(1);
+		}
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->next < pool->count) {
+		if (pool->next >= pool->written + pool->window) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		decode_segment(pool->config, &pool->segments[i], i == 0,
+			       profile);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->segments[i].done = true;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	if (profile) {
+		profile_merge(pool->config->profile, profile);
+		profile_free(profile);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static int decode_parallel(struct state *state, int jobs)
+{
+	struct decoder_pool pool;
+	pthread_t *threads;
+	struct segment *seg;
+	int i, started = 0;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.config = state;
+	pool.count = split_segments(state->input, state->input_size,
+				    &pool.segments);
+	pool.window = 2 * jobs;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	threads = calloc(jobs, sizeof(*threads));
+	if (!threads || !pool.segments)
+		return 1;
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[i], NULL, decode_worker, &pool))
+			break;
+		started++;
+	}
+	if (!started) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.written < pool.count) {
+		seg = &pool.segments[pool.written];
+		if (!seg->done) {
+			pthread_cond_wait(&pool.cond, &pool.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pool.lock);
+
+		fwrite(seg->output, 1, seg->output_size, stdout);
+		free(seg->output);
+		seg->output = NULL;
+
+		pthread_mutex_lock(&pool.lock);
+		pool.written++;
+		pthread_cond_broadcast(&pool.cond);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	if (state->print_stats)
+		fprintf(stderr, "%zu segments, %d jobs\n", pool.count, started);
+	free(threads);
+	free(pool.segments);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
+	jmp_buf eof;
+	int jobs = 1;
+	bool profile = false;
+	const char *symbols = NULL;
+	const char *folded = NULL;
 	int ch;
 	int i;
 	int mc;
-	int (*decode)(struct state *state);
 	bool print_config = false;
 	struct state state;
 	int c;
@@ -696,6 +1076,11 @@ int main(int argc, char **argv)
 		OPT_LONG_WAIT,
 		OPT_PRINT_INPUT,
 		OPT_PRINT_CONFIG,
+		OPT_PRINT_STATS,
+		OPT_JOBS,
+		OPT_PROFILE,
+		OPT_SYMBOLS,
+		OPT_FOLDED,
 		OPT_PRINT_HELP,
 	};
 
@@ -710,6 +1095,11 @@ int main(int argc, char **argv)
 		[OPT_LONG_WAIT] = { "print-long-waits", 1, (int*)&state.long_wait, 0 },
 		[OPT_PRINT_INPUT] = { "print-input", 2, &state.print_input, true },
 		[OPT_PRINT_CONFIG] = { "print-config", 0, &print_config, true },
+		[OPT_PRINT_STATS] = { "print-stats", 0, &state.print_stats, true },
+		[OPT_JOBS] = { "jobs", 1, 0, 0 },
+		[OPT_PROFILE] = { "profile", 0, &profile, true },
+		[OPT_SYMBOLS] = { "symbols", 1, 0, 0 },
+		[OPT_FOLDED] = { "folded", 1, 0, 0 },
 		[OPT_PRINT_HELP] = { "help", 0, 0, 'h'},
 		{},
 	};
@@ -727,10 +1117,17 @@ int main(int argc, char **argv)
 		[OPT_LONG_WAIT] = "Highlight long waits",
 		[OPT_PRINT_INPUT] = "Print input data",
 		[OPT_PRINT_CONFIG] = "Print configuration data",
+		[OPT_PRINT_STATS] = "Print the decoding throughput to stderr",
+		[OPT_JOBS] = "Decode with N threads, 0 for one per CPU (Default 1)",
+		[OPT_PROFILE] = "Count instructions and branch targets, print hot spots",
+		[OPT_SYMBOLS] = "Symbolize the profile from this ELF file, implies --profile",
+		[OPT_FOLDED] = "Write flame graph folded stacks to FILE, implies --profile",
 		[OPT_PRINT_HELP] = "Print usage information",
 	};
 
+	setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
 	memset(&state, 0, sizeof(state));
+	state.out = stdout;
 
 	state.contextid_bytes = 4;
 	state.cycle_accurate = 1;
@@ -761,6 +1158,19 @@ int main(int argc, char **argv)
 				state.formatter = true;
 				state.sourceid_match |= 1 << atoi(optarg);
 				break;
+			case OPT_SYMBOLS:
+				profile = true;
+				symbols = optarg;
+				break;
+			case OPT_FOLDED:
+				profile = true;
+				folded = optarg;
+				break;
+			case OPT_JOBS:
+				jobs = atoi(optarg);
+				if (jobs <= 0)
+					jobs = sysconf(_SC_NPROCESSORS_ONLN);
+				break;
 			default: {
 				int *flag = long_options[option_index].flag;
 				if (optarg && flag)
@@ -776,7 +1186,7 @@ int main(int argc, char **argv)
 			break;
 
 		case 'h':
-			printf("Usage: %s [options]\n", argv[0]);
+			printf("Usage: %s [options] [tracefile]\n", argv[0]);
 			printf("Options:\n");
 			for (i = 0; long_options[i].name; i++) {
 				printf("  --%-20s %s\n", long_options[i].name, help_txt[i]);
@@ -805,6 +1215,13 @@ int main(int argc, char **argv)
 		printf("long_wait %d\n", state.long_wait);
 	}
 
+	/* the first match of each byte, as the scan of packet_types[] found it */
+	for (ch = 0; ch < 256; ch++) {
+		for (i = 0; !is_match(i, ch); i++)
+			;
+		dispatch[ch] = &packet_types[i];
+	}
+
 	for (ch = 0; ch < 256; ch++) {
 		mc = 0;
 		for (i = 0; packet_types[i].match_mask; i++)
@@ -823,19 +1240,41 @@ int main(int argc, char **argv)
 					packet_types[i].name);
 		}
 	}
-	while (1) {
-		ch = get_byte(&state);
-		for (i = 0; !is_match(i, ch); i++)
-			;
-		if (state.print_input)
-			printf("  %s\n", packet_types[i].name);
-		decode = packet_types[i].decode;
-		if (decode) {
-			decode(&state);
-		} else {
-			state.sync = 0;
-			printf("  %02x: not handled (%s)\n", ch, packet_types[i].name);
+	if (optind < argc - 1) {
+		printf("%s: Only one trace file can be decoded\n", argv[0]);
+		return 1;
+	}
+	if (load_input(&state, optind < argc ? argv[optind] : NULL))
+		return 1;
+	clock_gettime(CLOCK_MONOTONIC, &state.start);
+
+	if (profile) {
+		state.profile = profile_new();
+		state.out = fopen("/dev/null", "w");
+		if (!state.profile || !state.out) {
+			perror("profile");
+			return 1;
 		}
 	}
+	if (jobs > 1 && (state.formatter || state.print_input)) {
+		fprintf(stderr, "--jobs ignored with --formatter or --print-input\n");
+		jobs = 1;
+	}
+	if (jobs > 1) {
+		if (decode_parallel(&state, jobs))
+			return 1;
+	} else {
+		state.eof = &eof;
+		if (!setjmp(eof))
+			decode_range(&state, SIZE_MAX);
+		end_of_trace(&state);
+	}
+	if (state.print_stats)
+		print_stats(&state);
+	if (profile) {
+		if (profile_report(state.profile, symbols, stdout, folded))
+			return 1;
+		profile_free(state.profile);
+	}
 	return 0;
 }
@@ -0,0 +1,568 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "etm_profile.h"
+
+#define PROFILE_INITIAL_SIZE (1 << 12)
+#define PROFILE_REPORT_ROWS 25
+
+struct profile_entry {
+	uint32_t addr;
+	uint32_t branches;
+	uint64_t executed;
+	uint64_t not_executed;
+	uint64_t cycles;
+};
+
+/* open addressing, linear probing, an entry is in use once it has counts */
+struct etm_profile {
+	struct profile_entry *entries;
+	uint32_t size;
+	uint32_t count;
+};
+
+struct symbol {
+	uint32_t addr;
+	uint32_t size;
+	uint32_t limit;
+	const char *name;
+};
+
+struct symbol_table {
+	struct symbol *symbols;
+	size_t count;
+	void *map;
+	size_t map_size;
+};
+
+/* per function totals of the report */
+struct function {
+	const char *name;
+	uint64_t executed;
+	uint64_t cycles;
+};
+
+static inline int entry_used(const struct profile_entry *e)
+{
+	return e->executed || e->not_executed || e->branches;
+}
+
+static inline uint32_t hash_addr(uint32_t addr, uint32_t size)
+{
+	return ((addr >> 1) * 0x9e3779b1u) & (size - 1);
+}
+
+struct etm_profile *profile_new(void)
+{
+	struct etm_profile *profile = calloc(1, sizeof(*profile));
+
+	if (!profile)
+		return NULL;
+	profile->size = PROFILE_INITIAL_SIZE;
+	profile->entries = calloc(profile->size, sizeof(*profile->entries));
+	if (!profile->entries) {
+		free(profile);
+		return NULL;
+	}
+	return profile;
+}
+
+void profile_free(struct etm_profile *profile)
+{
+	if (!profile)
+		return;
+	free(profile->entries);
+	free(profile);
+}
+
+static void profile_grow(struct etm_profile *profile)
+{
+	struct profile_entry *old = profile->entries;
+	uint32_t old_size = profile->size;
+	uint32_t i, h;
+
+	profile->size *= 2;
+	profile->entries = calloc(profile->size, sizeof(*profile->entries));
+	if (!profile->entries) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < old_size; i++) {
+		if (!entry_used(&old[i]))
+			continue;
+		h = hash_addr(old[i].addr, profile->size);
+		while (entry_used(&profile->entries[h]))
+			h = (h + 1) & (profile->size - 1);
+		profile->entries[h] = old[i];
+	}
+	free(old);
+}
+
+static struct profile_entry *profile_lookup(struct etm_profile *profile,
+					    uint32_t addr)
+{
+	struct profile_entry *e;
+	uint32_t h;
+
+	h = hash_addr(addr, profile->size);
+	while (1) {
+		e = &profile->entries[h];
+		if (!entry_used(e))
+			break;
+		if (e->addr == addr)
+			return e;
+		h = (h + 1) & (profile->size - 1);
+	}
+
+	/* a new entry, keep the load factor under 1/2 */
+	if (2 * (profile->count + 1) > profile->size) {
+		profile_grow(profile);
+		return profile_lookup(profile, addr);
+	}
+	profile->count++;
+	e->addr = addr;
+	return e;
+}
+
+void profile_instruction(struct etm_profile *profile, uint32_t addr,
+			 int executed, uint32_t cycles)
+{
+	struct profile_entry *e = profile_lookup(profile, addr);
+
+	if (executed)
+		e->executed++;
+	else
+		e->not_executed++;
+	e->cycles += cycles;
+}
+
+void profile_branch(struct etm_profile *profile, uint32_t addr)
+{
+	profile_lookup(profile, addr)->branches++;
+}
+
+void profile_merge(struct etm_profile *dst, const struct etm_profile *src)
+{
+	const struct profile_entry *s;
+	struct profile_entry *e;
+	uint32_t i;
+
+	for (i = 0; i < src->size; i++) {
+		s = &src->entries[i];
+		if (!entry_used(s))
+			continue;
+		e = profile_lookup(dst, s->addr);
+		e->executed += s->executed;
+		e->not_executed += s->not_executed;
+		e->cycles += s->cycles;
+		e->branches += s->branches;
+	}
+}
+
+static int cmp_symbol(const void *a, const void *b)
+{
+	const struct symbol *x = a, *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	/* sized symbols first, they are the ones kept */
+	return (x->size < y->size) - (x->size > y->size);
+}
+
+struct section {
+	uint32_t type;
+	uint32_t link;
+	uint64_t addr;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static void read_section(const unsigned char *sh, int is64,
+			 struct section *sec)
+{
+	if (is64) {
+		const Elf64_Shdr *s = (const Elf64_Shdr *)sh;
+
+		sec->type = s->sh_type;
+		sec->link = s->sh_link;
+		sec->addr = s->sh_addr;
+		sec->offset = s->sh_offset;
+		sec->size = s->sh_size;
+	} else {
+		const Elf32_Shdr *s = (const Elf32_Shdr *)sh;
+
+		sec->type = s->sh_type;
+		sec->link = s->sh_link;
+		sec->addr = s->sh_addr;
+		sec->offset = s->sh_offset;
+		sec->size = s->sh_size;
+	}
+}
+
+static int in_file(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+	return size <= file_size && offset <= file_size - size;
+}
+
+/* the function symbols of a little endian ELF32 or ELF64 file */
+static int load_symbols(const char *filename, struct symbol_table *table)
+{
+	const unsigned char *base;
+	const char *strtab;
+	size_t i, j, n, alloc = 0;
+	struct stat st;
+	int is64, fd;
+	uint16_t machine, shnum;
+	uint64_t shoff, shentsize;
+
+	memset(table, 0, sizeof(*table));
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(filename);
+		return -1;
+	}
+	table->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (table->map == MAP_FAILED) {
+		perror(filename);
+		return -1;
+	}
+	table->map_size = st.st_size;
+	base = table->map;
+
+	if (st.st_size < (off_t)sizeof(Elf32_Ehdr) ||
+	    memcmp(base, ELFMAG, SELFMAG) || base[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "%s: not a little endian ELF file\n", filename);
+		return -1;
+	}
+	is64 = base[EI_CLASS] == ELFCLASS64;
+	if (is64) {
+		const Elf64_Ehdr *eh = (const Elf64_Ehdr *)base;
+
+		if (st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+			fprintf(stderr, "%s: truncated ELF header\n", filename);
+			return -1;
+		}
+		machine = eh->e_machine;
+		shoff = eh->e_shoff;
+		shnum = eh->e_shnum;
+		shentsize = sizeof(Elf64_Shdr);
+	} else {
+		const Elf32_Ehdr *eh = (const Elf32_Ehdr *)base;
+
+		machine = eh->e_machine;
+		shoff = eh->e_shoff;
+		shnum = eh->e_shnum;
+		shentsize = sizeof(Elf32_Shdr);
+	}
+	if (!in_file(shoff, shnum * shentsize, st.st_size)) {
+		fprintf(stderr, "%s: section headers past the end of the file\n",
+			filename);
+		return -1;
+	}
+
+	/* .symtab, or .dynsym of stripped binaries */
+	for (j = 0; j < 2 && !table->count; j++) {
+		uint32_t want = j ? SHT_DYNSYM : SHT_SYMTAB;
+
+		for (i = 0; i < shnum; i++) {
+			struct section sec, str;
+			uint64_t entsize;
+
+			read_section(base + shoff + i * shentsize, is64, &sec);
+			if (sec.type != want || sec.link >= shnum)
+				continue;
+			read_section(base + shoff + sec.link * shentsize, is64,
+				     &str);
+			if (!in_file(sec.offset, sec.size, st.st_size) ||
+			    !in_file(str.offset, str.size, st.st_size))
+				continue;
+			strtab = (const char *)base + str.offset;
+			entsize = is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+
+			for (n = 0; n < sec.size / entsize; n++) {
+				struct symbol *sym;
+				struct section in;
+				uint64_t value, sym_size;
+				uint32_t name;
+				unsigned char info;
+				uint16_t shndx;
+
+				if (is64) {
+					const Elf64_Sym *s = (const Elf64_Sym *)(base + sec.offset) + n;
+
+					value = s->st_value;
+					sym_size = s->st_size;
+					name = s->st_name;
+					info = s->st_info;
+					shndx = s->st_shndx;
+				} else {
+					const Elf32_Sym *s = (const Elf32_Sym *)(base + sec.offset) + n;
+
+					value = s->st_value;
+					sym_size = s->st_size;
+					name = s->st_name;
+					info = s->st_info;
+					shndx = s->st_shndx;
+				}
+				if (ELF32_ST_TYPE(info) != STT_FUNC ||
+				    shndx == SHN_UNDEF || !name ||
+				    name >= str.size ||
+				    !memchr(strtab + name, 0, str.size - name))
+					continue;
+
+				if (table->count == alloc) {
+					alloc = alloc ? alloc * 2 : 1024;
+					sym = realloc(table->symbols,
+						      alloc * sizeof(*sym));
+					if (!sym)
+						return -1;
+					table->symbols = sym;
+				}
+				sym = &table->symbols[table->count++];
+				/* the Thumb bit isn't part of the address */
+				if (machine == EM_ARM)
+					value &= ~1ull;
+				sym->addr = value;
+				sym->size = sym_size;
+				sym->name = strtab + name;
+				/* where an unsized symbol has to end at the latest */
+				sym->limit = 0;
+				if (!sym_size && shndx < shnum) {
+					read_section(base + shoff + shndx * shentsize,
+						     is64, &in);
+					if (value >= in.addr &&
+					    value - in.addr < in.size)
+						sym->limit = in.addr + in.size;
+				}
+			}
+		}
+	}
+	if (!table->count) {
+		fprintf(stderr, "%s: no function symbols\n", filename);
+		return -1;
+	}
+
+	qsort(table->symbols, table->count, sizeof(*table->symbols),
+	      cmp_symbol);
+	for (i = 0, n = 0; i < table->count; i++) {
+		if (n && table->symbols[n - 1].addr == table->symbols[i].addr)
+			continue;
+		table->symbols[n++] = table->symbols[i];
+	}
+	table->count = n;
+
+	/* unsized symbols end at the next one or their section end */
+	for (i = 0; i < table->count; i++) {
+		struct symbol *sym = &table->symbols[i];
+		uint64_t end = sym->limit;
+
+		if (sym->size)
+			continue;
+		if (i + 1 < table->count &&
+		    (!end || table->symbols[i + 1].addr < end))
+			end = table->symbols[i + 1].addr;
+		if (end > sym->addr)
+			sym->size = end - sym->addr;
+	}
+	return 0;
+}
+
+static void free_symbols(struct symbol_table *table)
+{
+	free(table->symbols);
+	if (table->map && table->map != MAP_FAILED)
+		munmap(table->map, table->map_size);
+}
+
+/* index of the symbol containing addr, or -1 */
+static long find_symbol(const struct symbol_table *table, uint32_t addr)
+{
+	size_t lo = 0, hi = table->count;
+	const struct symbol *sym;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (table->symbols[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return -1;
+	sym = &table->symbols[lo - 1];
+	/* a symbol load_symbols() could not size holds only its address */
+	if (addr - sym->addr >= (sym->size ? sym->size : 1))
+		return -1;
+	return lo - 1;
+}
+
+static void format_location(const struct symbol_table *table, uint32_t addr,
+			    char *buf, size_t size)
+{
+	long i = find_symbol(table, addr);
+
+	if (i < 0)
+		snprintf(buf, size, "[unknown]");
+	else if (addr == table->symbols[i].addr)
+		snprintf(buf, size, "%s", table->symbols[i].name);
+	else
+		snprintf(buf, size, "%s+0x%x", table->symbols[i].name,
+			 addr - table->symbols[i].addr);
+}
+
+static int cmp_entry_addr(const void *a, const void *b)
+{
+	const struct profile_entry *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static int cmp_entry_branches(const void *a, const void *b)
+{
+	const struct profile_entry *x = a, *y = b;
+
+	if (x->branches != y->branches)
+		return x->branches < y->branches ? 1 : -1;
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static int cmp_function(const void *a, const void *b)
+{
+	const struct function *x = a, *y = b;
+
+	if (x->executed != y->executed)
+		return x->executed < y->executed ? 1 : -1;
+	return strcmp(x->name, y->name);
+}
+
+int profile_report(struct etm_profile *profile, const char *elf, FILE *out,
+		   const char *folded)
+{
+	struct symbol_table table;
+	struct profile_entry *entries;
+	struct function *functions;
+	uint64_t executed = 0, not_executed = 0, cycles = 0;
+	size_t count = 0, nfunc, i;
+	char loc[256];
+	FILE *fp;
+	long s;
+
+	memset(&table, 0, sizeof(table));
+	if (elf && load_symbols(elf, &table)) {
+		free_symbols(&table);
+		return -1;
+	}
+
+	entries = malloc((profile->count + 1) * sizeof(*entries));
+	/* one per symbol, and one for the addresses outside of them */
+	functions = calloc(table.count + 1, sizeof(*functions));
+	if (!entries || !functions) {
+		free(entries);
+		free(functions);
+		free_symbols(&table);
+		return -1;
+	}
+	for (i = 0; i < profile->size; i++) {
+		if (entry_used(&profile->entries[i]))
+			entries[count++] = profile->entries[i];
+	}
+	qsort(entries, count, sizeof(*entries), cmp_entry_addr);
+
+	for (i = 0; i <= table.count; i++)
+		functions[i].name = i < table.count ? table.symbols[i].name :
+				    "[unknown]";
+	for (i = 0; i < count; i++) {
+		executed += entries[i].executed;
+		not_executed += entries[i].not_executed;
+		cycles += entries[i].cycles;
+		s = find_symbol(&table, entries[i].addr);
+		if (s < 0)
+			s = table.count;
+		functions[s].executed += entries[i].executed;
+		functions[s].cycles += entries[i].cycles;
+	}
+
+	if (folded) {
+		fp = fopen(folded, "w");
+		if (!fp) {
+			perror(folded);
+		} else {
+			for (i = 0; i < count; i++) {
+				if (!entries[i].executed)
+					continue;
+				s = find_symbol(&table, entries[i].addr);
+				format_location(&table, entries[i].addr, loc,
+						sizeof(loc));
+				if (s < 0)
+					fprintf(fp, "[unknown];%08x %" PRIu64 "\n",
+						entries[i].addr, entries[i].executed);
+				else
+					fprintf(fp, "%s;%s %" PRIu64 "\n",
+						table.symbols[s].name, loc,
+						entries[i].executed);
+			}
+			fclose(fp);
+		}
+	}
+
+	fprintf(out, "Instructions: %" PRIu64 " executed, %" PRIu64
+		" not executed, %" PRIu64 " wait cycles, %zu addresses\n\n",
+		executed, not_executed, cycles, count);
+
+	nfunc = table.count + 1;
+	qsort(functions, nfunc, sizeof(*functions), cmp_function);
+	fprintf(out, "Hot functions:\n");
+	fprintf(out, "%14s %8s %14s  %s\n", "executed", "%", "cycles",
+		"function");
+	for (i = 0; i < nfunc && i < PROFILE_REPORT_ROWS; i++) {
+		if (!functions[i].executed)
+			break;
+		fprintf(out, "%14" PRIu64 " %7.2f%% %14" PRIu64 "  %s\n",
+			functions[i].executed,
+			100.0 * functions[i].executed / executed,
+			functions[i].cycles, functions[i].name);
+	}
+
+	/* the most taken branch targets are the loop heads */
+	qsort(entries, count, sizeof(*entries), cmp_entry_branches);
+	fprintf(out, "\nHot branch targets:\n");
+	fprintf(out, "%14s %8s  %s\n", "branches", "address", "location");
+	for (i = 0; i < count && i < PROFILE_REPORT_ROWS; i++) {
+		if (!entries[i].branches)
+			break;
+		format_location(&table, entries[i].addr, loc, sizeof(loc));
+		fprintf(out, "%14u %08x  %s\n", entries[i].branches,
+			entries[i].addr, loc);
+	}
+
+	free(entries);
+	free(functions);
+	free_symbols(&table);
+	return 0;
+}
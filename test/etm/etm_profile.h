@@ -0,0 +1,43 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ETM_PROFILE_H
+#define ETM_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct etm_profile;
+
+struct etm_profile *profile_new(void);
+void profile_free(struct etm_profile *profile);
+
+/* one traced instruction at addr, and the cycles it waited for */
+void profile_instruction(struct etm_profile *profile, uint32_t addr,
+			 int executed, uint32_t cycles);
+/* one branch, exception or waypoint landing on addr */
+void profile_branch(struct etm_profile *profile, uint32_t addr);
+void profile_merge(struct etm_profile *dst, const struct etm_profile *src);
+
+/*
+ * Sorted hot function and hot branch target tables to out, symbolized
+ * from the ELF symbol table of elf if given, and flame graph input
+ * (function;function+offset count) to folded if given.
+ */
+int profile_report(struct etm_profile *profile, const char *elf, FILE *out,
+		   const char *folded);
+
+#endif
@@ -4,6 +4,11 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
        memtool.c \
+       memtool_batch.c \
+       memtool_watch.c \
+       regio.c \
+       memdb.c \
+       memdb_build.c \
        mx6dl_modules.c \
        mx6q_modules.c \
        mx6sx_modules.c \
@@ -15,6 +20,8 @@ LOCAL_SRC_FILES := \
        mx8mq_modules.c
 
 #LOCAL_CFLAGS += -DBUILD_FOR_ANDROID
+# no memtool_db on the target, build the database from the tables at startup
+LOCAL_CFLAGS += -DMEMTOOL_BUILTIN_DB
 
 LOCAL_C_INCLUDES += $(LOCAL_PATH) \
 
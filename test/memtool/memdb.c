@@ -0,0 +1,286 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "memdb.h"
+
+uint32_t memdb_hash(uint32_t seed, const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	/* fnv-1a, the seed separates the arrays sharing one table */
+	hash = (hash ^ seed) * 16777619u;
+	while (*name)
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+
+	return hash;
+}
+
+/* "i.MX6ULL" -> "imx6ull.db" */
+void memdb_soc_filename(const char *soc, char *name, size_t size)
+{
+	size_t n = 0;
+
+	if (!size)
+		return;
+
+	for (; *soc && n + 1 < size; soc++) {
+		if (*soc == '.')
+			continue;
+		name[n++] = tolower((unsigned char)*soc);
+	}
+	name[n] = 0;
+	strncat(name, MEMDB_SUFFIX, size - n - 1);
+}
+
+static int memdb_check_section(const struct memdb_header *hdr,
+			       uint32_t offset, uint32_t count, size_t size)
+{
+	if (offset > hdr->size || offset & 3)
+		return -1;
+	if (count > (hdr->size - offset) / size)
+		return -1;
+
+	return 0;
+}
+
+static int memdb_check_hash_size(uint32_t size, uint32_t count)
+{
+	if (!size || size & (size - 1))
+		return -1;
+	/* there must be an empty slot to stop the probing */
+	if (size <= count)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Only the layout is checked, the records are trusted so that opening a
+ * database doesn't page in the whole image.
+ */
+static int memdb_setup(struct memdb *db)
+{
+	const struct memdb_header *hdr = (const struct memdb_header *)db->image;
+
+	if (db->size < sizeof(*hdr))
+		return -1;
+	if (memcmp(hdr->magic, MEMDB_MAGIC, 4) || hdr->version != MEMDB_VERSION)
+		return -1;
+	if (hdr->size > db->size)
+		return -1;
+	if (memdb_check_section(hdr, hdr->modules, hdr->module_count,
+				sizeof(struct memdb_module)) ||
+	    memdb_check_section(hdr, hdr->regs, hdr->reg_count,
+				sizeof(struct memdb_reg)) ||
+	    memdb_check_section(hdr, hdr->fields, hdr->field_count,
+				sizeof(struct memdb_field)) ||
+	    memdb_check_section(hdr, hdr->strings, hdr->strings_size, 1) ||
+	    memdb_check_section(hdr, hdr->module_hash, hdr->module_hash_size,
+				sizeof(struct memdb_hash_entry)) ||
+	    memdb_check_section(hdr, hdr->reg_hash, hdr->reg_hash_size,
+				sizeof(struct memdb_hash_entry)) ||
+	    memdb_check_section(hdr, hdr->field_hash, hdr->field_hash_size,
+				sizeof(struct memdb_hash_entry)))
+		return -1;
+	if (memdb_check_hash_size(hdr->module_hash_size, hdr->module_count) ||
+	    memdb_check_hash_size(hdr->reg_hash_size, hdr->reg_count) ||
+	    memdb_check_hash_size(hdr->field_hash_size, hdr->field_count))
+		return -1;
+	if (!hdr->strings_size || db->image[hdr->strings + hdr->strings_size - 1])
+		return -1;
+
+	db->hdr = hdr;
+	db->modules = (const void *)(db->image + hdr->modules);
+	db->regs = (const void *)(db->image + hdr->regs);
+	db->fields = (const void *)(db->image + hdr->fields);
+	db->strings = (const char *)(db->image + hdr->strings);
+	db->module_hash = (const void *)(db->image + hdr->module_hash);
+	db->reg_hash = (const void *)(db->image + hdr->reg_hash);
+	db->field_hash = (const void *)(db->image + hdr->field_hash);
+
+	return 0;
+}
+
+struct memdb *memdb_open_image(const void *image, size_t size)
+{
+	struct memdb *db;
+
+	db = calloc(1, sizeof(*db));
+	if (!db)
+		return NULL;
+
+	db->image = image;
+	db->size = size;
+	if (memdb_setup(db)) {
+		free(db);
+		return NULL;
+	}
+
+	return db;
+}
+
+struct memdb *memdb_open_file(const char *filename)
+{
+	struct memdb *db;
+	struct stat st;
+	void *image;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		return NULL;
+
+	db = memdb_open_image(image, st.st_size);
+	if (!db) {
+		fprintf(stderr, "invalid register database %s\n", filename);
+		munmap(image, st.st_size);
+		return NULL;
+	}
+	db->mapped = 1;
+
+	return db;
+}
+
+/*
+ * The database of a SoC is looked up in $MEMTOOL_DB, then in the
+ * memtool_db directory next to the executable.
+ */
+struct memdb *memdb_open(const char *soc)
+{
+	char filename[PATH_MAX];
+	char name[64];
+	const char *dir;
+	char *slash;
+	ssize_t n;
+
+	memdb_soc_filename(soc, name, sizeof(name));
+
+	dir = getenv(MEMDB_ENV_DIR);
+	if (dir) {
+		snprintf(filename, sizeof(filename), "%s/%s", dir, name);
+		return memdb_open_file(filename);
+	}
+
+	n = readlink("/proc/self/exe", filename, sizeof(filename) - 1);
+	if (n <= 0)
+		return NULL;
+	filename[n] = 0;
+	slash = strrchr(filename, '/');
+	if (!slash)
+		return NULL;
+	*(slash + 1) = 0;
+	if (strlen(filename) + strlen(MEMDB_DIR) + strlen(name) + 2 > sizeof(filename))
+		return NULL;
+	strcat(filename, MEMDB_DIR "/");
+	strcat(filename, name);
+
+	return memdb_open_file(filename);
+}
+
+void memdb_close(struct memdb *db)
+{
+	if (!db)
+		return;
+
+	if (db->mapped)
+		munmap((void *)db->image, db->size);
+	free(db);
+}
+
+const struct memdb_module *memdb_find_module(const struct memdb *db,
+		const char *name)
+{
+	const struct memdb_hash_entry *e;
+	const struct memdb_module *m;
+	uint32_t mask = db->hdr->module_hash_size - 1;
+	uint32_t hash = memdb_hash(0, name);
+	uint32_t i;
+
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		e = &db->module_hash[i];
+		if (!e->index)
+			return NULL;
+		if (e->hash != hash || e->index > db->hdr->module_count)
+			continue;
+		m = &db->modules[e->index - 1];
+		if (!strcmp(memdb_str(db, m->name), name))
+			return m;
+	}
+}
+
+const struct memdb_reg *memdb_find_reg(const struct memdb *db,
+		const struct memdb_module *m, const char *name)
+{
+	const struct memdb_hash_entry *e;
+	const struct memdb_reg *r;
+	uint32_t mask = db->hdr->reg_hash_size - 1;
+	uint32_t hash = memdb_hash(m->reg_first, name);
+	uint32_t i;
+
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		e = &db->reg_hash[i];
+		if (!e->index)
+			return NULL;
+		if (e->hash != hash)
+			continue;
+		if (e->index - 1 < m->reg_first ||
+		    e->index - 1 >= m->reg_first + m->reg_count)
+			continue;
+		r = &db->regs[e->index - 1];
+		if (!strcmp(memdb_str(db, r->name), name))
+			return r;
+	}
+}
+
+const struct memdb_field *memdb_find_field(const struct memdb *db,
+		const struct memdb_reg *r, const char *name)
+{
+	const struct memdb_hash_entry *e;
+	const struct memdb_field *f;
+	uint32_t mask = db->hdr->field_hash_size - 1;
+	uint32_t hash = memdb_hash(r->field_first, name);
+	uint32_t i;
+
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		e = &db->field_hash[i];
+		if (!e->index)
+			return NULL;
+		if (e->hash != hash)
+			continue;
+		if (e->index - 1 < r->field_first ||
+		    e->index - 1 >= r->field_first + r->field_count)
+			continue;
+		f = &db->fields[e->index - 1];
+		if (!strcmp(memdb_str(db, f->name), name))
+			return f;
+	}
+}
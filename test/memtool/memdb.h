@@ -0,0 +1,152 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Compact register database
+ *
+ * One image per SoC, generated from the module_t tables by memtool_mkdb and
+ * mmapped by memtool for the detected soc_id only. The image has no
+ * pointers: records refer to each other by index and to the interned,
+ * NUL terminated names and descriptions by offset in the string section.
+ * Register arrays shared by several module instances (UART1..UART8) and
+ * field arrays shared by several registers are stored once.
+ *
+ * Exact name lookups go through open addressing hash tables which store
+ * the full hash next to the record index, so a miss rarely touches the
+ * strings. Registers and fields are hashed together with the first index
+ * of the array they belong to, which keeps shared arrays in one table.
+ */
+#ifndef __MEMDB_H__
+#define __MEMDB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MEMDB_MAGIC		"MTDB"
+#define MEMDB_VERSION		1
+#define MEMDB_SUFFIX		".db"
+#define MEMDB_DIR		"memtool_db"
+#define MEMDB_ENV_DIR		"MEMTOOL_DB"
+
+#define MEMDB_READABLE		(1 << 0)
+#define MEMDB_WRITABLE		(1 << 1)
+
+struct memdb_header {
+	char magic[4];
+	uint32_t version;
+	char soc[16];
+	uint32_t size;
+	uint32_t module_count;
+	uint32_t reg_count;
+	uint32_t field_count;
+	uint32_t strings_size;
+	uint32_t module_hash_size;
+	uint32_t reg_hash_size;
+	uint32_t field_hash_size;
+	/* byte offsets of the sections from the start of the image */
+	uint32_t modules;
+	uint32_t regs;
+	uint32_t fields;
+	uint32_t strings;
+	uint32_t module_hash;
+	uint32_t reg_hash;
+	uint32_t field_hash;
+};
+
+struct memdb_module {
+	uint32_t name;
+	uint32_t instance;
+	uint32_t base_address;
+	uint32_t reg_first;
+	uint32_t reg_count;
+};
+
+struct memdb_reg {
+	uint32_t name;
+	uint32_t description;
+	uint32_t offset;
+	uint32_t field_first;
+	uint16_t field_count;
+	uint8_t width;
+	uint8_t flags;
+};
+
+struct memdb_field {
+	uint32_t name;
+	uint32_t description;
+	uint8_t lsb;
+	uint8_t msb;
+	uint8_t flags;
+	uint8_t reserved;
+};
+
+/* index is the record index + 1, 0 marks an empty slot */
+struct memdb_hash_entry {
+	uint32_t hash;
+	uint32_t index;
+};
+
+struct memdb {
+	const uint8_t *image;
+	size_t size;
+	int mapped;
+	const struct memdb_header *hdr;
+	const struct memdb_module *modules;
+	const struct memdb_reg *regs;
+	const struct memdb_field *fields;
+	const char *strings;
+	const struct memdb_hash_entry *module_hash;
+	const struct memdb_hash_entry *reg_hash;
+	const struct memdb_hash_entry *field_hash;
+};
+
+uint32_t memdb_hash(uint32_t seed, const char *name);
+void memdb_soc_filename(const char *soc, char *name, size_t size);
+
+struct memdb *memdb_open(const char *soc);
+struct memdb *memdb_open_file(const char *filename);
+struct memdb *memdb_open_image(const void *image, size_t size);
+void memdb_close(struct memdb *db);
+
+static inline const char *memdb_str(const struct memdb *db, uint32_t offset)
+{
+	return db->strings + offset;
+}
+
+static inline const struct memdb_reg *memdb_module_regs(const struct memdb *db,
+		const struct memdb_module *m)
+{
+	return db->regs + m->reg_first;
+}
+
+static inline const struct memdb_field *memdb_reg_fields(const struct memdb *db,
+		const struct memdb_reg *r)
+{
+	return db->fields + r->field_first;
+}
+
+const struct memdb_module *memdb_find_module(const struct memdb *db,
+		const char *name);
+const struct memdb_reg *memdb_find_reg(const struct memdb *db,
+		const struct memdb_module *m, const char *name);
+const struct memdb_field *memdb_find_field(const struct memdb *db,
+		const struct memdb_reg *r, const char *name);
+
+/* memdb_build.c, only linked where the module_t tables are */
+struct module;
+int memdb_build(const struct module *mx, const char *soc,
+		void **image, size_t *size);
+const struct module *memdb_get_soc_modules(const char *soc);
+const char *memdb_get_soc_name(int index);
+
+#endif
@@ -0,0 +1,498 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Build the compact register database image of a SoC from its module_t
+ * table, see memdb.h for the layout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memtools_register_info.h"
+#include "memdb.h"
+
+extern const module_t mx6q[];
+extern const module_t mx6dl[];
+extern const module_t mx6sl[];
+extern const module_t mx6sx[];
+extern const module_t mx6ul[];
+extern const module_t mx7d[];
+extern const module_t mx6ull[];
+extern const module_t mx7ulp[];
+extern const module_t imx8mq7dvajz[];
+
+static const struct {
+	const char *soc;
+	const module_t *mx;
+} memdb_socs[] = {
+	{"i.MX6Q", mx6q},
+	{"i.MX6DL", mx6dl},
+	{"i.MX6SL", mx6sl},
+	{"i.MX6SX", mx6sx},
+	{"i.MX6UL", mx6ul},
+	{"i.MX7D", mx7d},
+	{"i.MX6ULL", mx6ull},
+	{"i.MX7ULP", mx7ulp},
+	{"i.MX8MQ", imx8mq7dvajz},
+};
+
+const struct module *memdb_get_soc_modules(const char *soc)
+{
+	int i;
+
+	for (i = 0; i < sizeof(memdb_socs) / sizeof(memdb_socs[0]); i++) {
+		if (!strcmp(memdb_socs[i].soc, soc))
+			return memdb_socs[i].mx;
+	}
+
+	return NULL;
+}
+
+const char *memdb_get_soc_name(int index)
+{
+	if (index < 0 || index >= sizeof(memdb_socs) / sizeof(memdb_socs[0]))
+		return NULL;
+
+	return memdb_socs[index].soc;
+}
+
+struct memdb_buf {
+	uint8_t *data;
+	size_t size;
+	size_t alloc;
+};
+
+/* array of (first, count) of the register or field arrays already stored */
+struct memdb_set {
+	const void *ptr;
+	uint32_t first;
+	uint32_t count;
+};
+
+struct memdb_sets {
+	struct memdb_set *sets;
+	uint32_t count;
+	uint32_t alloc;
+	/* open addressing index of sets by pointer */
+	uint32_t *table;
+	uint32_t mask;
+};
+
+struct memdb_builder {
+	struct memdb_buf modules;
+	struct memdb_buf regs;
+	struct memdb_buf fields;
+	struct memdb_buf strings;
+	uint32_t *string_table;
+	uint32_t string_mask;
+	uint32_t string_count;
+	struct memdb_sets regsets;
+	struct memdb_sets fieldsets;
+};
+
+static int buf_reserve(struct memdb_buf *buf, size_t size)
+{
+	size_t alloc;
+	uint8_t *data;
+
+	if (buf->size + size <= buf->alloc)
+		return 0;
+
+	alloc = buf->alloc ? buf->alloc : 4096;
+	while (alloc < buf->size + size)
+		alloc *= 2;
+	data = realloc(buf->data, alloc);
+	if (!data)
+		return -1;
+	buf->data = data;
+	buf->alloc = alloc;
+
+	return 0;
+}
+
+static int buf_append(struct memdb_buf *buf, const void *data, size_t size)
+{
+	if (buf_reserve(buf, size))
+		return -1;
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+
+	return 0;
+}
+
+static uint32_t next_pow2(uint32_t n)
+{
+	uint32_t size = 8;
+
+	while (size < n)
+		size <<= 1;
+
+	return size;
+}
+
+static uint32_t ptr_hash(const void *ptr)
+{
+	uintptr_t v = (uintptr_t)ptr;
+
+	v ^= v >> 17;
+	v *= 0xed5ad4bb;
+	v ^= v >> 11;
+
+	return (uint32_t)v;
+}
+
+static int sets_grow(struct memdb_sets *s)
+{
+	uint32_t size = next_pow2((s->count + 1) * 2);
+	uint32_t *table;
+	uint32_t i;
+	uint32_t j;
+
+	if (s->table && s->mask + 1 >= size)
+		return 0;
+
+	table = calloc(size, sizeof(*table));
+	if (!table)
+		return -1;
+	for (i = 0; i < s->count; i++) {
+		j = ptr_hash(s->sets[i].ptr) & (size - 1);
+		while (table[j])
+			j = (j + 1) & (size - 1);
+		table[j] = i + 1;
+	}
+	free(s->table);
+	s->table = table;
+	s->mask = size - 1;
+
+	return 0;
+}
+
+static struct memdb_set *sets_find(struct memdb_sets *s, const void *ptr,
+				   uint32_t count)
+{
+	uint32_t i;
+
+	if (!s->table)
+		return NULL;
+
+	for (i = ptr_hash(ptr) & s->mask; s->table[i]; i = (i + 1) & s->mask) {
+		struct memdb_set *set = &s->sets[s->table[i] - 1];
+
+		if (set->ptr == ptr && set->count == count)
+			return set;
+	}
+
+	return NULL;
+}
+
+static int sets_add(struct memdb_sets *s, const void *ptr,
+		    uint32_t first, uint32_t count)
+{
+	uint32_t i;
+
+	if (s->count >= s->alloc) {
+		uint32_t alloc = s->alloc ? s->alloc * 2 : 256;
+		struct memdb_set *sets;
+
+		sets = realloc(s->sets, alloc * sizeof(*sets));
+		if (!sets)
+			return -1;
+		s->sets = sets;
+		s->alloc = alloc;
+	}
+	if (sets_grow(s))
+		return -1;
+
+	s->sets[s->count].ptr = ptr;
+	s->sets[s->count].first = first;
+	s->sets[s->count].count = count;
+	s->count++;
+
+	for (i = ptr_hash(ptr) & s->mask; s->table[i]; i = (i + 1) & s->mask)
+		;
+	s->table[i] = s->count;
+
+	return 0;
+}
+
+static int intern_grow(struct memdb_builder *b)
+{
+	uint32_t size = next_pow2((b->string_count + 1) * 2);
+	uint32_t *table;
+	uint32_t i;
+	uint32_t j;
+
+	if (b->string_table && b->string_mask + 1 >= size)
+		return 0;
+
+	table = calloc(size, sizeof(*table));
+	if (!table)
+		return -1;
+	for (i = 0; b->string_table && i <= b->string_mask; i++) {
+		uint32_t off = b->string_table[i];
+
+		if (!off)
+			continue;
+		j = memdb_hash(0, (char *)b->strings.data + off) & (size - 1);
+		while (table[j])
+			j = (j + 1) & (size - 1);
+		table[j] = off;
+	}
+	free(b->string_table);
+	b->string_table = table;
+	b->string_mask = size - 1;
+
+	return 0;
+}
+
+/* offset 0 is the empty string, which also stands for NULL */
+static int intern(struct memdb_builder *b, const char *str, uint32_t *offset)
+{
+	uint32_t i;
+
+	if (!str || !*str) {
+		*offset = 0;
+		return 0;
+	}
+	if (intern_grow(b))
+		return -1;
+
+	for (i = memdb_hash(0, str) & b->string_mask; b->string_table[i];
+	     i = (i + 1) & b->string_mask) {
+		if (!strcmp((char *)b->strings.data + b->string_table[i], str)) {
+			*offset = b->string_table[i];
+			return 0;
+		}
+	}
+
+	*offset = b->strings.size;
+	if (buf_append(&b->strings, str, strlen(str) + 1))
+		return -1;
+	b->string_table[i] = *offset;
+	b->string_count++;
+
+	return 0;
+}
+
+static int add_fields(struct memdb_builder *b, const field_t *f,
+		      uint32_t count, uint32_t *first)
+{
+	struct memdb_set *set;
+	struct memdb_field rec;
+	uint32_t i;
+
+	*first = b->fields.size / sizeof(rec);
+	if (!count)
+		return 0;
+
+	set = sets_find(&b->fieldsets, f, count);
+	if (set) {
+		*first = set->first;
+		return 0;
+	}
+
+	for (i = 0; i < count; i++, f++) {
+		memset(&rec, 0, sizeof(rec));
+		if (intern(b, f->name, &rec.name) ||
+		    intern(b, f->description, &rec.description))
+			return -1;
+		rec.lsb = f->lsb;
+		rec.msb = f->msb;
+		rec.flags = (f->is_readable ? MEMDB_READABLE : 0) |
+			    (f->is_writable ? MEMDB_WRITABLE : 0);
+		if (buf_append(&b->fields, &rec, sizeof(rec)))
+			return -1;
+	}
+
+	return sets_add(&b->fieldsets, f - count, *first, count);
+}
+
+static int add_regs(struct memdb_builder *b, const reg_t *r,
+		    uint32_t count, uint32_t *first)
+{
+	struct memdb_set *set;
+	struct memdb_reg rec;
+	uint32_t i;
+
+	*first = b->regs.size / sizeof(rec);
+	if (!count)
+		return 0;
+
+	set = sets_find(&b->regsets, r, count);
+	if (set) {
+		*first = set->first;
+		return 0;
+	}
+
+	for (i = 0; i < count; i++, r++) {
+		memset(&rec, 0, sizeof(rec));
+		/* a count that takes in the { 0 } terminator */
+		if (!r->name || r->field_count > UINT16_MAX)
+			return -1;
+		if (intern(b, r->name, &rec.name) ||
+		    intern(b, r->description, &rec.description) ||
+		    add_fields(b, r->fields, r->field_count, &rec.field_first))
+			return -1;
+		rec.offset = r->offset;
+		rec.field_count = r->field_count;
+		rec.width = r->width;
+		rec.flags = (r->is_readable ? MEMDB_READABLE : 0) |
+			    (r->is_writable ? MEMDB_WRITABLE : 0);
+		if (buf_append(&b->regs, &rec, sizeof(rec)))
+			return -1;
+	}
+
+	return sets_add(&b->regsets, r - count, *first, count);
+}
+
+static void hash_insert(struct memdb_hash_entry *table, uint32_t size,
+			uint32_t hash, uint32_t index)
+{
+	uint32_t i;
+
+	for (i = hash & (size - 1); table[i].index; i = (i + 1) & (size - 1))
+		;
+	table[i].hash = hash;
+	table[i].index = index + 1;
+}
+
+static int build_image(struct memdb_builder *b, const char *soc,
+		       void **image, size_t *size)
+{
+	const struct memdb_module *modules = (void *)b->modules.data;
+	const struct memdb_reg *regs = (void *)b->regs.data;
+	const struct memdb_field *fields = (void *)b->fields.data;
+	struct memdb_hash_entry *hash;
+	struct memdb_header *hdr;
+	uint32_t module_count = b->modules.size / sizeof(*modules);
+	uint32_t reg_count = b->regs.size / sizeof(*regs);
+	uint32_t field_count = b->fields.size / sizeof(*fields);
+	uint32_t strings_size;
+	uint32_t i;
+	uint32_t j;
+	uint8_t *p;
+
+	/* keep the hash tables 4 bytes aligned */
+	while (b->strings.size & 3)
+		if (buf_append(&b->strings, "", 1))
+			return -1;
+	strings_size = b->strings.size;
+
+	hdr = calloc(1, sizeof(*hdr));
+	if (!hdr)
+		return -1;
+	memcpy(hdr->magic, MEMDB_MAGIC, 4);
+	hdr->version = MEMDB_VERSION;
+	snprintf(hdr->soc, sizeof(hdr->soc), "%s", soc);
+	hdr->module_count = module_count;
+	hdr->reg_count = reg_count;
+	hdr->field_count = field_count;
+	hdr->strings_size = strings_size;
+	hdr->module_hash_size = next_pow2(module_count * 2);
+	hdr->reg_hash_size = next_pow2(reg_count * 2);
+	hdr->field_hash_size = next_pow2(field_count * 2);
+	hdr->modules = sizeof(*hdr);
+	hdr->regs = hdr->modules + b->modules.size;
+	hdr->fields = hdr->regs + b->regs.size;
+	hdr->strings = hdr->fields + b->fields.size;
+	hdr->module_hash = hdr->strings + strings_size;
+	hdr->reg_hash = hdr->module_hash +
+		hdr->module_hash_size * sizeof(struct memdb_hash_entry);
+	hdr->field_hash = hdr->reg_hash +
+		hdr->reg_hash_size * sizeof(struct memdb_hash_entry);
+	hdr->size = hdr->field_hash +
+		hdr->field_hash_size * sizeof(struct memdb_hash_entry);
+
+	p = calloc(1, hdr->size);
+	if (!p) {
+		free(hdr);
+		return -1;
+	}
+	memcpy(p, hdr, sizeof(*hdr));
+	memcpy(p + hdr->modules, b->modules.data, b->modules.size);
+	memcpy(p + hdr->regs, b->regs.data, b->regs.size);
+	memcpy(p + hdr->fields, b->fields.data, b->fields.size);
+	memcpy(p + hdr->strings, b->strings.data, strings_size);
+
+	hash = (void *)(p + hdr->module_hash);
+	for (i = 0; i < module_count; i++)
+		hash_insert(hash, hdr->module_hash_size,
+			    memdb_hash(0, (char *)b->strings.data + modules[i].name), i);
+
+	hash = (void *)(p + hdr->reg_hash);
+	for (i = 0; i < b->regsets.count; i++) {
+		struct memdb_set *set = &b->regsets.sets[i];
+
+		for (j = set->first; j < set->first + set->count; j++)
+			hash_insert(hash, hdr->reg_hash_size,
+				    memdb_hash(set->first,
+					       (char *)b->strings.data + regs[j].name), j);
+	}
+
+	hash = (void *)(p + hdr->field_hash);
+	for (i = 0; i < b->fieldsets.count; i++) {
+		struct memdb_set *set = &b->fieldsets.sets[i];
+
+		for (j = set->first; j < set->first + set->count; j++)
+			hash_insert(hash, hdr->field_hash_size,
+				    memdb_hash(set->first,
+					       (char *)b->strings.data + fields[j].name), j);
+	}
+
+	*image = p;
+	*size = hdr->size;
+	free(hdr);
+
+	return 0;
+}
+
+int memdb_build(const struct module *mx, const char *soc,
+		void **image, size_t *size)
+{
+	struct memdb_builder b;
+	struct memdb_module rec;
+	int ret = -1;
+
+	if (!mx)
+		return -1;
+
+	memset(&b, 0, sizeof(b));
+	if (buf_append(&b.strings, "", 1))
+		goto exit;
+
+	for (; mx->name; mx++) {
+		memset(&rec, 0, sizeof(rec));
+		if (intern(&b, mx->name, &rec.name) ||
+		    add_regs(&b, mx->regs, mx->reg_count, &rec.reg_first))
+			goto exit;
+		rec.instance = mx->instance;
+		rec.base_address = mx->base_address;
+		rec.reg_count = mx->reg_count;
+		if (buf_append(&b.modules, &rec, sizeof(rec)))
+			goto exit;
+	}
+
+	ret = build_image(&b, soc, image, size);
+exit:
+	free(b.modules.data);
+	free(b.regs.data);
+	free(b.fields.data);
+	free(b.strings.data);
+	free(b.string_table);
+	free(b.regsets.sets);
+	free(b.regsets.table);
+	free(b.fieldsets.sets);
+	free(b.fieldsets.table);
+
+	return ret;
+}
@@ -22,7 +22,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/utsname.h>
+#include <limits.h>
 #include "memtools_register_info.h"
+#include "memtool.h"
+#include "regio.h"
 
 int g_size = 4;
 unsigned long g_paddr;
@@ -35,25 +38,12 @@ char *g_reg;
 char *g_field;
 char *g_reg_input;
 
-int g_fmem;
-uintptr_t g_map_vaddr = 0;
-int g_map_paddr = 0;
+struct regio *g_io;
 int g_comp = 0;
 int g_module_match = 0;
 
-#define MAP_SIZE 0x1000
 #define KERN_VER(a, b, c) (((a) << 16) + ((b) << 8) + (c))
 
-extern const module_t mx6q[];
-extern const module_t mx6dl[];
-extern const module_t mx6sl[];
-extern const module_t mx6sx[];
-extern const module_t mx6ul[];
-extern const module_t mx7d[];
-extern const module_t mx6ull[];
-extern const module_t mx7ulp[];
-extern const module_t imx8mq7dvajz[];
-
 char g_buffer[4096];
 
 void die(char *p)
@@ -64,49 +54,44 @@ void die(char *p)
 
 int open_mem_file(void)
 {
-	if (!g_fmem)
-		g_fmem = open("/dev/mem", O_RDWR | O_SYNC, 0);
+	if (!g_io)
+		g_io = regio_open(NULL);
 
-	if (!g_fmem)
-		die("Can't open file /dev/mem\n");
+	if (!g_io)
+		die("Can't open the register backend\n");
 	return 0;
 }
 
-int map_address(int address)
+/* <image>[@<base>] of -mem, or $REGIO */
+struct regio *open_regio(const char *mem_image)
 {
-	if ((address & (~(MAP_SIZE - 1))) == g_map_paddr)
-		return 0;
-	if (g_map_vaddr)
-		munmap((void *)g_map_vaddr, MAP_SIZE);
+	char spec[PATH_MAX + 16];
+
+	if (!mem_image)
+		return regio_open(NULL);
+
+	snprintf(spec, sizeof(spec), "sim:%s", mem_image);
+	return regio_open(spec);
+}
 
-	g_map_vaddr =
-	    (uintptr_t)mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
-		      g_fmem, address & (~(MAP_SIZE - 1)));
-	g_map_paddr = address & (~(MAP_SIZE - 1));
+int map_address(int address, int width)
+{
+	if (regio_map(g_io, address, width))
+		die("Can't map the address\n");
 
 	return 0;
 }
 
 int readm(int address, int width)
 {
-	uint8_t *addr8;
-	uint16_t *addr16;
-	uint32_t *addr32;
-
 	open_mem_file();
-	map_address(address);
-
-	addr32 = (uint32_t *) (g_map_vaddr + (address & (MAP_SIZE - 1)));
-	addr16 = (uint16_t *) addr32;
-	addr8 = (uint8_t *) addr16;
+	map_address(address, width);
 
 	switch (width) {
 	case 1:
-		return *addr8;
 	case 2:
-		return *addr16;
 	case 4:
-		return *addr32;
+		return regio_read(g_io, address, width);
 	default:
 		die("Unknown size\n");
 	}
@@ -115,25 +100,14 @@ int readm(int address, int width)
 
 int writem(int address, int width, int value)
 {
-	uint8_t *addr8;
-	uint16_t *addr16;
-	uint32_t *addr32;
-
 	open_mem_file();
-	map_address(address);
-	addr32 = (uint32_t *) (g_map_vaddr + (address & (MAP_SIZE - 1)));
-	addr16 = (uint16_t *) addr32;
-	addr8 = (uint8_t *) addr16;
+	map_address(address, width);
 
 	switch (width) {
 	case 1:
-		*addr8 = value;
-		break;
 	case 2:
-		*addr16 = value;
-		break;
 	case 4:
-		*addr32 = value;
+		regio_write(g_io, address, width, value);
 		break;
 	default:
 		die("Unknown size\n");
@@ -154,9 +128,13 @@ void print_blank(int x)
 		putchar(' ');
 }
 
-void parse_field(const module_t * mx, const reg_t * reg, char *field, int value)
+void parse_field(const struct memdb *db, const struct memdb_module *mx,
+		 const struct memdb_reg *reg, char *field, int value)
 {
-	const field_t *f = reg->fields;
+	const struct memdb_field *f = memdb_reg_fields(db, reg);
+	const char *mname = memdb_str(db, mx->name);
+	const char *rname = memdb_str(db, reg->name);
+	const char *fname;
 	char *str = NULL;
 	int i = 0;
 
@@ -166,25 +144,30 @@ void parse_field(const module_t * mx, const reg_t * reg, char *field, int value)
 		*str = 0;
 
 	for (i = 0; i < reg->field_count; i++) {
+		fname = memdb_str(db, f->name);
 		if (field == NULL || *field == 0
-		    || strncmp(f->name, field, strlen(field)) == 0) {
+		    || strncmp(fname, field, strlen(field)) == 0) {
 			if (g_comp) {
-				printf("%s.%s.%s\n", mx->name, reg->name, f->name);
+				printf("%s.%s.%s\n", mname, rname, fname);
 			} else {
-				printf("     %s.%s.%s(%d..%d) \t:0x%x\n", mx->name,
-				       reg->name, f->name, f->lsb, f->msb,
+				printf("     %s.%s.%s(%d..%d) \t:0x%x\n", mname,
+				       rname, fname, f->lsb, f->msb,
 				       get_value(value, f->lsb, f->msb)
 				    );
-				printf("             %s\n", f->description);
+				printf("             %s\n",
+				       memdb_str(db, f->description));
 			}
 		}
 		f++;
 	}
 }
 
-void parse_reg(const module_t * mx, const char *reg, char *field)
+void parse_reg(const struct memdb *db, const struct memdb_module *mx,
+	       const char *reg, char *field)
 {
-	const reg_t *sreg = mx->regs;
+	const struct memdb_reg *sreg = memdb_module_regs(db, mx);
+	const char *mname = memdb_str(db, mx->name);
+	const char *rname;
 	char *str;
 
 	int i = 0;
@@ -194,24 +177,25 @@ void parse_reg(const module_t * mx, const char *reg, char *field)
 		*str = 0;	/*cut register name */
 
 	for (i = 0; i < mx->reg_count; i++) {
+		rname = memdb_str(db, sreg->name);
 		if (g_comp) {
 			if (field != NULL && reg != NULL) {
-				if (strcmp(sreg->name, reg) == 0)
-					parse_field(mx, sreg, field, 0);
-			} else if (reg == NULL || strncmp(sreg->name, reg, strlen(reg)) == 0) {
-				printf("%s.%s.\n", mx->name, sreg->name);
+				if (strcmp(rname, reg) == 0)
+					parse_field(db, mx, sreg, field, 0);
+			} else if (reg == NULL || strncmp(rname, reg, strlen(reg)) == 0) {
+				printf("%s.%s.\n", mname, rname);
 			}
 
 		} else if (reg == NULL || *reg == 0 || strlen(reg) == 0 ||
-		    strncmp(sreg->name, reg, strlen(reg)) == 0 || *reg == '-') {
+		    strncmp(rname, reg, strlen(reg)) == 0 || *reg == '-') {
 			printf("  %s.%s Addr:0x%08X Value:0x%08X - %s\n",
-			       mx->name, sreg->name,
+			       mname, rname,
 			       mx->base_address + sreg->offset,
 			       readm(mx->base_address + sreg->offset,
 				     sreg->width),
-			       sreg->description);
+			       memdb_str(db, sreg->description));
 			if (!(reg && *reg == '-'))
-				parse_field(mx, sreg, field,
+				parse_field(db, mx, sreg, field,
 					    readm(mx->base_address +
 						  sreg->offset, sreg->width));
 			printf("\n");
@@ -249,10 +233,56 @@ void write_reg(int addr, int width, int value)
 	writem(addr, width, value);
 }
 
-void parse_module(char *module, char *reg, char *field, int iswrite)
+/*
+ * Only the database of the running SoC is mapped, see memdb.h. A build
+ * with the module tables linked in (MEMTOOL_BUILTIN_DB) generates it in
+ * memory when no database file is installed.
+ */
+static void *g_db_image;
+
+struct memdb *load_soc_db(const char *soc_name)
+{
+	struct memdb *db;
+
+	db = memdb_open(soc_name);
+#ifdef MEMTOOL_BUILTIN_DB
+	if (!db && !g_db_image) {
+		const module_t *mx = memdb_get_soc_modules(soc_name);
+		size_t size;
+
+		if (mx && !memdb_build(mx, soc_name, &g_db_image, &size))
+			db = memdb_open_image(g_db_image, size);
+	}
+#endif
+
+	return db;
+}
+
+struct memdb *open_soc_db(const char *soc_name)
+{
+	struct memdb *db;
+
+	db = load_soc_db(soc_name);
+	if (!db) {
+		printf("Can't load the register database of %s\n", soc_name);
+		printf("set %s to the directory of the %s files\n",
+		       MEMDB_ENV_DIR, MEMDB_SUFFIX);
+		die("");
+	}
+
+	return db;
+}
+
+void close_soc_db(struct memdb *db)
+{
+	memdb_close(db);
+	free(g_db_image);
+	g_db_image = NULL;
+}
+
+/* soc_name must hold 255 characters */
+void get_soc_name(char *soc_name, int size)
 {
-	const module_t *mx = NULL;
-	char *str = NULL;
 	int fd = 0;
 	int n;
 	char *rev;
@@ -290,16 +320,13 @@ void parse_module(char *module, char *reg, char *field, int iswrite)
 
 			switch (r >> 12) {
 			case 0x63:
-				mx = mx6q;
-				printf("SOC is mx6q\n\n");
+				snprintf(soc_name, size, "i.MX6Q");
 				break;
 			case 0x61:
-				mx = mx6dl;
-				printf("SOC is mx6dl\n\n");
+				snprintf(soc_name, size, "i.MX6DL");
 				break;
 			case 0x60:
-				mx = mx6sl;
-				printf("SOC is mx6sl\n\n");
+				snprintf(soc_name, size, "i.MX6SL");
 				break;
 			default:
 				die("Unknown SOC\n\n");
@@ -308,7 +335,6 @@ void parse_module(char *module, char *reg, char *field, int iswrite)
 			die("Unknown SOC\n");
 	} else {
 		FILE *fp;
-		char soc_name[255];
 
 		fp = fopen("/sys/devices/soc0/soc_id", "r");
 		if (fp == NULL) {
@@ -316,114 +342,69 @@ void parse_module(char *module, char *reg, char *field, int iswrite)
 			die("fail to get soc_id");
 		}
 
-		if (fscanf(fp, "%s", soc_name) != 1) {
+		if (fscanf(fp, "%254s", soc_name) != 1) {
 			fclose(fp);
 			die("fail to get soc_name");
 		}
 		fclose(fp);
-
-		if (!g_comp)
-			printf("SOC: %s\n", soc_name);
-
-		if (!strcmp(soc_name, "i.MX6Q"))
-			mx = mx6q;
-		else if (!strcmp(soc_name, "i.MX6DL"))
-			mx = mx6dl;
-		else if (!strcmp(soc_name, "i.MX6SL"))
-			mx = mx6sl;
-		else if (!strcmp(soc_name, "i.MX6SX"))
-			mx = mx6sx;
-		else if (!strcmp(soc_name, "i.MX6UL"))
-			mx = mx6ul;
-		else if (!strcmp(soc_name, "i.MX7D"))
-			mx = mx7d;
-		else if (!strcmp(soc_name, "i.MX6ULL"))
-			mx = mx6ull;
-		else if (!strcmp(soc_name, "i.MX7ULP"))
-			mx = mx7ulp;
-		else if (!strcmp(soc_name, "i.MX8MQ"))
-			mx = imx8mq7dvajz;
-		else
-			die("Unknown SOC\n");
 	}
+}
+
+void parse_module(char *module, char *reg, char *field, int iswrite)
+{
+	const struct memdb_module *mx = NULL;
+	const struct memdb_module *end;
+	struct memdb *db;
+	char soc_name[255];
+	char *str = NULL;
+	const char *mname;
+
+	get_soc_name(soc_name, sizeof(soc_name));
+	if (!g_comp)
+		printf("SOC: %s\n", soc_name);
+	db = open_soc_db(soc_name);
+	end = db->modules + db->hdr->module_count;
 
 	if (iswrite && !g_comp) {
-		while (mx) {
-			if (strcmp(mx->name, module) == 0) {
-
-				const reg_t *r = mx->regs;
-				int i = 0;
-				for (i = 0; i < mx->reg_count; i++) {
-					if (strcmp(r->name, reg) == 0) {
-						if (field == NULL || *field == 0) {
-							if (r->is_writable)
-								write_reg(mx->
-									  base_address
-									  +
-									  r->
-									  offset,
-									  r->
-									  width,
-									  g_value);
-							else
-								printf
-								    ("%s.%s is not writable register\n",
-								     mx->name,
-								     r->name);
-							return;
-						} else {
-							const field_t *f = r->fields;
-							int j;
-							for (j = 0; j < r->field_count; j++) {
-								if (strcmp(f->name, field) == 0) {
-									if (f->is_writable)
-										write_reg_mask
-										    (mx->
-										     base_address
-										     +
-										     r->
-										     offset,
-										     r->
-										     width,
-										     g_value,
-										     f->
-										     lsb,
-										     f->
-										     msb);
-									else
-										printf
-										    ("%s.%s.%s is not writable\n",
-										     mx->
-										     name,
-										     r->
-										     name,
-										     f->
-										     name);
-								}
-								f++;
-
-							}
-							return;
-						}
-					}
-
-					r++;
-
-				}
-				printf("Can't find register %s\n", reg);
-				return;
-			}
-			mx++;
+		const struct memdb_reg *r;
+		const struct memdb_field *f;
+
+		mx = memdb_find_module(db, module);
+		if (!mx) {
+			printf("Can't find module %s\n", module);
+			goto exit;
+		}
+		r = memdb_find_reg(db, mx, reg);
+		if (!r) {
+			printf("Can't find register %s\n", reg);
+			goto exit;
 		}
-		printf("Can't find module %s\n", module);
-		return;
+		if (field == NULL || *field == 0) {
+			if (r->flags & MEMDB_WRITABLE)
+				write_reg(mx->base_address + r->offset,
+					  r->width, g_value);
+			else
+				printf("%s.%s is not writable register\n",
+				       memdb_str(db, mx->name),
+				       memdb_str(db, r->name));
+			goto exit;
+		}
+		f = memdb_find_field(db, r, field);
+		if (f && (f->flags & MEMDB_WRITABLE))
+			write_reg_mask(mx->base_address + r->offset, r->width,
+				       g_value, f->lsb, f->msb);
+		else if (f)
+			printf("%s.%s.%s is not writable\n",
+			       memdb_str(db, mx->name), memdb_str(db, r->name),
+			       memdb_str(db, f->name));
+		goto exit;
 	}
 
 	if (g_comp && !g_module_match) {
-		while (mx->name) {
-			if (module == NULL || strlen(module)==0 || (strncmp(mx->name, module, strlen(module)) == 0))
-				printf("%s.\n", mx->name);
-			mx++;
+		for (mx = db->modules; mx < end; mx++) {
+			mname = memdb_str(db, mx->name);
+			if (module == NULL || strlen(module)==0 || (strncmp(mname, module, strlen(module)) == 0))
+				printf("%s.\n", mname);
 		}
 
 	} else if (module == NULL || *module == 0 || (str = strchr(module, '*'))) {	/* list all modules */
@@ -431,29 +412,29 @@ void parse_module(char *module, char *reg, char *field, int iswrite)
 		if (str)
 			*str = 0;	/*Cut module */
 
-		while (mx->name) {
+		for (mx = db->modules; mx < end; mx++) {
+			mname = memdb_str(db, mx->name);
 			if (str == NULL
-			    || (strncmp(mx->name, module, strlen(module)) ==
+			    || (strncmp(mname, module, strlen(module)) ==
 				0)) {
-				printf("  %s", mx->name);
-				print_blank(20 - strlen(mx->name));
+				printf("  %s", mname);
+				print_blank(20 - strlen(mname));
 				printf("0x%08X\n", mx->base_address);
 			}
-			mx++;
 		}
 		if(!g_comp)
-			return;
+			goto exit;
 	}
 
-	while (mx->name) {
-		if (strcmp(mx->name, module) == 0) {
-			if (!g_comp)
-				printf("%s\t Addr:0x%x \n", mx->name, mx->base_address);
-			parse_reg(mx, reg, field);
-			break;
-		}
-		mx++;
+	mx = module ? memdb_find_module(db, module) : NULL;
+	if (mx) {
+		if (!g_comp)
+			printf("%s\t Addr:0x%x \n", memdb_str(db, mx->name),
+			       mx->base_address);
+		parse_reg(db, mx, reg, field);
 	}
+exit:
+	close_soc_db(db);
 }
 
 int parse_cmdline(int argc, char **argv)
@@ -560,19 +541,16 @@ int parse_cmdline(int argc, char **argv)
 	return 0;
 }
 
-void read_mem(void *addr, uint32_t count, uint32_t size)
+void read_mem(uint32_t count, uint32_t size)
 {
 	int i;
-	uint8_t *addr8 = addr;
-	uint16_t *addr16 = addr;
-	uint32_t *addr32 = addr;
 
 	switch (size) {
 	case 1:
 		for (i = 0; i < count; i++) {
 			if ((i % 16) == 0)
 				printf("\n0x%08lX: ", g_paddr);
-			printf(" %02X", addr8[i]);
+			printf(" %02X", regio_read(g_io, g_paddr, 1));
 			g_paddr++;
 		}
 		break;
@@ -580,7 +558,7 @@ void read_mem(void *addr, uint32_t count, uint32_t size)
 		for (i = 0; i < count; i++) {
 			if ((i % 8) == 0)
 				printf("\n0x%08lX: ", g_paddr);
-			printf(" %04X", addr16[i]);
+			printf(" %04X", regio_read(g_io, g_paddr, 2));
 			g_paddr += 2;
 		}
 		break;
@@ -588,7 +566,7 @@ void read_mem(void *addr, uint32_t count, uint32_t size)
 		for (i = 0; i < count; i++) {
 			if ((i % 4) == 0)
 				printf("\n0x%08lX: ", g_paddr);
-			printf(" %08X", addr32[i]);
+			printf(" %08X", regio_read(g_io, g_paddr, 4));
 			g_paddr += 4;
 		}
 		break;
@@ -597,34 +575,24 @@ void read_mem(void *addr, uint32_t count, uint32_t size)
 
 }
 
-void write_mem(void *addr, uint32_t value, uint32_t size)
+void write_mem(uint32_t value, uint32_t size)
 {
-	uint8_t *addr8 = addr;
-	uint16_t *addr16 = addr;
-	uint32_t *addr32 = addr;
-
-	switch (size) {
-	case 1:
-		*addr8 = value;
-		break;
-	case 2:
-		*addr16 = value;
-		break;
-	case 4:
-		*addr32 = value;
-		break;
-	}
+	regio_write(g_io, g_paddr, size, value);
 }
 
 int main(int argc, char **argv)
 {
-	int fd;
-	void *mem;
-	void *aligned_vaddr;
 	unsigned long aligned_paddr;
 	uint32_t aligned_size;
 	int page_size = getpagesize();
 
+	if (argc > 1 && strcmp(argv[1], "-batch") == 0)
+		return batch_main(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "-diff") == 0)
+		return diff_main(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "-watch") == 0)
+		return watch_main(argc - 2, argv + 2);
+
 	if (parse_cmdline(argc, argv)) {
 		printf("Usage:\n\n"
 		       "Read memory: memtool [-8 | -16 | -32] <phys addr> <count>\n"
@@ -638,7 +606,14 @@ int main(int argc, char **argv)
 		       "                memtool UART.UMCR.MDEN=0x1\n"
 		       "Default access size is 32-bit.\n\nAddress, count and value are all in hex.\n"
 		       "\nTo support autocompete feature please run below command:\n"
-		       "     complete -o nospace -C /unit_tests/memtool memtool\n");
+		       "     complete -o nospace -C /unit_tests/memtool memtool\n"
+		       "\nThe register database of the SOC is read from $MEMTOOL_DB,\n"
+		       "or from the memtool_db directory next to memtool.\n"
+		       "\nRun a script and take one snapshot: memtool -batch ...\n"
+		       "Compare two snapshots: memtool -diff <snapshot> <snapshot>\n"
+		       "Trace register changes: memtool -watch ...\n"
+		       "\nThe registers are accessed through $REGIO: devmem (default),\n"
+		       "uio:<n> or sim:[<image>[@<base>]][,replay=<file>].\n");
 		return 1;
 	}
 
@@ -660,33 +635,20 @@ int main(int argc, char **argv)
 		printf("Reading 0x%X count starting at address 0x%08lX\n",
 		       g_count, g_paddr);
 
-	if ((fd = open("/dev/mem", O_RDWR | O_SYNC, 0)) < 0)
-		return 1;
-
-	aligned_vaddr =
-	    mmap(NULL, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
-		 aligned_paddr);
-	if (aligned_vaddr == NULL) {
+	open_mem_file();
+	if (regio_map(g_io, aligned_paddr, aligned_size)) {
 		printf("Error mapping address\n");
-		close(fd);
+		regio_close(g_io);
 		return 1;
 	}
 
-	mem = (char *)aligned_vaddr + (g_paddr - aligned_paddr);
-
 	if (g_is_write) {
-		write_mem(mem, g_value, g_size);
+		write_mem(g_value, g_size);
 	} else {
-		read_mem(mem, g_count, g_size);
+		read_mem(g_count, g_size);
 	}
 
-	munmap(aligned_vaddr, aligned_size);
-	close(fd);
-
-	if (g_map_vaddr)
-		munmap((void *)g_map_vaddr, MAP_SIZE);
-	if (g_fmem)
-		close(g_fmem);
+	regio_close(g_io);
 
 	return 0;
 }
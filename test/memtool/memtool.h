@@ -0,0 +1,38 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#ifndef __MEMTOOL_H__
+#define __MEMTOOL_H__
+
+#include <stdint.h>
+#include "memdb.h"
+
+struct regio;
+
+/* memtool.c */
+void die(char *p);
+unsigned int get_value(int value, int lsb, int msb);
+void get_soc_name(char *soc_name, int size);
+struct memdb *load_soc_db(const char *soc_name);
+struct memdb *open_soc_db(const char *soc_name);
+void close_soc_db(struct memdb *db);
+struct regio *open_regio(const char *mem_image);
+
+/* memtool_batch.c */
+int batch_main(int argc, char **argv);
+int diff_main(int argc, char **argv);
+
+/* memtool_watch.c */
+int watch_main(int argc, char **argv);
+
+#endif
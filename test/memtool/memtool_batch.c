@@ -0,0 +1,1014 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Batch mode: run a script of register reads, writes and module dumps in
+ * one process and emit a single snapshot.
+ *
+ *     memtool -batch [-json | -bin] [-o <file>] [-soc <soc_id>]
+ *                    [-mem <image>[@<base>]] <script | ->
+ *     memtool -diff <snapshot> <snapshot>
+ *
+ * A script line is one of
+ *     [-8 | -16 | -32] <phys addr> [<count>]
+ *     [-8 | -16 | -32] <phys addr>=<value>
+ *     MODULE.REG[.FIELD]
+ *     MODULE.REG[.FIELD]=<value>
+ *     MODULE.*                 all registers, "REG*" and "MOD*." are prefixes
+ * Addresses, counts and values are in hex, '#' starts a comment.
+ *
+ * All the pages the script touches are collected first, sorted, and mapped
+ * once with contiguous pages merged into one mapping. Reads between two
+ * writes are done in address order, writes keep their place in the script.
+ *
+ * The accesses go through regio ($REGIO, /dev/mem by default). -mem is a
+ * shorthand for the simulator backend: a copy-on-write mapping of a raw
+ * memory image whose first byte is at physical address <base>, so
+ * snapshots can be taken offline. The image file itself is never modified.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "memtool.h"
+#include "regio.h"
+
+#define SNAP_MAGIC		"MTSN"
+#define SNAP_VERSION		1
+#define SNAP_WRITE		(1 << 0)
+
+struct snap_header {
+	char magic[4];
+	uint32_t version;
+	char soc[16];
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct snap_entry {
+	uint32_t addr;
+	uint32_t value;
+	uint8_t width;
+	uint8_t flags;
+	uint16_t reserved;
+};
+
+struct snapshot {
+	char soc[255];
+	struct snap_entry *entries;
+	size_t count;
+};
+
+enum {
+	OP_READ,
+	OP_WRITE,
+	OP_SKIP,
+};
+
+struct batch_op {
+	int type;
+	int line;
+	uint32_t seq;
+	uint32_t addr;
+	uint32_t value;
+	uint32_t mask;
+	uint8_t width;
+	const struct memdb_module *m;
+	const struct memdb_reg *r;
+};
+
+struct batch {
+	struct memdb *db;
+	char soc[255];
+
+	struct batch_op *ops;
+	size_t count;
+	size_t alloc;
+
+	struct regio *io;
+	size_t map_count;
+	uint32_t page_size;
+};
+
+static struct batch_op *batch_add_op(struct batch *b, int type, int line,
+				     uint32_t addr, int width)
+{
+	struct batch_op *op;
+
+	if (b->count == b->alloc) {
+		size_t alloc = b->alloc ? b->alloc * 2 : 256;
+
+		op = realloc(b->ops, alloc * sizeof(*op));
+		if (!op)
+			die("out of memory");
+		b->ops = op;
+		b->alloc = alloc;
+	}
+
+	op = &b->ops[b->count++];
+	memset(op, 0, sizeof(*op));
+	op->type = type;
+	op->line = line;
+	op->seq = b->count - 1;
+	op->addr = addr;
+	op->width = width;
+	op->mask = 0xFFFFFFFF;
+
+	return op;
+}
+
+static int batch_check_addr(struct batch *b, int line, uint32_t addr, int width)
+{
+	if (addr & (width - 1)) {
+		fprintf(stderr, "line %d: 0x%08X is not %d-bit aligned\n",
+			line, addr, width * 8);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int name_match(const char *name, const char *pattern)
+{
+	size_t n = strlen(pattern);
+
+	if (n && pattern[n - 1] == '*')
+		return !strncmp(name, pattern, n - 1);
+
+	return !strcmp(name, pattern);
+}
+
+static int batch_add_reg(struct batch *b, int line,
+			 const struct memdb_module *m, const char *reg,
+			 const char *field, int is_write, uint32_t value)
+{
+	const struct memdb_reg *r = memdb_module_regs(b->db, m);
+	const struct memdb_field *f;
+	struct batch_op *op;
+	int found = 0;
+	int i;
+
+	if (reg && *reg && strcmp(reg, "-") && !strchr(reg, '*')) {
+		r = memdb_find_reg(b->db, m, reg);
+		if (!r) {
+			fprintf(stderr, "line %d: can't find register %s.%s\n",
+				line, memdb_str(b->db, m->name), reg);
+			return -1;
+		}
+		if (batch_check_addr(b, line, m->base_address + r->offset,
+				     r->width))
+			return -1;
+		if (!is_write) {
+			if (field && *field && !memdb_find_field(b->db, r, field)) {
+				fprintf(stderr, "line %d: can't find field %s.%s.%s\n",
+					line, memdb_str(b->db, m->name), reg, field);
+				return -1;
+			}
+			op = batch_add_op(b, OP_READ, line,
+					  m->base_address + r->offset, r->width);
+			op->m = m;
+			op->r = r;
+			return 0;
+		}
+		if (!field || !*field) {
+			if (!(r->flags & MEMDB_WRITABLE)) {
+				fprintf(stderr, "line %d: %s.%s is not writable\n",
+					line, memdb_str(b->db, m->name), reg);
+				return -1;
+			}
+			op = batch_add_op(b, OP_WRITE, line,
+					  m->base_address + r->offset, r->width);
+			op->value = value;
+			op->m = m;
+			op->r = r;
+			return 0;
+		}
+		f = memdb_find_field(b->db, r, field);
+		if (!f || !(f->flags & MEMDB_WRITABLE)) {
+			fprintf(stderr, "line %d: %s.%s.%s is %s\n", line,
+				memdb_str(b->db, m->name), reg, field,
+				f ? "not writable" : "not found");
+			return -1;
+		}
+		op = batch_add_op(b, OP_WRITE, line,
+				  m->base_address + r->offset, r->width);
+		op->mask = (0xFFFFFFFF >> (31 - f->msb + f->lsb)) << f->lsb;
+		op->value = (value << f->lsb) & op->mask;
+		op->m = m;
+		op->r = r;
+		return 0;
+	}
+
+	if (is_write) {
+		fprintf(stderr, "line %d: can't write more than one register\n",
+			line);
+		return -1;
+	}
+
+	for (i = 0; i < m->reg_count; i++, r++) {
+		if (reg && *reg && strcmp(reg, "*") && strcmp(reg, "-") &&
+		    !name_match(memdb_str(b->db, r->name), reg))
+			continue;
+		if (batch_check_addr(b, line, m->base_address + r->offset,
+				     r->width))
+			return -1;
+		op = batch_add_op(b, OP_READ, line,
+				  m->base_address + r->offset, r->width);
+		op->m = m;
+		op->r = r;
+		found++;
+	}
+	if (!found)
+		fprintf(stderr, "line %d: no register of %s matches %s\n",
+			line, memdb_str(b->db, m->name), reg);
+
+	return 0;
+}
+
+/* MODULE.REG[.FIELD][=value] */
+static int batch_parse_reg(struct batch *b, int line, char *path)
+{
+	const struct memdb_module *m;
+	const struct memdb_module *end;
+	char *reg, *field, *equal;
+	uint32_t value = 0;
+	int is_write = 0;
+	int found = 0;
+
+	reg = strchr(path, '.');
+	*reg++ = 0;
+	field = strchr(reg, '.');
+	if (field)
+		*field++ = 0;
+	equal = strchr(field ? field : reg, '=');
+	if (equal) {
+		*equal++ = 0;
+		value = strtoul(equal, NULL, 16);
+		is_write = 1;
+	}
+
+	if (!strchr(path, '*')) {
+		m = memdb_find_module(b->db, path);
+		if (!m) {
+			fprintf(stderr, "line %d: can't find module %s\n",
+				line, path);
+			return -1;
+		}
+		return batch_add_reg(b, line, m, reg, field, is_write, value);
+	}
+
+	if (is_write) {
+		fprintf(stderr, "line %d: can't write more than one module\n",
+			line);
+		return -1;
+	}
+
+	end = b->db->modules + b->db->hdr->module_count;
+	for (m = b->db->modules; m < end; m++) {
+		if (!name_match(memdb_str(b->db, m->name), path))
+			continue;
+		if (batch_add_reg(b, line, m, reg, field, 0, 0))
+			return -1;
+		found++;
+	}
+	if (!found)
+		fprintf(stderr, "line %d: no module matches %s\n", line, path);
+
+	return 0;
+}
+
+/* <phys addr> [<count>] or <phys addr>=<value> */
+static int batch_parse_raw(struct batch *b, int line, int width,
+			   char *addr_str, char *count_str)
+{
+	struct batch_op *op;
+	uint32_t addr, count = 1;
+	char *equal, *end;
+	uint32_t i;
+
+	equal = strchr(addr_str, '=');
+	if (equal)
+		*equal++ = 0;
+
+	addr = strtoul(addr_str, &end, 16);
+	if (*end || end == addr_str) {
+		fprintf(stderr, "line %d: invalid address %s\n", line, addr_str);
+		return -1;
+	}
+
+	if (equal) {
+		if (batch_check_addr(b, line, addr, width))
+			return -1;
+		op = batch_add_op(b, OP_WRITE, line, addr, width);
+		op->value = strtoul(equal, NULL, 16);
+		return 0;
+	}
+
+	if (count_str)
+		count = strtoul(count_str, NULL, 16);
+	for (i = 0; i < count; i++) {
+		if (batch_check_addr(b, line, addr + i * width, width))
+			return -1;
+		batch_add_op(b, OP_READ, line, addr + i * width, width);
+	}
+
+	return 0;
+}
+
+static int batch_parse_line(struct batch *b, int line, char *str)
+{
+	char *tok[3];
+	char *save = NULL;
+	char *comment;
+	int width = 4;
+	int n = 0;
+
+	comment = strchr(str, '#');
+	if (comment)
+		*comment = 0;
+
+	while (n < 3 && (tok[n] = strtok_r(n ? NULL : str, " \t\r\n", &save)))
+		n++;
+	if (!n)
+		return 0;
+
+	if (!strcmp(tok[0], "-8") || !strcmp(tok[0], "-16") ||
+	    !strcmp(tok[0], "-32")) {
+		width = atoi(tok[0] + 1) / 8;
+		memmove(tok, tok + 1, sizeof(tok[0]) * 2);
+		n--;
+		if (!n) {
+			fprintf(stderr, "line %d: missing address\n", line);
+			return -1;
+		}
+	}
+
+	if (strchr(tok[0], '.'))
+		return batch_parse_reg(b, line, tok[0]);
+
+	return batch_parse_raw(b, line, width, tok[0], n > 1 ? tok[1] : NULL);
+}
+
+static int batch_parse(struct batch *b, const char *script)
+{
+	char line[1024];
+	int lineno = 0;
+	int ret = 0;
+	FILE *fp;
+
+	if (!strcmp(script, "-"))
+		fp = stdin;
+	else
+		fp = fopen(script, "r");
+	if (!fp) {
+		perror(script);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (batch_parse_line(b, lineno, line))
+			ret = -1;
+	}
+
+	if (fp != stdin)
+		fclose(fp);
+
+	return ret;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int batch_map_pages(struct batch *b)
+{
+	uint32_t *pages;
+	size_t count = 0;
+	size_t i, j;
+
+	if (!b->count)
+		return 0;
+
+	pages = malloc(b->count * sizeof(*pages));
+	if (!pages)
+		die("out of memory");
+
+	for (i = 0; i < b->count; i++)
+		pages[i] = b->ops[i].addr & ~(b->page_size - 1);
+	qsort(pages, b->count, sizeof(*pages), cmp_u32);
+	for (i = 0; i < b->count; i++) {
+		if (!count || pages[i] != pages[count - 1])
+			pages[count++] = pages[i];
+	}
+
+	for (i = 0; i < count; i = j) {
+		for (j = i + 1; j < count; j++) {
+			if (pages[j] != pages[j - 1] + b->page_size)
+				break;
+		}
+
+		if (regio_map(b->io, pages[i], (j - i) * b->page_size)) {
+			free(pages);
+			return -1;
+		}
+		b->map_count++;
+	}
+
+	free(pages);
+
+	return 0;
+}
+
+static int cmp_op_addr(const void *a, const void *b)
+{
+	const struct batch_op *x = a;
+	const struct batch_op *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	if (x->width != y->width)
+		return x->width < y->width ? -1 : 1;
+	/* keep the script order of the same register */
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void batch_read_segment(struct batch *b, struct batch_op *ops,
+			       size_t count)
+{
+	struct batch_op *prev = NULL;
+	size_t i;
+
+	qsort(ops, count, sizeof(*ops), cmp_op_addr);
+	for (i = 0; i < count; i++) {
+		if (prev && prev->addr == ops[i].addr &&
+		    prev->width == ops[i].width) {
+			ops[i].type = OP_SKIP;
+			continue;
+		}
+		ops[i].value = regio_read(b->io, ops[i].addr, ops[i].width);
+		prev = &ops[i];
+	}
+}
+
+static void batch_run(struct batch *b)
+{
+	size_t first = 0;
+	size_t i;
+
+	for (i = 0; i <= b->count; i++) {
+		struct batch_op *op = &b->ops[i];
+		uint32_t value;
+
+		if (i < b->count && op->type == OP_READ)
+			continue;
+		if (i > first)
+			batch_read_segment(b, &b->ops[first], i - first);
+		first = i + 1;
+		if (i == b->count)
+			break;
+
+		value = op->value;
+		if (op->mask != 0xFFFFFFFF)
+			value |= regio_read(b->io, op->addr, op->width) & ~op->mask;
+		regio_write(b->io, op->addr, op->width, value);
+		/* record the value the register was set to */
+		op->value = value;
+	}
+}
+
+static void json_str(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', fp);
+		if ((unsigned char)*str < 0x20)
+			continue;
+		fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+/* one entry per line, snapshot_load() depends on it */
+static void batch_write_json(struct batch *b, FILE *fp)
+{
+	const struct memdb_field *f;
+	const char *sep = "";
+	size_t i;
+	int j;
+
+	fprintf(fp, "{\"soc\":");
+	json_str(fp, b->soc);
+	fprintf(fp, ",\"source\":");
+	json_str(fp, regio_name(b->io));
+	fprintf(fp, ",\"entries\":[");
+
+	for (i = 0; i < b->count; i++) {
+		struct batch_op *op = &b->ops[i];
+
+		if (op->type == OP_SKIP)
+			continue;
+
+		fprintf(fp, "%s\n{\"addr\":\"0x%08X\",\"width\":%d,\"value\":\"0x%0*X\"",
+			sep, op->addr, op->width, op->width * 2, op->value);
+		sep = ",";
+		if (op->type == OP_WRITE)
+			fprintf(fp, ",\"write\":true");
+		if (!op->r) {
+			fprintf(fp, "}");
+			continue;
+		}
+
+		fprintf(fp, ",\"module\":");
+		json_str(fp, memdb_str(b->db, op->m->name));
+		fprintf(fp, ",\"reg\":");
+		json_str(fp, memdb_str(b->db, op->r->name));
+		if (op->type == OP_WRITE || !op->r->field_count) {
+			fprintf(fp, "}");
+			continue;
+		}
+
+		fprintf(fp, ",\"fields\":{");
+		f = memdb_reg_fields(b->db, op->r);
+		for (j = 0; j < op->r->field_count; j++, f++) {
+			fprintf(fp, "%s", j ? "," : "");
+			json_str(fp, memdb_str(b->db, f->name));
+			fprintf(fp, ":%u", get_value(op->value, f->lsb, f->msb));
+		}
+		fprintf(fp, "}}");
+	}
+
+	fprintf(fp, "\n]}\n");
+}
+
+static void batch_write_bin(struct batch *b, FILE *fp)
+{
+	struct snap_header hdr;
+	struct snap_entry e;
+	size_t i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAP_MAGIC, 4);
+	hdr.version = SNAP_VERSION;
+	memcpy(hdr.soc, b->soc, strnlen(b->soc, sizeof(hdr.soc) - 1));
+	for (i = 0; i < b->count; i++) {
+		if (b->ops[i].type != OP_SKIP)
+			hdr.count++;
+	}
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+
+	memset(&e, 0, sizeof(e));
+	for (i = 0; i < b->count; i++) {
+		struct batch_op *op = &b->ops[i];
+
+		if (op->type == OP_SKIP)
+			continue;
+		e.addr = op->addr;
+		e.value = op->value;
+		e.width = op->width;
+		e.flags = op->type == OP_WRITE ? SNAP_WRITE : 0;
+		fwrite(&e, sizeof(e), 1, fp);
+	}
+}
+
+static void batch_usage(void)
+{
+	printf("Usage:\n\n"
+	       "memtool -batch [-json | -bin] [-o <file>] [-soc <soc_id>]\n"
+	       "               [-mem <image>[@<base>]] <script | ->\n"
+	       "memtool -diff <snapshot> <snapshot>\n\n"
+	       "Script lines:\n"
+	       "    [-8 | -16 | -32] <phys addr> [<count>]\n"
+	       "    [-8 | -16 | -32] <phys addr>=<value>\n"
+	       "    UART1.UCR1  UART1.UCR1.TXDMAEN  UART1.*  UART1.U*  IOMUXC*.*\n"
+	       "    UART1.UCR1=0x1  UART1.UCR1.TXDMAEN=0x1\n"
+	       "Address, count and value are all in hex.\n\n"
+	       "The snapshot is JSON unless -bin is given, both can be diffed.\n"
+	       "-mem reads a raw memory image starting at physical address\n"
+	       "<base> (hex, default 0) instead of /dev/mem, writes only change\n"
+	       "a private copy, it is the same as REGIO=sim:<image>@<base>.\n"
+	       "-soc is needed where soc_id isn't available.\n");
+}
+
+int batch_main(int argc, char **argv)
+{
+	const char *output = NULL;
+	const char *script = NULL;
+	char *mem = NULL;
+	struct batch b;
+	int binary = 0;
+	int ret = 1;
+	FILE *fp;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.page_size = getpagesize();
+
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "-json")) {
+			binary = 0;
+		} else if (!strcmp(argv[i], "-bin")) {
+			binary = 1;
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if (!strcmp(argv[i], "-soc") && i + 1 < argc) {
+			snprintf(b.soc, sizeof(b.soc), "%s", argv[++i]);
+		} else if (!strcmp(argv[i], "-mem") && i + 1 < argc) {
+			mem = argv[++i];
+		} else if (!script && (argv[i][0] != '-' || !argv[i][1])) {
+			script = argv[i];
+		} else {
+			batch_usage();
+			return 1;
+		}
+	}
+	if (!script) {
+		batch_usage();
+		return 1;
+	}
+
+	if (!b.soc[0])
+		get_soc_name(b.soc, sizeof(b.soc));
+	b.db = open_soc_db(b.soc);
+
+	b.io = open_regio(mem);
+	if (!b.io)
+		goto exit;
+	if (batch_parse(&b, script))
+		goto exit;
+	if (batch_map_pages(&b))
+		goto exit;
+
+	batch_run(&b);
+
+	fp = output ? fopen(output, binary ? "wb" : "w") : stdout;
+	if (!fp) {
+		perror(output);
+		goto exit;
+	}
+	if (binary)
+		batch_write_bin(&b, fp);
+	else
+		batch_write_json(&b, fp);
+	if (fflush(fp) || ferror(fp))
+		fprintf(stderr, "write snapshot fail\n");
+	else
+		ret = 0;
+	if (fp != stdout)
+		fclose(fp);
+
+	fprintf(stderr, "%zu accesses, %zu mappings\n", b.count, b.map_count);
+exit:
+	regio_close(b.io);
+	free(b.ops);
+	close_soc_db(b.db);
+
+	return ret;
+}
+
+static int snapshot_add(struct snapshot *s, size_t *alloc,
+			const struct snap_entry *e)
+{
+	if (s->count == *alloc) {
+		size_t n = *alloc ? *alloc * 2 : 256;
+		struct snap_entry *entries;
+
+		entries = realloc(s->entries, n * sizeof(*entries));
+		if (!entries)
+			return -1;
+		s->entries = entries;
+		*alloc = n;
+	}
+	s->entries[s->count++] = *e;
+
+	return 0;
+}
+
+static int snapshot_load_bin(struct snapshot *s, FILE *fp)
+{
+	struct snap_header hdr;
+	struct snap_entry e;
+	size_t alloc = 0;
+	uint32_t i;
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.version != SNAP_VERSION)
+		return -1;
+	memcpy(s->soc, hdr.soc, sizeof(hdr.soc));
+	s->soc[sizeof(hdr.soc)] = 0;
+
+	for (i = 0; i < hdr.count; i++) {
+		if (fread(&e, sizeof(e), 1, fp) != 1)
+			return -1;
+		if (snapshot_add(s, &alloc, &e))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int snapshot_load_json(struct snapshot *s, FILE *fp)
+{
+	struct snap_entry e;
+	size_t alloc = 0;
+	char line[4096];
+	char *str;
+
+	while (fgets(line, sizeof(line), fp)) {
+		str = strstr(line, "\"soc\":\"");
+		if (str && !s->soc[0])
+			sscanf(str + 7, "%254[^\"]", s->soc);
+
+		str = strstr(line, "\"addr\":\"");
+		if (!str)
+			continue;
+
+		memset(&e, 0, sizeof(e));
+		e.addr = strtoul(str + 8, NULL, 16);
+		str = strstr(line, "\"width\":");
+		e.width = str ? atoi(str + 8) : 4;
+		str = strstr(line, "\"value\":\"");
+		if (!str)
+			return -1;
+		e.value = strtoul(str + 9, NULL, 16);
+		if (strstr(line, "\"write\":true"))
+			e.flags |= SNAP_WRITE;
+		if (snapshot_add(s, &alloc, &e))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int snapshot_load(struct snapshot *s, const char *filename)
+{
+	char magic[4];
+	int ret;
+	FILE *fp;
+
+	memset(s, 0, sizeof(*s));
+	fp = fopen(filename, "rb");
+	if (!fp) {
+		perror(filename);
+		return -1;
+	}
+
+	if (fread(magic, sizeof(magic), 1, fp) == 1 &&
+	    !memcmp(magic, SNAP_MAGIC, 4)) {
+		rewind(fp);
+		ret = snapshot_load_bin(s, fp);
+	} else {
+		rewind(fp);
+		ret = snapshot_load_json(s, fp);
+	}
+	fclose(fp);
+
+	if (ret)
+		fprintf(stderr, "invalid snapshot %s\n", filename);
+
+	return ret;
+}
+
+struct snap_sort {
+	struct snap_entry e;
+	uint32_t seq;
+};
+
+static int cmp_snap_sort(const void *a, const void *b)
+{
+	const struct snap_sort *x = a;
+	const struct snap_sort *y = b;
+
+	if (x->e.addr != y->e.addr)
+		return x->e.addr < y->e.addr ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* sorts the reads by address, the last read of a register wins */
+static int snapshot_sort(struct snapshot *s)
+{
+	struct snap_sort *sorted;
+	size_t i, n = 0;
+
+	sorted = malloc((s->count ? s->count : 1) * sizeof(*sorted));
+	if (!sorted)
+		return -1;
+
+	for (i = 0; i < s->count; i++) {
+		if (s->entries[i].flags & SNAP_WRITE)
+			continue;
+		sorted[n].e = s->entries[i];
+		sorted[n].seq = i;
+		n++;
+	}
+	qsort(sorted, n, sizeof(*sorted), cmp_snap_sort);
+
+	s->count = 0;
+	for (i = 0; i < n; i++) {
+		if (i + 1 < n && sorted[i + 1].e.addr == sorted[i].e.addr)
+			continue;
+		s->entries[s->count++] = sorted[i].e;
+	}
+	free(sorted);
+
+	return 0;
+}
+
+struct reg_index {
+	uint32_t addr;
+	const struct memdb_module *m;
+	const struct memdb_reg *r;
+};
+
+static int cmp_reg_index(const void *a, const void *b)
+{
+	const struct reg_index *x = a;
+	const struct reg_index *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	/* the first module at an address wins */
+	return x->m < y->m ? -1 : x->m > y->m;
+}
+
+static struct reg_index *build_reg_index(const struct memdb *db, size_t *count)
+{
+	const struct memdb_module *m;
+	const struct memdb_reg *r;
+	struct reg_index *index;
+	size_t n = 0;
+	uint32_t i;
+
+	for (m = db->modules, i = 0; i < db->hdr->module_count; i++, m++)
+		n += m->reg_count;
+	index = malloc((n ? n : 1) * sizeof(*index));
+	if (!index)
+		return NULL;
+
+	n = 0;
+	for (m = db->modules, i = 0; i < db->hdr->module_count; i++, m++) {
+		uint32_t j;
+
+		r = memdb_module_regs(db, m);
+		for (j = 0; j < m->reg_count; j++, r++) {
+			index[n].addr = m->base_address + r->offset;
+			index[n].m = m;
+			index[n].r = r;
+			n++;
+		}
+	}
+	qsort(index, n, sizeof(*index), cmp_reg_index);
+	*count = n;
+
+	return index;
+}
+
+static const struct reg_index *find_reg_index(const struct reg_index *index,
+					      size_t count, uint32_t addr)
+{
+	size_t lo = 0, hi = count;
+
+	/* lower bound, so the first module at the address is returned */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (index[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < count && index[lo].addr == addr ? &index[lo] : NULL;
+}
+
+static void diff_print(const struct memdb *db, const struct reg_index *ri,
+		       const struct snap_entry *a, const struct snap_entry *b)
+{
+	const struct memdb_field *f;
+	const char *mname, *rname;
+	int i;
+
+	if (!ri) {
+		printf("  0x%08X: 0x%08X -> 0x%08X\n", a->addr, a->value,
+		       b->value);
+		return;
+	}
+
+	mname = memdb_str(db, ri->m->name);
+	rname = memdb_str(db, ri->r->name);
+	printf("  %s.%s Addr:0x%08X 0x%08X -> 0x%08X\n", mname, rname,
+	       a->addr, a->value, b->value);
+
+	f = memdb_reg_fields(db, ri->r);
+	for (i = 0; i < ri->r->field_count; i++, f++) {
+		uint32_t x = get_value(a->value, f->lsb, f->msb);
+		uint32_t y = get_value(b->value, f->lsb, f->msb);
+
+		if (x != y)
+			printf("     %s.%s.%s(%d..%d) \t:0x%x -> 0x%x\n", mname,
+			       rname, memdb_str(db, f->name), f->lsb, f->msb,
+			       x, y);
+	}
+}
+
+static void diff_print_only(const struct memdb *db, const struct reg_index *ri,
+			    const struct snap_entry *e, const char *filename)
+{
+	if (ri)
+		printf("  %s.%s Addr:0x%08X 0x%08X only in %s\n",
+		       memdb_str(db, ri->m->name), memdb_str(db, ri->r->name),
+		       e->addr, e->value, filename);
+	else
+		printf("  0x%08X: 0x%08X only in %s\n", e->addr, e->value,
+		       filename);
+}
+
+int diff_main(int argc, char **argv)
+{
+	struct reg_index *index = NULL;
+	const struct reg_index *ri;
+	struct snapshot s[2];
+	struct memdb *db = NULL;
+	size_t index_count = 0;
+	size_t compared = 0, changed = 0;
+	size_t i = 0, j = 0;
+
+	if (argc != 2) {
+		batch_usage();
+		return 2;
+	}
+
+	if (snapshot_load(&s[0], argv[0]))
+		return 2;
+	if (snapshot_load(&s[1], argv[1])) {
+		free(s[0].entries);
+		return 2;
+	}
+	if (strcmp(s[0].soc, s[1].soc))
+		fprintf(stderr, "snapshots are from %s and %s\n",
+			s[0].soc, s[1].soc);
+	if (snapshot_sort(&s[0]) || snapshot_sort(&s[1]))
+		die("out of memory");
+
+	/* without the database the registers are shown by address */
+	if (s[0].soc[0])
+		db = load_soc_db(s[0].soc);
+	if (db)
+		index = build_reg_index(db, &index_count);
+	else
+		fprintf(stderr, "no register database of %s\n", s[0].soc);
+
+	while (i < s[0].count || j < s[1].count) {
+		struct snap_entry *a = i < s[0].count ? &s[0].entries[i] : NULL;
+		struct snap_entry *b = j < s[1].count ? &s[1].entries[j] : NULL;
+
+		if (a && (!b || a->addr < b->addr)) {
+			ri = find_reg_index(index, index_count, a->addr);
+			diff_print_only(db, ri, a, argv[0]);
+			changed++;
+			i++;
+			continue;
+		}
+		if (b && (!a || b->addr < a->addr)) {
+			ri = find_reg_index(index, index_count, b->addr);
+			diff_print_only(db, ri, b, argv[1]);
+			changed++;
+			j++;
+			continue;
+		}
+
+		compared++;
+		if (a->value != b->value) {
+			ri = find_reg_index(index, index_count, a->addr);
+			diff_print(db, ri, a, b);
+			changed++;
+		}
+		i++;
+		j++;
+	}
+
+	printf("%zu registers compared, %zu differ\n", compared, changed);
+
+	free(index);
+	if (db)
+		close_soc_db(db);
+	free(s[0].entries);
+	free(s[1].entries);
+
+	return changed ? 1 : 0;
+}
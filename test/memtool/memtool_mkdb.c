@@ -0,0 +1,112 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Generate the register database of each SoC for memtool:
+ *     memtool_mkdb <outdir> [soc ...]
+ * soc is either the soc_id ("i.MX6UL") or the database name ("imx6ul"),
+ * all SoCs are generated if none is given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "memtools_register_info.h"
+#include "memdb.h"
+
+static int is_selected(const char *soc, int argc, char **argv)
+{
+	char name[64];
+	size_t n;
+	int i;
+
+	if (!argc)
+		return 1;
+
+	memdb_soc_filename(soc, name, sizeof(name));
+	n = strlen(name) - strlen(MEMDB_SUFFIX);
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], soc) || !strcmp(argv[i], name))
+			return 1;
+		if (strlen(argv[i]) == n && !strncmp(argv[i], name, n))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int write_db(const char *outdir, const char *soc)
+{
+	char filename[PATH_MAX];
+	char name[64];
+	struct memdb *db;
+	void *image;
+	size_t size;
+	FILE *fp;
+
+	if (memdb_build(memdb_get_soc_modules(soc), soc, &image, &size)) {
+		fprintf(stderr, "build %s database fail\n", soc);
+		return -1;
+	}
+
+	/* check the image the way memtool opens it */
+	db = memdb_open_image(image, size);
+	if (!db) {
+		fprintf(stderr, "invalid %s database\n", soc);
+		free(image);
+		return -1;
+	}
+
+	memdb_soc_filename(soc, name, sizeof(name));
+	snprintf(filename, sizeof(filename), "%s/%s", outdir, name);
+	fp = fopen(filename, "wb");
+	if (!fp || fwrite(image, 1, size, fp) != size) {
+		fprintf(stderr, "write %s fail\n", filename);
+		if (fp)
+			fclose(fp);
+		memdb_close(db);
+		free(image);
+		return -1;
+	}
+	fclose(fp);
+
+	printf("%s: %u modules, %u registers, %u fields, %u bytes of strings, %zu bytes -> %s\n",
+	       soc, db->hdr->module_count, db->hdr->reg_count,
+	       db->hdr->field_count, db->hdr->strings_size, size, filename);
+
+	memdb_close(db);
+	free(image);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *soc;
+	int ret = 0;
+	int i;
+
+	if (argc < 2) {
+		printf("Usage: %s <outdir> [soc ...]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; (soc = memdb_get_soc_name(i)); i++) {
+		if (!is_selected(soc, argc - 2, argv + 2))
+			continue;
+		if (write_db(argv[1], soc))
+			ret = 1;
+	}
+
+	return ret;
+}
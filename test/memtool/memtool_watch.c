@@ -0,0 +1,545 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Watch mode: sample registers or fields at a fixed rate and trace their
+ * transitions.
+ *
+ *     memtool -watch [-rate <Hz>] [-t <seconds>] [-n <samples>] [-cpu <n>]
+ *                    [-rt] [-ring <entries>] [-csv | -bin] [-o <file>]
+ *                    [-soc <soc_id>] [-mem <image>[@<base>]] <reg> ...
+ *
+ * <reg> is MODULE.REG, MODULE.REG.FIELD or a physical address in hex.
+ * Fields of the same register share one read per sample.
+ *
+ * The sampling loop only reads the registers, takes one CLOCK_MONOTONIC
+ * timestamp per sample and stores the registers whose watched bits
+ * changed in a preallocated ring. Nothing is printed until the run ends;
+ * when the ring wraps, the oldest transitions are dropped. Without -rate
+ * the registers are sampled back to back, below 1 ms the period is busy
+ * waited, above it the loop sleeps until the next deadline.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "memtool.h"
+#include "regio.h"
+
+#define TRACE_MAGIC		"MTTR"
+#define TRACE_VERSION		1
+#define TRACE_NAME_SIZE		56
+
+#define WATCH_DEFAULT_RING	65536
+#define WATCH_SPIN_NS		1000000
+
+struct trace_header {
+	char magic[4];
+	uint32_t version;
+	char soc[16];
+	uint32_t item_count;
+	uint32_t reg_count;
+	uint32_t entry_count;
+	uint32_t reserved;
+	uint64_t samples;
+	uint64_t lost;
+	uint64_t duration_ns;
+};
+
+struct trace_item {
+	uint32_t addr;
+	uint32_t reg;
+	uint8_t width;
+	uint8_t lsb;
+	uint8_t msb;
+	uint8_t reserved;
+	char name[TRACE_NAME_SIZE];
+};
+
+/* old == value marks the value at the start of the run */
+struct trace_entry {
+	uint64_t time_ns;
+	uint32_t reg;
+	uint32_t old;
+	uint32_t value;
+	uint32_t reserved;
+};
+
+struct watch_reg {
+	uint32_t addr;
+	uint8_t width;
+	uint32_t mask;
+	uint32_t value;
+	volatile void *vaddr;	/* NULL when regio_read() is needed */
+};
+
+struct watch {
+	struct memdb *db;
+	char soc[255];
+
+	struct trace_item *items;
+	size_t item_count;
+	struct watch_reg *regs;
+	size_t reg_count;
+
+	struct trace_entry *ring;
+	uint64_t ring_size;
+	uint64_t head;
+	uint64_t samples;
+	uint64_t duration_ns;
+	uint64_t max_gap_ns;
+
+	struct regio *io;
+};
+
+static volatile sig_atomic_t g_watch_stop;
+
+static void watch_signal(int sig)
+{
+	g_watch_stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int watch_add_reg(struct watch *w, uint32_t addr, int width,
+			 uint32_t mask)
+{
+	struct watch_reg *r;
+	size_t i;
+
+	for (i = 0; i < w->reg_count; i++) {
+		if (w->regs[i].addr == addr && w->regs[i].width == width) {
+			w->regs[i].mask |= mask;
+			return i;
+		}
+	}
+
+	r = realloc(w->regs, (w->reg_count + 1) * sizeof(*r));
+	if (!r)
+		die("out of memory");
+	w->regs = r;
+	r = &w->regs[w->reg_count];
+	memset(r, 0, sizeof(*r));
+	r->addr = addr;
+	r->width = width;
+	r->mask = mask;
+
+	return w->reg_count++;
+}
+
+static int watch_add_item(struct watch *w, char *arg)
+{
+	const struct memdb_module *m;
+	const struct memdb_reg *r;
+	const struct memdb_field *f = NULL;
+	struct trace_item *item;
+	char *reg, *field, *end;
+	uint32_t addr;
+	int width = 4;
+	int lsb = 0, msb;
+
+	item = realloc(w->items, (w->item_count + 1) * sizeof(*item));
+	if (!item)
+		die("out of memory");
+	w->items = item;
+	item = &w->items[w->item_count];
+	memset(item, 0, sizeof(*item));
+	snprintf(item->name, sizeof(item->name), "%s", arg);
+
+	reg = strchr(arg, '.');
+	if (!reg) {
+		addr = strtoul(arg, &end, 16);
+		if (*end || end == arg || addr & 3) {
+			fprintf(stderr, "invalid address %s\n", arg);
+			return -1;
+		}
+		msb = 31;
+		goto add;
+	}
+
+	*reg++ = 0;
+	field = strchr(reg, '.');
+	if (field)
+		*field++ = 0;
+
+	m = memdb_find_module(w->db, arg);
+	if (!m) {
+		fprintf(stderr, "can't find module %s\n", arg);
+		return -1;
+	}
+	r = memdb_find_reg(w->db, m, reg);
+	if (!r) {
+		fprintf(stderr, "can't find register %s.%s\n", arg, reg);
+		return -1;
+	}
+	if (field && *field) {
+		f = memdb_find_field(w->db, r, field);
+		if (!f) {
+			fprintf(stderr, "can't find field %s.%s.%s\n",
+				arg, reg, field);
+			return -1;
+		}
+	}
+
+	addr = m->base_address + r->offset;
+	width = r->width;
+	msb = width * 8 - 1;
+	if (f) {
+		lsb = f->lsb;
+		msb = f->msb;
+	}
+
+add:
+	item->addr = addr;
+	item->width = width;
+	item->lsb = lsb;
+	item->msb = msb;
+	item->reg = watch_add_reg(w, addr, width,
+				  (0xFFFFFFFF >> (31 - msb + lsb)) << lsb);
+	w->item_count++;
+
+	return 0;
+}
+
+static int watch_map(struct watch *w)
+{
+	size_t i;
+
+	for (i = 0; i < w->reg_count; i++) {
+		struct watch_reg *r = &w->regs[i];
+
+		if (regio_map(w->io, r->addr, r->width))
+			return -1;
+		r->vaddr = regio_ptr(w->io, r->addr);
+	}
+
+	return 0;
+}
+
+static inline uint32_t watch_read(struct watch *w, const struct watch_reg *r)
+{
+	if (!r->vaddr)
+		return regio_read(w->io, r->addr, r->width);
+
+	switch (r->width) {
+	case 1:
+		return *(volatile uint8_t *)r->vaddr;
+	case 2:
+		return *(volatile uint16_t *)r->vaddr;
+	default:
+		return *(volatile uint32_t *)r->vaddr;
+	}
+}
+
+static inline void watch_record(struct watch *w, uint64_t t, uint32_t reg,
+				uint32_t old, uint32_t value)
+{
+	struct trace_entry *e = &w->ring[w->head & (w->ring_size - 1)];
+
+	e->time_ns = t;
+	e->reg = reg;
+	e->old = old;
+	e->value = value;
+	w->head++;
+}
+
+static void watch_run(struct watch *w, uint64_t period_ns, uint64_t max_ns,
+		      uint64_t max_samples)
+{
+	struct watch_reg *regs = w->regs;
+	size_t count = w->reg_count;
+	uint64_t start, t, last, next;
+	struct timespec ts;
+	size_t i;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		regs[i].value = watch_read(w, &regs[i]);
+		watch_record(w, 0, i, regs[i].value, regs[i].value);
+	}
+	last = start;
+	next = start + period_ns;
+
+	while (!g_watch_stop) {
+		if (period_ns) {
+			if (period_ns >= WATCH_SPIN_NS) {
+				ts.tv_sec = next / 1000000000ull;
+				ts.tv_nsec = next % 1000000000ull;
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						&ts, NULL);
+			} else {
+				while (now_ns() < next)
+					;
+			}
+			next += period_ns;
+		}
+
+		t = now_ns();
+		for (i = 0; i < count; i++) {
+			uint32_t value = watch_read(w, &regs[i]);
+
+			if ((value ^ regs[i].value) & regs[i].mask) {
+				watch_record(w, t - start, i, regs[i].value,
+					     value);
+				regs[i].value = value;
+			}
+		}
+		w->samples++;
+
+		if (t - last > w->max_gap_ns)
+			w->max_gap_ns = t - last;
+		last = t;
+		if (max_samples && w->samples >= max_samples)
+			break;
+		if (max_ns && t - start >= max_ns)
+			break;
+	}
+
+	w->duration_ns = last - start;
+}
+
+static const struct trace_entry *watch_entry(const struct watch *w,
+					     uint64_t i)
+{
+	return &w->ring[i & (w->ring_size - 1)];
+}
+
+static uint64_t watch_first(const struct watch *w)
+{
+	return w->head > w->ring_size ? w->head - w->ring_size : 0;
+}
+
+static void watch_write_csv(const struct watch *w, FILE *fp)
+{
+	const struct trace_entry *e;
+	uint64_t i;
+	size_t j;
+
+	fprintf(fp, "time_ns,name,old,new\n");
+	for (i = watch_first(w); i < w->head; i++) {
+		e = watch_entry(w, i);
+		for (j = 0; j < w->item_count; j++) {
+			const struct trace_item *item = &w->items[j];
+			uint32_t old, value;
+
+			if (item->reg != e->reg)
+				continue;
+			old = get_value(e->old, item->lsb, item->msb);
+			value = get_value(e->value, item->lsb, item->msb);
+			if (e->old == e->value)
+				fprintf(fp, "%llu,%s,,0x%x\n",
+					(unsigned long long)e->time_ns,
+					item->name, value);
+			else if (old != value)
+				fprintf(fp, "%llu,%s,0x%x,0x%x\n",
+					(unsigned long long)e->time_ns,
+					item->name, old, value);
+		}
+	}
+}
+
+static void watch_write_bin(const struct watch *w, FILE *fp)
+{
+	struct trace_header hdr;
+	uint64_t i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, 4);
+	hdr.version = TRACE_VERSION;
+	memcpy(hdr.soc, w->soc, strnlen(w->soc, sizeof(hdr.soc) - 1));
+	hdr.item_count = w->item_count;
+	hdr.reg_count = w->reg_count;
+	hdr.entry_count = w->head - watch_first(w);
+	hdr.samples = w->samples;
+	hdr.lost = watch_first(w);
+	hdr.duration_ns = w->duration_ns;
+
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fwrite(w->items, sizeof(*w->items), w->item_count, fp);
+	for (i = watch_first(w); i < w->head; i++)
+		fwrite(watch_entry(w, i), sizeof(struct trace_entry), 1, fp);
+}
+
+static int watch_setup_cpu(int cpu, int rt)
+{
+	struct sched_param param;
+	cpu_set_t set;
+
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			perror("sched_setaffinity");
+			return -1;
+		}
+	}
+
+	if (rt) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+		if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+			perror("sched_setscheduler");
+			return -1;
+		}
+		if (mlockall(MCL_CURRENT | MCL_FUTURE))
+			perror("mlockall");
+	}
+
+	return 0;
+}
+
+static void watch_usage(void)
+{
+	printf("Usage:\n\n"
+	       "memtool -watch [-rate <Hz>] [-t <seconds>] [-n <samples>] [-cpu <n>]\n"
+	       "               [-rt] [-ring <entries>] [-csv | -bin] [-o <file>]\n"
+	       "               [-soc <soc_id>] [-mem <image>[@<base>]] <reg> ...\n\n"
+	       "<reg> is MODULE.REG, MODULE.REG.FIELD or a physical address in hex.\n"
+	       "Samples as fast as possible until Ctrl-C unless -rate, -t or -n\n"
+	       "is given. Only transitions are recorded, the trace is written when\n"
+	       "the run ends (CSV by default). -cpu pins the sampling loop, -rt\n"
+	       "runs it SCHED_FIFO with the memory locked. -ring is rounded up to\n"
+	       "a power of 2, default %d. -mem is REGIO=sim:<image>@<base>, with\n"
+	       "REGIO=sim:...,replay=<file> recorded values can be played back.\n",
+	       WATCH_DEFAULT_RING);
+}
+
+int watch_main(int argc, char **argv)
+{
+	const char *output = NULL;
+	char *mem = NULL;
+	uint64_t period_ns = 0, max_ns = 0, max_samples = 0;
+	uint64_t ring_size = WATCH_DEFAULT_RING;
+	struct sigaction sa;
+	struct watch w;
+	int binary = 0;
+	int cpu = -1, rt = 0;
+	int first = -1;
+	int ret = 1;
+	FILE *fp;
+	int i;
+
+	memset(&w, 0, sizeof(w));
+
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "-csv")) {
+			binary = 0;
+		} else if (!strcmp(argv[i], "-bin")) {
+			binary = 1;
+		} else if (!strcmp(argv[i], "-rt")) {
+			rt = 1;
+		} else if (!strcmp(argv[i], "-rate") && i + 1 < argc) {
+			double rate = strtod(argv[++i], NULL);
+
+			period_ns = rate > 0 ? 1e9 / rate : 0;
+		} else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			max_ns = strtod(argv[++i], NULL) * 1e9;
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			max_samples = strtoull(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "-cpu") && i + 1 < argc) {
+			cpu = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-ring") && i + 1 < argc) {
+			ring_size = strtoull(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if (!strcmp(argv[i], "-soc") && i + 1 < argc) {
+			snprintf(w.soc, sizeof(w.soc), "%s", argv[++i]);
+		} else if (!strcmp(argv[i], "-mem") && i + 1 < argc) {
+			mem = argv[++i];
+		} else if (argv[i][0] != '-') {
+			first = i;
+			break;
+		} else {
+			watch_usage();
+			return 1;
+		}
+	}
+	if (first < 0 || !ring_size) {
+		watch_usage();
+		return 1;
+	}
+	for (w.ring_size = 1; w.ring_size < ring_size; w.ring_size <<= 1)
+		;
+
+	if (!w.soc[0])
+		get_soc_name(w.soc, sizeof(w.soc));
+	w.db = open_soc_db(w.soc);
+
+	for (i = first; i < argc; i++) {
+		if (watch_add_item(&w, argv[i]))
+			goto exit;
+	}
+	w.io = open_regio(mem);
+	if (!w.io || watch_map(&w))
+		goto exit;
+
+	/* fault the ring in now, not in the sampling loop */
+	w.ring = malloc(w.ring_size * sizeof(*w.ring));
+	if (!w.ring)
+		die("out of memory");
+	memset(w.ring, 0, w.ring_size * sizeof(*w.ring));
+
+	if (watch_setup_cpu(cpu, rt))
+		goto exit;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watch_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	watch_run(&w, period_ns, max_ns, max_samples);
+
+	fp = output ? fopen(output, binary ? "wb" : "w") : stdout;
+	if (!fp) {
+		perror(output);
+		goto exit;
+	}
+	if (binary)
+		watch_write_bin(&w, fp);
+	else
+		watch_write_csv(&w, fp);
+	if (fflush(fp) || ferror(fp))
+		fprintf(stderr, "write trace fail\n");
+	else
+		ret = 0;
+	if (fp != stdout)
+		fclose(fp);
+
+	fprintf(stderr, "%llu samples in %llu us, %.0f samples/s, max gap %llu ns\n",
+		(unsigned long long)w.samples,
+		(unsigned long long)(w.duration_ns / 1000),
+		w.duration_ns ? w.samples * 1e9 / w.duration_ns : 0.0,
+		(unsigned long long)w.max_gap_ns);
+	fprintf(stderr, "%llu transitions, %llu lost\n",
+		(unsigned long long)(w.head - w.reg_count),
+		(unsigned long long)watch_first(&w));
+exit:
+	regio_close(w.io);
+	free(w.ring);
+	free(w.regs);
+	free(w.items);
+	close_soc_db(w.db);
+
+	return ret;
+}
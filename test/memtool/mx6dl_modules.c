@@ -154290,17 +154290,17 @@ const module_t mx6dl[] =
     { "MIPI_DSI",        1, 0x021e0000, 27,   hw_mipi_dsi },
     { "MIPI_HSI",        1, 0x02208000, 132,  hw_mipi_hsi },
     { "MLB150",          1, 0x0218c000, 32,   hw_mlb150 },
-    { "MMDC0",           1, 0x021b0000, 81,   hw_mmdc },
-    { "MMDC1",           2, 0x021b0000, 81,   hw_mmdc },
+    { "MMDC0",           1, 0x021b0000, 79,   hw_mmdc },
+    { "MMDC1",           2, 0x021b0000, 79,   hw_mmdc },
     { "OCOTP",           1, 0x021bc000, 41,   hw_ocotp },
-    { "PCIE",            1, 0x01000000, 47,   hw_pcie },
+    { "PCIE",            1, 0x01000000, 46,   hw_pcie },
     { "PGC",             1, 0x020dc000, 12,   hw_pgc },
     { "PMU",             1, 0x020c8000, 7,    hw_pmu },
     { "PWM1",            1, 0x02080000, 6,    hw_pwm },
     { "PWM2",            2, 0x02084000, 6,    hw_pwm },
     { "PWM3",            3, 0x02088000, 6,    hw_pwm },
     { "PWM4",            4, 0x0208c000, 6,    hw_pwm },
-    { "PXP",             1, 0x020f0000, 53,   hw_pxp },
+    { "PXP",             1, 0x020f0000, 52,   hw_pxp },
     { "ROMC",            1, 0x021ac000, 28,   hw_romc },
     { "SDMAARM",         1, 0x020ec000, 106,  hw_sdmaarm },
     { "SDMABP",          1, 0x020ec000, 7,    hw_sdmabp },
@@ -0,0 +1,517 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "regio.h"
+
+#define REGIO_UIO_MAPS		5
+
+enum {
+	REGIO_DEVMEM,
+	REGIO_UIO,
+	REGIO_SIM,
+};
+
+struct regio_map {
+	uint32_t paddr;
+	uint32_t size;
+	uint8_t *vaddr;
+};
+
+struct regio_uio_map {
+	uint32_t paddr;
+	uint32_t size;
+	uint8_t *vaddr;
+};
+
+struct regio_replay {
+	uint32_t addr;
+	uint32_t *values;
+	uint32_t count;
+	uint32_t next;
+};
+
+struct regio {
+	int type;
+	int fd;
+	char name[64];
+	uint32_t page_size;
+
+	struct regio_map *maps;
+	size_t map_count;
+
+	struct regio_uio_map uio[REGIO_UIO_MAPS];
+
+	uint32_t sim_base;
+	uint64_t sim_size;
+
+	struct regio_replay *replay;
+	size_t replay_count;
+};
+
+static int regio_uio_open(struct regio *io, const char *dev)
+{
+	char path[128];
+	FILE *fp;
+	int n = atoi(dev);
+	int i;
+
+	snprintf(path, sizeof(path), "/dev/uio%d", n);
+	io->fd = open(path, O_RDWR | O_SYNC);
+	if (io->fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	for (i = 0; i < REGIO_UIO_MAPS; i++) {
+		unsigned long addr = 0, size = 0;
+
+		snprintf(path, sizeof(path),
+			 "/sys/class/uio/uio%d/maps/map%d/addr", n, i);
+		fp = fopen(path, "r");
+		if (!fp)
+			break;
+		if (fscanf(fp, "%lx", &addr) != 1)
+			addr = 0;
+		fclose(fp);
+
+		snprintf(path, sizeof(path),
+			 "/sys/class/uio/uio%d/maps/map%d/size", n, i);
+		fp = fopen(path, "r");
+		if (!fp)
+			break;
+		if (fscanf(fp, "%lx", &size) != 1)
+			size = 0;
+		fclose(fp);
+
+		io->uio[i].paddr = addr;
+		io->uio[i].size = size;
+	}
+	if (!i) {
+		fprintf(stderr, "uio%d has no maps\n", n);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int regio_load_replay(struct regio *io, const char *filename)
+{
+	char line[4096];
+	FILE *fp;
+	int lineno = 0;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		perror(filename);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct regio_replay *r;
+		char *str = line, *end;
+		char *comment;
+		uint32_t addr;
+
+		lineno++;
+		comment = strchr(line, '#');
+		if (comment)
+			*comment = 0;
+		addr = strtoul(str, &end, 16);
+		if (end == str)
+			continue;
+
+		r = realloc(io->replay, (io->replay_count + 1) * sizeof(*r));
+		if (!r)
+			goto fail;
+		io->replay = r;
+		r = &io->replay[io->replay_count++];
+		memset(r, 0, sizeof(*r));
+		r->addr = addr;
+
+		for (str = end; ; str = end) {
+			uint32_t value = strtoul(str, &end, 16);
+			uint32_t *values;
+
+			if (end == str)
+				break;
+			values = realloc(r->values, (r->count + 1) * sizeof(*values));
+			if (!values)
+				goto fail;
+			r->values = values;
+			r->values[r->count++] = value;
+		}
+		if (!r->count) {
+			fprintf(stderr, "%s:%d: no values for 0x%08X\n",
+				filename, lineno, addr);
+			goto fail;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+fail:
+	fclose(fp);
+	return -1;
+}
+
+/* sim:[<image>[@<base>]][,replay=<file>] */
+static int regio_sim_open(struct regio *io, char *args)
+{
+	char *replay = strstr(args, ",replay=");
+	char *base;
+	struct stat st;
+
+	if (replay) {
+		*replay = 0;
+		replay += strlen(",replay=");
+	} else if (!strncmp(args, "replay=", 7)) {
+		replay = args + 7;
+		args = "";
+	}
+
+	if (*args) {
+		base = strchr(args, '@');
+		if (base) {
+			*base++ = 0;
+			io->sim_base = strtoul(base, NULL, 16);
+		}
+		if (io->sim_base & (io->page_size - 1)) {
+			fprintf(stderr, "base 0x%08X of %s is not page aligned\n",
+				io->sim_base, args);
+			return -1;
+		}
+		io->fd = open(args, O_RDONLY);
+		if (io->fd < 0 || fstat(io->fd, &st)) {
+			perror(args);
+			return -1;
+		}
+		io->sim_size = st.st_size;
+	}
+
+	if (replay && regio_load_replay(io, replay))
+		return -1;
+
+	return 0;
+}
+
+struct regio *regio_open(const char *spec)
+{
+	struct regio *io;
+	char *args;
+	int ret;
+
+	if (!spec)
+		spec = getenv(REGIO_ENV);
+	if (!spec || !*spec)
+		spec = "devmem";
+
+	io = calloc(1, sizeof(*io));
+	if (!io)
+		return NULL;
+	io->fd = -1;
+	io->page_size = getpagesize();
+	snprintf(io->name, sizeof(io->name), "%s", spec);
+
+	args = strdup(spec);
+	if (!args) {
+		free(io);
+		return NULL;
+	}
+
+	if (!strcmp(args, "devmem")) {
+		io->type = REGIO_DEVMEM;
+		io->fd = open("/dev/mem", O_RDWR | O_SYNC, 0);
+		if (io->fd < 0)
+			perror("/dev/mem");
+		ret = io->fd < 0 ? -1 : 0;
+	} else if (!strncmp(args, "uio:", 4)) {
+		io->type = REGIO_UIO;
+		ret = regio_uio_open(io, args + 4);
+	} else if (!strncmp(args, "sim:", 4) || !strcmp(args, "sim")) {
+		io->type = REGIO_SIM;
+		ret = regio_sim_open(io, args + (args[3] ? 4 : 3));
+	} else {
+		fprintf(stderr, "unknown register backend %s\n", spec);
+		ret = -1;
+	}
+	free(args);
+
+	if (ret) {
+		regio_close(io);
+		return NULL;
+	}
+
+	return io;
+}
+
+void regio_close(struct regio *io)
+{
+	size_t i;
+
+	if (!io)
+		return;
+
+	for (i = 0; i < io->map_count; i++) {
+		if (io->type != REGIO_UIO)
+			munmap(io->maps[i].vaddr, io->maps[i].size);
+	}
+	for (i = 0; i < REGIO_UIO_MAPS; i++) {
+		if (io->uio[i].vaddr)
+			munmap(io->uio[i].vaddr, io->uio[i].size);
+	}
+	for (i = 0; i < io->replay_count; i++)
+		free(io->replay[i].values);
+	free(io->replay);
+	free(io->maps);
+	if (io->fd >= 0)
+		close(io->fd);
+	free(io);
+}
+
+const char *regio_name(const struct regio *io)
+{
+	return io->name;
+}
+
+static struct regio_map *regio_find(struct regio *io, uint32_t paddr)
+{
+	size_t lo = 0, hi = io->map_count;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		struct regio_map *map = &io->maps[mid];
+
+		if (paddr < map->paddr)
+			hi = mid;
+		else if (paddr - map->paddr >= map->size)
+			lo = mid + 1;
+		else
+			return map;
+	}
+
+	return NULL;
+}
+
+static void *regio_map_uio(struct regio *io, uint32_t paddr, uint32_t size)
+{
+	struct regio_uio_map *u;
+	int i;
+
+	for (i = 0; i < REGIO_UIO_MAPS; i++) {
+		u = &io->uio[i];
+		if (!u->size || paddr < u->paddr ||
+		    (uint64_t)paddr - u->paddr + size > u->size)
+			continue;
+		if (!u->vaddr) {
+			/* map N of a uio device is at offset N pages */
+			void *vaddr = mmap(NULL, u->size, PROT_READ | PROT_WRITE,
+					   MAP_SHARED, io->fd,
+					   (off_t)i * io->page_size);
+
+			if (vaddr == MAP_FAILED)
+				return MAP_FAILED;
+			u->vaddr = vaddr;
+		}
+		return u->vaddr + (paddr - u->paddr);
+	}
+
+	errno = ENXIO;
+	return MAP_FAILED;
+}
+
+static void *regio_map_sim(struct regio *io, uint32_t paddr, uint32_t size)
+{
+	if (io->fd < 0)
+		return mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (paddr < io->sim_base ||
+	    (uint64_t)paddr - io->sim_base + size >
+	    ((io->sim_size + io->page_size - 1) & ~(uint64_t)(io->page_size - 1))) {
+		errno = ENXIO;
+		return MAP_FAILED;
+	}
+
+	/* private: the accesses never modify the image */
+	return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, io->fd,
+		    paddr - io->sim_base);
+}
+
+/* map whole pages of [paddr, paddr + size), pages already mapped are kept */
+int regio_map(struct regio *io, uint32_t paddr, uint32_t size)
+{
+	uint32_t page = paddr & ~(io->page_size - 1);
+	uint64_t end = ((uint64_t)paddr + size + io->page_size - 1) &
+		       ~(uint64_t)(io->page_size - 1);
+
+	/*
+	 * Checked for every register, not only the one that maps a page:
+	 * the tail of the last page past the end of an image file faults.
+	 */
+	if (io->type == REGIO_SIM && io->fd >= 0 &&
+	    (paddr < io->sim_base ||
+	     (uint64_t)paddr - io->sim_base + size > io->sim_size)) {
+		fprintf(stderr, "can't map 0x%08X..0x%08X on %s: %s\n",
+			paddr, paddr + size - 1, io->name, strerror(ENXIO));
+		return -1;
+	}
+
+	while (page < end) {
+		struct regio_map *map;
+		uint32_t len;
+		void *vaddr;
+		size_t i;
+
+		map = regio_find(io, page);
+		if (map) {
+			if ((uint64_t)map->paddr + map->size >= end)
+				return 0;
+			page = map->paddr + map->size;
+			continue;
+		}
+
+		/* up to the next mapping, so that mappings never overlap */
+		len = end - page;
+		for (i = 0; i < io->map_count; i++) {
+			if (io->maps[i].paddr > page &&
+			    io->maps[i].paddr - page < len)
+				len = io->maps[i].paddr - page;
+		}
+
+		switch (io->type) {
+		case REGIO_UIO:
+			vaddr = regio_map_uio(io, page, len);
+			break;
+		case REGIO_SIM:
+			vaddr = regio_map_sim(io, page, len);
+			break;
+		default:
+			vaddr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, io->fd, page);
+			break;
+		}
+		if (vaddr == MAP_FAILED) {
+			fprintf(stderr, "can't map 0x%08X..0x%08X on %s: %s\n",
+				page, page + len - 1, io->name, strerror(errno));
+			return -1;
+		}
+
+		map = realloc(io->maps, (io->map_count + 1) * sizeof(*map));
+		if (!map) {
+			if (io->type != REGIO_UIO)
+				munmap(vaddr, len);
+			return -1;
+		}
+		io->maps = map;
+		for (i = io->map_count; i > 0 && io->maps[i - 1].paddr > page; i--)
+			io->maps[i] = io->maps[i - 1];
+		io->maps[i].paddr = page;
+		io->maps[i].size = len;
+		io->maps[i].vaddr = vaddr;
+		io->map_count++;
+
+		page += len;
+	}
+
+	return 0;
+}
+
+static struct regio_replay *regio_find_replay(struct regio *io, uint32_t paddr)
+{
+	size_t i;
+
+	for (i = 0; i < io->replay_count; i++) {
+		if (io->replay[i].addr == paddr)
+			return &io->replay[i];
+	}
+
+	return NULL;
+}
+
+volatile void *regio_ptr(struct regio *io, uint32_t paddr)
+{
+	struct regio_map *map;
+
+	if (io->replay_count && regio_find_replay(io, paddr))
+		return NULL;
+
+	map = regio_find(io, paddr);
+	if (!map)
+		return NULL;
+
+	return map->vaddr + (paddr - map->paddr);
+}
+
+static volatile void *regio_addr(struct regio *io, uint32_t paddr)
+{
+	struct regio_map *map = regio_find(io, paddr);
+
+	if (!map) {
+		fprintf(stderr, "0x%08X is not mapped\n", paddr);
+		abort();
+	}
+
+	return map->vaddr + (paddr - map->paddr);
+}
+
+uint32_t regio_read(struct regio *io, uint32_t paddr, int width)
+{
+	volatile void *p;
+
+	if (io->replay_count) {
+		struct regio_replay *r = regio_find_replay(io, paddr);
+
+		if (r) {
+			uint32_t value = r->values[r->next];
+
+			r->next = (r->next + 1) % r->count;
+			return value;
+		}
+	}
+
+	p = regio_addr(io, paddr);
+	switch (width) {
+	case 1:
+		return *(volatile uint8_t *)p;
+	case 2:
+		return *(volatile uint16_t *)p;
+	default:
+		return *(volatile uint32_t *)p;
+	}
+}
+
+void regio_write(struct regio *io, uint32_t paddr, int width, uint32_t value)
+{
+	volatile void *p = regio_addr(io, paddr);
+
+	switch (width) {
+	case 1:
+		*(volatile uint8_t *)p = value;
+		break;
+	case 2:
+		*(volatile uint16_t *)p = value;
+		break;
+	default:
+		*(volatile uint32_t *)p = value;
+		break;
+	}
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Register access shared by memtool and mmdc
+ *
+ * The backend is chosen by a spec string, $REGIO when the tool has no
+ * option for it:
+ *     devmem (default)          /dev/mem
+ *     uio:<n>                   the maps of /dev/uio<n>, at the physical
+ *                               addresses listed in /sys/class/uio
+ *     sim:[<image>[@<base>]][,replay=<file>]
+ *                               a private copy of a raw memory image whose
+ *                               first byte is at physical address <base>,
+ *                               or zeroed memory without an image
+ *
+ * A replay file lists recorded values, one register per line:
+ *     <addr> <value> <value> ...        (hex, '#' starts a comment)
+ * every read of <addr> returns the next value, wrapping at the end, so
+ * counter sequences captured on a board can drive the tools on a host.
+ *
+ * Ranges must be mapped with regio_map() before they are accessed.
+ */
+#ifndef __REGIO_H__
+#define __REGIO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define REGIO_ENV		"REGIO"
+
+struct regio;
+
+struct regio *regio_open(const char *spec);
+void regio_close(struct regio *io);
+const char *regio_name(const struct regio *io);
+
+int regio_map(struct regio *io, uint32_t paddr, uint32_t size);
+
+uint32_t regio_read(struct regio *io, uint32_t paddr, int width);
+void regio_write(struct regio *io, uint32_t paddr, int width, uint32_t value);
+
+/*
+ * Direct pointer to a mapped register for hot loops, NULL when the
+ * accesses have to go through regio_read() (replayed registers).
+ */
+volatile void *regio_ptr(struct regio *io, uint32_t paddr);
+
+#endif
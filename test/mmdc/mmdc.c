@@ -14,8 +14,6 @@
 
 #include "mmdc.h"
 #include <stdio.h>
-#include <sys/mman.h>
-#include <fcntl.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <stdlib.h>
@@ -23,9 +21,6 @@
 
 const int AXI_BUS_WIDTH_IN_BYTE = 8;
 
-#define MMDC_P0_IPS_BASE_ADDR 0x021B0000
-#define MMDC_P1_IPS_BASE_ADDR 0x021B4000
-
 /************************* Global Variables ***********************************/
 pMMDC_t mmdc_p0 = (pMMDC_t)(MMDC_P0_IPS_BASE_ADDR);
 pMMDC_t mmdc_p1 = (pMMDC_t)(MMDC_P1_IPS_BASE_ADDR);
@@ -43,135 +38,192 @@ static unsigned long getTickCount(void)
 
 /************************ Profiler Functions **********************************/
 
-void start_mmdc_profiling(pMMDC_t mmdc)
+/*
+ * AXI ID filter of each master, the first entry matching the name and the
+ * SoC (any SoC when part is 0) is used.
+ */
+static const struct mmdc_master mmdc_masters[] = {
+	{ "DSP1",	0x62, axi_lcd1_6sx },
+	{ "DSP1",	0x60, axi_lcd1_6sl },
+	{ "DSP1",	0x64, axi_lcdif_6ul },
+	{ "DSP1",	0, axi_ipu1 },
+	{ "DSP2",	0x63, axi_ipu2_6q },
+	{ "DSP2",	0x65, axi_ipu2_6qp },
+	{ "DSP2",	0x62, axi_lcd2_6sx },
+	{ "M4",		0x62, axi_m4_6sx },
+	{ "PXP",	0x62, axi_pxp_6sx },
+	{ "PXP",	0x64, axi_pxp_6ul },
+	{ "ENET1",	0x64, axi_enet1_6ul },
+	{ "ENET2",	0x64, axi_enet2_6ul },
+	{ "GPU3D",	0x62, axi_gpu3d_6sx },
+	{ "GPU3D",	0x61, axi_gpu3d_6dl },
+	{ "GPU3D",	0x65, axi_gpu3dd0_6qp },
+	{ "GPU3D2",	0x65, axi_gpu3dd1_6qp, "GPU3DD1" },
+	{ "GPU3D",	0x63, axi_gpu3d_6q },
+	{ "GPU2D1",	0x61, axi_gpu2d1_6dl },
+	{ "GPU2D",	0x65, axi_gpu2d_6qp },
+	{ "GPU2D",	0x63, axi_gpu2d_6q },
+	{ "GPU2D2",	0x61, axi_gpu2d2_6dl },
+	{ "GPU2D",	0x60, axi_gpu2d_6sl },
+	{ "VPU",	0x61, axi_vpu_6dl },
+	{ "VPU",	0x65, axi_vpu_6qp },
+	{ "VPU",	0x63, axi_vpu_6q },
+	{ "PRE",	0x65, axi_pre_6qp },
+	{ "PRE0",	0x65, axi_pre0_6qp },
+	{ "PRE1",	0x65, axi_pre1_6qp },
+	{ "PRE2",	0x65, axi_pre2_6qp },
+	{ "PRE3",	0x65, axi_pre3_6qp },
+	{ "GPUVG",	0x63, axi_openvg_6q },
+	{ "GPUVG",	0x65, axi_openvg_6qp },
+	{ "GPUVG",	0x60, axi_openvg_6sl },
+	{ "USB",	0x62, axi_usb_6sx },
+	{ "USB",	0x60, axi_usb_6sl },
+	{ "USB",	0x64, axi_usb_6ul },
+	{ "USB",	0, axi_usb },
+	{ "ARM",	0x62, axi_arm_6sx },
+	{ "ARM",	0x64, axi_arm_6ul },
+	{ "ARM",	0, axi_arm },
+	{ "SUM",	0, axi_default },
+};
+
+const struct mmdc_master *find_mmdc_master(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(mmdc_masters) / sizeof(mmdc_masters[0]); i++) {
+		if (strcmp(mmdc_masters[i].name, name))
+			continue;
+		if (mmdc_masters[i].part && !mxc_is_cpu(mmdc_masters[i].part))
+			continue;
+		return &mmdc_masters[i];
+	}
+
+	return NULL;
+}
+
+
+void start_mmdc_profiling(struct regio *mmdc)
 {
 	/* Reset counters and clear Overflow bit */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 = 0x1A;
+		mmdc_writel(mmdc, madpcr0, 0x1A);
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1
 		|| cpu_is_mx6ul() == 1)
-		mmdc->madpcr0 = 0xA;
+		mmdc_writel(mmdc, madpcr0, 0xA);
 	else
 		return;
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 
 	/* Enable counters */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 = 0x11;
+		mmdc_writel(mmdc, madpcr0, 0x11);
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1
 		|| cpu_is_mx6ul() == 1)
-		mmdc->madpcr0 = 0x1;
+		mmdc_writel(mmdc, madpcr0, 0x1);
 	else
 		return;
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 
 }
 
-void stop_mmdc_profiling(pMMDC_t mmdc)
+void stop_mmdc_profiling(struct regio *mmdc)
 {
 	/* Disable counters */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 = 0x10;
+		mmdc_writel(mmdc, madpcr0, 0x10);
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1)
-		mmdc->madpcr0 = 0x0;
+		mmdc_writel(mmdc, madpcr0, 0x0);
 	else
 		return;
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 
 }
 
-void pause_mmdc_profiling(pMMDC_t mmdc)
+void pause_mmdc_profiling(struct regio *mmdc)
 {
 	/* PRF_FRZ = 1 */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 = 0x13;
+		mmdc_writel(mmdc, madpcr0, 0x13);
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1)
-		mmdc->madpcr0 = 0x3;
+		mmdc_writel(mmdc, madpcr0, 0x3);
 	else
 		return;
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 }
 
-void resume_mmdc_profiling(pMMDC_t mmdc)
+void resume_mmdc_profiling(struct regio *mmdc)
 {
 	/* PRF_FRZ = 0 */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 = 0x11;
+		mmdc_writel(mmdc, madpcr0, 0x11);
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1)
-		mmdc->madpcr0 = 0x1;
+		mmdc_writel(mmdc, madpcr0, 0x1);
 	else
 		return;
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 }
-void load_mmdc_results(pMMDC_t mmdc)
+void load_mmdc_results(struct regio *mmdc)
 {
 	/* printf("before : mmdc->madpcr0 0x%x\n",mmdc->madpcr0);*/
 	/* sets the PRF_FRZ bit to 1 in order to load the results into the registers */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 |= 0x14; 
+		mmdc_writel(mmdc, madpcr0, mmdc_readl(mmdc, madpcr0) | 0x14); 
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1)
-		mmdc->madpcr0 |= 0x4;
+		mmdc_writel(mmdc, madpcr0, mmdc_readl(mmdc, madpcr0) | 0x4);
 	else
 		return;
 	/* printf("after : mmdc->madpcr0 0x%x\n",mmdc->madpcr0); */
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 }
 
-void clear_mmdc_results(pMMDC_t mmdc)
+void clear_mmdc_results(struct regio *mmdc)
 {
 	/* Reset counters and clear Overflow bit */
 	if(cpu_is_mx6qp() == 1)
-		mmdc->madpcr0 = 0x1A;
+		mmdc_writel(mmdc, madpcr0, 0x1A);
 	else if( cpu_is_mx6q() == 1
 		|| cpu_is_mx6dl() == 1
 		|| cpu_is_mx6sl() == 1
 		|| cpu_is_mx6sx() == 1)
-		mmdc->madpcr0 = 0xA;
+		mmdc_writel(mmdc, madpcr0, 0xA);
 	else
 		return;
-	msync(&(mmdc->madpcr0),4,MS_SYNC);
 }
 
-void get_mmdc_profiling_results(pMMDC_t mmdc, MMDC_PROFILE_RES_t *results)
+void get_mmdc_profiling_results(struct regio *mmdc, MMDC_PROFILE_RES_t *results)
 {
 	unsigned int bytewidth;
-	results->total_cycles 	= mmdc->madpsr0;
-	results->busy_cycles 	= mmdc->madpsr1;
-	results->read_accesses	= mmdc->madpsr2;
-	results->write_accesses	= mmdc->madpsr3;
-	results->read_bytes	= mmdc->madpsr4;
-	results->write_bytes	= mmdc->madpsr5;
-	bytewidth = 4 << ((mmdc->mdctl & 0x30000)>>16);
+	results->total_cycles 	= mmdc_readl(mmdc, madpsr0);
+	results->busy_cycles 	= mmdc_readl(mmdc, madpsr1);
+	results->read_accesses	= mmdc_readl(mmdc, madpsr2);
+	results->write_accesses	= mmdc_readl(mmdc, madpsr3);
+	results->read_bytes	= mmdc_readl(mmdc, madpsr4);
+	results->write_bytes	= mmdc_readl(mmdc, madpsr5);
+	bytewidth = 4 << ((mmdc_readl(mmdc, mdctl) & 0x30000)>>16);
 	if(results->read_bytes!=0 || results->write_bytes!=0)
 	{
 		results->utilization	= (int)(((double)results->read_bytes+(double)results->write_bytes)/((double)results->busy_cycles * bytewidth) * 100);
 
 		results->data_load  	= (int)((float)results->busy_cycles/(float)results->total_cycles * 100);
 		results->access_utilization	= (int)(((double)results->read_bytes+(double)results->write_bytes)/((double)results->read_accesses + (double)results->write_accesses));
-		if(mmdc->madpsr3)
-			results->avg_write_burstsize = (int)mmdc->madpsr5 / mmdc->madpsr3;
+		if(results->write_accesses)
+			results->avg_write_burstsize = (int)results->write_bytes / results->write_accesses;
 		else
 			results->avg_write_burstsize = 0;
-		if(mmdc->madpsr2)
-			results->avg_read_burstsize = (int)mmdc->madpsr4 / mmdc->madpsr2;
+		if(results->read_accesses)
+			results->avg_read_burstsize = (int)results->read_bytes / results->read_accesses;
 		else
 			results->avg_read_burstsize = 0;
 	}
@@ -231,6 +283,13 @@ static int get_system_rev(void)
 	int rev_major, rev_minor;
 	int ret = -1;
 
+	/* to run against a simulated MMDC, see REGIO */
+	tmp = getenv("MMDC_SYSTEM_REV");
+	if (tmp != NULL) {
+		system_rev = strtoul(tmp, NULL, 16);
+		return 0;
+	}
+
 	fp = fopen("/proc/cpuinfo", "r");
 	if (fp == NULL) {
 		perror("/proc/cpuinfo\n");
@@ -338,11 +397,15 @@ void help(void)
 	printf("export MMDC_CUST_MADPCR1 can be used to customize madpcr1. Will ignore it if defined master\n");
 	printf("Note1: More than 1 master can be inputed. They will be profiled one by one.\n");
 	printf("Note2: MX6DL can't profile master GPU2D, GPU2D1 and GPU2D2 are used instead.\n");
+	printf("mmdc -sample [...] samples the counters continuously, see mmdc -sample -h\n");
+	printf("mmdc -top [...] shows the masters side by side, see mmdc -top -h\n");
+	printf("export REGIO selects the register access: devmem (default), uio:<n> or\n");
+	printf("sim:[<image>[@<base>]][,replay=<file>], with MMDC_SYSTEM_REV set for sim.\n");
 }
 int main(int argc, char **argv)
 {
 	unsigned int timeForSleep = 500;
-	void *A;
+	struct regio *mmdc;
 	MMDC_PROFILE_RES_t results;
 	int ulStartTime = 0;
 	int i;
@@ -368,17 +431,16 @@ int main(int argc, char **argv)
 		customized_madpcr1 = strtol(p, 0, 16);
 	}
 
-	int fd = open("/dev/mem", O_RDWR, 0);
-		if (fd < 0)
+	mmdc = regio_open(NULL);
+	if (!mmdc)
 	{
-		printf("Could not open /dev/mem\n");
+		printf("Could not open %s\n", getenv(REGIO_ENV) ? getenv(REGIO_ENV) : "/dev/mem");
 		return -1;
 	}
-	A = (unsigned long*) mmap(NULL, 0x4000, PROT_READ | PROT_WRITE, MAP_SHARED, fd, MMDC_P0_IPS_BASE_ADDR);
-		if (A == MAP_FAILED)
+	if (regio_map(mmdc, MMDC_P0_IPS_BASE_ADDR, 0x4000))
 	{
 		printf("Mapping failed mmdc_p0\n");
-		close(fd);
+		regio_close(mmdc);
 		return -1;
 	}
 
@@ -387,6 +449,19 @@ int main(int argc, char **argv)
 		printf("Fail to get system revision,parameter will be ignored \n");
 		argc = 1;
 	}
+
+	if (argc > 1 && (strcmp(argv[1], "-sample") == 0 ||
+			 strcmp(argv[1], "-top") == 0)) {
+		int ret;
+
+		if (strcmp(argv[1], "-sample") == 0)
+			ret = mmdc_sample_main(mmdc, argc - 2, argv + 2);
+		else
+			ret = mmdc_top_main(mmdc, argc - 2, argv + 2);
+
+		regio_close(mmdc);
+		return ret;
+	}
 	g_quit = 0;
 	for(i=0; !g_quit && i!=loopcount; i++)
 	{
@@ -395,163 +470,47 @@ int main(int argc, char **argv)
 			int j;
 			for(j=1; j<argc; j++)
 			{
-				if(strcmp(argv[j],"DSP1")==0){
-					if(cpu_is_mx6sx()==1)
-						((pMMDC_t)A)->madpcr1 = axi_lcd1_6sx;
-					else if(cpu_is_mx6sl()==1)
-						((pMMDC_t)A)->madpcr1 = axi_lcd1_6sl;
-					else if(cpu_is_mx6ul()==1)
-						((pMMDC_t)A)->madpcr1 = axi_lcdif_6ul;
-					else
-						((pMMDC_t)A)->madpcr1 = axi_ipu1;
-					printf("MMDC DSP1 \n");
-				}else if((strcmp(argv[j], "DSP2")==0)&&(cpu_is_mx6q()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_ipu2_6q;
-				  printf("MMDC DSP2 \n");
-				}else if((strcmp(argv[j], "DSP2")==0)&&(cpu_is_mx6qp()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_ipu2_6qp;
-				  printf("MMDC DSP2 \n");
-				}else if((strcmp(argv[j], "DSP2")==0)&&(cpu_is_mx6sx()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_lcd2_6sx;
-				  printf("MMDC DSP2 \n");
-				}else if((strcmp(argv[j], "M4")==0)&&(cpu_is_mx6sx()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_m4_6sx;
-				  printf("MMDC M4 \n");
-				}else if((strcmp(argv[j], "PXP")==0)&&(cpu_is_mx6sx()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_pxp_6sx;
-				  printf("MMDC PXP \n");
-				}else if((strcmp(argv[j], "PXP")==0)&&(cpu_is_mx6ul()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_pxp_6ul;
-				  printf("MMDC PXP \n");
-				}else if((strcmp(argv[j], "ENET1")==0)&&(cpu_is_mx6ul()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_enet1_6ul;
-				  printf("MMDC ENET1 \n");
-				}else if((strcmp(argv[j], "ENET2")==0)&&(cpu_is_mx6ul()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_enet2_6ul;
-				  printf("MMDC ENET2 \n");
-				}else if((strcmp(argv[j], "GPU3D")==0)&&(cpu_is_mx6sx()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu3d_6sx;
-				  printf("MMDC GPU3D \n");
-				}else if((strcmp(argv[j], "GPU3D")==0)&&(cpu_is_mx6dl()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu3d_6dl;
-				  printf("MMDC GPU3D \n");
-				}else if((strcmp(argv[j], "GPU3D")==0)&&(cpu_is_mx6qp()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu3dd0_6qp;
-				  printf("MMDC GPU3D \n");
-				}else if((strcmp(argv[j], "GPU3D2")==0)&&(cpu_is_mx6qp()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu3dd1_6qp;
-				  printf("MMDC GPU3DD1 \n");
-				}else if((strcmp(argv[j], "GPU3D")==0)&&(cpu_is_mx6q()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu3d_6q;
-				  printf("MMDC GPU3D \n");
-				}else if((strcmp(argv[j], "GPU2D1")==0)&&(cpu_is_mx6dl()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu2d1_6dl;
-				  printf("MMDC GPU2D1 \n");
-				}else if((strcmp(argv[j], "GPU2D")==0)&&(cpu_is_mx6qp()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu2d_6qp;
-				  printf("MMDC GPU2D \n");
-				}else if((strcmp(argv[j], "GPU2D")==0)&&(cpu_is_mx6q()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu2d_6q;
-				  printf("MMDC GPU2D \n");
-				}else if((strcmp(argv[j], "GPU2D2")==0)&&(cpu_is_mx6dl()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu2d2_6dl;
-				  printf("MMDC GPU2D2 \n");
-				}else if((strcmp(argv[j], "GPU2D")==0)&&(cpu_is_mx6sl()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_gpu2d_6sl;
-				  printf("MMDC GPU2D \n");
-				}else if((strcmp(argv[j],"VPU")==0)&&(cpu_is_mx6dl()==1)){
-				  ((pMMDC_t)A)->madpcr1 = axi_vpu_6dl;
-				  printf("MMDC VPU \n");
-				}else if((strcmp(argv[j],"VPU")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_vpu_6qp;
-				   printf("MMDC VPU \n");
-				}else if((strcmp(argv[j],"VPU")==0)&&(cpu_is_mx6q()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_vpu_6q;
-				   printf("MMDC VPU \n");
-				}else if((strcmp(argv[j],"PRE")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_pre_6qp;
-				   printf("MMDC PRE \n");
-				}else if((strcmp(argv[j],"PRE0")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_pre0_6qp;
-				   printf("MMDC PRE0 \n");
-				}else if((strcmp(argv[j],"PRE1")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_pre1_6qp;
-				   printf("MMDC PRE1 \n");
-				}else if((strcmp(argv[j],"PRE2")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_pre2_6qp;
-				   printf("MMDC PRE2 \n");
-				}else if((strcmp(argv[j],"PRE3")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_pre3_6qp;
-				   printf("MMDC PRE3 \n");
-				}else if((strcmp(argv[j],"GPUVG")==0)&&(cpu_is_mx6q()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_openvg_6q;
-				   printf("MMDC GPUVG \n");
-				}else if((strcmp(argv[j],"GPUVG")==0)&&(cpu_is_mx6qp()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_openvg_6qp;
-				   printf("MMDC GPUVG \n");
-				}else if((strcmp(argv[j],"GPUVG")==0)&&(cpu_is_mx6sl()==1)){
-				   ((pMMDC_t)A)->madpcr1 = axi_openvg_6sl;
-				   printf("MMDC GPUVG \n");
-				}else if(strcmp(argv[j],"USB")==0){
-					if(cpu_is_mx6sx()==1)
-						((pMMDC_t)A)->madpcr1 = axi_usb_6sx;
-					else if(cpu_is_mx6sl()==1)
-						((pMMDC_t)A)->madpcr1 = axi_usb_6sl;
-					else if(cpu_is_mx6ul()==1)
-						((pMMDC_t)A)->madpcr1 = axi_usb_6ul;
-					else
-						((pMMDC_t)A)->madpcr1 = axi_usb;
-				        printf("MMDC USB \n");
-				}else if(strcmp(argv[j],"ARM")==0){
-					if((cpu_is_mx6sx()==1))
-						((pMMDC_t)A)->madpcr1 = axi_arm_6sx;
-					else if((cpu_is_mx6ul()==1))
-						((pMMDC_t)A)->madpcr1 = axi_arm_6ul;
-					else
-						((pMMDC_t)A)->madpcr1 = axi_arm;
-					printf("MMDC ARM \n");
-				}else if(strcmp(argv[j], "SUM")==0){
-				  ((pMMDC_t)A)->madpcr1 = axi_default;
-				  printf("MMDC SUM \n");
-				}else{
+				const struct mmdc_master *master;
+
+				master = find_mmdc_master(argv[j]);
+				if (!master) {
 					printf("MMDC DOES NOT KNOW %s \n",argv[j]);
 					help();
-					close(fd);
+					regio_close(mmdc);
 					return 0;
 				}
-				msync(&(((pMMDC_t)A)->madpcr1),4,MS_SYNC);
-				clear_mmdc_results((pMMDC_t)A);
+				mmdc_writel(mmdc, madpcr1, master->madpcr1);
+				printf("MMDC %s \n", master->label ? master->label : master->name);
+				clear_mmdc_results(mmdc);
 				ulStartTime=getTickCount();
-				start_mmdc_profiling((pMMDC_t)A);
+				start_mmdc_profiling(mmdc);
 				usleep(timeForSleep*1000);
-				load_mmdc_results((pMMDC_t)A);
-				get_mmdc_profiling_results((pMMDC_t)A, &results);
+				load_mmdc_results(mmdc);
+				get_mmdc_profiling_results(mmdc, &results);
 				print_mmdc_profiling_results(results , RES_FULL,getTickCount()-ulStartTime);
 				fflush(stdout);
-				stop_mmdc_profiling((pMMDC_t)A);
+				stop_mmdc_profiling(mmdc);
 			}
 		}else {
 			if(customized_madpcr1!= 0)
 			{
-				((pMMDC_t)A)->madpcr1 = customized_madpcr1;
-				msync(&(((pMMDC_t)A)->madpcr1),4,MS_SYNC);
+				mmdc_writel(mmdc, madpcr1, customized_madpcr1);
 				printf("MMDC 0x%x \n",customized_madpcr1);
 			}else{
-				((pMMDC_t)A)->madpcr1 = axi_default;
-				msync(&(((pMMDC_t)A)->madpcr1),4,MS_SYNC);
+				mmdc_writel(mmdc, madpcr1, axi_default);
 				printf("MMDC SUM \n");
 			}
-			clear_mmdc_results((pMMDC_t)A);
+			clear_mmdc_results(mmdc);
 			ulStartTime=getTickCount();
-			start_mmdc_profiling((pMMDC_t)A);
+			start_mmdc_profiling(mmdc);
 			usleep(timeForSleep*1000);
-			load_mmdc_results((pMMDC_t)A);
-			get_mmdc_profiling_results((pMMDC_t)A, &results);
+			load_mmdc_results(mmdc);
+			get_mmdc_profiling_results(mmdc, &results);
 			print_mmdc_profiling_results(results , RES_FULL,getTickCount()-ulStartTime);
 			fflush(stdout);
-			stop_mmdc_profiling((pMMDC_t)A);
+			stop_mmdc_profiling(mmdc);
 		}
 	}
-	close(fd);
+	regio_close(mmdc);
 	return 0;
 }
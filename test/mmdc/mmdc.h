@@ -14,6 +14,13 @@
 #ifndef MMDC_H_
 #define MMDC_H_
 
+#include <stdint.h>
+#include <stddef.h>
+#include "../memtool/regio.h"
+
+#define MMDC_P0_IPS_BASE_ADDR 0x021B0000
+#define MMDC_P1_IPS_BASE_ADDR 0x021B4000
+
 typedef struct
 {
 	unsigned int mdctl;
@@ -108,6 +115,11 @@ typedef struct
 
 typedef MMDC_t *pMMDC_t;
 
+/* the registers are accessed through regio, see ../memtool/regio.h */
+#define MMDC_REG(reg)		(MMDC_P0_IPS_BASE_ADDR + offsetof(MMDC_t, reg))
+#define mmdc_readl(io, reg)	regio_read(io, MMDC_REG(reg), 4)
+#define mmdc_writel(io, reg, v)	regio_write(io, MMDC_REG(reg), 4, v)
+
 /********************* Profiler Types & Functions ************************/
 typedef struct
 {
@@ -130,14 +142,64 @@ typedef enum
     RES_UTILIZATION
 } MMDC_RES_TYPE_t;
 
-void start_mmdc_profiling(pMMDC_t mmdc);
-void stop_mmdc_profiling(pMMDC_t mmdc);
-void pause_mmdc_profiling(pMMDC_t mmdc);
-void resume_mmdc_profiling(pMMDC_t mmdc);
-void get_mmdc_profiling_results(pMMDC_t mmdc, MMDC_PROFILE_RES_t *results);
+void start_mmdc_profiling(struct regio *mmdc);
+void stop_mmdc_profiling(struct regio *mmdc);
+void pause_mmdc_profiling(struct regio *mmdc);
+void resume_mmdc_profiling(struct regio *mmdc);
+void get_mmdc_profiling_results(struct regio *mmdc, MMDC_PROFILE_RES_t *results);
 void print_mmdc_profiling_results(MMDC_PROFILE_RES_t results, MMDC_RES_TYPE_t print_type,int time);
 
+struct mmdc_master {
+	const char *name;
+	unsigned int part;
+	unsigned int madpcr1;
+	const char *label;
+};
+
+const struct mmdc_master *find_mmdc_master(const char *name);
+
+/* mmdc_sample.c, one record per sampling interval */
+#define MMDC_SAMPLE_OVERFLOW	(1 << 0)
+
+struct mmdc_sample {
+	uint64_t time_ns;	/* end of the interval, CLOCK_MONOTONIC_RAW */
+	uint64_t interval_ns;
+	uint32_t counters[6];	/* madpsr0..madpsr5 */
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+#define MMDC_RING_MAGIC		"MMDS"
+#define MMDC_RING_VERSION	1
+
+/* record head % ring_size is written next, the oldest once head > ring_size */
+struct mmdc_ring_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t ring_size;
+	uint64_t head;
+	uint64_t period_ns;
+	uint32_t madpcr1;
+	uint32_t bytewidth;
+};
+
+uint64_t now_raw_ns(void);
+int get_madpcr0_base(unsigned int *base);
+void mmdc_sample_read(struct regio *mmdc, unsigned int base,
+		      struct mmdc_sample *sample);
+void mmdc_sample_start(struct regio *mmdc, unsigned int base);
+void mmdc_sample_stop(struct regio *mmdc, unsigned int base);
+void mmdc_sample_counters(struct regio *mmdc, unsigned int base,
+			  struct mmdc_sample *sample);
+int mmdc_sample_main(struct regio *mmdc, int argc, char **argv);
+
+/* mmdc_top.c */
+int mmdc_top_main(struct regio *mmdc, int argc, char **argv);
+
 extern unsigned int system_rev;
+extern int g_quit;
+void signalhandler(int signal);
 
 #define CHIP_REV_1_0            	0x1
 #define CHIP_REV_2_0			0x2
@@ -0,0 +1,357 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Continuous sampler: the profiling counters are latched, read and reset
+ * every period, so the 32-bit madpsr registers never overflow, and the
+ * intervals are accumulated in 64-bit totals. Each interval is timestamped
+ * with CLOCK_MONOTONIC_RAW and streamed as one CSV line, or stored in a
+ * fixed size binary ring file which keeps the last records of runs lasting
+ * hours.
+ */
+
+#include "mmdc.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MMDC_SAMPLE_PERIOD_MS	10
+#define MMDC_SAMPLE_RING	360000
+
+#define MADPCR0_DBG_EN		0x1
+#define MADPCR0_DBG_RST		0x2
+#define MADPCR0_PRF_FRZ		0x4
+#define MADPCR0_CYC_OVF		0x8
+
+struct mmdc_totals {
+	uint64_t total_cycles;
+	uint64_t busy_cycles;
+	uint64_t read_accesses;
+	uint64_t write_accesses;
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+};
+
+uint64_t now_raw_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* madpcr0 bits the SoC needs on top of the profiling controls */
+int get_madpcr0_base(unsigned int *base)
+{
+	if (cpu_is_mx6qp())
+		*base = 0x10;
+	else if (cpu_is_mx6q() || cpu_is_mx6dl() || cpu_is_mx6sl() ||
+		 cpu_is_mx6sx() || cpu_is_mx6ul())
+		*base = 0;
+	else
+		return -1;
+
+	return 0;
+}
+
+static void write_madpcr0(struct regio *mmdc, unsigned int value)
+{
+	mmdc_writel(mmdc, madpcr0, value);
+}
+
+/* Latch the counters and read them, counting goes on until restarted */
+void mmdc_sample_read(struct regio *mmdc, unsigned int base,
+		      struct mmdc_sample *sample)
+{
+	write_madpcr0(mmdc, base | MADPCR0_DBG_EN | MADPCR0_PRF_FRZ);
+
+	sample->counters[0] = mmdc_readl(mmdc, madpsr0);
+	sample->counters[1] = mmdc_readl(mmdc, madpsr1);
+	sample->counters[2] = mmdc_readl(mmdc, madpsr2);
+	sample->counters[3] = mmdc_readl(mmdc, madpsr3);
+	sample->counters[4] = mmdc_readl(mmdc, madpsr4);
+	sample->counters[5] = mmdc_readl(mmdc, madpsr5);
+	sample->flags = (mmdc_readl(mmdc, madpcr0) & MADPCR0_CYC_OVF) ?
+			MMDC_SAMPLE_OVERFLOW : 0;
+}
+
+/* Reset the counters and the overflow bit, and count from zero */
+void mmdc_sample_start(struct regio *mmdc, unsigned int base)
+{
+	write_madpcr0(mmdc, base | MADPCR0_DBG_RST | MADPCR0_CYC_OVF);
+	write_madpcr0(mmdc, base | MADPCR0_DBG_EN);
+}
+
+/*
+ * The few register accesses between the latch and the restart are the
+ * only time not accounted to any interval.
+ */
+void mmdc_sample_counters(struct regio *mmdc, unsigned int base,
+			  struct mmdc_sample *sample)
+{
+	mmdc_sample_read(mmdc, base, sample);
+	mmdc_sample_start(mmdc, base);
+}
+
+void mmdc_sample_stop(struct regio *mmdc, unsigned int base)
+{
+	write_madpcr0(mmdc, base);
+}
+
+static void add_totals(struct mmdc_totals *t, const struct mmdc_sample *s)
+{
+	t->total_cycles += s->counters[0];
+	t->busy_cycles += s->counters[1];
+	t->read_accesses += s->counters[2];
+	t->write_accesses += s->counters[3];
+	t->read_bytes += s->counters[4];
+	t->write_bytes += s->counters[5];
+}
+
+static double mbps(uint64_t bytes, uint64_t ns)
+{
+	return ns ? (double)bytes * 1000000000.0 / ns / (1024 * 1024) : 0;
+}
+
+static void write_csv_header(FILE *fp)
+{
+	fprintf(fp, "time_s,interval_us,total_cycles,busy_cycles,"
+		"read_accesses,write_accesses,read_bytes,write_bytes,"
+		"read_MBps,write_MBps,busy_pct,overflow\n");
+}
+
+static void write_csv_sample(FILE *fp, const struct mmdc_sample *s)
+{
+	fprintf(fp, "%.6f,%llu,%u,%u,%u,%u,%u,%u,%.2f,%.2f,%.1f,%d\n",
+		s->time_ns / 1e9, (unsigned long long)(s->interval_ns / 1000),
+		s->counters[0], s->counters[1], s->counters[2],
+		s->counters[3], s->counters[4], s->counters[5],
+		mbps(s->counters[4], s->interval_ns),
+		mbps(s->counters[5], s->interval_ns),
+		s->counters[0] ? 100.0 * s->counters[1] / s->counters[0] : 0,
+		!!(s->flags & MMDC_SAMPLE_OVERFLOW));
+}
+
+static int ring_open(const char *filename, struct mmdc_ring_header *hdr)
+{
+	int fd;
+
+	fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(filename);
+		return -1;
+	}
+	if (pwrite(fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr)) {
+		perror(filename);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int ring_write(int fd, struct mmdc_ring_header *hdr,
+		      const struct mmdc_sample *s)
+{
+	off_t offset = sizeof(*hdr) + (hdr->head % hdr->ring_size) * sizeof(*s);
+
+	if (pwrite(fd, s, sizeof(*s), offset) != sizeof(*s))
+		return -1;
+	hdr->head++;
+	/* the header tells a reader where the oldest record is */
+	if (pwrite(fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr))
+		return -1;
+
+	return 0;
+}
+
+static void sample_usage(void)
+{
+	printf("Usage: mmdc -sample [-p <ms>] [-t <seconds>] [-o <file>] [-bin [-ring <records>]] [MASTER]\n");
+	printf("Sample the counters every <ms> (%d by default) until Ctrl-C or <seconds>.\n",
+	       MMDC_SAMPLE_PERIOD_MS);
+	printf("One CSV line per sample is written to stdout or <file>. With -bin <file> is\n");
+	printf("a ring of the last <records> samples (%d by default) in struct mmdc_sample\n",
+	       MMDC_SAMPLE_RING);
+	printf("format after a struct mmdc_ring_header, see mmdc.h.\n");
+	printf("MASTER is one of the masters of mmdc, SUM (all) by default.\n");
+}
+
+int mmdc_sample_main(struct regio *mmdc, int argc, char **argv)
+{
+	struct mmdc_ring_header hdr;
+	struct mmdc_totals totals;
+	struct mmdc_sample s;
+	const struct mmdc_master *master = NULL;
+	const char *output = NULL;
+	unsigned int madpcr1 = axi_default;
+	unsigned int base;
+	uint64_t period_ns = MMDC_SAMPLE_PERIOD_MS * 1000000ull;
+	uint64_t duration_ns = 0;
+	uint64_t ring_size = MMDC_SAMPLE_RING;
+	uint64_t start, last, next, count = 0, overflows = 0;
+	struct timespec ts;
+	int binary = 0;
+	int fd = -1;
+	FILE *fp = stdout;
+	char *p;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+			period_ns = strtod(argv[++i], NULL) * 1000000;
+		} else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			duration_ns = strtod(argv[++i], NULL) * 1e9;
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if (!strcmp(argv[i], "-bin")) {
+			binary = 1;
+		} else if (!strcmp(argv[i], "-ring") && i + 1 < argc) {
+			ring_size = strtoull(argv[++i], NULL, 0);
+		} else if (argv[i][0] != '-' && !master) {
+			master = find_mmdc_master(argv[i]);
+			if (!master) {
+				printf("MMDC DOES NOT KNOW %s \n", argv[i]);
+				sample_usage();
+				return 1;
+			}
+			madpcr1 = master->madpcr1;
+		} else {
+			sample_usage();
+			return 1;
+		}
+	}
+	if (!period_ns || !ring_size || (binary && !output)) {
+		sample_usage();
+		return 1;
+	}
+
+	p = getenv("MMDC_CUST_MADPCR1");
+	if (!master && p)
+		madpcr1 = strtol(p, 0, 16);
+
+	if (get_madpcr0_base(&base)) {
+		printf("MMDC profiling is not supported on this SoC\n");
+		return 1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MMDC_RING_MAGIC, 4);
+	hdr.version = MMDC_RING_VERSION;
+	hdr.record_size = sizeof(struct mmdc_sample);
+	hdr.ring_size = ring_size;
+	hdr.period_ns = period_ns;
+	hdr.madpcr1 = madpcr1;
+	hdr.bytewidth = 4 << ((mmdc_readl(mmdc, mdctl) & 0x30000) >> 16);
+
+	if (binary) {
+		fd = ring_open(output, &hdr);
+		if (fd < 0)
+			return 1;
+	} else {
+		if (output)
+			fp = fopen(output, "w");
+		if (!fp) {
+			perror(output);
+			return 1;
+		}
+		write_csv_header(fp);
+	}
+
+	g_quit = 0;
+	signal(SIGINT, signalhandler);
+	signal(SIGTERM, signalhandler);
+
+	memset(&totals, 0, sizeof(totals));
+	mmdc_writel(mmdc, madpcr1, madpcr1);
+	fprintf(stderr, "MMDC sampling madpcr1 0x%08x every %llu us\n", madpcr1,
+		(unsigned long long)(period_ns / 1000));
+
+	mmdc_sample_start(mmdc, base);
+	start = last = now_raw_ns();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	next = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+	while (!g_quit) {
+		uint64_t now;
+
+		next += period_ns;
+		ts.tv_sec = next / 1000000000ull;
+		ts.tv_nsec = next % 1000000000ull;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		mmdc_sample_counters(mmdc, base, &s);
+		now = now_raw_ns();
+		s.time_ns = now - start;
+		s.interval_ns = now - last;
+		last = now;
+
+		add_totals(&totals, &s);
+		count++;
+		if (s.flags & MMDC_SAMPLE_OVERFLOW)
+			overflows++;
+
+		if (binary) {
+			if (ring_write(fd, &hdr, &s)) {
+				perror(output);
+				break;
+			}
+		} else {
+			write_csv_sample(fp, &s);
+			/* keep the file usable for live plotting */
+			if (count % 16 == 0)
+				fflush(fp);
+		}
+
+		if (duration_ns && s.time_ns >= duration_ns)
+			break;
+
+		/* don't try to catch up after a long stall */
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+		if (now > next + period_ns)
+			next = now;
+	}
+
+	mmdc_sample_stop(mmdc, base);
+
+	if (binary)
+		close(fd);
+	else if (fp != stdout)
+		fclose(fp);
+	else
+		fflush(fp);
+
+	fprintf(stderr, "%llu samples in %.3f s, %llu overflowed\n",
+		(unsigned long long)count, (last - start) / 1e9,
+		(unsigned long long)overflows);
+	fprintf(stderr, "Total cycles %llu, busy cycles %llu\n",
+		(unsigned long long)totals.total_cycles,
+		(unsigned long long)totals.busy_cycles);
+	fprintf(stderr, "Read %llu accesses %llu bytes, write %llu accesses %llu bytes\n",
+		(unsigned long long)totals.read_accesses,
+		(unsigned long long)totals.read_bytes,
+		(unsigned long long)totals.write_accesses,
+		(unsigned long long)totals.write_bytes);
+	fprintf(stderr, "Average read %.2f MB/s, write %.2f MB/s, total %.2f MB/s\n",
+		mbps(totals.read_bytes, last - start),
+		mbps(totals.write_bytes, last - start),
+		mbps(totals.read_bytes + totals.write_bytes, last - start));
+
+	return 0;
+}
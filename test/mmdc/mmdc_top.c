@@ -0,0 +1,283 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Per-master attribution: the MMDC has a single AXI ID filter, so it is
+ * rotated across the masters in short slots, with an unfiltered (SUM) slot
+ * in every round as the reference. The bandwidth of a master is estimated
+ * from the slots it was observed in, with a 95% confidence interval from
+ * the spread of the per-slot rates, and compared to the SUM estimate of
+ * the same period. The table is refreshed like top.
+ */
+
+#include "mmdc.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MMDC_TOP_SLOT_MS	5
+#define MMDC_TOP_REFRESH_MS	1000
+#define MMDC_TOP_MAX_MASTERS	16
+
+struct top_stat {
+	uint64_t slots;
+	uint64_t time_ns;
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+	uint64_t total_cycles;
+	uint64_t busy_cycles;
+	/* per-slot total rate in MB/s, for the confidence interval */
+	double sum;
+	double sum2;
+};
+
+struct top_master {
+	const char *name;
+	unsigned int madpcr1;
+	struct top_stat window;
+	struct top_stat run;
+};
+
+/* two-sided 95% quantiles of Student's t, for 1..30 degrees of freedom */
+static const double t95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static double mbps(uint64_t bytes, uint64_t ns)
+{
+	return ns ? (double)bytes * 1000000000.0 / ns / (1024 * 1024) : 0;
+}
+
+static void add_slot(struct top_stat *st, const struct mmdc_sample *s)
+{
+	double rate = mbps((uint64_t)s->counters[4] + s->counters[5],
+			   s->interval_ns);
+
+	st->slots++;
+	st->time_ns += s->interval_ns;
+	st->total_cycles += s->counters[0];
+	st->busy_cycles += s->counters[1];
+	st->read_bytes += s->counters[4];
+	st->write_bytes += s->counters[5];
+	st->sum += rate;
+	st->sum2 += rate * rate;
+}
+
+/* half width of the 95% confidence interval of the mean slot rate */
+static double ci95(const struct top_stat *st)
+{
+	double mean, var;
+	uint64_t n = st->slots;
+
+	if (n < 2)
+		return NAN;
+
+	mean = st->sum / n;
+	var = (st->sum2 - n * mean * mean) / (n - 1);
+	if (var < 0)
+		var = 0;
+
+	return (n - 1 <= 30 ? t95[n - 2] : 1.96) * sqrt(var / n);
+}
+
+static void print_row(const char *name, const struct top_stat *st,
+		      double sum_rate)
+{
+	double read = mbps(st->read_bytes, st->time_ns);
+	double write = mbps(st->write_bytes, st->time_ns);
+	double ci = ci95(st);
+
+	printf("%-10s %10.2f %10.2f %10.2f ", name, read, write, read + write);
+	if (isnan(ci))
+		printf("%10s ", "-");
+	else
+		printf("%10.2f ", ci);
+	if (sum_rate > 0)
+		printf("%6.1f%% ", 100 * (read + write) / sum_rate);
+	else
+		printf("%7s ", "-");
+	printf("%6llu\n", (unsigned long long)st->slots);
+}
+
+static void print_table(struct top_master *masters, int count, int clear,
+			uint64_t elapsed_ns, int run)
+{
+	const struct top_stat *sum = run ? &masters[0].run : &masters[0].window;
+	double sum_rate = mbps(sum->read_bytes + sum->write_bytes, sum->time_ns);
+	double others = sum_rate;
+	int i;
+
+	if (clear)
+		printf("\033[H\033[2J");
+	printf("MMDC %s %.1f s, bus load %.1f%%\n", run ? "total" : "at",
+	       elapsed_ns / 1e9, sum->total_cycles ?
+	       100.0 * sum->busy_cycles / sum->total_cycles : 0.0);
+	printf("%-10s %10s %10s %10s %10s %7s %6s\n", "MASTER", "READ MB/s",
+	       "WRITE MB/s", "TOTAL MB/s", "+-95%", "OF SUM", "SLOTS");
+
+	for (i = 1; i < count; i++) {
+		const struct top_stat *st = run ? &masters[i].run : &masters[i].window;
+
+		print_row(masters[i].name, st, sum_rate);
+		others -= mbps(st->read_bytes + st->write_bytes, st->time_ns);
+	}
+	/* masters not listed, only meaningful when the filters don't overlap */
+	if (count > 1)
+		printf("%-10s %10s %10s %10.2f\n", "(others)", "", "",
+		       others > 0 ? others : 0);
+	print_row("SUM", sum, sum_rate);
+	printf("\n");
+	fflush(stdout);
+}
+
+static void top_usage(void)
+{
+	printf("Usage: mmdc -top [-s <slot ms>] [-r <refresh ms>] [-t <seconds>] [-b] MASTER [...]\n");
+	printf("Rotate the AXI ID filter over SUM and the masters, one slot of <slot ms>\n");
+	printf("(%d by default) each, and print the estimated bandwidth of every master\n",
+	       MMDC_TOP_SLOT_MS);
+	printf("every <refresh ms> (%d by default). -b appends the tables instead of\n",
+	       MMDC_TOP_REFRESH_MS);
+	printf("redrawing them. A summary of the whole run is printed at the end.\n");
+}
+
+int mmdc_top_main(struct regio *mmdc, int argc, char **argv)
+{
+	struct top_master masters[MMDC_TOP_MAX_MASTERS + 1];
+	const struct mmdc_master *master;
+	uint64_t slot_ns = MMDC_TOP_SLOT_MS * 1000000ull;
+	uint64_t refresh_ns = MMDC_TOP_REFRESH_MS * 1000000ull;
+	uint64_t duration_ns = 0;
+	uint64_t start, last, refresh, next;
+	struct mmdc_sample s;
+	struct timespec ts;
+	unsigned int base;
+	int clear = isatty(STDOUT_FILENO);
+	int count = 1;
+	int cur = 0;
+	int i, j;
+
+	memset(masters, 0, sizeof(masters));
+	masters[0].name = "SUM";
+	masters[0].madpcr1 = axi_default;
+
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			slot_ns = strtod(argv[++i], NULL) * 1000000;
+		} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			refresh_ns = strtod(argv[++i], NULL) * 1000000;
+		} else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			duration_ns = strtod(argv[++i], NULL) * 1e9;
+		} else if (!strcmp(argv[i], "-b")) {
+			clear = 0;
+		} else if (argv[i][0] != '-') {
+			master = find_mmdc_master(argv[i]);
+			if (!master) {
+				printf("MMDC DOES NOT KNOW %s \n", argv[i]);
+				top_usage();
+				return 1;
+			}
+			if (master->madpcr1 == axi_default)
+				continue;
+			for (j = 1; j < count; j++) {
+				if (masters[j].madpcr1 == master->madpcr1)
+					break;
+			}
+			if (j < count)
+				continue;
+			if (count > MMDC_TOP_MAX_MASTERS) {
+				printf("At most %d masters\n", MMDC_TOP_MAX_MASTERS);
+				return 1;
+			}
+			masters[count].name = master->label ? master->label : master->name;
+			masters[count].madpcr1 = master->madpcr1;
+			count++;
+		} else {
+			top_usage();
+			return 1;
+		}
+	}
+	if (count < 2 || !slot_ns || refresh_ns < slot_ns) {
+		top_usage();
+		return 1;
+	}
+
+	if (get_madpcr0_base(&base)) {
+		printf("MMDC profiling is not supported on this SoC\n");
+		return 1;
+	}
+
+	g_quit = 0;
+	signal(SIGINT, signalhandler);
+	signal(SIGTERM, signalhandler);
+
+	mmdc_writel(mmdc, madpcr1, masters[0].madpcr1);
+	mmdc_sample_start(mmdc, base);
+	start = last = now_raw_ns();
+	refresh = start + refresh_ns;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	next = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+	while (!g_quit) {
+		uint64_t now;
+
+		next += slot_ns;
+		ts.tv_sec = next / 1000000000ull;
+		ts.tv_nsec = next % 1000000000ull;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		/* switch the filter while the counters are latched */
+		mmdc_sample_read(mmdc, base, &s);
+		cur = (cur + 1) % count;
+		mmdc_writel(mmdc, madpcr1, masters[cur].madpcr1);
+		mmdc_sample_start(mmdc, base);
+
+		now = now_raw_ns();
+		s.interval_ns = now - last;
+		last = now;
+
+		/* the slot that just ended belongs to the previous filter */
+		i = (cur + count - 1) % count;
+		if (!(s.flags & MMDC_SAMPLE_OVERFLOW)) {
+			add_slot(&masters[i].window, &s);
+			add_slot(&masters[i].run, &s);
+		}
+
+		if (now >= refresh) {
+			print_table(masters, count, clear, now - start, 0);
+			for (j = 0; j < count; j++)
+				memset(&masters[j].window, 0, sizeof(masters[j].window));
+			refresh += refresh_ns;
+		}
+
+		if (duration_ns && now - start >= duration_ns)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+		if (now > next + slot_ns)
+			next = now;
+	}
+
+	mmdc_sample_stop(mmdc, base);
+	print_table(masters, count, 0, last - start, 1);
+
+	return 0;
+}
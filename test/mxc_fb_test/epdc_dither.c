@@ -0,0 +1,451 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+/*
+ * @file epdc_dither.c
+ *
+ * @brief Software dithering and grayscale quantization for EPDC updates
+ *
+ * Rows are spread over the threads. Ordered dithering and quantization
+ * rows are independent, error diffusion rows run as a wavefront: a row
+ * goes on with a chunk once the row above is a pixel past it. Gray
+ * conversion, ordered dithering, quantization and the output are done
+ * with NEON on 8 pixels at a time where available.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#include "epdc_dither.h"
+
+#define DITHER_CHUNK	64
+
+struct epdc_dither {
+	int threads;
+	pthread_t *tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t done;
+	unsigned long gen;
+	int running;
+	int stop;
+
+	const struct epdc_dither_job *job;
+	int lm1;		/* levels - 1 */
+	int scale;		/* 255 / (levels - 1) */
+	int depth;		/* rows below reached by the error */
+	int16_t off[8][16];	/* ordered dither offsets, rows repeated */
+
+	int *progress;		/* pixels done in each row */
+	int nprogress;
+	int16_t *err;		/* ring of error rows */
+	int err_rows;
+	int err_stride;
+	int nerr;
+};
+
+static const uint8_t bayer8[8][8] = {
+	{  0, 32,  8, 40,  2, 34, 10, 42 },
+	{ 48, 16, 56, 24, 50, 18, 58, 26 },
+	{ 12, 44,  4, 36, 14, 46,  6, 38 },
+	{ 60, 28, 52, 20, 62, 30, 54, 22 },
+	{  3, 35, 11, 43,  1, 33,  9, 41 },
+	{ 51, 19, 59, 27, 49, 17, 57, 25 },
+	{ 15, 47,  7, 39, 13, 45,  5, 37 },
+	{ 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+/* x / 255 for x < 65535 */
+static inline int div255(int x)
+{
+	return (x + 1 + (x >> 8)) >> 8;
+}
+
+static inline int quant(struct epdc_dither *d, int v)
+{
+	return div255(v * d->lm1 + 127) * d->scale;
+}
+
+static void to_gray(uint8_t *y, const uint8_t *src, int fmt, int n)
+{
+	const uint16_t *p = (const uint16_t *)src;
+	int i = 0, r, g, b;
+
+	if (fmt == EPDC_DITHER_Y8) {
+		memcpy(y, src, n);
+		return;
+	}
+
+#ifdef __ARM_NEON
+	for (; i + 8 <= n; i += 8) {
+		uint16x8_t v = vld1q_u16(p + i);
+		uint16x8_t r5 = vshrq_n_u16(v, 11);
+		uint16x8_t g6 = vandq_u16(vshrq_n_u16(v, 5), vdupq_n_u16(0x3f));
+		uint16x8_t b5 = vandq_u16(v, vdupq_n_u16(0x1f));
+		uint16x8_t r8 = vorrq_u16(vshlq_n_u16(r5, 3), vshrq_n_u16(r5, 2));
+		uint16x8_t g8 = vorrq_u16(vshlq_n_u16(g6, 2), vshrq_n_u16(g6, 4));
+		uint16x8_t b8 = vorrq_u16(vshlq_n_u16(b5, 3), vshrq_n_u16(b5, 2));
+		uint16x8_t acc = vdupq_n_u16(128);
+
+		acc = vmlaq_n_u16(acc, r8, 77);
+		acc = vmlaq_n_u16(acc, g8, 150);
+		acc = vmlaq_n_u16(acc, b8, 29);
+		vst1_u8(y + i, vshrn_n_u16(acc, 8));
+	}
+#endif
+	for (; i < n; i++) {
+		r = p[i] >> 11;
+		g = (p[i] >> 5) & 0x3f;
+		b = p[i] & 0x1f;
+		r = (r << 3) | (r >> 2);
+		g = (g << 2) | (g >> 4);
+		b = (b << 3) | (b >> 2);
+		y[i] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+	}
+}
+
+static void from_gray(uint8_t *dst, const uint8_t *y, int fmt, int n)
+{
+	uint16_t *p = (uint16_t *)dst;
+	int i = 0;
+
+	if (fmt == EPDC_DITHER_Y8) {
+		memcpy(dst, y, n);
+		return;
+	}
+
+#ifdef __ARM_NEON
+	for (; i + 8 <= n; i += 8) {
+		uint16x8_t v = vmovl_u8(vld1_u8(y + i));
+		uint16x8_t rb = vshrq_n_u16(v, 3);
+		uint16x8_t g = vshrq_n_u16(v, 2);
+
+		vst1q_u16(p + i, vorrq_u16(vorrq_u16(vshlq_n_u16(rb, 11),
+				vshlq_n_u16(g, 5)), rb));
+	}
+#endif
+	for (; i < n; i++)
+		p[i] = ((y[i] >> 3) << 11) | ((y[i] >> 2) << 5) | (y[i] >> 3);
+}
+
+/* ordered dithering with off, or plain quantization without */
+static void quantize(struct epdc_dither *d, uint8_t *y, const int16_t *off,
+		     int n)
+{
+	int i = 0, v;
+
+#ifdef __ARM_NEON
+	int16x8_t o = vdupq_n_s16(0);
+
+	if (off)
+		o = vld1q_s16(off);
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t t = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i)));
+		uint16x8_t u, x;
+
+		t = vminq_s16(vmaxq_s16(vaddq_s16(t, o), vdupq_n_s16(0)),
+			      vdupq_n_s16(255));
+		u = vreinterpretq_u16_s16(t);
+		x = vmlaq_n_u16(vdupq_n_u16(127), u, d->lm1);
+		x = vshrq_n_u16(vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)),
+					  vshrq_n_u16(x, 8)), 8);
+		vst1_u8(y + i, vmovn_u16(vmulq_n_u16(x, d->scale)));
+	}
+#endif
+	for (; i < n; i++) {
+		v = y[i];
+		if (off) {
+			v += off[i & 7];
+			v = v < 0 ? 0 : (v > 255 ? 255 : v);
+		}
+		y[i] = quant(d, v);
+	}
+}
+
+static void wait_progress(int *progress, int need)
+{
+	int spins = 0;
+
+	while (__atomic_load_n(progress, __ATOMIC_ACQUIRE) < need)
+		if (++spins > 64)
+			sched_yield();
+}
+
+static void dither_row(struct epdc_dither *d, int r)
+{
+	const struct epdc_dither_job *job = d->job;
+	int sbpp = job->src_fmt == EPDC_DITHER_RGB565 ? 2 : 1;
+	int dbpp = job->dst_fmt == EPDC_DITHER_RGB565 ? 2 : 1;
+	int y = job->top + r, x0, x1, x, n, i, v, e;
+	const uint8_t *src = (const uint8_t *)job->src + y * job->src_stride +
+			     job->left * sbpp;
+	uint8_t *dst = (uint8_t *)job->dst + y * job->dst_stride +
+		       job->left * dbpp;
+	int16_t *cur, *next, *next2;
+	int c1 = 0, c2 = 0;
+	uint8_t tmp[DITHER_CHUNK];
+	const int16_t *off;
+
+	if (job->mode != EPDC_DITHER_FLOYD_STEINBERG &&
+	    job->mode != EPDC_DITHER_ATKINSON) {
+		off = job->mode == EPDC_DITHER_ORDERED ? d->off[y & 7] : NULL;
+		for (x0 = 0; x0 < job->width; x0 += DITHER_CHUNK) {
+			n = job->width - x0 < DITHER_CHUNK ?
+			    job->width - x0 : DITHER_CHUNK;
+			to_gray(tmp, src + x0 * sbpp, job->src_fmt, n);
+			if (job->mode != EPDC_DITHER_PASSTHROUGH)
+				quantize(d, tmp, off ?
+					 off + ((job->left + x0) & 7) : NULL, n);
+			from_gray(dst + x0 * dbpp, tmp, job->dst_fmt, n);
+		}
+		return;
+	}
+
+	/* error rows have a pixel of margin on both sides */
+	cur = d->err + (r % d->err_rows) * d->err_stride + 1;
+	next = d->err + ((r + 1) % d->err_rows) * d->err_stride + 1;
+	next2 = d->err + ((r + 2) % d->err_rows) * d->err_stride + 1;
+	memset(d->err + ((r + d->depth) % d->err_rows) * d->err_stride, 0,
+	       d->err_stride * sizeof(int16_t));
+
+	for (x0 = 0; x0 < job->width; x0 = x1) {
+		x1 = x0 + DITHER_CHUNK < job->width ?
+		     x0 + DITHER_CHUNK : job->width;
+		n = x1 - x0;
+		if (r)
+			wait_progress(&d->progress[r - 1],
+				      x1 + 1 < job->width ? x1 + 1 : job->width);
+
+		to_gray(tmp, src + x0 * sbpp, job->src_fmt, n);
+		if (job->mode == EPDC_DITHER_FLOYD_STEINBERG) {
+			/* errors in 1/16 */
+			for (i = 0; i < n; i++) {
+				x = x0 + i;
+				v = tmp[i] + ((cur[x] + c1 + 8) >> 4);
+				v = v < 0 ? 0 : (v > 255 ? 255 : v);
+				tmp[i] = quant(d, v);
+				e = v - tmp[i];
+				next[x - 1] += 3 * e;
+				next[x] += 5 * e;
+				next[x + 1] += e;
+				c1 = 7 * e;
+			}
+		} else {
+			/* errors in 1/8, 2/8 of them are dropped */
+			for (i = 0; i < n; i++) {
+				x = x0 + i;
+				v = tmp[i] + ((cur[x] + c1 + c2 + 4) >> 3);
+				v = v < 0 ? 0 : (v > 255 ? 255 : v);
+				tmp[i] = quant(d, v);
+				e = v - tmp[i];
+				next[x - 1] += e;
+				next[x] += e;
+				next[x + 1] += e;
+				next2[x] += e;
+				c2 = c1;
+				c1 = e;
+			}
+		}
+		from_gray(dst + x0 * dbpp, tmp, job->dst_fmt, n);
+
+		__atomic_store_n(&d->progress[r], x1, __ATOMIC_RELEASE);
+	}
+}
+
+static void dither_rows(struct epdc_dither *d, int idx)
+{
+	int r;
+
+	for (r = idx; r < d->job->height; r += d->threads)
+		dither_row(d, r);
+}
+
+static void *dither_thread(void *arg)
+{
+	struct epdc_dither *d = arg;
+	unsigned long gen = 0;
+	int idx;
+
+	pthread_mutex_lock(&d->lock);
+	/* worker index handed over through running */
+	idx = d->running++;
+	pthread_cond_broadcast(&d->done);
+	while (1) {
+		while (d->gen == gen && !d->stop)
+			pthread_cond_wait(&d->cond, &d->lock);
+		if (d->stop)
+			break;
+		gen = d->gen;
+		pthread_mutex_unlock(&d->lock);
+
+		dither_rows(d, idx);
+
+		pthread_mutex_lock(&d->lock);
+		if (--d->running == 0)
+			pthread_cond_broadcast(&d->done);
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return NULL;
+}
+
+struct epdc_dither *epdc_dither_new(int threads)
+{
+	struct epdc_dither *d;
+	int i;
+
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return NULL;
+
+	if (threads < 1)
+		threads = 1;
+	d->threads = threads;
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->cond, NULL);
+	pthread_cond_init(&d->done, NULL);
+
+	d->tid = calloc(threads, sizeof(*d->tid));
+	if (!d->tid) {
+		epdc_dither_free(d);
+		return NULL;
+	}
+
+	/* workers take the indexes 1 .. threads - 1, the caller 0 */
+	d->running = 1;
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&d->tid[i], NULL, dither_thread, d)) {
+			d->threads = i;
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&d->lock);
+	while (d->running < d->threads)
+		pthread_cond_wait(&d->done, &d->lock);
+	d->running = 0;
+	pthread_mutex_unlock(&d->lock);
+
+	return d;
+}
+
+void epdc_dither_free(struct epdc_dither *d)
+{
+	int i;
+
+	if (!d)
+		return;
+
+	pthread_mutex_lock(&d->lock);
+	d->stop = 1;
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+	for (i = 1; d->tid && i < d->threads; i++)
+		pthread_join(d->tid[i], NULL);
+
+	pthread_cond_destroy(&d->done);
+	pthread_cond_destroy(&d->cond);
+	pthread_mutex_destroy(&d->lock);
+	free(d->tid);
+	free(d->progress);
+	free(d->err);
+	free(d);
+}
+
+static int dither_prepare(struct epdc_dither *d, const struct epdc_dither_job *job)
+{
+	int i, j, size;
+	void *p;
+
+	if (job->bits != 1 && job->bits != 2 && job->bits != 4)
+		return -1;
+	if (job->mode < EPDC_DITHER_PASSTHROUGH ||
+	    job->mode > EPDC_DITHER_QUANT_ONLY)
+		return -1;
+
+	d->lm1 = (1 << job->bits) - 1;
+	d->scale = 255 / d->lm1;
+	for (i = 0; i < 8; i++)
+		for (j = 0; j < 16; j++)
+			d->off[i][j] = ((2 * bayer8[i][j & 7] + 1) - 64) *
+				       d->scale / 128;
+
+	if (job->mode != EPDC_DITHER_FLOYD_STEINBERG &&
+	    job->mode != EPDC_DITHER_ATKINSON)
+		return 0;
+
+	d->depth = job->mode == EPDC_DITHER_ATKINSON ? 2 : 1;
+	if (job->height > d->nprogress) {
+		p = realloc(d->progress, job->height * sizeof(int));
+		if (!p)
+			return -1;
+		d->progress = p;
+		d->nprogress = job->height;
+	}
+	memset(d->progress, 0, job->height * sizeof(int));
+
+	/* a row reuses the error row of one done threads + 3 rows before */
+	d->err_rows = d->threads + 3;
+	d->err_stride = job->width + 2;
+	size = d->err_rows * d->err_stride;
+	if (size > d->nerr) {
+		p = realloc(d->err, size * sizeof(int16_t));
+		if (!p)
+			return -1;
+		d->err = p;
+		d->nerr = size;
+	}
+	/* rows the first row doesn't clear itself */
+	memset(d->err, 0, d->depth * d->err_stride * sizeof(int16_t));
+
+	return 0;
+}
+
+int epdc_dither_run(struct epdc_dither *d, const struct epdc_dither_job *job)
+{
+	if (job->width <= 0 || job->height <= 0)
+		return 0;
+	if (dither_prepare(d, job))
+		return -1;
+
+	d->job = job;
+	if (d->threads > 1) {
+		pthread_mutex_lock(&d->lock);
+		d->running = d->threads - 1;
+		d->gen++;
+		pthread_cond_broadcast(&d->cond);
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	dither_rows(d, 0);
+
+	if (d->threads > 1) {
+		pthread_mutex_lock(&d->lock);
+		while (d->running)
+			pthread_cond_wait(&d->done, &d->lock);
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	return 0;
+}
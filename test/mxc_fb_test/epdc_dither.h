@@ -0,0 +1,68 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+/*
+ * @file epdc_dither.h
+ *
+ * @brief Software dithering and grayscale quantization for EPDC updates
+ *
+ */
+
+#ifndef EPDC_DITHER_H
+#define EPDC_DITHER_H
+
+/* same numbering as the EPDC hardware dither_mode */
+#define EPDC_DITHER_PASSTHROUGH		0
+#define EPDC_DITHER_FLOYD_STEINBERG	1
+#define EPDC_DITHER_ATKINSON		2
+#define EPDC_DITHER_ORDERED		3
+#define EPDC_DITHER_QUANT_ONLY		4
+
+#define EPDC_DITHER_Y8			0
+#define EPDC_DITHER_RGB565		1
+
+/*
+ * Convert the width x height region at left, top of src to gray, dither
+ * it to 2^bits levels (1, 2 or 4 bits) and write the levels scaled back
+ * to 8 bits to the same region of dst. RGB565 destinations get grays.
+ * Strides are in bytes, src and dst may be the same buffer.
+ */
+struct epdc_dither_job {
+	const void *src;
+	int src_fmt;
+	int src_stride;
+	void *dst;
+	int dst_fmt;
+	int dst_stride;
+	int left;
+	int top;
+	int width;
+	int height;
+	int mode;
+	int bits;
+};
+
+struct epdc_dither;
+
+/* rows are shared among threads, the caller being one of them */
+struct epdc_dither *epdc_dither_new(int threads);
+void epdc_dither_free(struct epdc_dither *d);
+int epdc_dither_run(struct epdc_dither *d, const struct epdc_dither_job *job);
+
+#endif
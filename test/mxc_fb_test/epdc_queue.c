@@ -0,0 +1,641 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+/*
+ * @file epdc_queue.c
+ *
+ * @brief Asynchronous EPDC update queue and mock EPDC ioctl backend
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "epdc_queue.h"
+
+#define QUEUE_PENDING		64
+#define QUEUE_INFLIGHT		64
+#define QUEUE_LAT_BUCKETS	4096	/* 1 ms each, last one overflows */
+#define QUEUE_BACKOFF_MAX_MS	128
+#define QUEUE_STALL_MS		10000	/* give up an update after this */
+
+#define MOCK_UPDATES		256
+
+struct queued_update {
+	struct mxcfb_rect r;
+	__u32 wave_mode;
+	unsigned int flags;
+	__u32 marker;
+	int requests;		/* requests merged into this update */
+	uint64_t queued;	/* first request, ns */
+};
+
+struct epdc_queue {
+	epdc_ioctl_fn ioctl;
+	void *priv;
+	__u32 *marker;
+	int max_inflight;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int stop;
+
+	/* in request order, sent when not colliding */
+	struct queued_update pending[QUEUE_PENDING];
+	int npending;
+	/* in send order, completed from head */
+	struct queued_update inflight[QUEUE_INFLIGHT];
+	int head;
+	int ninflight;
+
+	unsigned long events;	/* completions, to back off on */
+	int backoff_ms;
+	int stalled_ms;
+
+	unsigned long requests;
+	unsigned long merged;
+	unsigned long sent;
+	unsigned long completed;
+	unsigned long completed_requests;
+	unsigned long retries;
+	unsigned long dropped;
+	unsigned long tests;
+	unsigned long collisions;
+	uint64_t t_first;
+	uint64_t t_last;
+	uint64_t lat_sum;
+	uint64_t lat_max;
+	unsigned int lat_hist[QUEUE_LAT_BUCKETS];
+};
+
+struct mock_update {
+	__u32 marker;
+	struct mxcfb_rect r;
+	uint64_t done;		/* ns, entry is free after this */
+	int collision;
+};
+
+struct epdc_mock {
+	pthread_mutex_t lock;
+	int slots;
+	int scale_pct;
+	struct mock_update upd[MOCK_UPDATES];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int rect_overlap(const struct mxcfb_rect *a, const struct mxcfb_rect *b)
+{
+	return a->left < b->left + b->width && b->left < a->left + a->width &&
+	       a->top < b->top + b->height && b->top < a->top + a->height;
+}
+
+static void rect_union(struct mxcfb_rect *d, const struct mxcfb_rect *a,
+		       const struct mxcfb_rect *b)
+{
+	__u32 right = a->left + a->width, bottom = a->top + a->height;
+
+	if (b->left + b->width > right)
+		right = b->left + b->width;
+	if (b->top + b->height > bottom)
+		bottom = b->top + b->height;
+	d->left = a->left < b->left ? a->left : b->left;
+	d->top = a->top < b->top ? a->top : b->top;
+	d->width = right - d->left;
+	d->height = bottom - d->top;
+}
+
+static uint64_t rect_area(const struct mxcfb_rect *r)
+{
+	return (uint64_t)r->width * r->height;
+}
+
+int epdc_fd_ioctl(void *priv, unsigned long req, void *arg)
+{
+	return ioctl((int)(long)priv, req, arg);
+}
+
+/*
+ * Mock backend
+ */
+
+/* rough update times of the common waveforms, in ms */
+static int mock_waveform_ms(__u32 wave_mode)
+{
+	switch (wave_mode) {
+	case 0:		/* INIT */
+		return 2000;
+	case 1:		/* DU */
+		return 260;
+	case 6:		/* A2 */
+		return 120;
+	case 7:		/* DU4 */
+		return 290;
+	default:	/* GC16, GL16, REAGL, AUTO */
+		return 450;
+	}
+}
+
+struct epdc_mock *epdc_mock_new(int slots, int scale_pct)
+{
+	struct epdc_mock *mock;
+
+	mock = calloc(1, sizeof(*mock));
+	if (!mock)
+		return NULL;
+
+	pthread_mutex_init(&mock->lock, NULL);
+	if (slots <= 0 || slots > MOCK_UPDATES)
+		slots = MOCK_UPDATES;
+	mock->slots = slots;
+	mock->scale_pct = scale_pct > 0 ? scale_pct : 100;
+
+	return mock;
+}
+
+void epdc_mock_free(struct epdc_mock *mock)
+{
+	if (!mock)
+		return;
+	pthread_mutex_destroy(&mock->lock);
+	free(mock);
+}
+
+static int mock_send_update(struct epdc_mock *mock,
+			    struct mxcfb_update_data *upd)
+{
+	struct mock_update *u, *slot = NULL;
+	uint64_t now = now_ns(), start = now;
+	int i, busy = 0, collision = 0;
+
+	for (i = 0; i < MOCK_UPDATES; i++) {
+		u = &mock->upd[i];
+		if (u->done <= now) {
+			/* completed, reuse the one retired first */
+			if (!slot || u->done < slot->done)
+				slot = u;
+			continue;
+		}
+		busy++;
+		if (rect_overlap(&u->r, &upd->update_region)) {
+			/* the driver holds colliding updates back */
+			collision = 1;
+			if (u->done > start)
+				start = u->done;
+		}
+	}
+
+	if (busy >= mock->slots || !slot) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	slot->marker = upd->update_marker;
+	slot->r = upd->update_region;
+	slot->collision = collision;
+	if (upd->flags & EPDC_FLAG_TEST_COLLISION)
+		/* dry run, nothing is shown */
+		slot->done = now + 1;
+	else
+		slot->done = start + (uint64_t)mock_waveform_ms(upd->waveform_mode) *
+			     mock->scale_pct * 10000;
+
+	return 0;
+}
+
+static int mock_wait_for_update(struct epdc_mock *mock,
+				struct mxcfb_update_marker_data *md)
+{
+	struct mock_update *u = NULL;
+	struct timespec ts;
+	uint64_t done;
+	int i;
+
+	for (i = 0; md->update_marker && i < MOCK_UPDATES; i++)
+		if (mock->upd[i].marker == md->update_marker) {
+			u = &mock->upd[i];
+			break;
+		}
+
+	if (!u) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	done = u->done;
+	md->collision_test = u->collision;
+	u->marker = 0;
+
+	pthread_mutex_unlock(&mock->lock);
+	ts.tv_sec = done / 1000000000ULL;
+	ts.tv_nsec = done % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+	pthread_mutex_lock(&mock->lock);
+
+	return 0;
+}
+
+int epdc_mock_ioctl(void *priv, unsigned long req, void *arg)
+{
+	struct epdc_mock *mock = priv;
+	int ret = 0;
+
+	pthread_mutex_lock(&mock->lock);
+	if (req == MXCFB_SEND_UPDATE)
+		ret = mock_send_update(mock, arg);
+	else if (req == MXCFB_WAIT_FOR_UPDATE_COMPLETE)
+		ret = mock_wait_for_update(mock, arg);
+	pthread_mutex_unlock(&mock->lock);
+
+	return ret;
+}
+
+/*
+ * Update queue, all helpers below run with q->lock held
+ */
+
+static int queue_send(struct epdc_queue *q, struct queued_update *u)
+{
+	struct mxcfb_update_data upd;
+
+	memset(&upd, 0, sizeof(upd));
+	upd.update_mode = UPDATE_MODE_PARTIAL;
+	upd.waveform_mode = u->wave_mode;
+	upd.update_region = u->r;
+	upd.temp = TEMP_USE_AMBIENT;
+	upd.flags = u->flags;
+	do
+		u->marker = __atomic_fetch_add(q->marker, 1, __ATOMIC_RELAXED);
+	while (u->marker == 0);
+	upd.update_marker = u->marker;
+
+	if (q->ioctl(q->priv, MXCFB_SEND_UPDATE, &upd) < 0) {
+		/* update memory is full */
+		q->retries++;
+		return -1;
+	}
+
+	q->inflight[(q->head + q->ninflight) % QUEUE_INFLIGHT] = *u;
+	q->ninflight++;
+	q->sent++;
+	q->backoff_ms = 0;
+	q->stalled_ms = 0;
+	pthread_cond_broadcast(&q->cond);
+
+	return 0;
+}
+
+/* sendable once it collides with nothing in flight or pending before it */
+static int queue_can_send(struct epdc_queue *q, int idx)
+{
+	struct mxcfb_rect *r = &q->pending[idx].r;
+	int i;
+
+	for (i = 0; i < q->ninflight; i++)
+		if (rect_overlap(r, &q->inflight[(q->head + i) % QUEUE_INFLIGHT].r))
+			return 0;
+	for (i = 0; i < idx; i++)
+		if (rect_overlap(r, &q->pending[i].r))
+			return 0;
+
+	return 1;
+}
+
+static void queue_remove_pending(struct epdc_queue *q, int idx)
+{
+	q->npending--;
+	memmove(&q->pending[idx], &q->pending[idx + 1],
+		(q->npending - idx) * sizeof(q->pending[0]));
+}
+
+static void queue_submit(struct epdc_queue *q)
+{
+	int i = 0;
+
+	while (i < q->npending && q->ninflight < q->max_inflight) {
+		if (!queue_can_send(q, i)) {
+			i++;
+			continue;
+		}
+		if (queue_send(q, &q->pending[i]))
+			break;
+		queue_remove_pending(q, i);
+	}
+}
+
+/*
+ * Wait for a completion, or with nothing of ours in flight, for the
+ * update memory other updates hold, with an exponential backoff. The
+ * oldest pending update is dropped once stalled for QUEUE_STALL_MS.
+ */
+static int queue_backoff(struct epdc_queue *q)
+{
+	unsigned long events = q->events;
+	struct timespec ts;
+	int ms;
+
+	if (q->ninflight) {
+		ms = 100;
+	} else {
+		q->backoff_ms = q->backoff_ms ? q->backoff_ms * 2 : 1;
+		if (q->backoff_ms > QUEUE_BACKOFF_MAX_MS)
+			q->backoff_ms = QUEUE_BACKOFF_MAX_MS;
+		ms = q->backoff_ms;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	while (q->events == events)
+		if (pthread_cond_timedwait(&q->cond, &q->lock, &ts) == ETIMEDOUT)
+			break;
+
+	if (q->events != events) {
+		q->stalled_ms = 0;
+		return 0;
+	}
+
+	q->stalled_ms += ms;
+	if (q->stalled_ms >= QUEUE_STALL_MS && q->npending) {
+		printf("Max retries exceeded\n");
+		queue_remove_pending(q, 0);
+		q->dropped++;
+		q->stalled_ms = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void queue_complete(struct epdc_queue *q, struct queued_update *u,
+			   int ret, struct mxcfb_update_marker_data *md)
+{
+	uint64_t now = now_ns(), lat = now - u->queued;
+	unsigned long ms = lat / 1000000;
+
+	if (u->flags & EPDC_FLAG_TEST_COLLISION) {
+		q->tests++;
+		if (ret == 0 && md->collision_test)
+			q->collisions++;
+	}
+
+	if (ms >= QUEUE_LAT_BUCKETS)
+		ms = QUEUE_LAT_BUCKETS - 1;
+	q->lat_hist[ms]++;
+	q->lat_sum += lat;
+	if (lat > q->lat_max)
+		q->lat_max = lat;
+
+	q->completed++;
+	q->completed_requests += u->requests;
+	q->t_last = now;
+}
+
+static void *queue_complete_thread(void *arg)
+{
+	struct epdc_queue *q = arg;
+	struct mxcfb_update_marker_data md;
+	struct queued_update u;
+	int ret;
+
+	pthread_mutex_lock(&q->lock);
+	while (1) {
+		while (!q->ninflight && !q->stop)
+			pthread_cond_wait(&q->cond, &q->lock);
+		if (!q->ninflight)
+			break;
+
+		u = q->inflight[q->head];
+		pthread_mutex_unlock(&q->lock);
+
+		/*
+		 * The driver frees markers nobody waits for when they
+		 * complete, so an error here usually means it is done.
+		 */
+		md.update_marker = u.marker;
+		md.collision_test = 0;
+		ret = q->ioctl(q->priv, MXCFB_WAIT_FOR_UPDATE_COMPLETE, &md);
+
+		pthread_mutex_lock(&q->lock);
+		queue_complete(q, &u, ret, &md);
+		q->head = (q->head + 1) % QUEUE_INFLIGHT;
+		q->ninflight--;
+		q->events++;
+		queue_submit(q);
+		pthread_cond_broadcast(&q->cond);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return NULL;
+}
+
+struct epdc_queue *epdc_queue_open(epdc_ioctl_fn ioctl_fn, void *priv,
+				   int max_inflight, __u32 *marker)
+{
+	struct epdc_queue *q;
+
+	q = calloc(1, sizeof(*q));
+	if (!q)
+		return NULL;
+
+	q->ioctl = ioctl_fn;
+	q->priv = priv;
+	q->marker = marker;
+	if (max_inflight <= 0)
+		max_inflight = 1;
+	if (max_inflight > QUEUE_INFLIGHT)
+		max_inflight = QUEUE_INFLIGHT;
+	q->max_inflight = max_inflight;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+
+	if (pthread_create(&q->thread, NULL, queue_complete_thread, q)) {
+		printf("Unable to create update completion thread\n");
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->lock);
+		free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+/* merge into the latest overlapping pending update if nothing after it cares */
+static int queue_merge(struct epdc_queue *q, struct queued_update *u)
+{
+	struct queued_update *p;
+	struct mxcfb_rect m;
+	int i, j;
+
+	if (u->flags & EPDC_FLAG_TEST_COLLISION)
+		return 0;
+
+	for (i = q->npending - 1; i >= 0; i--) {
+		p = &q->pending[i];
+		if (!rect_overlap(&p->r, &u->r))
+			continue;
+		if (p->wave_mode != u->wave_mode || p->flags != u->flags)
+			return 0;
+
+		rect_union(&m, &p->r, &u->r);
+		if (rect_area(&m) > rect_area(&p->r) + rect_area(&u->r))
+			return 0;
+		for (j = i + 1; j < q->npending; j++)
+			if (rect_overlap(&m, &q->pending[j].r))
+				return 0;
+
+		p->r = m;
+		p->requests++;
+		return 1;
+	}
+
+	return 0;
+}
+
+int epdc_queue_update(struct epdc_queue *q, int left, int top, int width,
+		      int height, int wave_mode, unsigned int flags)
+{
+	struct queued_update u;
+	int ret = 0;
+
+	memset(&u, 0, sizeof(u));
+	u.r.left = left;
+	u.r.top = top;
+	u.r.width = width;
+	u.r.height = height;
+	u.wave_mode = wave_mode;
+	u.flags = flags;
+	u.requests = 1;
+	u.queued = now_ns();
+
+	pthread_mutex_lock(&q->lock);
+	if (!q->requests)
+		q->t_first = u.queued;
+	q->requests++;
+
+	if (queue_merge(q, &u)) {
+		q->merged++;
+	} else {
+		while (1) {
+			queue_submit(q);
+			if (q->npending < QUEUE_PENDING)
+				break;
+			if (queue_backoff(q))
+				ret = -1;
+		}
+		q->pending[q->npending++] = u;
+	}
+
+	queue_submit(q);
+	pthread_mutex_unlock(&q->lock);
+
+	return ret;
+}
+
+int epdc_queue_flush(struct epdc_queue *q)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&q->lock);
+	while (1) {
+		queue_submit(q);
+		if (!q->npending && !q->ninflight)
+			break;
+		if (queue_backoff(q))
+			ret = -1;
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return ret;
+}
+
+static int queue_percentile(struct epdc_queue *q, int pct)
+{
+	unsigned long target = (q->completed * pct + 99) / 100, sum = 0;
+	int i;
+
+	for (i = 0; i < QUEUE_LAT_BUCKETS - 1; i++) {
+		sum += q->lat_hist[i];
+		if (sum >= target)
+			break;
+	}
+
+	return i;
+}
+
+void epdc_queue_print_stats(struct epdc_queue *q)
+{
+	double secs;
+
+	pthread_mutex_lock(&q->lock);
+	secs = (q->t_last - q->t_first) / 1e9;
+	printf("Update queue: %lu requests, %lu merged, %lu updates, "
+	       "%lu send retries, %lu dropped\n", q->requests, q->merged,
+	       q->sent, q->retries, q->dropped);
+	if (q->completed && secs > 0) {
+		printf("Update queue: %.1f requests/s, %.1f updates/s "
+		       "in %.3f s, %d in flight\n", q->completed_requests / secs,
+		       q->completed / secs, secs, q->max_inflight);
+		printf("Update queue: latency avg %.1f ms, p50 %d ms, "
+		       "p99 %d ms, max %.1f ms\n",
+		       q->lat_sum / 1e6 / q->completed, queue_percentile(q, 50),
+		       queue_percentile(q, 99), q->lat_max / 1e6);
+	}
+	if (q->tests)
+		printf("Update queue: %lu of %lu collision tests collided\n",
+		       q->collisions, q->tests);
+	pthread_mutex_unlock(&q->lock);
+}
+
+void epdc_queue_close(struct epdc_queue *q)
+{
+	if (!q)
+		return;
+
+	epdc_queue_flush(q);
+	epdc_queue_print_stats(q);
+
+	pthread_mutex_lock(&q->lock);
+	q->stop = 1;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+	pthread_join(q->thread, NULL);
+
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+}
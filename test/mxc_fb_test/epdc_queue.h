@@ -0,0 +1,69 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+/*
+ * @file epdc_queue.h
+ *
+ * @brief Asynchronous EPDC update queue and mock EPDC ioctl backend
+ *
+ */
+
+#ifndef EPDC_QUEUE_H
+#define EPDC_QUEUE_H
+
+#include <linux/mxcfb.h>
+
+/* EPDC ioctl backend: the fb device or the mock below */
+typedef int (*epdc_ioctl_fn)(void *priv, unsigned long req, void *arg);
+
+/* priv is the fd cast to a pointer */
+int epdc_fd_ioctl(void *priv, unsigned long req, void *arg);
+
+/*
+ * Mock EPDC: MXCFB_SEND_UPDATE takes one of slots update buffers (ENOMEM
+ * when all are busy) and completes after a waveform dependent time, later
+ * when it collides with an update in progress. Times are scaled by
+ * scale_pct percent. Other ioctls succeed and do nothing.
+ */
+struct epdc_mock;
+
+struct epdc_mock *epdc_mock_new(int slots, int scale_pct);
+void epdc_mock_free(struct epdc_mock *mock);
+int epdc_mock_ioctl(void *mock, unsigned long req, void *arg);
+
+/*
+ * Update queue: partial updates are merged with an overlapping pending
+ * update of the same waveform and flags, and sent once they no longer
+ * collide with an update in flight. At most max_inflight markers are in
+ * flight, a completion thread waits for them in order. Markers are taken
+ * from *marker, shared with synchronous updates.
+ */
+struct epdc_queue;
+
+struct epdc_queue *epdc_queue_open(epdc_ioctl_fn ioctl_fn, void *priv,
+				   int max_inflight, __u32 *marker);
+int epdc_queue_update(struct epdc_queue *q, int left, int top, int width,
+		      int height, int wave_mode, unsigned int flags);
+/* send everything pending and wait until nothing is in flight */
+int epdc_queue_flush(struct epdc_queue *q);
+void epdc_queue_print_stats(struct epdc_queue *q);
+/* flush, print the statistics and free the queue */
+void epdc_queue_close(struct epdc_queue *q);
+
+#endif
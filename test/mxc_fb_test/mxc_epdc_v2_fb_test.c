@@ -57,6 +57,8 @@ extern "C"{
 #include "python_tutorial_0003_rgb_1024x758.c"
 #include "python_tutorial_0004_rgb_1024x758.c"
 #include "../../include/test_utils.h"
+#include "epdc_queue.h"
+#include "epdc_dither.h"
 
 
 #define TFAIL -1
@@ -85,7 +87,7 @@ extern "C"{
 #define ALLOW_COLLISIONS	0
 #define NO_COLLISIONS		1
 
-#define NUM_TESTS		20
+#define NUM_TESTS		21
 
 #define ARRAY_SIZE(x)	(sizeof(x)/sizeof(x[0]))
 
@@ -107,6 +109,17 @@ int num_flashes = 10;
 static int use_reagl;
 static int use_reagld;
 
+/* EPDC ioctls go to the fb device, or the mock backend with -M */
+static epdc_ioctl_fn ioctl_backend = epdc_fd_ioctl;
+static void *ioctl_priv;
+static struct epdc_mock *epdc_mock;
+static int mock_scale;
+/* markers in flight for the update queue, 0 - synchronous updates */
+static int queue_depth;
+/* software dithering instead of the EPDC one, -s */
+static struct epdc_dither *sw_dither;
+static int sw_dither_threads;
+
 struct hw_dithering {
 	int dither_mode;
 	int quant_bit;
@@ -123,6 +136,39 @@ const char *dithering_name[5] = {
 struct timespec time1 = {0, 0};
 struct timespec time2 = {0, 0};
 
+static int epdc_ioctl(unsigned long req, void *arg)
+{
+	return ioctl_backend(ioctl_priv, req, arg);
+}
+
+/* dither a region of the frame buffer in place */
+static int sw_dither_region(int left, int top, int width, int height,
+	int mode, int bits)
+{
+	struct epdc_dither_job job;
+
+	memset(&job, 0, sizeof(job));
+	job.src = job.dst = fb;
+	job.src_fmt = job.dst_fmt = screen_info.bits_per_pixel == 8 ?
+		EPDC_DITHER_Y8 : EPDC_DITHER_RGB565;
+	job.src_stride = job.dst_stride =
+		screen_info.xres_virtual * screen_info.bits_per_pixel / 8;
+	job.left = left;
+	job.top = top;
+	job.width = width;
+	job.height = height;
+	job.mode = mode;
+	job.bits = bits;
+
+	if (epdc_dither_run(sw_dither, &job)) {
+		printf("Software dithering mode %d to %d bits unsupported\n",
+			mode, bits);
+		return -1;
+	}
+
+	return 0;
+}
+
 void memset_dword(void *s, int c, size_t count)
 {
 	int i;
@@ -183,12 +229,12 @@ static __u32 update_to_display(int left, int top, int width, int height, int wav
 	else
 		upd_data.update_marker = 0;
 
-	retval = ioctl(fd_fb_ioctl, MXCFB_SEND_UPDATE, &upd_data);
+	retval = epdc_ioctl(MXCFB_SEND_UPDATE, &upd_data);
 	while (retval < 0) {
 		/* We have limited memory available for updates, so wait and
 		 * then try again after some updates have completed */
 		sleep(1);
-		retval = ioctl(fd_fb_ioctl, MXCFB_SEND_UPDATE, &upd_data);
+		retval = epdc_ioctl(MXCFB_SEND_UPDATE, &upd_data);
 		if (--max_retry <= 0) {
 			printf("Max retries exceeded\n");
 			wait = 0;
@@ -201,7 +247,7 @@ static __u32 update_to_display(int left, int top, int width, int height, int wav
 		upd_marker_data.update_marker = upd_data.update_marker;
 
 		/* Wait for update to complete */
-		retval = ioctl(fd_fb_ioctl, MXCFB_WAIT_FOR_UPDATE_COMPLETE, &upd_marker_data);
+		retval = epdc_ioctl(MXCFB_WAIT_FOR_UPDATE_COMPLETE, &upd_marker_data);
 		if (retval < 0) {
 			printf("Wait for update complete failed.  Error = 0x%x", retval);
 			flags = 0;
@@ -245,12 +291,12 @@ static __u32 update_to_display_with_dithering(int left, int top, int width, int
 	else
 		upd_data.update_marker = 0;
 
-	retval = ioctl(fd_fb_ioctl, MXCFB_SEND_UPDATE, &upd_data);
+	retval = epdc_ioctl(MXCFB_SEND_UPDATE, &upd_data);
 	while (retval < 0) {
 		/* We have limited memory available for updates, so wait and
 		 * then try again after some updates have completed */
 		sleep(1);
-		retval = ioctl(fd_fb_ioctl, MXCFB_SEND_UPDATE, &upd_data);
+		retval = epdc_ioctl(MXCFB_SEND_UPDATE, &upd_data);
 		if (--max_retry <= 0) {
 			printf("Max retries exceeded\n");
 			wait = 0;
@@ -263,7 +309,7 @@ static __u32 update_to_display_with_dithering(int left, int top, int width, int
 		upd_marker_data.update_marker = upd_data.update_marker;
 
 		/* Wait for update to complete */
-		retval = ioctl(fd_fb_ioctl, MXCFB_WAIT_FOR_UPDATE_COMPLETE, &upd_marker_data);
+		retval = epdc_ioctl(MXCFB_WAIT_FOR_UPDATE_COMPLETE, &upd_marker_data);
 		if (retval < 0) {
 			printf("Wait for update complete failed.  Error = 0x%x", retval);
 			flags = 0;
@@ -301,12 +347,12 @@ static __u32 full_update_to_display(int wave_mode, int wait_for_complete, uint f
 	else
 		upd_data.update_marker = 0;
 
-	retval = ioctl(fd_fb_ioctl, MXCFB_SEND_UPDATE, &upd_data);
+	retval = epdc_ioctl(MXCFB_SEND_UPDATE, &upd_data);
 	while (retval < 0) {
 		/* We have limited memory available for updates, so wait and
 		 * then try again after some updates have completed */
 		sleep(1);
-		retval = ioctl(fd_fb_ioctl, MXCFB_SEND_UPDATE, &upd_data);
+		retval = epdc_ioctl(MXCFB_SEND_UPDATE, &upd_data);
 		if (--max_retry <= 0) {
 			printf("Max retries exceeded\n");
 			wait = 0;
@@ -319,7 +365,7 @@ static __u32 full_update_to_display(int wave_mode, int wait_for_complete, uint f
 		upd_marker_data.update_marker = upd_data.update_marker;
 
 		/* Wait for update to complete */
-		retval = ioctl(fd_fb_ioctl, MXCFB_WAIT_FOR_UPDATE_COMPLETE, &upd_marker_data);
+		retval = epdc_ioctl(MXCFB_WAIT_FOR_UPDATE_COMPLETE, &upd_marker_data);
 		if (retval < 0) {
 			printf("Wait for update complete failed.  Error = 0x%x", retval);
 			flags = 0;
@@ -2075,6 +2121,17 @@ static int test_colormap(void)
 
 	sleep(2);
 
+	if (sw_dither) {
+		/* same two levels, dithered instead of posterized */
+		sw_dither_region(0, 0, screen_info.xres, screen_info.yres,
+			EPDC_DITHER_ATKINSON, 1);
+		update_to_display(0, 0, screen_info.xres, screen_info.yres,
+			wave_mode, TRUE, 0);
+		printf("Software dithered colorbar\n");
+
+		sleep(2);
+	}
+
 	printf("Change back to non-inverted RGB565\n");
 	screen_info.rotate = FB_ROTATE_UR;
 	screen_info.bits_per_pixel = 16;
@@ -2165,6 +2222,7 @@ static int test_stress(void)
 	0x738E, 0x8410, 0x9492, 0xA514, 0xB596, 0xC618, 0xD69A, 0xE71C, 0xFFFF};
 	uint flags;
 	int wave_mode;
+	struct epdc_queue *q = NULL;
 
 	if (use_reagl)
 		wave_mode =  WAVEFORM_MODE_GLR16;
@@ -2185,16 +2243,29 @@ static int test_stress(void)
 	update_to_display(0, 0, screen_info.xres, screen_info.yres,
 		wave_mode, TRUE, 0);
 
+	if (queue_depth) {
+		printf("Using update queue, %d in flight\n", queue_depth);
+		q = epdc_queue_open(ioctl_backend, ioctl_priv, queue_depth,
+				    &marker_val);
+		if (!q)
+			return TFAIL;
+	}
+
 	for (i = 0; i < 200; i++) {
 
+		/* rotation needs the updates of the last one done */
+		if (q && epdc_queue_flush(q))
+			retval = TFAIL;
+
 		screen_info.rotate = i % 4;
 		screen_info.bits_per_pixel = 16;
 		screen_info.grayscale = 0;
 		printf("Rotating FB 90 degrees to %d\n", screen_info.rotate);
-		retval = ioctl(fd_fb, FBIOPUT_VSCREENINFO, &screen_info);
-		if (retval < 0)
+		if (!epdc_mock &&
+		    ioctl(fd_fb, FBIOPUT_VSCREENINFO, &screen_info) < 0)
 		{
 			printf("Rotation failed\n");
+			epdc_queue_close(q);
 			return TFAIL;
 		}
 
@@ -2226,17 +2297,29 @@ static int test_stress(void)
 				flags = EPDC_FLAG_TEST_COLLISION;
 			else
 				flags = 0;
-			update_to_display(x, y, width, height,
-				wave_mode, FALSE, flags);
+			if (q)
+				epdc_queue_update(q, x, y, width, height,
+					wave_mode, flags);
+			else
+				update_to_display(x, y, width, height,
+					wave_mode, FALSE, flags);
 		}
 	}
 
+	if (q) {
+		if (epdc_queue_flush(q))
+			retval = TFAIL;
+		epdc_queue_close(q);
+	}
+
+	if (epdc_mock)
+		return retval;
+
 	printf("Change back to non-inverted RGB565\n");
 	screen_info.rotate = FB_ROTATE_UR;
 	screen_info.bits_per_pixel = 16;
 	screen_info.grayscale = 0;
-	retval = ioctl(fd_fb, FBIOPUT_VSCREENINFO, &screen_info);
-	if (retval < 0)
+	if (ioctl(fd_fb, FBIOPUT_VSCREENINFO, &screen_info) < 0)
 	{
 		printf("Back to normal failed\n");
 		return TFAIL;
@@ -2245,6 +2328,82 @@ static int test_stress(void)
 	return retval;
 }
 
+/*
+ * Typing like workload through the update queue: each glyph update
+ * covers the glyph and the cursor after it, so it overlaps the next
+ * one, and every tenth update is a larger GC16 region.
+ */
+static int test_update_queue(void)
+{
+	struct epdc_queue *q;
+	int i, x, y, width, height, col = 0, row = 0;
+	int glyph_w = 16, glyph_h = 24;
+	int cols = (screen_info.xres - 32) / glyph_w;
+	int rows = (screen_info.yres - 32) / glyph_h;
+	int retval = TPASS;
+
+	if (scheme == UPDATE_SCHEME_SNAPSHOT) {
+		printf("Unable to run update queue test with SNAPSHOT scheme.\n");
+		return TPASS;
+	}
+
+	printf("Blank screen\n");
+	memset(fb, 0xFF, screen_info.xres_virtual*screen_info.yres*2);
+	update_to_display(0, 0, screen_info.xres, screen_info.yres,
+		WAVEFORM_MODE_GC16, TRUE, 0);
+
+	q = epdc_queue_open(ioctl_backend, ioctl_priv,
+			    queue_depth ? queue_depth : 4, &marker_val);
+	if (!q)
+		return TFAIL;
+
+	printf("Typing through the update queue\n");
+	for (i = 0; i < 2000; i++) {
+		if (i % 10 == 9) {
+			width = (rand() % (screen_info.xres / 2)) + 2;
+			height = (rand() % (screen_info.yres / 2)) + 1;
+			x = rand() % (screen_info.xres - width) & ~1;
+			y = rand() % (screen_info.yres - height);
+			draw_rectangle(fb, x, y, width & ~1, height,
+				(rand() & 1) ? 0x8410 : 0xFFFF);
+			epdc_queue_update(q, x, y, width, height,
+				WAVEFORM_MODE_GC16, 0);
+			continue;
+		}
+
+		x = 16 + col * glyph_w;
+		y = 16 + row * glyph_h;
+		draw_rectangle(fb, x + 2, y + 3, glyph_w - 4, glyph_h - 6, 0);
+		epdc_queue_update(q, x, y, glyph_w * 2, glyph_h,
+			WAVEFORM_MODE_DU, 0);
+		if (++col == cols - 1) {
+			col = 0;
+			row = (row + 1) % rows;
+		}
+	}
+
+	if (epdc_queue_flush(q))
+		retval = TFAIL;
+	epdc_queue_close(q);
+
+	return retval;
+}
+
+/* Y1/Y4 dithered update, done in software on the update region with -s */
+static void dithered_update(int left, int top, int width, int height,
+	int wave_mode, uint flags)
+{
+	if (sw_dither) {
+		sw_dither_region(left, top, width, height,
+			EPDC_DITHER_FLOYD_STEINBERG,
+			(flags & EPDC_FLAG_USE_DITHERING_Y1) ? 1 : 4);
+		flags &= ~(EPDC_FLAG_USE_DITHERING_Y1 |
+			EPDC_FLAG_USE_DITHERING_Y4);
+	}
+
+	update_to_display(left, top, width, height, wave_mode, TRUE, flags);
+}
+
 static int test_dithering_y8_y1(void)
 {
 	/* FB to white */
@@ -2258,14 +2417,10 @@ static int test_dithering_y8_y1(void)
 	copy_image_to_buffer(0, 0, 800, 600, ginger_rgb_800x600,
 		BUFFER_FB, &screen_info);
 
-	update_to_display(0, 0, 400, 300, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y1);
-	update_to_display(400, 300, 400, 300, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y1);
-	update_to_display(450, 50, 300, 200, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y1);
-	update_to_display(50, 350, 300, 200, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y1);
+	dithered_update(0, 0, 400, 300, 2, EPDC_FLAG_USE_DITHERING_Y1);
+	dithered_update(400, 300, 400, 300, 2, EPDC_FLAG_USE_DITHERING_Y1);
+	dithered_update(450, 50, 300, 200, 2, EPDC_FLAG_USE_DITHERING_Y1);
+	dithered_update(50, 350, 300, 200, 2, EPDC_FLAG_USE_DITHERING_Y1);
 	sleep(2);
 	return 0;
 }
@@ -2283,14 +2438,10 @@ static int test_dithering_y8_y4(void)
 	copy_image_to_buffer(0, 0, 800, 600, ginger_rgb_800x600,
 		BUFFER_FB, &screen_info);
 
-	update_to_display(0, 0, 400, 300, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y4);
-	update_to_display(400, 300, 400, 300, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y4);
-	update_to_display(450, 50, 300, 200, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y4);
-	update_to_display(50, 350, 300, 200, 2, TRUE,
-		EPDC_FLAG_USE_DITHERING_Y4);
+	dithered_update(0, 0, 400, 300, 2, EPDC_FLAG_USE_DITHERING_Y4);
+	dithered_update(400, 300, 400, 300, 2, EPDC_FLAG_USE_DITHERING_Y4);
+	dithered_update(450, 50, 300, 200, 2, EPDC_FLAG_USE_DITHERING_Y4);
+	dithered_update(50, 350, 300, 200, 2, EPDC_FLAG_USE_DITHERING_Y4);
 	sleep(2);
 	return 0;
 }
@@ -2322,8 +2473,16 @@ static int test_hw_dithering(void)
 	copy_image_to_buffer(0, 0, 800, 600, ginger_rgb_800x600,
 		BUFFER_FB, &screen_info);
 
-	update_to_display_with_dithering(0, 0, 800, 600, wave_mode, TRUE,
-		0, &hw_dithering);
+	if (sw_dither) {
+		printf("Dithering in software\n");
+		/* Y4 unless -q asks for another depth, as -B does */
+		if (sw_dither_region(0, 0, 800, 600, hw_dithering.dither_mode,
+			hw_dithering.quant_bit ? hw_dithering.quant_bit : 4))
+			return TFAIL;
+		update_to_display(0, 0, 800, 600, wave_mode, TRUE, 0);
+	} else
+		update_to_display_with_dithering(0, 0, 800, 600, wave_mode,
+			TRUE, 0, &hw_dithering);
 	sleep(2);
 	return 0;
 }
@@ -2478,6 +2637,115 @@ static int test_page_flip(void)
 	return retval;
 }
 
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 +
+		(end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/*
+ * File in/file out software dithering benchmark: an RGB565 or Y8 image
+ * (told apart by the file size) is dithered with -d and -q, timed with
+ * one thread and with the -s threads, and written out as Y8.
+ */
+static int dither_bench(const char *in, const char *out, int width, int height)
+{
+	struct epdc_dither_job job;
+	struct epdc_dither *d;
+	struct timespec start, end;
+	int threads[2] = {1, sw_dither_threads};
+	unsigned char *src, *dst;
+	double ms;
+	FILE *fp;
+	long size;
+	int i, loops, retval = TFAIL;
+
+	fp = fopen(in, "rb");
+	if (!fp) {
+		printf("Unable to open %s\n", in);
+		return TFAIL;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	memset(&job, 0, sizeof(job));
+	if (size == (long)width * height * 2) {
+		job.src_fmt = EPDC_DITHER_RGB565;
+		job.src_stride = width * 2;
+	} else if (size == (long)width * height) {
+		job.src_fmt = EPDC_DITHER_Y8;
+		job.src_stride = width;
+	} else {
+		printf("%s is neither %dx%d RGB565 nor Y8\n", in, width, height);
+		fclose(fp);
+		return TFAIL;
+	}
+
+	src = malloc(size);
+	dst = malloc(width * height);
+	if (!src || !dst || fread(src, 1, size, fp) != size) {
+		printf("Unable to read %s\n", in);
+		goto out;
+	}
+
+	job.src = src;
+	job.dst = dst;
+	job.dst_fmt = EPDC_DITHER_Y8;
+	job.dst_stride = width;
+	job.width = width;
+	job.height = height;
+	job.mode = hw_dithering.dither_mode;
+	job.bits = hw_dithering.quant_bit ? hw_dithering.quant_bit : 4;
+
+	printf("Dithering %s %dx%d %s, mode \"%s\" to %d bits\n", in, width,
+		height, job.src_fmt == EPDC_DITHER_Y8 ? "Y8" : "RGB565",
+		((job.mode >= 0) && (job.mode < ARRAY_SIZE(dithering_name))) ?
+		dithering_name[job.mode] : "Unsupported", job.bits);
+
+	for (i = 0; i < 2; i++) {
+		if (i && threads[i] <= 1)
+			break;
+		d = epdc_dither_new(threads[i]);
+		if (!d)
+			goto out;
+
+		/* at least a second and three runs */
+		loops = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			if (epdc_dither_run(d, &job)) {
+				printf("Unsupported dithering mode or bits\n");
+				epdc_dither_free(d);
+				goto out;
+			}
+			loops++;
+			clock_gettime(CLOCK_MONOTONIC, &end);
+		} while (loops < 3 || elapsed_ms(&start, &end) < 1000);
+		epdc_dither_free(d);
+
+		ms = elapsed_ms(&start, &end) / loops;
+		printf("%d thread(s): %.2f ms per frame, %.1f Mpixel/s\n",
+			threads[i], ms, width * height / ms / 1000);
+	}
+
+	fclose(fp);
+	fp = fopen(out, "wb");
+	if (!fp || fwrite(dst, 1, width * height, fp) != width * height) {
+		printf("Unable to write %s\n", out);
+		goto out;
+	}
+	printf("Y8 output written to %s\n", out);
+	retval = TPASS;
+
+out:
+	if (fp)
+		fclose(fp);
+	free(src);
+	free(dst);
+	return retval;
+}
+
 void usage(char *app)
 {
 	printf("EPDC framebuffer driver test program.\n");
@@ -2496,7 +2764,7 @@ void usage(char *app)
 	printf("\t\t  m - Queue and merge update scheme (default)\n");
 	printf("\t-n\t  Execute the tests specified in expression\n");
 	printf("\t\t  Expression is a set of comma-separated numeric ranges\n");
-	printf("\t\t  If not specified, all tests except Stress are run\n");
+	printf("\t\t  If not specified, all tests except Stress and Update Queue are run\n");
 	printf("\t-d\t  Execute the hardware dithering test\n");
 	printf("\t\t  0 - Pass Through\n");
 	printf("\t\t  1 - Floyd-Steinberg\n");
@@ -2504,6 +2772,14 @@ void usage(char *app)
 	printf("\t\t  3 - Ordered\n"),
 	printf("\t\t  4 - No Dithering, quantization only\n");
 	printf("\t-q\t  quantization bit (1 - 7) \n");
+	printf("\t-Q\t  Send the Stress and Update Queue test updates through\n");
+	printf("\t\t  the update queue with <depth> markers in flight\n");
+	printf("\t-s\t  Dither in software with <threads> threads instead of\n");
+	printf("\t\t  the EPDC (tests 12, 15-17)\n");
+	printf("\t-B\t  Benchmark software dithering, -B <width>x<height> <in> <out>\n");
+	printf("\t\t  with -d, -q and -s, <in> RGB565 or Y8, <out> Y8\n");
+	printf("\t-M\t  Run without a panel on a mock EPDC, update times\n");
+	printf("\t\t  scaled to <percent>, only tests 14 and 21 are run\n");
 	printf("Example:\n");
 	printf("%s -n 1-3,5,7\n", app);
 	printf("\nEPDC tests:\n");
@@ -2527,6 +2803,7 @@ void usage(char *app)
 	printf("18 - Advanced Algorithm Test\n");
 	printf("19 - Power AN case: Partial Screen Update Test\n");
 	printf("20 - Power AN case: Page Flip Test\n");
+	printf("21 - Update Queue Test\n");
 }
 
 int parse_test_nums(char *num_str)
@@ -2582,6 +2859,7 @@ main(int argc, char **argv)
 	struct fb_fix_screeninfo screen_info_fix;
 
 	int i, rt;
+	int bench_width = 0, bench_height = 0;
 
 	print_name(argv);
 
@@ -2593,12 +2871,12 @@ main(int argc, char **argv)
 		close(tfd);
 	}
 
-	/* Initialize test map so all tests (except stress test) will run */
+	/* Initialize test map so all tests (except stress and queue) will run */
 	for (i = 0; i < NUM_TESTS; i++)
-		if (i != 13)
+		if (i != 13 && i != 20)
 			test_map[i] = TRUE;
 
-	while ((rt = getopt(argc, argv, "hargu:w:n:d:q:p:f:")) >= 0) {
+	while ((rt = getopt(argc, argv, "hargu:w:n:d:q:p:f:Q:M:s:B:")) >= 0) {
 		switch (rt) {
 		case 'h':
 			usage(argv[0]);
@@ -2648,12 +2926,77 @@ main(int argc, char **argv)
 			pwrdown_delay = atoi(optarg);
 			printf("powerdown delay %d\n", pwrdown_delay);
 			break;
+		case 'Q':
+			queue_depth = atoi(optarg);
+			break;
+		case 'M':
+			mock_scale = atoi(optarg);
+			if (mock_scale <= 0)
+				mock_scale = 100;
+			break;
+		case 's':
+			sw_dither_threads = atoi(optarg);
+			if (sw_dither_threads <= 0)
+				sw_dither_threads = 1;
+			break;
+		case 'B':
+			if (sscanf(optarg, "%dx%d", &bench_width,
+				&bench_height) != 2 || bench_width <= 0 ||
+				bench_height <= 0) {
+				usage(argv[0]);
+				return TFAIL;
+			}
+			break;
 		default:
 			usage(argv[0]);
 			break;
 		}
 	}
 
+	if (bench_width) {
+		if (argc - optind < 2) {
+			usage(argv[0]);
+			return TFAIL;
+		}
+		return dither_bench(argv[optind], argv[optind + 1],
+			bench_width, bench_height);
+	}
+
+	if (sw_dither_threads) {
+		sw_dither = epdc_dither_new(sw_dither_threads);
+		if (!sw_dither)
+			return TFAIL;
+	}
+
+	if (mock_scale) {
+		printf("Using mock EPDC, update times at %d%%\n", mock_scale);
+		for (i = 0; i < NUM_TESTS; i++)
+			if (test_map[i] && i != 13 && i != 20)
+				test_map[i] = FALSE;
+		if (!test_map[13])
+			test_map[20] = TRUE;
+
+		epdc_mock = epdc_mock_new(16, mock_scale);
+		if (!epdc_mock) {
+			retval = TFAIL;
+			goto err0;
+		}
+		ioctl_backend = epdc_mock_ioctl;
+		ioctl_priv = epdc_mock;
+		fd_fb = fd_fb_ioctl = -1;
+
+		screen_info.xres = screen_info.xres_virtual = 800;
+		screen_info.yres = screen_info.yres_virtual = 600;
+		screen_info.bits_per_pixel = 16;
+		g_fb_size = screen_info.xres_virtual * screen_info.yres_virtual * 2;
+		fb = calloc(1, g_fb_size);
+		if (!fb) {
+			retval = TFAIL;
+			goto err1;
+		}
+		goto setup;
+	}
+
 	/* Find EPDC FB device */
 	while (1) {
 		fb_dev[7] = '0' + fb_num;
@@ -2691,6 +3034,7 @@ main(int argc, char **argv)
 		printf("\n****Using EPDC kernel module test driver!****\n\n");
 	else
 		fd_fb_ioctl = fd_fb;
+	ioctl_priv = (void *)(long)fd_fb_ioctl;
 
 	retval = ioctl(fd_fb, FBIOGET_VSCREENINFO, &screen_info);
 	if (retval < 0)
@@ -2723,9 +3067,10 @@ main(int argc, char **argv)
 		goto err1;
 	}
 
+setup:
 	printf("Set to region update mode\n");
 	auto_update_mode = AUTO_UPDATE_MODE_REGION_MODE;
-	retval = ioctl(fd_fb_ioctl, MXCFB_SET_AUTO_UPDATE_MODE, &auto_update_mode);
+	retval = epdc_ioctl(MXCFB_SET_AUTO_UPDATE_MODE, &auto_update_mode);
 	if (retval < 0)
 	{
 		printf("\nError: failed to set update mode.\n");
@@ -2739,7 +3084,7 @@ main(int argc, char **argv)
 	wv_modes.mode_gc8 = WAVEFORM_MODE_GC16;
 	wv_modes.mode_gc16 = WAVEFORM_MODE_GC16;
 	wv_modes.mode_gc32 = WAVEFORM_MODE_GC16;
-	retval = ioctl(fd_fb_ioctl, MXCFB_SET_WAVEFORM_MODES, &wv_modes);
+	retval = epdc_ioctl(MXCFB_SET_WAVEFORM_MODES, &wv_modes);
 	if (retval < 0)
 	{
 		printf("\nError: failed to set waveform mode.\n");
@@ -2747,7 +3092,7 @@ main(int argc, char **argv)
 	}
 
 	printf("Set update scheme - %d\n", scheme);
-	retval = ioctl(fd_fb_ioctl, MXCFB_SET_UPDATE_SCHEME, &scheme);
+	retval = epdc_ioctl(MXCFB_SET_UPDATE_SCHEME, &scheme);
 	if (retval < 0)
 	{
 		printf("\nError: failed to set update scheme.\n");
@@ -2755,7 +3100,7 @@ main(int argc, char **argv)
 	}
 
 	printf("Set pwrdown_delay - %d\n", pwrdown_delay);
-	retval = ioctl(fd_fb_ioctl, MXCFB_SET_PWRDOWN_DELAY, &pwrdown_delay);
+	retval = epdc_ioctl(MXCFB_SET_PWRDOWN_DELAY, &pwrdown_delay);
 	if (retval < 0)
 	{
 		printf("\nError: failed to set power down delay.\n");
@@ -2782,6 +3127,7 @@ main(int argc, char **argv)
 	testfunc_array[17] = &test_aa;
 	testfunc_array[18] = &test_partial_screen_update;
 	testfunc_array[19] = &test_page_flip;
+	testfunc_array[20] = &test_update_queue;
 
 	for (i = 0; i < NUM_TESTS; i++)
 		if (test_map[i])
@@ -2791,11 +3137,19 @@ main(int argc, char **argv)
 			}
 
 err2:
-	munmap(fb, g_fb_size);
+	if (epdc_mock)
+		free(fb);
+	else
+		munmap(fb, g_fb_size);
 err1:
+	if (epdc_mock) {
+		epdc_mock_free(epdc_mock);
+		goto err0;
+	}
 	close(fd_fb);
 	if (fd_fb != fd_fb_ioctl)
 		close(fd_fb_ioctl);
 err0:
+	epdc_dither_free(sw_dither);
 	return retval;
 }
@@ -20,6 +20,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <time.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 #include "../../include/test_utils.h"
@@ -28,12 +30,131 @@
 #define DEV_SPI1	"/dev/spidev1.4"
 #define DEV_SPI2   	"/dev/spidev2.4"
 #define DEV_SPI3   	"/dev/spidev3.4"
+#define SPIDEV_BUFSIZ	"/sys/module/spidev/parameters/bufsiz"
+/* transfers that fit the 14 bit ioctl size field */
+#define SPI_MAX_CHAIN	((int)(_IOC_SIZEMASK / sizeof(struct spi_ioc_transfer)))
+#define BENCH_MAX_POINTS	16
 static unsigned char mode;
 static unsigned char bits_per_word = 8;
 static unsigned int speed = 100000;
 
 char *buffer;
 
+/* benchmark sweep, see help_info() */
+static int bench;
+static int bench_sizes[BENCH_MAX_POINTS] = { 4, 16, 64, 256, 1024, 4096 };
+static int bench_nr_sizes = 6;
+static int bench_chains[BENCH_MAX_POINTS] = { 1, 2, 8, 32 };
+static int bench_nr_chains = 4;
+static int bench_speeds[BENCH_MAX_POINTS];
+static int bench_nr_speeds;
+static int bench_iters = 200;
+static int bench_pio;
+/* ECSPI: transfers shorter than the 64 word FIFO are done by PIO */
+static int dma_threshold = 64;
+static unsigned int spidev_bufsiz = 4096;
+
+/*
+ * Userspace spidev stand-in for runs without hardware ("-D sim"): a
+ * loopback device that enforces the spidev message limits and takes the
+ * wire time at the transfer clock plus the modelled controller overhead.
+ */
+#define SIM_MSG_NS	5000	/* per message: queueing, chip select */
+#define SIM_XFER_NS	1000	/* per transfer: controller setup */
+#define SIM_DMA_NS	8000	/* per transfer at or above the DMA threshold */
+static int sim;
+static unsigned char sim_mode;
+static unsigned char sim_bits = 8;
+static unsigned int sim_speed = 500000;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* bits clocked out for len bytes of bits wide words */
+static uint64_t wire_bits(int len, int bits)
+{
+	if (bits > 16)
+		return (uint64_t)len / 4 * bits;
+	if (bits > 8)
+		return (uint64_t)len / 2 * bits;
+	return (uint64_t)len * bits;
+}
+
+static int sim_message(struct spi_ioc_transfer *tr, int n)
+{
+	uint64_t start = now_ns(), ns = SIM_MSG_NS;
+	unsigned int total = 0, hz;
+	int bits, i;
+
+	for (i = 0; i < n; i++) {
+		total += tr[i].len;
+		if (total > spidev_bufsiz) {
+			errno = EMSGSIZE;
+			return -1;
+		}
+		if (tr[i].rx_buf && tr[i].tx_buf)
+			memcpy((void *)(unsigned long)tr[i].rx_buf,
+			       (void *)(unsigned long)tr[i].tx_buf, tr[i].len);
+		else if (tr[i].rx_buf)
+			memset((void *)(unsigned long)tr[i].rx_buf, 0,
+			       tr[i].len);
+
+		hz = tr[i].speed_hz ? tr[i].speed_hz : sim_speed;
+		bits = tr[i].bits_per_word ? tr[i].bits_per_word : sim_bits;
+		ns += wire_bits(tr[i].len, bits) * 1000000000ull / hz;
+		ns += tr[i].len >= dma_threshold ? SIM_DMA_NS : SIM_XFER_NS;
+	}
+
+	while (now_ns() - start < ns)
+		;
+	return total;
+}
+
+static int sim_ioctl(unsigned long req, void *arg)
+{
+	switch (req) {
+	case SPI_IOC_WR_MODE:
+		sim_mode = *(unsigned char *)arg;
+		return 0;
+	case SPI_IOC_RD_MODE:
+		*(unsigned char *)arg = sim_mode;
+		return 0;
+	case SPI_IOC_WR_BITS_PER_WORD:
+		sim_bits = *(unsigned char *)arg;
+		return 0;
+	case SPI_IOC_RD_BITS_PER_WORD:
+		*(unsigned char *)arg = sim_bits;
+		return 0;
+	case SPI_IOC_WR_MAX_SPEED_HZ:
+		sim_speed = *(unsigned int *)arg;
+		return 0;
+	case SPI_IOC_RD_MAX_SPEED_HZ:
+		*(unsigned int *)arg = sim_speed;
+		return 0;
+	}
+
+	if (_IOC_TYPE(req) != SPI_IOC_MAGIC || _IOC_NR(req) != 0 ||
+	    _IOC_DIR(req) != _IOC_WRITE ||
+	    _IOC_SIZE(req) % sizeof(struct spi_ioc_transfer)) {
+		errno = ENOTTY;
+		return -1;
+	}
+	return sim_message(arg, _IOC_SIZE(req) /
+			   sizeof(struct spi_ioc_transfer));
+}
+
+static int spi_ioctl(int fd, unsigned long req, void *arg)
+{
+	if (sim)
+		return sim_ioctl(req, arg);
+	return ioctl(fd, req, arg);
+}
+
 void help_info(const char *appname)
 {
 	printf("\n"
@@ -61,14 +182,30 @@ void help_info(const char *appname)
 	       "                  [-D spi_no]  [-s speed]              \n"
 	       "                  [-b bits_per_word]                   \n"
 	       "                  [-H] [-O] [-C] <value>               \n"
+	       "                  [-D spi_no] -B [-L sizes] [-N chains]\n"
+	       "                  [-F speeds] [-i iterations]          \n"
+	       "                  [-t dma_threshold] [-P] [options]    \n"
 	       "*                                                     *\n"
-	       "*    <spi_no> - CSPI Module number in [0, 1, 2]       *\n"
+	       "*    <spi_no> - CSPI Module number in [0, 1, 2], or   *\n"
+	       "*      sim for a loopback stand-in without hardware   *\n"
 	       "*    <speed> - Max transfer speed                     *\n"
 	       "*    <bits_per_word> - bits per word                  *\n"
 	       "*    -H - Phase 1 operation of clock                  *\n"
 	       "*    -O - Active low polarity of clock                *\n"
 	       "*    -C - Active high for chip select                 *\n"
 	       "*    <value> - Actual values to be sent               *\n"
+	       "*                                                     *\n"
+	       "*    -B - Benchmark: send chains of transfers in one  *\n"
+	       "*      SPI_IOC_MESSAGE(N) for every transfer size,    *\n"
+	       "*      chain length and clock, and report bytes/s and *\n"
+	       "*      message latency                                *\n"
+	       "*    <sizes> - Transfer bytes, e.g. 4,64,1024         *\n"
+	       "*    <chains> - Transfers per message, e.g. 1,8,32    *\n"
+	       "*    <speeds> - Clocks in Hz, default <speed>         *\n"
+	       "*    <iterations> - Messages per point (200)          *\n"
+	       "*    <dma_threshold> - Smallest DMA transfer (64)     *\n"
+	       "*    -P - Also send DMA sized transfers as PIO sized  *\n"
+	       "*      pieces in the same message                     *\n"
 	       "*******************************************************\n"
 	       "\n", appname);
 }
@@ -126,19 +263,20 @@ static int transfer(int fd, char *tbuf, char *rbuf, int bytes)
 		.len = bytes,
 	};
 
-	ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
+	ret = spi_ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
 	if (ret == 1)
 		printf("can't send spi message");
 	return ret;
 }
 
-int execute_buffer_test(int spi_id, int len, char *buffer)
+static int open_spi(int spi_id)
 {
-	char *rbuf;
-	int res = 0;
 	int fd = -1;
 
-	if (spi_id == 0) {
+	if (sim) {
+		/* a real fd so the callers need not care */
+		fd = open("/dev/null", O_RDWR);
+	} else if (spi_id == 0) {
 		fd = open(DEV_SPI1, O_RDWR);
 	} else if (spi_id == 1) {
 		fd = open(DEV_SPI2, O_RDWR);
@@ -151,51 +289,72 @@ int execute_buffer_test(int spi_id, int len, char *buffer)
 		       "(Maybe not present in your board?)\n");
 		return -1;
 	}
+	return fd;
+}
 
-	res = ioctl(fd, SPI_IOC_WR_MODE, &mode);
+static int setup_spi(int fd)
+{
+	int res;
+
+	res = spi_ioctl(fd, SPI_IOC_WR_MODE, &mode);
 	if (res == -1) {
 		printf("can't set spi mode");
-		goto exit;
+		return res;
 	}
 
-	res = ioctl(fd, SPI_IOC_RD_MODE, &mode);
+	res = spi_ioctl(fd, SPI_IOC_RD_MODE, &mode);
 	if (res == -1) {
 		printf("can't set spi mode");
-		goto exit;
+		return res;
 	}
 	/*
 	 * bits per word
 	 */
-	res = ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits_per_word);
+	res = spi_ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits_per_word);
 	if (res == -1) {
 		printf("can't set bits per word");
-		goto exit;
+		return res;
 	}
 
-	res = ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits_per_word);
+	res = spi_ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits_per_word);
 	if (res == -1) {
 		printf("can't get bits per word");
-		goto exit;
+		return res;
 	}
 
 	/*
 	 * max speed hz
 	 */
-	res = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+	res = spi_ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
 	if (res == -1) {
 		printf("can't set max speed hz");
-		goto exit;
+		return res;
 	}
 
-	res = ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
+	res = spi_ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
 	if (res == -1) {
 		printf("can't get max speed hz");
-		goto exit;
+		return res;
 	}
 
 	printf("spi mode: %d\n", mode);
 	printf("bits per word: %d\n", bits_per_word);
 	printf("max speed: %d Hz (%d KHz)\n", speed, speed/1000);
+	return 0;
+}
+
+int execute_buffer_test(int spi_id, int len, char *buffer)
+{
+	char *rbuf;
+	int res = 0;
+	int fd;
+
+	fd = open_spi(spi_id);
+	if (fd < 0)
+		return -1;
+
+	if (setup_spi(fd) == -1)
+		goto exit;
 
 	rbuf = malloc(len);
 	memset(rbuf, 0, len);
@@ -224,6 +383,182 @@ exit:
 	return 0;
 }
 
+static int parse_list(const char *arg, int *vals)
+{
+	char *end;
+	int n = 0;
+
+	do {
+		if (n == BENCH_MAX_POINTS)
+			return -1;
+		vals[n] = strtol(arg, &end, 0);
+		if (end == arg || vals[n] < 1)
+			return -1;
+		n++;
+		arg = end + 1;
+	} while (*end == ',');
+
+	return *end ? -1 : n;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * One point of the sweep: iterations messages of chain transfers of size
+ * bytes at hz. A non zero piece sends every transfer as transfers of at
+ * most piece bytes instead, still in one message, so DMA sized transfers
+ * can be compared with the same bytes done by PIO. Returns 1 when the
+ * point does not fit in one spidev message.
+ */
+static int bench_point(int fd, int hz, int size, int chain, int piece)
+{
+	struct spi_ioc_transfer *tr;
+	char *tbuf, *rbuf;
+	uint64_t *lat, total = 0, t;
+	int per = piece ? (size + piece - 1) / piece : 1;
+	int nr = chain * per, bytes = size * chain;
+	int c, p, i, j, bad = 0, res = 0;
+	const char *path;
+	double secs, wire;
+
+	if (bytes > spidev_bufsiz || nr > SPI_MAX_CHAIN) {
+		printf("%10d %6d %5d  skipped, over the spidev limits\n",
+		       hz, size, chain);
+		return 1;
+	}
+
+	tr = calloc(nr, sizeof(*tr));
+	tbuf = malloc(bytes);
+	rbuf = malloc(bytes);
+	lat = malloc(bench_iters * sizeof(*lat));
+	if (!tr || !tbuf || !rbuf || !lat) {
+		printf("out of memory\n");
+		res = -1;
+		goto out;
+	}
+
+	for (c = 0, i = 0; c < chain; c++) {
+		for (p = 0; p < per; p++, i++) {
+			tr[i].tx_buf = (unsigned long)(tbuf + c * size +
+						       p * piece);
+			tr[i].rx_buf = (unsigned long)(rbuf + c * size +
+						       p * piece);
+			tr[i].len = piece ? size - p * piece : size;
+			if (piece && tr[i].len > piece)
+				tr[i].len = piece;
+			tr[i].speed_hz = hz;
+			tr[i].bits_per_word = bits_per_word;
+		}
+	}
+
+	for (i = 0; i < bench_iters; i++) {
+		/* a new pattern every message so stale data shows */
+		for (j = 0; j < bytes; j++)
+			tbuf[j] = i + j;
+
+		t = now_ns();
+		res = spi_ioctl(fd, SPI_IOC_MESSAGE(nr), tr);
+		lat[i] = now_ns() - t;
+		if (res < 0) {
+			printf("%10d %6d %5d  failed: %s\n", hz, size, chain,
+			       strerror(errno));
+			goto out;
+		}
+		total += lat[i];
+
+		if (!bad && check_data_integrity(tbuf, rbuf, bytes))
+			bad = 1;
+	}
+	res = bad ? -1 : 0;
+
+	if (piece)
+		path = "pio*";
+	else
+		path = size >= dma_threshold ? "dma" : "pio";
+	secs = total / 1e9;
+	wire = wire_bits(bytes, bits_per_word) * bench_iters / (double)hz;
+	qsort(lat, bench_iters, sizeof(*lat), cmp_u64);
+	printf("%10d %6d %5d %-4s %8.0f %9.1f %5.1f %7.1f %7.1f %7.1f %7.1f%s\n",
+	       hz, size, chain, path, bench_iters / secs,
+	       bytes * (double)bench_iters / secs / 1024, wire / secs * 100,
+	       total / 1e3 / bench_iters, lat[bench_iters / 2] / 1e3,
+	       lat[(bench_iters * 99 - 1) / 100] / 1e3,
+	       lat[bench_iters - 1] / 1e3, bad ? "  CORRUPTED" : "");
+
+out:
+	free(tr);
+	free(tbuf);
+	free(rbuf);
+	free(lat);
+	return res;
+}
+
+int execute_bench(int spi_id)
+{
+	int word = bits_per_word > 16 ? 4 : bits_per_word > 8 ? 2 : 1;
+	int fd, f, s, c, size, piece, ret, res = 0;
+	FILE *fp;
+
+	fd = open_spi(spi_id);
+	if (fd < 0)
+		return -1;
+
+	if (setup_spi(fd) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	/* a message may carry at most bufsiz bytes */
+	if (!sim) {
+		fp = fopen(SPIDEV_BUFSIZ, "r");
+		if (fp) {
+			if (fscanf(fp, "%u", &spidev_bufsiz) != 1)
+				spidev_bufsiz = 4096;
+			fclose(fp);
+		}
+	}
+
+	if (!bench_nr_speeds) {
+		bench_speeds[0] = speed;
+		bench_nr_speeds = 1;
+	}
+	/* the largest PIO transfer, in whole words */
+	piece = (dma_threshold - 1) / word * word;
+
+	printf("spidev bufsiz: %u, DMA from %d bytes, %d messages per point\n",
+	       spidev_bufsiz, dma_threshold, bench_iters);
+	printf("%10s %6s %5s %-4s %8s %9s %5s %7s %7s %7s %7s\n", "clock Hz",
+	       "bytes", "chain", "path", "msg/s", "KB/s", "wire%", "avg",
+	       "p50", "p99", "max us");
+
+	for (f = 0; f < bench_nr_speeds; f++) {
+		for (s = 0; s < bench_nr_sizes; s++) {
+			/* whole words only */
+			size = (bench_sizes[s] + word - 1) / word * word;
+			for (c = 0; c < bench_nr_chains; c++) {
+				ret = bench_point(fd, bench_speeds[f], size,
+						  bench_chains[c], 0);
+				if (!ret && bench_pio && piece >= word &&
+				    size >= dma_threshold)
+					ret = bench_point(fd, bench_speeds[f],
+							  size, bench_chains[c],
+							  piece);
+				if (ret < 0)
+					res = -1;
+			}
+		}
+	}
+
+	printf("Benchmark %s.\n", res ? "FAILED" : "PASSED");
+	close(fd);
+	return res;
+}
+
 int main(int argc, char **argv)
 {
 	int spi_id = -1;
@@ -242,7 +577,34 @@ int main(int argc, char **argv)
 	for(i = 1; i < argc; i++) {
 		if(!strcmp(argv[i], "-D")) {
 			i++;
-			spi_id = atoi(argv[i]);
+			if (i < argc && !strcmp(argv[i], "sim"))
+				sim = 1;
+			else if (i < argc)
+				spi_id = atoi(argv[i]);
+		} else if(!strcmp(argv[i], "-B"))
+			bench = 1;
+		else if(!strcmp(argv[i], "-P"))
+			bench_pio = 1;
+		else if(i + 1 < argc && !strcmp(argv[i], "-L")) {
+			bench_nr_sizes = parse_list(argv[++i], bench_sizes);
+			if (bench_nr_sizes < 0)
+				goto bad_list;
+		} else if(i + 1 < argc && !strcmp(argv[i], "-N")) {
+			bench_nr_chains = parse_list(argv[++i], bench_chains);
+			if (bench_nr_chains < 0)
+				goto bad_list;
+		} else if(i + 1 < argc && !strcmp(argv[i], "-F")) {
+			bench_nr_speeds = parse_list(argv[++i], bench_speeds);
+			if (bench_nr_speeds < 0)
+				goto bad_list;
+		} else if(i + 1 < argc && !strcmp(argv[i], "-i")) {
+			bench_iters = atoi(argv[++i]);
+			if (bench_iters < 1)
+				goto bad_list;
+		} else if(i + 1 < argc && !strcmp(argv[i], "-t")) {
+			dma_threshold = atoi(argv[++i]);
+			if (dma_threshold < 1)
+				goto bad_list;
 		} else if(!strcmp(argv[i], "-s")) {
 			i++;
 			speed = atoi(argv[i]);
@@ -262,12 +624,15 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (spi_id < 0 || spi_id > 2) {
+	if (!sim && (spi_id < 0 || spi_id > 2)) {
 		printf("invalid parameter for device option\n");
 		help_info(argv[0]);
 		return -1;
 	}
 
+	if (bench)
+		return execute_bench(spi_id);
+
 	bytes = strlen((char *)argv[argc - 1]);
 	if (bytes < 1) {
 		printf("invalid parameter for buffer size\n");
@@ -295,4 +660,9 @@ int main(int argc, char **argv)
 	res = execute_buffer_test(spi_id, len, buffer);
 	free(buffer);
 	return res;
+
+bad_list:
+	printf("invalid parameter for %s\n", argv[i - 1]);
+	help_info(argv[0]);
+	return -1;
 }
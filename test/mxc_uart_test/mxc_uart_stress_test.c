@@ -10,15 +10,20 @@
  * http://www.opensource.org/licenses/gpl-license.html
  * http://www.gnu.org/copyleft/gpl.html
  */
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <asm-generic/ioctls.h>
 #include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include "../../include/test_utils.h"
 
 #define TIOCM_LOOP      0x8000
@@ -71,8 +76,48 @@ static int uart_speed(int s)
 	}
 }
 
+/*
+ * Kernel termios2, for rates without a Bxxx constant (e.g. 5 Mbaud). Local
+ * copy as <asm/termbits.h> clashes with <termios.h>.
+ */
+struct uart_termios2 {
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+
+static int set_other_speed(int fd, int speed)
+{
+	struct uart_termios2 ti2;
+
+	if (ioctl(fd, _IOR('T', 0x2A, struct uart_termios2), &ti2) < 0)
+		return -1;
+	ti2.c_cflag &= ~CBAUD;
+	ti2.c_cflag |= BOTHER;
+	ti2.c_ispeed = speed;
+	ti2.c_ospeed = speed;
+	return ioctl(fd, _IOW('T', 0x2B, struct uart_termios2), &ti2);
+}
+
 int set_speed(int fd, struct termios *ti, int speed)
 {
+	if (uart_speed(speed) == B0 && speed > 0) {
+		if (set_other_speed(fd, speed) < 0) {
+			perror("Can't set speed");
+			return -1;
+		}
+		goto stable;
+	}
+
 	cfsetospeed(ti, uart_speed(speed));
 	cfsetispeed(ti, uart_speed(speed));
 	if (tcsetattr(fd, TCSANOW, ti) < 0) {
@@ -80,6 +125,7 @@ int set_speed(int fd, struct termios *ti, int speed)
 		return -1;
 	}
 
+stable:
 	/* wait baud rate stable */
 	if (speed < 230400)
 		usleep(500000);
@@ -437,6 +483,671 @@ int real_op(int fd, char op)
 	return 0;
 }
 
+/*
+ * epoll engine (-e): every port is driven from one thread. Frames carry a
+ * sequence number, the send time and a CRC32; the receiver checks them and
+ * measures latency from the send time, so loss, reordering, corruption,
+ * latency and throughput are reported per direction.
+ *
+ * A port alone is looped back to itself (external wire or -l), a:b is a
+ * pair of ports wired to each other (a->b and b->a), and "pty" creates a
+ * pseudo terminal pair standing in for two wired UARTs.
+ */
+#define ENGINE_MAX_PORTS	32
+#define ENGINE_MAX_PAYLOAD	4096
+#define FRAME_HDR_SIZE		16	/* magic, length, sequence, send time */
+#define FRAME_CRC_SIZE		4
+#define FRAME_MAX		(FRAME_HDR_SIZE + ENGINE_MAX_PAYLOAD + FRAME_CRC_SIZE)
+#define FRAME_MAGIC0		0xa5
+#define FRAME_MAGIC1		0x5a
+/* latency histogram: 8 buckets per power of two microseconds */
+#define LAT_BUCKETS		256
+#define STALL_TIMEOUT_NS	2000000000ULL
+
+struct uart_port;
+
+/* one direction: frames written to tx and read back from rx */
+struct uart_link {
+	struct uart_port *tx;
+	struct uart_port *rx;
+
+	uint32_t tx_seq;
+	uint32_t rx_next;
+	uint64_t last_progress;
+
+	uint64_t received;
+	uint64_t bytes;
+	uint64_t lost;
+	uint64_t corrupt;
+	uint64_t reordered;
+	uint64_t garbage;
+	uint64_t stalls;
+	int resyncing;
+
+	uint64_t lat_sum;
+	uint64_t lat_min;
+	uint64_t lat_max;
+	uint32_t hist[LAT_BUCKETS];
+
+	/* at the last periodic report */
+	uint64_t report_bytes;
+	uint64_t report_received;
+};
+
+struct uart_port {
+	char name[64];
+	int fd;
+	int want_out;
+
+	struct uart_link *tx_link;
+	struct uart_link *rx_link;
+
+	uint8_t txbuf[FRAME_MAX];
+	int tx_len;
+	int tx_off;
+
+	uint8_t rxbuf[2 * FRAME_MAX];
+	int rx_len;
+};
+
+static struct uart_port engine_ports[ENGINE_MAX_PORTS];
+static struct uart_link engine_links[ENGINE_MAX_PORTS];
+static int nr_ports, nr_links;
+
+static int engine_payload = 256;
+static int engine_window = 4;
+static uint32_t engine_frames = 1000;
+static int engine_seconds;
+static int engine_interval = 1000;
+static int engine_sending = 1;
+static uint64_t engine_stall_ns = STALL_TIMEOUT_NS;
+static uint32_t crc_table[256];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void crc32_init(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+static uint32_t crc32(const uint8_t *buf, int len)
+{
+	uint32_t c = 0xffffffff;
+
+	while (len--)
+		c = crc_table[(c ^ *buf++) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffff;
+}
+
+static void put_le(uint8_t *p, uint64_t v, int bytes)
+{
+	while (bytes--) {
+		*p++ = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes--)
+		v = (v << 8) | p[bytes];
+	return v;
+}
+
+static int lat_bucket(uint64_t us)
+{
+	int msb, b;
+
+	if (us < 8)
+		return us;
+	msb = 63 - __builtin_clzll(us);
+	b = msb * 8 + (int)((us >> (msb - 3)) & 7) - 16;
+	return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+/* lower bound of a histogram bucket in microseconds */
+static uint64_t lat_bucket_us(int b)
+{
+	if (b < 8)
+		return b;
+	b += 16;
+	return (uint64_t)(8 + (b & 7)) << (b / 8 - 3);
+}
+
+static uint64_t lat_percentile(struct uart_link *link, int pct)
+{
+	uint64_t want = (link->received * pct + 99) / 100, sum = 0;
+	int b;
+
+	for (b = 0; b < LAT_BUCKETS; b++) {
+		sum += link->hist[b];
+		if (sum >= want && sum)
+			return lat_bucket_us(b);
+	}
+	return 0;
+}
+
+static void engine_build_frame(struct uart_port *port)
+{
+	struct uart_link *link = port->tx_link;
+	uint8_t *f = port->txbuf;
+	uint32_t x;
+	int i;
+
+	f[0] = FRAME_MAGIC0;
+	f[1] = FRAME_MAGIC1;
+	put_le(f + 2, engine_payload, 2);
+	put_le(f + 4, link->tx_seq, 4);
+	put_le(f + 8, now_ns(), 8);
+
+	/* xorshift pattern, different for every frame */
+	x = link->tx_seq * 2654435761u + 1;
+	for (i = 0; i < engine_payload; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		f[FRAME_HDR_SIZE + i] = x;
+	}
+	put_le(f + FRAME_HDR_SIZE + engine_payload,
+	       crc32(f, FRAME_HDR_SIZE + engine_payload), 4);
+
+	port->tx_len = FRAME_HDR_SIZE + engine_payload + FRAME_CRC_SIZE;
+	port->tx_off = 0;
+	link->tx_seq++;
+}
+
+static int link_can_send(struct uart_link *link)
+{
+	if (!engine_sending)
+		return 0;
+	if (engine_frames && link->tx_seq >= engine_frames)
+		return 0;
+	return link->tx_seq - link->rx_next < (uint32_t)engine_window;
+}
+
+static int engine_update_events(int epfd, struct uart_port *port)
+{
+	struct epoll_event ev;
+	int want_out = port->tx_off < port->tx_len || link_can_send(port->tx_link);
+
+	if (want_out == port->want_out)
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+	ev.data.ptr = port;
+	port->want_out = want_out;
+	return epoll_ctl(epfd, EPOLL_CTL_MOD, port->fd, &ev);
+}
+
+static int engine_write(struct uart_port *port)
+{
+	int n;
+
+	while (1) {
+		if (port->tx_off == port->tx_len) {
+			if (!link_can_send(port->tx_link))
+				return 0;
+			engine_build_frame(port);
+		}
+		n = write(port->fd, port->txbuf + port->tx_off,
+			  port->tx_len - port->tx_off);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return 0;
+			printf("%s: write error: %s\n", port->name, strerror(errno));
+			return -1;
+		}
+		port->tx_off += n;
+	}
+}
+
+static void engine_frame(struct uart_link *link, const uint8_t *f, int len)
+{
+	uint32_t seq = get_le(f + 4, 4);
+	uint64_t now = now_ns();
+	uint64_t lat = (now - get_le(f + 8, 8)) / 1000;
+	int b;
+
+	link->resyncing = 0;
+	link->last_progress = now;
+
+	if (seq < link->rx_next) {
+		/* late or duplicated, already counted as lost */
+		link->reordered++;
+		return;
+	}
+	if (seq > link->rx_next) {
+		if (log_out)
+			printf("%s: frames %u..%u lost\n", link->rx->name,
+			       link->rx_next, seq - 1);
+		link->lost += seq - link->rx_next;
+	}
+	link->rx_next = seq + 1;
+
+	link->received++;
+	link->bytes += len;
+	link->lat_sum += lat;
+	if (lat < link->lat_min || link->received == 1)
+		link->lat_min = lat;
+	if (lat > link->lat_max)
+		link->lat_max = lat;
+	b = lat_bucket(lat);
+	link->hist[b]++;
+}
+
+/* find the frames in what port received, resynchronizing on the magic */
+static void engine_parse(struct uart_port *port)
+{
+	struct uart_link *link = port->rx_link;
+	uint8_t *p = port->rxbuf;
+	int left = port->rx_len;
+	int len, total;
+
+	while (left >= FRAME_HDR_SIZE) {
+		if (p[0] != FRAME_MAGIC0 || p[1] != FRAME_MAGIC1) {
+			link->garbage++;
+			p++;
+			left--;
+			continue;
+		}
+
+		len = get_le(p + 2, 2);
+		total = FRAME_HDR_SIZE + len + FRAME_CRC_SIZE;
+		if (len > ENGINE_MAX_PAYLOAD) {
+			total = 0;
+		} else if (left < total) {
+			break;
+		} else if (crc32(p, FRAME_HDR_SIZE + len) ==
+			   get_le(p + FRAME_HDR_SIZE + len, 4)) {
+			engine_frame(link, p, len);
+			p += total;
+			left -= total;
+			continue;
+		}
+
+		/* bad length or CRC: count once, then look for the next frame */
+		if (!link->resyncing) {
+			link->corrupt++;
+			if (log_out)
+				printf("%s: corrupted frame after %u\n",
+				       port->name, link->rx_next);
+		}
+		link->resyncing = 1;
+		p++;
+		left--;
+	}
+
+	memmove(port->rxbuf, p, left);
+	port->rx_len = left;
+}
+
+static int engine_read(struct uart_port *port)
+{
+	int n;
+
+	while (1) {
+		n = read(port->fd, port->rxbuf + port->rx_len,
+			 sizeof(port->rxbuf) - port->rx_len);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return 0;
+			/* pty master after the slave side is gone */
+			if (errno == EIO)
+				return 0;
+			printf("%s: read error: %s\n", port->name, strerror(errno));
+			return -1;
+		}
+		if (n == 0)
+			return 0;
+		port->rx_len += n;
+		engine_parse(port);
+	}
+}
+
+static void engine_report(uint64_t elapsed, uint64_t interval, int final)
+{
+	struct uart_link *link;
+	uint64_t bytes, frames;
+	int i;
+
+	for (i = 0; i < nr_links; i++) {
+		link = &engine_links[i];
+		if (final) {
+			bytes = link->bytes;
+			frames = link->received;
+			interval = elapsed;
+		} else {
+			bytes = link->bytes - link->report_bytes;
+			frames = link->received - link->report_received;
+			link->report_bytes = link->bytes;
+			link->report_received = link->received;
+		}
+		if (!interval)
+			interval = 1;
+
+		printf("%s -> %s: %s%llu frames %.1f frames/s %.1f KB/s",
+		       link->tx->name, link->rx->name, final ? "total " : "",
+		       (unsigned long long)frames, frames * 1e9 / interval,
+		       bytes * 1e9 / interval / 1024);
+		if (link->received)
+			printf(", latency avg %llu min %llu p50 %llu p99 %llu max %llu us",
+			       (unsigned long long)(link->lat_sum / link->received),
+			       (unsigned long long)link->lat_min,
+			       (unsigned long long)lat_percentile(link, 50),
+			       (unsigned long long)lat_percentile(link, 99),
+			       (unsigned long long)link->lat_max);
+		printf("\n");
+		if (final || link->lost || link->corrupt || link->reordered)
+			printf("\tsent %u lost %llu corrupt %llu reordered %llu "
+			       "garbage bytes %llu stalls %llu\n",
+			       link->tx_seq, (unsigned long long)link->lost,
+			       (unsigned long long)link->corrupt,
+			       (unsigned long long)link->reordered,
+			       (unsigned long long)link->garbage,
+			       (unsigned long long)link->stalls);
+	}
+}
+
+static struct uart_port *engine_add_port(const char *name, int fd)
+{
+	struct uart_port *port = &engine_ports[nr_ports++];
+
+	snprintf(port->name, sizeof(port->name), "%s", name);
+	port->fd = fd;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return port;
+}
+
+static int engine_open_uart(const char *dev, int speed, int flow_control)
+{
+	struct termios ti;
+	int fd;
+
+	fd = init_uart((char *)dev, &ti);
+	if (fd < 0)
+		return -1;
+	if (set_flow_control(fd, &ti, flow_control) ||
+	    set_speed(fd, &ti, speed)) {
+		close(fd);
+		return -1;
+	}
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+static void engine_link(struct uart_port *tx, struct uart_port *rx)
+{
+	struct uart_link *link = &engine_links[nr_links++];
+
+	link->tx = tx;
+	link->rx = rx;
+	tx->tx_link = link;
+	rx->rx_link = link;
+}
+
+/* "pty": a pseudo terminal pair, each side sending to the other */
+static int engine_open_pty(void)
+{
+	struct termios ti;
+	char name[64];
+	int master, slave;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) || unlockpt(master)) {
+		perror("Can't create pty");
+		return -1;
+	}
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if (slave < 0) {
+		perror("Can't open pty slave");
+		close(master);
+		return -1;
+	}
+	/* no echo nor line editing between the two sides */
+	tcgetattr(slave, &ti);
+	cfmakeraw(&ti);
+	tcsetattr(slave, TCSANOW, &ti);
+
+	snprintf(name, sizeof(name), "ptmx%d", master);
+	engine_add_port(name, master);
+	engine_add_port(ptsname(master), slave);
+	printf("Pseudo terminal pair %s <-> %s\n", name, ptsname(master));
+	return 0;
+}
+
+static void engine_usage(const char *prog)
+{
+	printf("Usage:\n\t%s -e [-b <baud>] [-f] [-l] [-s <payload>] [-n <frames>]\n"
+		"\t\t[-t <seconds>] [-w <window>] [-i <ms>] [-o] <PORT>...\n"
+		"<PORT>: /dev/ttymxcN looped back to itself, /dev/ttymxcN:/dev/ttymxcM\n"
+		"\ttwo ports wired to each other, or pty for a pseudo terminal pair\n"
+		"-b: baud rate (115200), -f: RTS/CTS flow control, -l: internal loopback\n"
+		"-s: payload bytes per frame (256, max %d)\n"
+		"-n: frames per direction (1000), 0 to run until -t\n"
+		"-t: stop sending after <seconds>\n"
+		"-w: frames in flight per direction (4)\n"
+		"-i: report interval in ms (1000), 0 for the final report only\n"
+		"-o: print every loss and corruption\n"
+		"For example, all UARTs of a board wired in pairs at 4 Mbaud:\n"
+		"\t%s -e -b 4000000 -f -t 60 /dev/ttymxc1:/dev/ttymxc2 /dev/ttymxc3:/dev/ttymxc4\n",
+		prog, ENGINE_MAX_PAYLOAD, prog);
+}
+
+static int engine_main(int argc, char *argv[])
+{
+	struct epoll_event ev, events[ENGINE_MAX_PORTS];
+	struct uart_port *port, *a, *b;
+	struct uart_link *link;
+	uint64_t start, now, last_report, stop_sending = 0;
+	int speed = 115200, flow_control = 0;
+	int epfd, n, i, fd, ret = 0;
+	char *sep;
+
+	for (i = 2; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-f"))
+			flow_control = 1;
+		else if (!strcmp(argv[i], "-l"))
+			loopflag = 1;
+		else if (!strcmp(argv[i], "-o"))
+			log_out = 1;
+		else if (i + 1 < argc && !strcmp(argv[i], "-b"))
+			speed = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-s"))
+			engine_payload = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-n"))
+			engine_frames = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-t"))
+			engine_seconds = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-w"))
+			engine_window = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-i"))
+			engine_interval = atoi(argv[++i]);
+		else {
+			engine_usage(argv[0]);
+			return -1;
+		}
+	}
+	if (i == argc || engine_payload < 0 || engine_payload > ENGINE_MAX_PAYLOAD ||
+	    engine_window < 1 || (!engine_frames && !engine_seconds)) {
+		engine_usage(argv[0]);
+		return -1;
+	}
+
+	crc32_init();
+
+	/* give a full window twice its time on the wire (10 bits a byte) */
+	engine_stall_ns += (uint64_t)engine_window *
+			   (FRAME_HDR_SIZE + engine_payload + FRAME_CRC_SIZE) *
+			   10 * 2 * 1000000000ULL / (speed > 0 ? speed : 115200);
+
+	for (; i < argc; i++) {
+		if (nr_ports + 2 > ENGINE_MAX_PORTS) {
+			printf("Too many ports, at most %d\n", ENGINE_MAX_PORTS);
+			return -1;
+		}
+		if (!strcmp(argv[i], "pty")) {
+			if (engine_open_pty())
+				return -1;
+			a = &engine_ports[nr_ports - 2];
+			b = &engine_ports[nr_ports - 1];
+			engine_link(a, b);
+			engine_link(b, a);
+			continue;
+		}
+
+		sep = strchr(argv[i], ':');
+		if (sep)
+			*sep = '\0';
+		fd = engine_open_uart(argv[i], speed, flow_control);
+		if (fd < 0)
+			return -1;
+		a = engine_add_port(argv[i], fd);
+		if (!sep) {
+			engine_link(a, a);
+			continue;
+		}
+		fd = engine_open_uart(sep + 1, speed, flow_control);
+		if (fd < 0)
+			return -1;
+		b = engine_add_port(sep + 1, fd);
+		engine_link(a, b);
+		engine_link(b, a);
+	}
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+	for (i = 0; i < nr_ports; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = &engine_ports[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, engine_ports[i].fd, &ev) < 0) {
+			perror("epoll_ctl");
+			return -1;
+		}
+	}
+
+	printf("%d ports, %d directions, %d byte payload, window %d\n",
+	       nr_ports, nr_links, engine_payload, engine_window);
+
+	start = last_report = now_ns();
+	for (i = 0; i < nr_links; i++)
+		engine_links[i].last_progress = start;
+
+	while (1) {
+		for (i = 0; i < nr_ports; i++) {
+			port = &engine_ports[i];
+			if (engine_write(port) < 0 ||
+			    engine_update_events(epfd, port) < 0) {
+				ret = -1;
+				goto out;
+			}
+		}
+
+		n = epoll_wait(epfd, events, ENGINE_MAX_PORTS, 100);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			ret = -1;
+			goto out;
+		}
+		for (i = 0; i < n; i++) {
+			port = events[i].data.ptr;
+			if ((events[i].events & EPOLLIN) && engine_read(port) < 0) {
+				ret = -1;
+				goto out;
+			}
+		}
+
+		now = now_ns();
+		if (engine_seconds && engine_sending &&
+		    now - start >= (uint64_t)engine_seconds * 1000000000ULL) {
+			engine_sending = 0;
+			stop_sending = now;
+		}
+
+		n = 0;
+		for (i = 0; i < nr_links; i++) {
+			link = &engine_links[i];
+			if (link->rx_next == link->tx_seq) {
+				link->last_progress = now;
+				if (engine_frames && link->tx_seq >= engine_frames)
+					n++;
+				continue;
+			}
+			/* what is in flight for this long is not coming */
+			if (now - link->last_progress > engine_stall_ns) {
+				printf("%s -> %s: no frame for %llu ms, %u in flight lost\n",
+				       link->tx->name, link->rx->name,
+				       (unsigned long long)engine_stall_ns / 1000000,
+				       link->tx_seq - link->rx_next);
+				link->lost += link->tx_seq - link->rx_next;
+				link->rx_next = link->tx_seq;
+				link->stalls++;
+				link->last_progress = now;
+			}
+		}
+		if (engine_sending && n == nr_links)
+			engine_sending = 0;
+
+		if (engine_interval && now - last_report >= engine_interval * 1000000ULL) {
+			engine_report(now - start, now - last_report, 0);
+			last_report = now;
+		}
+
+		if (!engine_sending) {
+			if (!stop_sending)
+				stop_sending = now;
+			for (i = 0; i < nr_links; i++)
+				if (engine_links[i].rx_next != engine_links[i].tx_seq)
+					break;
+			if (i == nr_links || now - stop_sending > engine_stall_ns)
+				break;
+		}
+	}
+
+	/* frames still missing at the end are lost */
+	for (i = 0; i < nr_links; i++) {
+		link = &engine_links[i];
+		link->lost += link->tx_seq - link->rx_next;
+	}
+
+	printf("\n");
+	engine_report(now_ns() - start, 0, 1);
+	for (i = 0; i < nr_links; i++) {
+		link = &engine_links[i];
+		if (link->lost || link->corrupt || link->reordered ||
+		    link->received != link->tx_seq)
+			ret = -1;
+	}
+	printf("%s\n", ret ? "FAIL: frames lost, corrupted or out of order" :
+			     "PASS: every frame received intact and in order");
+
+out:
+	close(epfd);
+	for (i = 0; i < nr_ports; i++)
+		close(engine_ports[i].fd);
+	return ret;
+}
+
 int main(int argc, char* argv[])
 {
 	struct termios ti;
@@ -445,8 +1156,15 @@ int main(int argc, char* argv[])
 	char op;
 
 	print_name(argv);
+	if (argc > 1 && !strcmp(argv[1], "-e")) {
+		ret = engine_main(argc, argv);
+		print_result(argv);
+		return ret;
+	}
+
 	if (argc < 8) {
 		printf("Usage:\n\t%s <PORT> <BAUDRATE> <F> <R/W/L/D> <X> <Y> <O>\n"
+			"\t%s -e [options] <PORT>... (all ports at once, -e for details)\n"
 			"<PORT>: like /dev/ttymxc4\n"
 			"<BAUDRATE>: the baud rate number value (0~4000000)\n"
 			"<F>: enable flow control; other chars: disable flow control\n"
@@ -480,7 +1198,7 @@ int main(int argc, char* argv[])
 			"in mx6, two board full duplex R/W test (flowcontrol enable)"
 			"	  ./mxc_uart_stress_test.out /dev/ttymxc4 115200 F D 1000 1000 O\n\n"
 			,
-			argv[0]);
+			argv[0], argv[0]);
 		return 0;
 	}
 
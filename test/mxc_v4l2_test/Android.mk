@@ -39,7 +39,7 @@ include $(BUILD_EXECUTABLE)
 endif
 
 include $(CLEAR_VARS)
-LOCAL_SRC_FILES := mx8_v4l2_cap_drm.c
+LOCAL_SRC_FILES := mx8_v4l2_cap_drm.c v4l2_recorder.c
 LOCAL_C_INCLUDES += $(LOCAL_PATH) $(LIBDRM_IMX)/libdrm-imx/ $(LIBDRM_IMX)/libdrm-imx/include/drm/
 LOCAL_MULTILIB := both
 LOCAL_CFLAGS += -DBUILD_FOR_ANDROID
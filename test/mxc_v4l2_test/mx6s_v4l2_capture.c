@@ -53,6 +53,7 @@ extern "C"{
 
 #include "../../include/soc_check.h"
 #include "../../include/test_utils.h"
+#include "v4l2_recorder.h"
 
 sigset_t sigset;
 int quitflag;
@@ -63,6 +64,7 @@ int quitflag;
 		})
 
 #define TEST_BUFFER_NUM 3
+#define MAX_BUFFER_NUM 16
 #define MAX_V4L2_DEVICE_NR     64
 
 struct testbuffer
@@ -72,9 +74,9 @@ struct testbuffer
 	unsigned int length;
 };
 
-struct testbuffer buffers[TEST_BUFFER_NUM];
+struct testbuffer buffers[MAX_BUFFER_NUM];
 #ifdef	GET_CONTI_PHY_MEM_VIA_PXP_LIB
-struct pxp_mem_desc mem[TEST_BUFFER_NUM];
+struct pxp_mem_desc mem[MAX_BUFFER_NUM];
 #endif
 int g_out_width = 640;
 int g_out_height = 480;
@@ -88,6 +90,9 @@ int g_frame_size;
 char g_v4l_device[100] = "/dev/video0";
 char g_saved_filename[100] = "1.yuv";
 int  g_saved_to_file = 0;
+int g_num_buffers = TEST_BUFFER_NUM;
+int g_rec_depth = 0;
+int g_rec_batch = 0;
 
 int start_capturing(int fd_v4l)
 {
@@ -97,7 +102,7 @@ int start_capturing(int fd_v4l)
 	struct v4l2_requestbuffers req;
 
 	memset(&req, 0, sizeof (req));
-	req.count = TEST_BUFFER_NUM;
+	req.count = g_num_buffers;
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = g_mem_type;
 
@@ -107,7 +112,7 @@ int start_capturing(int fd_v4l)
 	}
 
 	if (g_mem_type == V4L2_MEMORY_MMAP) {
-		for (i = 0; i < TEST_BUFFER_NUM; i++) {
+		for (i = 0; i < g_num_buffers; i++) {
 			memset(&buf, 0, sizeof (buf));
 			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 			buf.memory = g_mem_type;
@@ -127,7 +132,7 @@ int start_capturing(int fd_v4l)
 		}
 	}
 
-	for (i = 0; i < TEST_BUFFER_NUM; i++)
+	for (i = 0; i < g_num_buffers; i++)
 	{
 		memset(&buf, 0, sizeof (buf));
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -396,6 +401,25 @@ void software_csc(unsigned char *inbuf, unsigned char *outbuf, int xres, int yre
 		printf("Unsupport format in %s\n", __func__);
 }
 
+/* recorder release callback, priv is the capture fd */
+static void requeue_buffer(void *priv, int index)
+{
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof (buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = g_mem_type;
+	buf.index = index;
+	buf.length = buffers[index].length;
+	if (g_mem_type == V4L2_MEMORY_USERPTR)
+		buf.m.userptr = (unsigned long) buffers[index].start;
+	else
+		buf.m.offset = buffers[index].offset;
+
+	if (ioctl((long)priv, VIDIOC_QBUF, &buf) < 0)
+		printf("VIDIOC_QBUF failed\n");
+}
+
 int v4l_capture_test(int fd_v4l)
 {
 	struct fb_var_screeninfo var;
@@ -409,6 +433,11 @@ int v4l_capture_test(int fd_v4l)
 	int out_w = 0, out_h = 0;
 	int bufoffset;
 	FILE * fd_y_file = 0;
+	struct v4l2_recorder *rec = NULL;
+	char index_file[sizeof(g_saved_filename) + 4];
+	void *planes[1];
+	uint32_t sizes[1];
+	int held;
 	size_t wsize;
 	unsigned char *cscbuf = NULL;
 	int ret = -1;
@@ -418,6 +447,16 @@ int v4l_capture_test(int fd_v4l)
 			printf("Unable to create y frame recording file\n");
 			return -1;
 		}
+		if (g_rec_depth > 0) {
+			snprintf(index_file, sizeof(index_file), "%s.idx",
+				 g_saved_filename);
+			rec = recorder_open(g_saved_filename, fileno(fd_y_file),
+					    index_file, g_rec_depth,
+					    (size_t)g_rec_batch * 1024,
+					    requeue_buffer, (void *)(long)fd_v4l);
+			if (!rec)
+				goto FAIL;
+		}
 		goto loop; /* skip the fb display */
 	}
 
@@ -484,7 +523,20 @@ loop:
 			break;
 		}
 
-		if (g_saved_to_file) {
+		held = 0;
+		if (rec) {
+			/* the writer thread queues the buffer back */
+			planes[0] = buffers[buf.index].start;
+			sizes[0] = g_frame_size;
+			ret = recorder_push(rec, buf.index, planes, sizes, 1,
+					    buf.timestamp.tv_sec * 1000000ULL +
+					    buf.timestamp.tv_usec, buf.sequence);
+			if (ret < 0) {
+				printf("Recording failed. Stopping after %d frames.\n", frame_num);
+				break;
+			}
+			held = (ret == 0);
+		} else if (g_saved_to_file) {
 			/* Save capture frame to file */
 			wsize = fwrite(buffers[buf.index].start, g_frame_size, 1, fd_y_file);
 			if (wsize < 1) {
@@ -519,7 +571,7 @@ loop:
 			}
 		}
 
-		if (ioctl (fd_v4l, VIDIOC_QBUF, &buf) < 0) {
+		if (!held && ioctl (fd_v4l, VIDIOC_QBUF, &buf) < 0) {
 			printf("VIDIOC_QBUF failed\n");
 			break;
 		}
@@ -535,6 +587,10 @@ loop:
 			printf("FBIOPAN_DISPLAY failed\n");
 	}
 
+	/* the recorder gives back the buffers it holds before stream off */
+	if (rec)
+		recorder_flush(rec);
+
 	if (stop_capturing(fd_v4l) < 0)
 		printf("stop_capturing failed\n");
 
@@ -554,6 +610,9 @@ FAIL:
 	if (fd_fb >= 0)
 		close(fd_fb);
 
+	if (rec)
+		recorder_close(rec);
+
 	if (fd_y_file)
 		fclose(fd_y_file);
 
@@ -570,6 +629,8 @@ void print_help(void)
 		" -t <time> -fr <framerate>\n"
 		" -d <camera select, /dev/video0, /dev/video1> \n" \
 		" -of <save_to_file>\n"
+		" -rec <depth> with -of, write from a thread holding up to depth frames, and an index file\n"
+		" -batch <KB> with -rec, gather pending frames into writes of up to KB\n"
 		" -l <device support list>\n"
 #ifdef	GET_CONTI_PHY_MEM_VIA_PXP_LIB
 		" [-u if defined, means use userp, otherwise mmap]\n"
@@ -602,6 +663,10 @@ int process_cmdline(int argc, char **argv)
 		} else if (strcmp(argv[i], "-of") == 0) {
 			strcpy(g_saved_filename, argv[++i]);
 			g_saved_to_file = 1;
+		} else if (strcmp(argv[i], "-rec") == 0) {
+			g_rec_depth = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-batch") == 0) {
+			g_rec_batch = atoi(argv[++i]);
 #ifdef	GET_CONTI_PHY_MEM_VIA_PXP_LIB
 		} else if (strcmp(argv[i], "-u") == 0) {
 			g_mem_type = V4L2_MEMORY_USERPTR;
@@ -615,6 +680,22 @@ int process_cmdline(int argc, char **argv)
 		}
 	}
 
+	if (g_rec_depth > 0) {
+		if (!g_saved_to_file) {
+			printf("-rec needs -of\n");
+			return -1;
+		}
+		/* keep TEST_BUFFER_NUM buffers with the driver */
+		g_num_buffers = TEST_BUFFER_NUM + g_rec_depth;
+		if (g_num_buffers > MAX_BUFFER_NUM) {
+			g_num_buffers = MAX_BUFFER_NUM;
+			g_rec_depth = MAX_BUFFER_NUM - TEST_BUFFER_NUM;
+		}
+	} else if (g_rec_batch) {
+		printf("-batch needs -rec\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -731,7 +812,7 @@ int main(int argc, char **argv)
 		return -1;
 
 	if (g_mem_type == V4L2_MEMORY_USERPTR)
-		if (memalloc(g_frame_size, TEST_BUFFER_NUM) < 0) {
+		if (memalloc(g_frame_size, g_num_buffers) < 0) {
 			close(fd_v4l);
 		}
 
@@ -740,7 +821,7 @@ int main(int argc, char **argv)
 	close(fd_v4l);
 
 	if (g_mem_type == V4L2_MEMORY_USERPTR)
-		memfree(g_frame_size, TEST_BUFFER_NUM);
+		memfree(g_frame_size, g_num_buffers);
 
 	print_result(argv);
 
@@ -37,15 +37,19 @@
 
 #include <drm/drm.h>
 #include <drm/drm_mode.h>
+#include <drm/drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <linux/videodev2.h>
 
 #include "../../include/soc_check.h"
+#include "v4l2_recorder.h"
 
 /* Helper Macro */
 #define NUM_PLANES				3
 #define TEST_BUFFER_NUM			3
+#define DMABUF_BUFFER_NUM		6
+#define MAX_BUFFER_NUM			16
 #define NUM_SENSORS				16
 #define NUM_CARDS				8
 #define DEFAULT					4
@@ -93,6 +97,7 @@ struct drm_device {
 	__s32 crtc_id;
 	__s32 card_id;
 	uint32_t conn_id;
+	__u32 crtc_index;
 
 	__u32 bits_per_pixel;
 	__u32 bytes_per_pixel;
@@ -104,6 +109,18 @@ struct drm_device {
 	struct drm_buffer buffers[2];
 	__u32 nr_buffer;
 	__u32 front_buf;
+
+	/* atomic presentation (-dmabuf) */
+	__u32 primary_plane;
+	__u32 prop_fb_id;
+	__u32 prop_crtc_id;
+	__u32 prop_src[4];	/* SRC_X, SRC_Y, SRC_W, SRC_H */
+	__u32 prop_crtc[4];	/* CRTC_X, CRTC_Y, CRTC_W, CRTC_H */
+	bool flip_pending;
+	__u32 flips;
+
+	/* software compositor workers */
+	struct compositor *comp;
 };
 
 /*
@@ -113,12 +130,18 @@ struct plane_buffer {
 	__u8 *start;
 	__u32 plane_size;
 	__u32 length;
+	__u32 bytesperline;
 	size_t offset;
 };
 
 struct testbuffer {
 	struct plane_buffer planes[NUM_PLANES];
 	__u32 nr_plane;
+
+	/* exported with VIDIOC_EXPBUF and imported as a DRM framebuffer */
+	int dmabuf_fd[NUM_PLANES];
+	__u32 gem_handle[NUM_PLANES];
+	__u32 fb_id;
 };
 
 struct video_channel {
@@ -132,6 +155,8 @@ struct video_channel {
 	__u32 mem_type;
 	__u32 cur_buf_id;
 	__u32 frame_num;
+	__u32 cur_sequence;
+	__u64 cur_timestamp;
 
 	__u32 out_width;
 	__u32 out_height;
@@ -143,9 +168,25 @@ struct video_channel {
 	__s32 x_offset;
 	__s32 y_offset;
 
-	struct testbuffer buffers[TEST_BUFFER_NUM];
+	struct testbuffer buffers[MAX_BUFFER_NUM];
 	__u32 nr_buffer;
 
+	/*
+	 * Buffers held for atomic presentation, -1 if none: the last one
+	 * dequeued and not committed yet, the one in a pending commit and
+	 * the one on screen.
+	 */
+	int pending_buf;
+	int flip_buf;
+	int shown_buf;
+	__u32 plane_id;
+	__u32 shown;
+	__u32 dropped;
+
+	/* asynchronous recording (-rec), cur_buf_id held by the recorder */
+	struct v4l2_recorder *rec;
+	bool buf_held;
+
 	struct timeval tv1;
 	struct timeval tv2;
 };
@@ -181,7 +222,13 @@ static uint32_t g_cap_oh;
 
 static bool g_saved_to_file;
 static bool g_performance_test;
+static bool g_dmabuf;
+static bool g_skip_soc_check;
 static bool quitflag;
+static int32_t g_comp_threads;
+static int32_t g_drm_card;
+static int32_t g_rec_depth;
+static int32_t g_rec_batch;
 
 static char g_v4l_device[NUM_SENSORS][100];
 static char g_saved_filename[NUM_SENSORS][100];
@@ -243,6 +290,12 @@ static void global_vars_init(void)
 	quitflag = false;
 	g_saved_to_file = false;
 	g_performance_test = false;
+	g_dmabuf = false;
+	g_skip_soc_check = false;
+	g_comp_threads = 0;
+	g_drm_card = 0;
+	g_rec_depth = 0;
+	g_rec_batch = 0;
 
 	g_cap_hfilp = false;
 	g_cap_vfilp = false;
@@ -275,6 +328,12 @@ static void print_help(const char *name)
 		   " -hflip <num> enable horizontal flip, num: 0->disable or 1->enable\n"
 		   " -vflip <num> enable vertical flip, num: 0->disable or 1->enable\n"
 		   " -alpha <num> enable and set global alpha for camera, num equal to 0~255\n"
+		   " -dmabuf display without copy: export the capture buffers and show each camera on its own overlay plane with atomic page flips\n"
+		   " -swcomp <threads> with -dmabuf, compose the cameras with threads instead of using overlay planes\n"
+		   " -card <num> use /dev/dri/card<num> or the first card after it with dumb buffers\n"
+		   " -nosoc skip the SoC check, e.g. to run against vivid and vkms\n"
+		   " -rec <depth> with -of, write from a thread per channel holding up to depth frames, and an index file\n"
+		   " -batch <KB> with -rec, gather pending frames into writes of up to KB\n"
 	       "example:\n"
 	       "./mx8_cap -cam 1        capture data from video0 and playback\n"
 	       "./mx8_cap -cam 3        capture data from video0/1 and playback\n"
@@ -282,7 +341,9 @@ static void print_help(const char *name)
 	       "./mx8_cap -cam 255 -of  capture data from video0~7 and save to 0~7.BX24\n"
 	       "./mx8_cap -cam 0xff -of capture data from video0~7 and save to 0~7.BX24\n"
 	       "./mx8_cap -cam 1 -fmt NV12 -of capture data from video0 and save to 0.NV12\n"
-	       "./mx8_cap -cam 1 -ow 1920 -oh 1080 -crop 0 0 640 480"
+	       "./mx8_cap -cam 1 -ow 1920 -oh 1080 -crop 0 0 640 480\n"
+	       "./mx8_cap -cam 15 -dmabuf  capture data from video0~3 and show them on four overlay planes\n"
+	       "./mx8_cap -cam 15 -of -rec 4 -batch 8192 record video0~3 from writer threads in 8MB writes\n"
 	       "./mx8_cap -cam 1 -of -p test video0 performace\n", name);
 }
 
@@ -446,11 +507,50 @@ static int parse_cmdline(int argc, const char *argv[])
 			g_crop_top  = atoi(argv[++i]);
 			g_crop_width = atoi(argv[++i]);
 			g_crop_height = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-dmabuf") == 0) {
+			g_dmabuf = true;
+		} else if (strcmp(argv[i], "-swcomp") == 0) {
+			g_comp_threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-card") == 0) {
+			g_drm_card = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-nosoc") == 0) {
+			g_skip_soc_check = true;
+		} else if (strcmp(argv[i], "-rec") == 0) {
+			g_rec_depth = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-batch") == 0) {
+			g_rec_batch = atoi(argv[++i]);
 		} else {
 			print_help(argv[0]);
 			return -1;
 		}
 	}
+
+	if (g_dmabuf) {
+		if (g_saved_to_file) {
+			v4l2_err("-dmabuf is a display mode, it can't be used with -of\n");
+			return -1;
+		}
+		g_num_buffers = DMABUF_BUFFER_NUM;
+	} else if (g_comp_threads) {
+		v4l2_err("-swcomp needs -dmabuf\n");
+		return -1;
+	}
+
+	if (g_rec_depth > 0) {
+		if (!g_saved_to_file || g_performance_test) {
+			v4l2_err("-rec needs -of and can't be used with -p\n");
+			return -1;
+		}
+		/* keep TEST_BUFFER_NUM buffers with the driver */
+		g_num_buffers = TEST_BUFFER_NUM + g_rec_depth;
+		if (g_num_buffers > MAX_BUFFER_NUM) {
+			g_num_buffers = MAX_BUFFER_NUM;
+			g_rec_depth = MAX_BUFFER_NUM - TEST_BUFFER_NUM;
+		}
+	} else if (g_rec_batch) {
+		v4l2_err("-batch needs -rec\n");
+		return -1;
+	}
 	return 0;
 }
 
@@ -603,7 +703,7 @@ static int open_drm_device(struct drm_device *drm)
 	uint64_t has_dumb;
 	int fd, i;
 
-	i = 0;
+	i = g_drm_card;
 loop:
 	sprintf(dev_name, "/dev/dri/card%d", i++);
 
@@ -739,6 +839,7 @@ static int modeset_find_crtc(struct drm_device *drm,
 				crtc_id = res->crtcs[j];
 				if (crtc_id > 0) {
 					drm->crtc_id = crtc_id;
+					drm->crtc_index = j;
 					drmModeFreeEncoder(encoder);
 					return 0;
 				}
@@ -890,6 +991,15 @@ static int drm_device_prepare(struct drm_device *drm)
 		return ret;
 	}
 
+	if (g_dmabuf) {
+		if (drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) < 0 ||
+		    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1) < 0) {
+			v4l2_err("DRM device doesn't support atomic modesetting\n");
+			drmDropMaster(drm_fd);
+			return -EOPNOTSUPP;
+		}
+	}
+
 	res = drmModeGetResources(drm_fd);
 	if (res == NULL) {
 		v4l2_err("Cannot retrieve DRM resources\n");
@@ -1063,10 +1173,12 @@ static void fill_video_channel(struct video_channel *video_ch,
 {
 	int i, j;
 
-	for (i = 0; i < TEST_BUFFER_NUM; i++) {
+	for (i = 0; i < g_num_buffers; i++) {
 		for (j = 0; j < g_num_planes; j++) {
 			video_ch->buffers[i].planes[j].plane_size =
 				      fmt->fmt.pix_mp.plane_fmt[j].sizeimage;
+			video_ch->buffers[i].planes[j].bytesperline =
+				      fmt->fmt.pix_mp.plane_fmt[j].bytesperline;
 		}
 	}
 	video_ch->on = 1;
@@ -1225,7 +1337,7 @@ static void get_memory_map_info(struct video_channel *video_ch)
 		return;
 	}
 
-	for (i = 0; i < TEST_BUFFER_NUM; i++) {
+	for (i = 0; i < g_num_buffers; i++) {
 		memset(&buf, 0, sizeof(buf));
 		memset(planes, 0, sizeof(*planes));
 
@@ -1265,7 +1377,7 @@ static void memory_map_info_put(struct video_channel *video_ch)
 {
 	int i, k;
 
-	for (i = 0; i < TEST_BUFFER_NUM; i++) {
+	for (i = 0; i < g_num_buffers; i++) {
 		for (k = 0; k < g_num_planes; k++) {
 			munmap(video_ch->buffers[i].planes[k].start,
 				   video_ch->buffers[i].planes[k].length);
@@ -1280,7 +1392,7 @@ static int v4l2_create_buffer(int ch_id, struct video_channel *video_ch)
 	int ret;
 
 	memset(&req, 0, sizeof(req));
-	req.count = TEST_BUFFER_NUM;
+	req.count = g_num_buffers;
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 	req.memory = video_ch[ch_id].mem_type;
 	ret = ioctl(fd, VIDIOC_REQBUFS, &req);
@@ -1289,7 +1401,7 @@ static int v4l2_create_buffer(int ch_id, struct video_channel *video_ch)
 		return ret;
 	}
 
-	if (req.count < TEST_BUFFER_NUM) {
+	if (req.count < g_num_buffers) {
 		v4l2_err("channel[%d] can't alloc enought buffers\n", ch_id);
 		return -ENOMEM;
 	}
@@ -1322,6 +1434,9 @@ static void v4l2_destroy_buffer(int ch_id, struct video_channel *video_ch)
 	v4l2_dbg("channel[%d] free v4l2 buffer success\n", ch_id);
 }
 
+static int drm_atomic_prepare(struct media_dev *media);
+static void drm_atomic_cleanup(struct media_dev *media);
+
 static void media_device_cleanup(struct media_dev *media)
 {
 	struct video_channel *video_ch = media->v4l2_dev->video_ch;
@@ -1329,6 +1444,8 @@ static void media_device_cleanup(struct media_dev *media)
 
 	if (!g_saved_to_file) {
 		fd = media->drm_dev->drm_fd;
+		if (g_dmabuf)
+			drm_atomic_cleanup(media);
 		drmDropMaster(fd);
 		drm_destroy_fb(fd, 0, &media->drm_dev->buffers[0]);
 		drm_destroy_fb(fd, 1, &media->drm_dev->buffers[1]);
@@ -1407,6 +1524,9 @@ static int dqueue_buffer(int buf_id, struct video_channel *video_ch)
 	}
 	video_ch->frame_num++;
 	video_ch->cur_buf_id = buf.index;
+	video_ch->cur_sequence = buf.sequence;
+	video_ch->cur_timestamp = buf.timestamp.tv_sec * 1000000ULL +
+				  buf.timestamp.tv_usec;
 
 	setbuf(stdout, NULL);
 	printf(" %c",
@@ -1448,7 +1568,7 @@ static int v4l2_device_prepare(struct v4l2_device *v4l2,
 				return ret;
 			}
 
-			for (j = 0; j < TEST_BUFFER_NUM; j++) {
+			for (j = 0; j < g_num_buffers; j++) {
 				ret = queue_buffer(j, &video_ch[i]);
 				if (ret < 0) {
 					while (i) {
@@ -1503,7 +1623,7 @@ static int media_device_prepare(struct media_dev *media)
 {
 	struct v4l2_device *v4l2 = media->v4l2_dev;
 	struct drm_device *drm = media->drm_dev;
-	int ret;
+	int i, ret;
 
 	if (!g_saved_to_file) {
 		ret = drm_device_prepare(drm);
@@ -1522,9 +1642,63 @@ static int media_device_prepare(struct media_dev *media)
 			return ret;
 		}
 	}
+
+	if (g_dmabuf) {
+		ret = drm_atomic_prepare(media);
+		if (ret < 0) {
+			for (i = 0; i < NUM_SENSORS; i++) {
+				if (v4l2->video_ch[i].on)
+					v4l2_destroy_buffer(i, v4l2->video_ch);
+			}
+			drm_destroy_fb(drm->drm_fd, 0, &drm->buffers[0]);
+			drm_destroy_fb(drm->drm_fd, 1, &drm->buffers[1]);
+			drmDropMaster(drm->drm_fd);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static void recorder_release(void *priv, int index)
+{
+	queue_buffer(index, priv);
+}
+
+static int open_recorders(struct video_channel *video_ch)
+{
+	char index_file[sizeof(video_ch->save_file_name) + 4];
+	int i;
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (!video_ch[i].on)
+			continue;
+		snprintf(index_file, sizeof(index_file), "%s.idx",
+			 video_ch[i].save_file_name);
+		video_ch[i].rec = recorder_open(video_ch[i].save_file_name,
+						video_ch[i].saved_file_fd, index_file,
+						g_rec_depth, (size_t)g_rec_batch * 1024,
+						recorder_release, &video_ch[i]);
+		if (!video_ch[i].rec) {
+			v4l2_err("channel[%d] open recorder fail\n", i);
+			return -1;
+		}
+	}
 	return 0;
 }
 
+/* write what is pending and give the buffers back before stream off */
+static void close_recorders(struct video_channel *video_ch)
+{
+	int i;
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (video_ch[i].rec) {
+			recorder_close(video_ch[i].rec);
+			video_ch[i].rec = NULL;
+		}
+	}
+}
+
 static int media_device_start(struct media_dev *media)
 {
 	struct v4l2_device *v4l2 = media->v4l2_dev;
@@ -1556,6 +1730,14 @@ static int media_device_start(struct media_dev *media)
 
 	}
 
+	if (g_rec_depth > 0) {
+		ret = open_recorders(video_ch);
+		if (ret < 0) {
+			close_recorders(video_ch);
+			return ret;
+		}
+	}
+
 	for (i = 0; i < NUM_SENSORS; i++) {
 		if (v4l2->video_ch[i].on) {
 			ret = v4l2_device_streamon(i, v4l2->video_ch);
@@ -1564,6 +1746,7 @@ static int media_device_start(struct media_dev *media)
 					if (v4l2->video_ch[i].on)
 						v4l2_device_streamoff(i, v4l2->video_ch);
 				}
+				close_recorders(video_ch);
 				return ret;
 			}
 		}
@@ -1576,6 +1759,8 @@ static int media_device_stop(struct media_dev *media)
 	struct v4l2_device *v4l2 = media->v4l2_dev;
 	int i, ret;
 
+	close_recorders(v4l2->video_ch);
+
 	for (i = 0; i < NUM_SENSORS; i++) {
 		if (v4l2->video_ch[i].on) {
 			ret = v4l2_device_streamoff(i, v4l2->video_ch);
@@ -1591,8 +1776,28 @@ static int save_to_file(int ch, struct video_channel *video_ch)
 {
 	int buf_id = video_ch[ch].cur_buf_id;
 	int fd = video_ch[ch].saved_file_fd;
+	void *planes[NUM_PLANES];
+	__u32 sizes[NUM_PLANES];
 	size_t wsize;
-	int i;
+	int i, ret;
+
+	if (video_ch[ch].rec) {
+		for (i = 0; i < g_num_planes; i++) {
+			planes[i] = video_ch[ch].buffers[buf_id].planes[i].start;
+			sizes[i] = video_ch[ch].buffers[buf_id].planes[i].plane_size;
+		}
+		ret = recorder_push(video_ch[ch].rec, buf_id, planes, sizes,
+				    g_num_planes, video_ch[ch].cur_timestamp,
+				    video_ch[ch].cur_sequence);
+		if (ret < 0) {
+			v4l2_err("channel[%d] recording fail. Stopping after %d frames.\n",
+					 ch, video_ch[ch].frame_num);
+			return -1;
+		}
+		/* dropped frames go straight back to the driver */
+		video_ch[ch].buf_held = (ret == 0);
+		return 0;
+	}
 
 	if (fd && !g_performance_test) {
 		/* Save capture frame to file */
@@ -1611,18 +1816,20 @@ static int save_to_file(int ch, struct video_channel *video_ch)
 	return 0;
 }
 
-static int display_on_screen(int ch, struct media_dev *media)
+/*
+ * Copy part (of nparts horizontal stripes) of frame buf_id of channel ch
+ * to its place in the DRM buffer
+ */
+static void copy_channel_rows(struct media_dev *media, int ch, int buf_id,
+			      struct drm_buffer *buf, int part, int nparts)
 {
 	struct video_channel *video_ch = media->v4l2_dev->video_ch;
 	struct drm_device *drm = media->drm_dev;
-	struct drm_buffer *buf = &drm->buffers[drm->front_buf^1];
-	int buf_id = video_ch[ch].cur_buf_id;
-	static int enter_count = 0;
 	int bufoffset;
 	int out_h, out_w, stride_v, stride_d;
 	int bytes_per_line;
 	int cor_offset_x, cor_offset_y;
-	int j, ret;
+	int j, first, last;
 
 	if (g_cam_num == 1) {
 		cor_offset_x = (buf->width >> 1) - (video_ch[ch].out_width >> 1);
@@ -1652,11 +1859,25 @@ static int display_on_screen(int ch, struct media_dev *media)
 	/* display screen stride value */
 	stride_d = out_w * drm->bytes_per_pixel;
 
-	for (j = 1; j < out_h; j++) {
+	first = 1 + (out_h - 1) * part / nparts;
+	last = 1 + (out_h - 1) * (part + 1) / nparts;
+
+	for (j = first; j < last; j++) {
 		memcpy(buf->fb_base + bufoffset + j * bytes_per_line,
 			   video_ch[ch].buffers[buf_id].planes[0].start + j * stride_v,
 			   stride_d);
 	}
+}
+
+static int display_on_screen(int ch, struct media_dev *media)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	struct drm_buffer *buf = &drm->buffers[drm->front_buf^1];
+	static int enter_count = 0;
+	int ret;
+
+	copy_channel_rows(media, ch, video_ch[ch].cur_buf_id, buf, 0, 1);
 
 	if (!(++enter_count % g_cam_num)) {
 		ret = drmModeSetCrtc(drm->drm_fd, drm->crtc_id, buf->buf_id, 0, 0,
@@ -1675,6 +1896,680 @@ static int display_on_screen(int ch, struct media_dev *media)
 	return 0;
 }
 
+/*
+ * Zero-copy presentation (-dmabuf)
+ *
+ * The capture buffers are exported with VIDIOC_EXPBUF and imported as DRM
+ * framebuffers. Each camera gets an overlay plane at its place in the
+ * mosaic, new frames are presented with non-blocking atomic commits, one
+ * in flight at a time, so flips follow vblank. A buffer is queued back to
+ * V4L2 once the flip that takes it off the screen has completed.
+ *
+ * Without enough overlay planes, or with -swcomp, worker threads compose
+ * the latest frame of every camera into the back dumb buffer and the
+ * primary plane is flipped the same way.
+ */
+struct compositor {
+	struct media_dev *media;
+	struct drm_buffer *target;
+
+	pthread_t *threads;
+	int nr_threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	__u32 generation;
+	int nr_done;
+	int nr_started;
+	bool exit;
+};
+
+static __u32 v4l2_to_drm_format(__u32 fourcc)
+{
+	switch (fourcc) {
+	case V4L2_PIX_FMT_XBGR32:
+		return DRM_FORMAT_XRGB8888;
+	case V4L2_PIX_FMT_ABGR32:
+		return DRM_FORMAT_ARGB8888;
+	case V4L2_PIX_FMT_XRGB32:
+		return DRM_FORMAT_BGRX8888;
+	case V4L2_PIX_FMT_ARGB32:
+		return DRM_FORMAT_BGRA8888;
+	case V4L2_PIX_FMT_RGB565:
+		return DRM_FORMAT_RGB565;
+	case V4L2_PIX_FMT_RGB24:
+		return DRM_FORMAT_BGR888;
+	case V4L2_PIX_FMT_BGR24:
+		return DRM_FORMAT_RGB888;
+	case V4L2_PIX_FMT_YUYV:
+		return DRM_FORMAT_YUYV;
+	case V4L2_PIX_FMT_NV12:
+		return DRM_FORMAT_NV12;
+	case V4L2_PIX_FMT_YUV444M:
+		return DRM_FORMAT_YUV444;
+	default:
+		return 0;
+	}
+}
+
+static int drm_get_prop(int fd, __u32 obj_id, __u32 obj_type,
+			const char *name, __u32 *id, uint64_t *value)
+{
+	drmModeObjectProperties *props;
+	drmModePropertyRes *prop;
+	int i, ret = -ENOENT;
+
+	props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+	if (!props)
+		return -errno;
+
+	for (i = 0; i < props->count_props && ret < 0; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, name)) {
+			if (id)
+				*id = prop->prop_id;
+			if (value)
+				*value = props->prop_values[i];
+			ret = 0;
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+	return ret;
+}
+
+/*
+ * Find the primary plane of our CRTC and give each camera an overlay
+ * plane which can scan out drm_fmt. Return the number of such planes.
+ */
+static int drm_find_planes(struct media_dev *media, __u32 drm_fmt)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	__u32 overlay[NUM_SENSORS];
+	drmModePlaneRes *res;
+	drmModePlane *plane;
+	uint64_t type;
+	int nr_overlay = 0;
+	int i, j;
+
+	res = drmModeGetPlaneResources(drm->drm_fd);
+	if (!res) {
+		v4l2_err("Cannot retrieve DRM planes\n");
+		return -errno;
+	}
+
+	for (i = 0; i < res->count_planes; i++) {
+		plane = drmModeGetPlane(drm->drm_fd, res->planes[i]);
+		if (!plane)
+			continue;
+
+		if (!(plane->possible_crtcs & (1 << drm->crtc_index)) ||
+		    drm_get_prop(drm->drm_fd, plane->plane_id, DRM_MODE_OBJECT_PLANE,
+				 "type", NULL, &type) < 0) {
+			drmModeFreePlane(plane);
+			continue;
+		}
+
+		if (type == DRM_PLANE_TYPE_PRIMARY && !drm->primary_plane) {
+			drm->primary_plane = plane->plane_id;
+		} else if (type == DRM_PLANE_TYPE_OVERLAY && nr_overlay < NUM_SENSORS) {
+			for (j = 0; j < plane->count_formats; j++)
+				if (plane->formats[j] == drm_fmt)
+					break;
+			if (j < plane->count_formats)
+				overlay[nr_overlay++] = plane->plane_id;
+		}
+		drmModeFreePlane(plane);
+	}
+	drmModeFreePlaneResources(res);
+
+	if (!drm->primary_plane) {
+		v4l2_err("no primary plane for crtc %d\n", drm->crtc_id);
+		return -ENOENT;
+	}
+	v4l2_dbg("primary plane %d, %d overlay planes for %.4s\n",
+			 drm->primary_plane, nr_overlay, (char *)&drm_fmt);
+
+	if (nr_overlay < g_cam_num)
+		return nr_overlay;
+
+	for (i = 0, j = 0; i < NUM_SENSORS; i++) {
+		if (video_ch[i].on)
+			video_ch[i].plane_id = overlay[j++];
+	}
+	return nr_overlay;
+}
+
+static void drm_release_buffer(struct drm_device *drm, struct testbuffer *buf)
+{
+	struct drm_gem_close gem_close;
+	int j;
+
+	if (buf->fb_id)
+		drmModeRmFB(drm->drm_fd, buf->fb_id);
+	buf->fb_id = 0;
+
+	for (j = 0; j < NUM_PLANES; j++) {
+		if (buf->gem_handle[j]) {
+			memset(&gem_close, 0, sizeof(gem_close));
+			gem_close.handle = buf->gem_handle[j];
+			drmIoctl(drm->drm_fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+			buf->gem_handle[j] = 0;
+		}
+		if (buf->dmabuf_fd[j] >= 0)
+			close(buf->dmabuf_fd[j]);
+		buf->dmabuf_fd[j] = -1;
+	}
+}
+
+static int drm_import_buffer(struct drm_device *drm, int ch, int index,
+			     struct video_channel *video_ch, __u32 drm_fmt)
+{
+	struct testbuffer *buf = &video_ch->buffers[index];
+	struct v4l2_exportbuffer expbuf;
+	__u32 handles[4] = { 0 };
+	__u32 pitches[4] = { 0 };
+	__u32 offsets[4] = { 0 };
+	int j, ret;
+
+	for (j = 0; j < g_num_planes; j++) {
+		memset(&expbuf, 0, sizeof(expbuf));
+		expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		expbuf.index = index;
+		expbuf.plane = j;
+		expbuf.flags = O_CLOEXEC | O_RDONLY;
+		ret = ioctl(video_ch->v4l_fd, VIDIOC_EXPBUF, &expbuf);
+		if (ret < 0) {
+			v4l2_err("channel[%d] buffer[%d] plane[%d] VIDIOC_EXPBUF fail\n",
+					 ch, index, j);
+			return -errno;
+		}
+		buf->dmabuf_fd[j] = expbuf.fd;
+
+		ret = drmPrimeFDToHandle(drm->drm_fd, expbuf.fd, &buf->gem_handle[j]);
+		if (ret < 0) {
+			v4l2_err("channel[%d] buffer[%d] plane[%d] dmabuf import fail\n",
+					 ch, index, j);
+			return ret;
+		}
+		handles[j] = buf->gem_handle[j];
+		pitches[j] = buf->planes[j].bytesperline;
+	}
+
+	/* NV12 in one memory plane: chroma follows luma */
+	if (drm_fmt == DRM_FORMAT_NV12 && g_num_planes == 1) {
+		handles[1] = handles[0];
+		pitches[1] = pitches[0];
+		offsets[1] = pitches[0] * video_ch->out_height;
+	}
+
+	ret = drmModeAddFB2(drm->drm_fd, video_ch->out_width, video_ch->out_height,
+			    drm_fmt, handles, pitches, offsets, &buf->fb_id, 0);
+	if (ret < 0) {
+		v4l2_err("channel[%d] buffer[%d] add framebuffer fail\n", ch, index);
+		buf->fb_id = 0;
+		return ret;
+	}
+	v4l2_dbg("channel[%d] buffer[%d] dmabuf fd=%d fb_id=%d\n",
+			 ch, index, buf->dmabuf_fd[0], buf->fb_id);
+	return 0;
+}
+
+static void drm_release_buffers(struct media_dev *media)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	int i, j;
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (!video_ch[i].on)
+			continue;
+		for (j = 0; j < g_num_buffers; j++)
+			drm_release_buffer(media->drm_dev, &video_ch[i].buffers[j]);
+	}
+}
+
+static void *compositor_thread(void *arg)
+{
+	struct compositor *comp = arg;
+	struct video_channel *video_ch = comp->media->v4l2_dev->video_ch;
+	__u32 generation = 0;
+	int part, i;
+
+	pthread_mutex_lock(&comp->lock);
+	part = comp->nr_started++;
+	while (1) {
+		while (comp->generation == generation && !comp->exit)
+			pthread_cond_wait(&comp->start, &comp->lock);
+		if (comp->exit)
+			break;
+		generation = comp->generation;
+		pthread_mutex_unlock(&comp->lock);
+
+		for (i = 0; i < NUM_SENSORS; i++) {
+			if (video_ch[i].on && video_ch[i].shown_buf >= 0)
+				copy_channel_rows(comp->media, i, video_ch[i].shown_buf,
+						  comp->target, part, comp->nr_threads);
+		}
+
+		pthread_mutex_lock(&comp->lock);
+		if (++comp->nr_done == comp->nr_threads)
+			pthread_cond_signal(&comp->done);
+	}
+	pthread_mutex_unlock(&comp->lock);
+	return NULL;
+}
+
+/* compose the frame on screen of every channel into target */
+static void compositor_run(struct compositor *comp, struct drm_buffer *target)
+{
+	pthread_mutex_lock(&comp->lock);
+	comp->target = target;
+	comp->nr_done = 0;
+	comp->generation++;
+	pthread_cond_broadcast(&comp->start);
+	while (comp->nr_done < comp->nr_threads)
+		pthread_cond_wait(&comp->done, &comp->lock);
+	pthread_mutex_unlock(&comp->lock);
+}
+
+static void compositor_stop(struct compositor *comp)
+{
+	int i;
+
+	pthread_mutex_lock(&comp->lock);
+	comp->exit = true;
+	pthread_cond_broadcast(&comp->start);
+	pthread_mutex_unlock(&comp->lock);
+
+	for (i = 0; i < comp->nr_threads; i++)
+		pthread_join(comp->threads[i], NULL);
+
+	pthread_cond_destroy(&comp->done);
+	pthread_cond_destroy(&comp->start);
+	pthread_mutex_destroy(&comp->lock);
+	free(comp->threads);
+	free(comp);
+}
+
+static struct compositor *compositor_start(struct media_dev *media, int threads)
+{
+	struct compositor *comp;
+	int i;
+
+	comp = calloc(1, sizeof(*comp));
+	if (!comp)
+		return NULL;
+	comp->threads = calloc(threads, sizeof(*comp->threads));
+	if (!comp->threads) {
+		free(comp);
+		return NULL;
+	}
+	comp->media = media;
+	pthread_mutex_init(&comp->lock, NULL);
+	pthread_cond_init(&comp->start, NULL);
+	pthread_cond_init(&comp->done, NULL);
+
+	/* stripes are split over the threads actually started */
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&comp->threads[i], NULL, compositor_thread, comp))
+			break;
+		comp->nr_threads++;
+	}
+	if (!comp->nr_threads) {
+		compositor_stop(comp);
+		return NULL;
+	}
+	return comp;
+}
+
+static int drm_atomic_prepare(struct media_dev *media)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	static const char * const src_props[4] = {
+		"SRC_X", "SRC_Y", "SRC_W", "SRC_H"
+	};
+	static const char * const crtc_props[4] = {
+		"CRTC_X", "CRTC_Y", "CRTC_W", "CRTC_H"
+	};
+	__u32 drm_fmt = 0;
+	int i, j, k, nr_overlay, threads, ret;
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (!video_ch[i].on)
+			continue;
+		drm_fmt = v4l2_to_drm_format(video_ch[i].cap_fmt);
+		video_ch[i].pending_buf = -1;
+		video_ch[i].flip_buf = -1;
+		video_ch[i].shown_buf = -1;
+		for (j = 0; j < g_num_buffers; j++)
+			for (k = 0; k < NUM_PLANES; k++)
+				video_ch[i].buffers[j].dmabuf_fd[k] = -1;
+	}
+
+	nr_overlay = drm_find_planes(media, drm_fmt);
+	if (nr_overlay < 0)
+		return nr_overlay;
+
+	ret = drm_get_prop(drm->drm_fd, drm->primary_plane, DRM_MODE_OBJECT_PLANE,
+			   "FB_ID", &drm->prop_fb_id, NULL);
+	ret |= drm_get_prop(drm->drm_fd, drm->primary_plane, DRM_MODE_OBJECT_PLANE,
+			    "CRTC_ID", &drm->prop_crtc_id, NULL);
+	for (i = 0; i < 4; i++) {
+		ret |= drm_get_prop(drm->drm_fd, drm->primary_plane,
+				    DRM_MODE_OBJECT_PLANE, src_props[i],
+				    &drm->prop_src[i], NULL);
+		ret |= drm_get_prop(drm->drm_fd, drm->primary_plane,
+				    DRM_MODE_OBJECT_PLANE, crtc_props[i],
+				    &drm->prop_crtc[i], NULL);
+	}
+	if (ret) {
+		v4l2_err("Cannot retrieve DRM plane properties\n");
+		return -ENOENT;
+	}
+
+	if (!g_comp_threads && drm_fmt && nr_overlay >= g_cam_num) {
+		for (i = 0; i < NUM_SENSORS; i++) {
+			if (!video_ch[i].on)
+				continue;
+			for (j = 0; j < g_num_buffers; j++) {
+				ret = drm_import_buffer(drm, i, j, &video_ch[i], drm_fmt);
+				if (ret < 0) {
+					drm_release_buffers(media);
+					return ret;
+				}
+			}
+			v4l2_info("channel[%d] on overlay plane %d\n",
+					  i, video_ch[i].plane_id);
+		}
+		return 0;
+	}
+
+	if (!g_comp_threads)
+		v4l2_info("%d overlay planes for %d cameras, using the software compositor\n",
+				  nr_overlay, g_cam_num);
+
+	threads = g_comp_threads;
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads <= 0)
+		threads = 1;
+
+	drm->comp = compositor_start(media, threads);
+	if (!drm->comp) {
+		v4l2_err("start compositor threads fail\n");
+		return -ENOMEM;
+	}
+	v4l2_info("software compositor with %d threads\n", drm->comp->nr_threads);
+	return 0;
+}
+
+static void drm_atomic_cleanup(struct media_dev *media)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	drmModeAtomicReq *req;
+	int i;
+
+	if (drm->comp) {
+		compositor_stop(drm->comp);
+		drm->comp = NULL;
+		return;
+	}
+
+	/* take the cameras off the screen before their buffers go away */
+	req = drmModeAtomicAlloc();
+	if (req) {
+		for (i = 0; i < NUM_SENSORS; i++) {
+			if (!video_ch[i].on)
+				continue;
+			drmModeAtomicAddProperty(req, video_ch[i].plane_id,
+						 drm->prop_fb_id, 0);
+			drmModeAtomicAddProperty(req, video_ch[i].plane_id,
+						 drm->prop_crtc_id, 0);
+		}
+		if (drmModeAtomicCommit(drm->drm_fd, req, 0, NULL) < 0)
+			v4l2_err("disable overlay planes fail\n");
+		drmModeAtomicFree(req);
+	}
+	drm_release_buffers(media);
+}
+
+/* where channel ch shows on a screen of the size of buf */
+static void channel_display_rect(struct video_channel *video_ch,
+				 struct drm_buffer *buf, __u32 *rect)
+{
+	int x = video_ch->x_offset;
+	int y = video_ch->y_offset;
+
+	if (g_cam_num == 1) {
+		x = (buf->width >> 1) - (video_ch->out_width >> 1);
+		y = (buf->height >> 1) - (video_ch->out_height >> 1);
+		x = (x < 0) ? 0 : x;
+		y = (y < 0) ? 0 : y;
+	}
+
+	rect[0] = x;
+	rect[1] = y;
+	rect[2] = (video_ch->out_width > buf->width - x) ?
+				buf->width - x : video_ch->out_width;
+	rect[3] = (video_ch->out_height > buf->height - y) ?
+				buf->height - y : video_ch->out_height;
+}
+
+static int drm_atomic_commit(struct media_dev *media, drmModeAtomicReq *req)
+{
+	struct drm_device *drm = media->drm_dev;
+	int ret;
+
+	ret = drmModeAtomicCommit(drm->drm_fd, req,
+				  DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT,
+				  media);
+	/* previous commit still busy, the frame waits for the next one */
+	if (ret == -EBUSY)
+		return 0;
+	if (ret < 0) {
+		v4l2_err("atomic commit fail (%d)\n", ret);
+		return ret;
+	}
+	drm->flip_pending = true;
+	return 1;
+}
+
+/*
+ * Present the frames dequeued since the last commit, if the previous one
+ * has been flipped
+ */
+static int drm_atomic_present(struct media_dev *media)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	struct drm_buffer *screen = &drm->buffers[0];
+	struct drm_buffer *back;
+	drmModeAtomicReq *req;
+	__u32 rect[4];
+	int i, j, nr = 0, ret;
+
+	if (drm->flip_pending)
+		return 0;
+
+	for (i = 0; i < NUM_SENSORS; i++)
+		if (video_ch[i].on && video_ch[i].pending_buf >= 0)
+			nr++;
+	if (!nr)
+		return 0;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	if (drm->comp) {
+		/* frames are copied, so the replaced ones can be queued again */
+		for (i = 0; i < NUM_SENSORS; i++) {
+			if (!video_ch[i].on || video_ch[i].pending_buf < 0)
+				continue;
+			if (video_ch[i].shown_buf >= 0)
+				queue_buffer(video_ch[i].shown_buf, &video_ch[i]);
+			video_ch[i].shown_buf = video_ch[i].pending_buf;
+			video_ch[i].pending_buf = -1;
+			video_ch[i].shown++;
+		}
+		back = &drm->buffers[drm->front_buf ^ 1];
+		compositor_run(drm->comp, back);
+		drmModeAtomicAddProperty(req, drm->primary_plane, drm->prop_fb_id,
+					 back->buf_id);
+		ret = drm_atomic_commit(media, req);
+		drmModeAtomicFree(req);
+		return ret;
+	}
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (!video_ch[i].on || video_ch[i].pending_buf < 0)
+			continue;
+		channel_display_rect(&video_ch[i], screen, rect);
+		drmModeAtomicAddProperty(req, video_ch[i].plane_id, drm->prop_fb_id,
+					 video_ch[i].buffers[video_ch[i].pending_buf].fb_id);
+		drmModeAtomicAddProperty(req, video_ch[i].plane_id,
+					 drm->prop_crtc_id, drm->crtc_id);
+		for (j = 0; j < 4; j++) {
+			drmModeAtomicAddProperty(req, video_ch[i].plane_id,
+						 drm->prop_crtc[j], rect[j]);
+			/* source rectangle is 16.16 fixed point */
+			drmModeAtomicAddProperty(req, video_ch[i].plane_id,
+						 drm->prop_src[j],
+						 (uint64_t)(j < 2 ? 0 : rect[j]) << 16);
+		}
+	}
+
+	ret = drm_atomic_commit(media, req);
+	drmModeAtomicFree(req);
+	if (ret <= 0)
+		return ret;
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (!video_ch[i].on || video_ch[i].pending_buf < 0)
+			continue;
+		video_ch[i].flip_buf = video_ch[i].pending_buf;
+		video_ch[i].pending_buf = -1;
+	}
+	return ret;
+}
+
+static void page_flip_handler(int fd, unsigned int frame, unsigned int sec,
+			      unsigned int usec, void *data)
+{
+	struct media_dev *media = data;
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	int i;
+
+	drm->flip_pending = false;
+	drm->flips++;
+
+	if (drm->comp) {
+		drm->front_buf ^= 1;
+		return;
+	}
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (!video_ch[i].on || video_ch[i].flip_buf < 0)
+			continue;
+		if (video_ch[i].shown_buf >= 0)
+			queue_buffer(video_ch[i].shown_buf, &video_ch[i]);
+		video_ch[i].shown_buf = video_ch[i].flip_buf;
+		video_ch[i].flip_buf = -1;
+		video_ch[i].shown++;
+	}
+}
+
+static int redraw_atomic(struct media_dev *media)
+{
+	struct video_channel *video_ch = media->v4l2_dev->video_ch;
+	struct drm_device *drm = media->drm_dev;
+	struct pollfd fds[NUM_SENSORS + 1];
+	int chs[NUM_SENSORS + 1];
+	drmEventContext evctx;
+	__u32 frames;
+	int i, n, ret;
+
+	memset(&evctx, 0, sizeof(evctx));
+	evctx.version = 2;
+	evctx.page_flip_handler = page_flip_handler;
+
+	fds[0].fd = drm->drm_fd;
+	fds[0].events = POLLIN;
+	n = 1;
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if (video_ch[i].on) {
+			fds[n].fd = video_ch[i].v4l_fd;
+			fds[n].events = POLLIN;
+			chs[n++] = i;
+			gettimeofday(&video_ch[i].tv1, NULL);
+		}
+	}
+
+	media->total_frames_cnt = 0;
+	while (media->total_frames_cnt < g_num_frames && !quitflag) {
+		ret = poll(fds, n, 1000);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			v4l2_err("poll fail\n");
+			return -1;
+		} else if (ret == 0) {
+			v4l2_warn("no frame or flip for 1s\n");
+			continue;
+		}
+
+		if (fds[0].revents & POLLIN)
+			drmHandleEvent(drm->drm_fd, &evctx);
+
+		for (i = 1; i < n; i++) {
+			struct video_channel *ch = &video_ch[chs[i]];
+
+			if (!(fds[i].revents & POLLIN))
+				continue;
+			ret = dqueue_buffer(chs[i], ch);
+			if (ret < 0)
+				return -1;
+			/* newer frame before the last one got on screen */
+			if (ch->pending_buf >= 0) {
+				queue_buffer(ch->pending_buf, ch);
+				ch->dropped++;
+			}
+			ch->pending_buf = ch->cur_buf_id;
+		}
+
+		ret = drm_atomic_present(media);
+		if (ret < 0)
+			return -1;
+
+		frames = g_num_frames;
+		for (i = 1; i < n; i++)
+			if (video_ch[chs[i]].frame_num < frames)
+				frames = video_ch[chs[i]].frame_num;
+		media->total_frames_cnt = frames;
+	}
+
+	/* let the last flip land before the planes are taken down */
+	while (drm->flip_pending && poll(fds, 1, 100) > 0)
+		drmHandleEvent(drm->drm_fd, &evctx);
+
+	for (i = 1; i < n; i++) {
+		struct video_channel *ch = &video_ch[chs[i]];
+
+		gettimeofday(&ch->tv2, NULL);
+		v4l2_info("channel[%d] captured=%d shown=%d dropped=%d\n",
+				  chs[i], ch->frame_num, ch->shown, ch->dropped);
+	}
+	v4l2_info("%d atomic flips\n", drm->flips);
+	return 0;
+}
+
 static void show_performance_test(struct media_dev *media)
 {
 	struct video_channel *video_ch = media->v4l2_dev->video_ch;
@@ -1736,8 +2631,9 @@ static int redraw(struct media_dev *media)
 
 		/* QBUF */
 		for (i = 0; i < NUM_SENSORS; i++) {
-			if (video_ch[i].on)
+			if (video_ch[i].on && !video_ch[i].buf_held)
 				queue_buffer(video_ch[i].cur_buf_id, &video_ch[i]);
+			video_ch[i].buf_held = false;
 		}
 	} while(++media->total_frames_cnt < g_num_frames && !quitflag);
 
@@ -1781,12 +2677,6 @@ int main(int argc, const char *argv[])
 	char *soc_list[] = { "i.MX8QM", "i.MX8QXP", "i.MX8MN", "i.MX8MP", "i.MX8ULP", "i.MX93"};
 	int ret;
 
-	ret = soc_version_check(soc_list);
-	if (ret == 0) {
-		v4l2_err("not supported on current soc\n");
-		return 0;
-	}
-
 	global_vars_init();
 
 	pthread_t sigtid;
@@ -1801,6 +2691,11 @@ int main(int argc, const char *argv[])
 		return ret;
 	}
 
+	if (!g_skip_soc_check && soc_version_check(soc_list) == 0) {
+		v4l2_err("not supported on current soc\n");
+		return 0;
+	}
+
 	ret = media_device_alloc(&media);
 	if (ret < 0) {
 		v4l2_err("No enough memory\n");
@@ -1819,7 +2714,10 @@ int main(int argc, const char *argv[])
 	if (ret < 0)
 		goto cleanup;
 
-	ret = redraw(&media);
+	if (g_dmabuf)
+		ret = redraw_atomic(&media);
+	else
+		ret = redraw(&media);
 	if (ret < 0)
 		goto stop;
 
@@ -29,6 +29,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
 #include <linux/v4l2-common.h>
 #include <linux/v4l2-controls.h>
 #include <linux/v4l2-dv-timings.h>
@@ -58,6 +62,7 @@ do {                                      \
 
 #define TEST_BUFFER_NUM_IN		1
 #define TEST_BUFFER_NUM_OUT		3
+#define MAX_BUFFER_NUM			32
 
 #define TEST_WIDTH		640
 #define TEST_HEIGHT		480
@@ -87,11 +92,19 @@ struct mxc_m2m_device {
 	FILE *in_file;
 	FILE *out_file;
 
+	/* vim2m and other single-planar m2m drivers use the non-MPLANE API */
+	bool mplane;
+	bool virtual_dev;
+	__u32 in_type;
+	__u32 out_type;
+
 	struct rect src;
 	struct rect dst;
 
 	int in_num_planes;
 	int o_num_planes;
+	__u32 in_plane_size[3];
+	__u32 o_plane_size[3];
 
 	int in_frame_num;
 	int out_frame_num;
@@ -100,9 +113,13 @@ struct mxc_m2m_device {
 	int out_cur_buf_id;
 
 	int frames;
+	/* input frames handed to the OUTPUT queue so far, streaming mode */
+	int in_filled;
 
-	struct mxc_buffer in_buffers[TEST_BUFFER_NUM_IN];
-	struct mxc_buffer out_buffers[TEST_BUFFER_NUM_OUT];
+	int in_buf_num;
+	int out_buf_num;
+	struct mxc_buffer in_buffers[MAX_BUFFER_NUM];
+	struct mxc_buffer out_buffers[MAX_BUFFER_NUM];
 };
 
 static sigset_t sigset_v;
@@ -128,6 +145,8 @@ static int32_t g_crop_left = 0;
 static int32_t g_crop_top = 0;
 static int32_t g_crop_width = TEST_WIDTH;
 static int32_t g_crop_height = TEST_HEIGHT;
+static bool g_alpha_set = false;
+static int g_stream_depth = 0;
 
 /*
  *
@@ -175,11 +194,16 @@ static void print_usage(char *name)
 		   " -vflip <num> enable vertical flip, num: 0->disable or 1->enable\n"
 		   " -alpha <num> enable and set global alpha for camera, num equal to 0~255\n"
 		   " -crop <left top width height> left: left corner coordinates, top: Upper corner coordinates, width: crop width, height: crop height\n"
+		   " -p: performance test, no file read/write while converting\n"
+		   " -stream <depth>: keep <depth> buffers in flight on each queue, with\n"
+		   "                  file read/write in separate threads. Prints fps and\n"
+		   "                  per-frame latency from the buffer timestamps\n"
 		   "examples:\n"
 		   "\t %s\n"
 		   "\t %s -i 0.rgb32 -iw 1280 -ih 800 -ifmt \"XR24\" "
-		   "-o out.dat -ow 1280 -oh 800 -ofmt \"NV12\"\n",
-		   name, name, name, name, name);
+		   "-o out.dat -ow 1280 -oh 800 -ofmt \"NV12\"\n"
+		   "\t %s -d /dev/video0 -i 0.yuyv -ifmt YUYV -ofmt RGBP -stream 4 (vim2m)\n",
+		   name, name, name, name, name, name);
 }
 
 static __u32 to_fourcc(char fmt[])
@@ -215,8 +239,9 @@ static __u32 to_fourcc(char fmt[])
 	return fourcc;
 }
 
-static void show_device_cap_list(int fd_v4l)
+static void show_device_cap_list(struct mxc_m2m_device *m2m_dev)
 {
+	int fd_v4l = m2m_dev->fd;
 	struct v4l2_fmtdesc fmtdesc;
 	struct v4l2_frmivalenum frmival;
 	struct v4l2_frmsizeenum frmsize;
@@ -225,7 +250,7 @@ static void show_device_cap_list(int fd_v4l)
 
 	/* Show capture device */
 	fmtdesc.index = 0;
-	fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	fmtdesc.type = m2m_dev->out_type;
 	while (ioctl(fd_v4l, VIDIOC_ENUM_FMT, &fmtdesc) >= 0) {
 		v4l2_info("support output pixelformat %.4s\n",
 					(char *)&fmtdesc.pixelformat);
@@ -257,7 +282,7 @@ static void show_device_cap_list(int fd_v4l)
 
 	/* Show out device */
 	fmtdesc.index = 0;
-	fmtdesc.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	fmtdesc.type = m2m_dev->in_type;
 	while (ioctl(fd_v4l, VIDIOC_ENUM_FMT, &fmtdesc) >= 0) {
 		v4l2_info("support input pixelformat %.4s\n",
 					(char *)&fmtdesc.pixelformat);
@@ -322,8 +347,15 @@ static int parse_cmdline(int argc, char *argv[])
 			g_cap_vfilp = atoi(argv[++i]);
 		} else if (strcmp(argv[i], "-alpha") == 0) {
 			g_cap_alpha = atoi(argv[++i]);
+			g_alpha_set = true;
 		} else if (strcmp(argv[i], "-p") == 0) {
 			g_performance_test = true;
+		} else if (strcmp(argv[i], "-stream") == 0) {
+			g_stream_depth = atoi(argv[++i]);
+			if (g_stream_depth < 1 || g_stream_depth > MAX_BUFFER_NUM) {
+				v4l2_err("stream depth should be 1 ~ %d\n", MAX_BUFFER_NUM);
+				return -1;
+			}
 		} else if (strcmp(argv[i], "-crop") == 0) {
 			g_crop_en = true;
 			g_crop_left = atoi(argv[++i]);
@@ -403,11 +435,24 @@ static int check_device_cap(struct mxc_m2m_device *m2m_dev)
 		return -1;
 	}
 
-	if (!(capabilities.capabilities & V4L2_CAP_VIDEO_M2M_MPLANE)) {
+	if (capabilities.capabilities & V4L2_CAP_VIDEO_M2M_MPLANE) {
+		m2m_dev->mplane = true;
+		m2m_dev->in_type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+		m2m_dev->out_type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	} else if (capabilities.capabilities & V4L2_CAP_VIDEO_M2M) {
+		m2m_dev->mplane = false;
+		m2m_dev->in_type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		m2m_dev->out_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	} else {
 		v4l2_err("The device does not handle memory to memory video capture.\n");
 		return -1;
 	}
 
+	/* The virtual m2m driver lets the test run without ISI/PXP hardware */
+	m2m_dev->virtual_dev = !strcmp((char *)capabilities.driver, "vim2m");
+	v4l2_info("driver %s, %s-planar\n", capabilities.driver,
+		  m2m_dev->mplane ? "multi" : "single");
+
 	return 0;
 }
 
@@ -442,7 +487,8 @@ static int mxc_m2m_open(struct mxc_m2m_device *m2m_dev)
 	int fd;
 	FILE *in, *out;
 
-	fd = open(dev_name, O_RDWR, 0);
+	/* The streaming event loop waits in poll(), never in VIDIOC_DQBUF */
+	fd = open(dev_name, O_RDWR | (g_stream_depth ? O_NONBLOCK : 0), 0);
 	if (fd < 0) {
 		v4l2_err("Open %s fail\n", dev_name);
 		return -1;
@@ -494,7 +540,7 @@ static int fill_in_buffer(int buf_id, struct mxc_m2m_device *m2m_dev)
 
 	for (j = 0; j < m2m_dev->in_num_planes; j++) {
 		rsize = fread(m2m_dev->in_buffers[buf_id].planes[j].start,
-					m2m_dev->in_buffers[buf_id].planes[j].length,
+					m2m_dev->in_buffers[buf_id].planes[j].plane_size,
 					1, m2m_dev->in_file);
 		if (rsize < 1) {
 			v4l2_err("No more data read from input file\n");
@@ -504,15 +550,14 @@ static int fill_in_buffer(int buf_id, struct mxc_m2m_device *m2m_dev)
 	return 0;
 }
 
-static int save_to_file(struct mxc_m2m_device *m2m_dev)
+static int save_to_file(int buf_id, struct mxc_m2m_device *m2m_dev)
 {
 	size_t wsize;
-	int buf_id = m2m_dev->out_cur_buf_id;
 	int j;
 
 	for (j = 0; j < m2m_dev->o_num_planes; j++) {
 		wsize = fwrite(m2m_dev->out_buffers[buf_id].planes[j].start,
-					   m2m_dev->out_buffers[buf_id].planes[j].length,
+					   m2m_dev->out_buffers[buf_id].planes[j].plane_size,
 					   1, m2m_dev->out_file);
 		if (wsize < 1) {
 			v4l2_err("No more device space for output file\n");
@@ -522,75 +567,93 @@ static int save_to_file(struct mxc_m2m_device *m2m_dev)
 	return 0;
 }
 
+static int set_format(struct mxc_m2m_device *m2m_dev, __u32 type,
+		      char format[], struct rect *r)
+{
+	struct v4l2_format fmt;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = type;
+	if (m2m_dev->mplane) {
+		fmt.fmt.pix_mp.pixelformat = to_fourcc(format);
+		fmt.fmt.pix_mp.width = r->width;
+		fmt.fmt.pix_mp.height = r->height;
+	} else {
+		fmt.fmt.pix.pixelformat = to_fourcc(format);
+		fmt.fmt.pix.width = r->width;
+		fmt.fmt.pix.height = r->height;
+	}
+	return ioctl(m2m_dev->fd, VIDIOC_S_FMT, &fmt);
+}
+
+/* Returns the number of planes, and their sizes in plane_size */
+static int get_format(struct mxc_m2m_device *m2m_dev, __u32 type,
+		      __u32 plane_size[], const char *name)
+{
+	struct v4l2_format fmt;
+	int i, ret;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = type;
+	ret = ioctl(m2m_dev->fd, VIDIOC_G_FMT, &fmt);
+	if (ret < 0)
+		return ret;
+
+	if (!m2m_dev->mplane) {
+		v4l2_info("%s: w/h=(%d,%d) pixelformat=%.4s bytesperline=%d sizeimage=%d\n",
+			  name, fmt.fmt.pix.width, fmt.fmt.pix.height,
+			  (char *)&fmt.fmt.pix.pixelformat,
+			  fmt.fmt.pix.bytesperline, fmt.fmt.pix.sizeimage);
+		plane_size[0] = fmt.fmt.pix.sizeimage;
+		return 1;
+	}
+
+	v4l2_info("%s: w/h=(%d,%d) pixelformat=%.4s num_planes=%d\n", name,
+			  fmt.fmt.pix_mp.width,
+			  fmt.fmt.pix_mp.height,
+			  (char *)&fmt.fmt.pix_mp.pixelformat,
+			  fmt.fmt.pix_mp.num_planes);
+	for (i = 0; i < fmt.fmt.pix_mp.num_planes && i < 3; i++) {
+		v4l2_info("\t plane[%d]: bytesperline=%d sizeimage=%d\n", i,
+			  fmt.fmt.pix_mp.plane_fmt[i].bytesperline,
+			  fmt.fmt.pix_mp.plane_fmt[i].sizeimage);
+		plane_size[i] = fmt.fmt.pix_mp.plane_fmt[i].sizeimage;
+	}
+	return i;
+}
+
 static int mxc_m2m_prepare(struct mxc_m2m_device *m2m_dev)
 {
-	struct v4l2_format in_fmt;
-	struct v4l2_format out_fmt;
 	struct v4l2_control ctrl;
 	struct v4l2_selection sel;
-	int i, fd = m2m_dev->fd;
+	int fd = m2m_dev->fd;
 	int ret;
 
-	memset(&in_fmt, 0, sizeof(in_fmt));
-	in_fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-	in_fmt.fmt.pix_mp.pixelformat = to_fourcc(in_format);
-	in_fmt.fmt.pix_mp.width = m2m_dev->src.width;
-	in_fmt.fmt.pix_mp.height = m2m_dev->src.height;
-	ret = ioctl(fd, VIDIOC_S_FMT, &in_fmt);
+	ret = set_format(m2m_dev, m2m_dev->in_type, in_format, &m2m_dev->src);
 	if (ret < 0) {
 		v4l2_err("in VIDIOC_S_FMT fail\n");
 		return ret;
 	}
 
-	memset(&out_fmt, 0, sizeof(out_fmt));
-	out_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-	out_fmt.fmt.pix_mp.pixelformat = to_fourcc(out_format);
-	out_fmt.fmt.pix_mp.width = m2m_dev->dst.width;
-	out_fmt.fmt.pix_mp.height = m2m_dev->dst.height;
-	ret = ioctl(fd, VIDIOC_S_FMT, &out_fmt);
+	ret = set_format(m2m_dev, m2m_dev->out_type, out_format, &m2m_dev->dst);
 	if (ret < 0) {
 		v4l2_err("out VIDIOC_S_FMT fail\n");
 		return ret;
 	}
 
-	/* IN G_FMT */
-	memset(&in_fmt, 0, sizeof(in_fmt));
-	in_fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-	ret = ioctl(fd, VIDIOC_G_FMT, &in_fmt);
+	ret = get_format(m2m_dev, m2m_dev->in_type, m2m_dev->in_plane_size, "in");
 	if (ret < 0) {
 		v4l2_err("in VIDIOC_G_FMT fail\n");
 		return ret;
 	}
-	v4l2_info("in: w/h=(%d,%d) pixelformat=%.4s num_planes=%d\n",
-			  in_fmt.fmt.pix_mp.width,
-			  in_fmt.fmt.pix_mp.height,
-			  (char *)&in_fmt.fmt.pix_mp.pixelformat,
-			  in_fmt.fmt.pix_mp.num_planes);
-	for (i = 0; i < in_fmt.fmt.pix_mp.num_planes; i++) {
-		v4l2_info("\t plane[%d]: bytesperline=%d sizeimage=%d\n", i,
-			  in_fmt.fmt.pix_mp.plane_fmt[i].bytesperline,
-			  in_fmt.fmt.pix_mp.plane_fmt[i].sizeimage);
-	}
-	m2m_dev->in_num_planes = in_fmt.fmt.pix_mp.num_planes;
+	m2m_dev->in_num_planes = ret;
 
-	memset(&out_fmt, 0, sizeof(out_fmt));
-	out_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-	ret = ioctl(fd, VIDIOC_G_FMT, &out_fmt);
+	ret = get_format(m2m_dev, m2m_dev->out_type, m2m_dev->o_plane_size, "out");
 	if (ret < 0) {
 		v4l2_err("out VIDIOC_G_FMT fail\n");
 		return ret;
 	}
-	v4l2_info("out: w/h=(%d,%d) pixelformat=%.4s num_planes=%d\n",
-			  out_fmt.fmt.pix_mp.width,
-			  out_fmt.fmt.pix_mp.height,
-			  (char *)&out_fmt.fmt.pix_mp.pixelformat,
-			  out_fmt.fmt.pix_mp.num_planes);
-	for (i = 0; i < out_fmt.fmt.pix_mp.num_planes; i++) {
-		v4l2_info("\t plane[%d]: bytesperline=%d sizeimage=%d\n", i,
-				  out_fmt.fmt.pix_mp.plane_fmt[i].bytesperline,
-				  out_fmt.fmt.pix_mp.plane_fmt[i].sizeimage);
-	}
-	m2m_dev->o_num_planes = out_fmt.fmt.pix_mp.num_planes;
+	m2m_dev->o_num_planes = ret;
 
 	memset(&ctrl, 0, sizeof(ctrl));
 	ctrl.id = V4L2_CID_HFLIP;
@@ -614,7 +677,7 @@ static int mxc_m2m_prepare(struct mxc_m2m_device *m2m_dev)
 	ctrl.id = V4L2_CID_ALPHA_COMPONENT;
 	ctrl.value = g_cap_alpha;
 	ret = ioctl(fd, VIDIOC_S_CTRL, &ctrl);
-	if (ret < 0) {
+	if (ret < 0 && (g_alpha_set || errno != EINVAL)) {
 		v4l2_err("VIDIOC_S_CTRL set alpha failed\n");
 		return ret;
 	}
@@ -648,60 +711,77 @@ static int mxc_m2m_prepare(struct mxc_m2m_device *m2m_dev)
 	return 0;
 }
 
-static int query_in_buffer(struct mxc_m2m_device *m2m_dev)
+static int query_buffer(struct mxc_m2m_device *m2m_dev, __u32 type,
+			struct mxc_buffer *buffers, int count,
+			int num_planes, __u32 plane_size[])
 {
-	struct v4l2_buffer bufferin;
-	struct v4l2_plane *planes;
-	int i, fd = m2m_dev->fd;
-
-	planes = malloc(m2m_dev->in_num_planes * sizeof(*planes));
-	if (!planes) {
-		v4l2_err("alloc %d planes fail\n", m2m_dev->in_num_planes);
-		return -1;
-	}
-
-	/* Query Buffer for IN */
-	for (i = 0; i < TEST_BUFFER_NUM_IN; i++) {
-		memset(&bufferin, 0, sizeof(bufferin));
-		memset(planes, 0, m2m_dev->in_num_planes * sizeof(*planes));
-		bufferin.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-		bufferin.memory = V4L2_MEMORY_MMAP;
-		bufferin.m.planes = planes;
-		bufferin.length = m2m_dev->in_num_planes;
-		bufferin.index = i;
-		if (ioctl(fd, VIDIOC_QUERYBUF, &bufferin) < 0) {
+	struct v4l2_buffer buffer;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	struct plane_buffer *plane;
+	int i, j, fd = m2m_dev->fd;
+
+	for (i = 0; i < count; i++) {
+		memset(&buffer, 0, sizeof(buffer));
+		memset(planes, 0, sizeof(planes));
+		buffer.type = type;
+		buffer.memory = V4L2_MEMORY_MMAP;
+		buffer.index = i;
+		if (m2m_dev->mplane) {
+			buffer.m.planes = planes;
+			buffer.length = num_planes;
+		}
+		if (ioctl(fd, VIDIOC_QUERYBUF, &buffer) < 0) {
 			v4l2_err("query buffer[%d] info fail\n", i);
-			free(planes);
 			return -1;
 		}
 
-		for (int j = 0; j < m2m_dev->in_num_planes; j++) {
-			m2m_dev->in_buffers[i].planes[j].length = bufferin.m.planes[j].length;
-			m2m_dev->in_buffers[i].planes[j].offset =
-							(size_t)bufferin.m.planes[j].m.mem_offset;
-			m2m_dev->in_buffers[i].planes[j].start = mmap(NULL,
-						bufferin.m.planes[j].length,
-						PROT_READ | PROT_WRITE, MAP_SHARED,
-						fd, (size_t)bufferin.m.planes[j].m.mem_offset);
-
-			v4l2_dbg("in buffer[%d]->planes[%d]:"
+		for (j = 0; j < num_planes; j++) {
+			plane = &buffers[i].planes[j];
+			if (m2m_dev->mplane) {
+				plane->length = buffer.m.planes[j].length;
+				plane->offset = (size_t)buffer.m.planes[j].m.mem_offset;
+			} else {
+				plane->length = buffer.length;
+				plane->offset = (size_t)buffer.m.offset;
+			}
+			plane->plane_size = plane_size[j];
+			if (!plane->plane_size || plane->plane_size > plane->length)
+				plane->plane_size = plane->length;
+			plane->start = mmap(NULL, plane->length,
+					    PROT_READ | PROT_WRITE, MAP_SHARED,
+					    fd, plane->offset);
+
+			v4l2_dbg("%s buffer[%d]->planes[%d]:"
 					 "startAddr=0x%p, offset=0x%x, buf_size=%d\n",
-					 i, j,
-					 (unsigned int *)m2m_dev->in_buffers[i].planes[j].start,
-					 (unsigned int)m2m_dev->in_buffers[i].planes[j].offset,
-					 m2m_dev->in_buffers[i].planes[j].length);
+					 V4L2_TYPE_IS_OUTPUT(type) ? "in" : "out", i, j,
+					 (unsigned int *)plane->start,
+					 (unsigned int)plane->offset,
+					 plane->length);
 		}
 	}
 
-	free(planes);
 	return 0;
 }
 
+static int query_in_buffer(struct mxc_m2m_device *m2m_dev)
+{
+	return query_buffer(m2m_dev, m2m_dev->in_type, m2m_dev->in_buffers,
+			    m2m_dev->in_buf_num, m2m_dev->in_num_planes,
+			    m2m_dev->in_plane_size);
+}
+
+static int query_out_buffer(struct mxc_m2m_device *m2m_dev)
+{
+	return query_buffer(m2m_dev, m2m_dev->out_type, m2m_dev->out_buffers,
+			    m2m_dev->out_buf_num, m2m_dev->o_num_planes,
+			    m2m_dev->o_plane_size);
+}
+
 static void unmap_in_buffer(struct mxc_m2m_device *m2m_dev)
 {
 	int i, j;
 
-	for (i = 0; i < TEST_BUFFER_NUM_IN; i++) {
+	for (i = 0; i < m2m_dev->in_buf_num; i++) {
 		for (j = 0; j < m2m_dev->in_num_planes; j++) {
 			if (m2m_dev->in_buffers[i].planes[j].start != MAP_FAILED &&
 				m2m_dev->in_buffers[i].planes[j].start > 0)
@@ -715,7 +795,7 @@ static void unmap_out_buffer(struct mxc_m2m_device *m2m_dev)
 {
 	int i, j;
 
-	for (i = 0; i < TEST_BUFFER_NUM_OUT; i++) {
+	for (i = 0; i < m2m_dev->out_buf_num; i++) {
 		for (j = 0; j < m2m_dev->o_num_planes; j++) {
 			if (m2m_dev->out_buffers[i].planes[j].start != MAP_FAILED &&
 				m2m_dev->out_buffers[i].planes[j].start > 0)
@@ -725,69 +805,26 @@ static void unmap_out_buffer(struct mxc_m2m_device *m2m_dev)
 	}
 }
 
-static int query_out_buffer(struct mxc_m2m_device *m2m_dev)
-{
-	struct v4l2_buffer bufferout;
-	struct v4l2_plane *planes;
-	int i, fd = m2m_dev->fd;
-
-	planes = malloc(m2m_dev->o_num_planes * sizeof(*planes));
-	if (!planes) {
-		v4l2_err("alloc %d planes fail\n", m2m_dev->o_num_planes);
-		return -1;
-	}
-
-	/* Query Buffer for IN */
-	for (i = 0; i < TEST_BUFFER_NUM_OUT; i++) {
-		memset(&bufferout, 0, sizeof(bufferout));
-		memset(planes, 0, m2m_dev->o_num_planes * sizeof(*planes));
-		bufferout.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-		bufferout.memory = V4L2_MEMORY_MMAP;
-		bufferout.m.planes = planes;
-		bufferout.length = m2m_dev->o_num_planes;
-		bufferout.index = i;
-		if (ioctl(fd, VIDIOC_QUERYBUF, &bufferout) < 0) {
-			v4l2_err("query buffer[%d] info fail\n", i);
-			free(planes);
-			return -1;
-		}
-
-		for (int j = 0; j < m2m_dev->o_num_planes; j++) {
-			m2m_dev->out_buffers[i].planes[j].length = bufferout.m.planes[j].length;
-			m2m_dev->out_buffers[i].planes[j].offset =
-							(size_t)bufferout.m.planes[j].m.mem_offset;
-			m2m_dev->out_buffers[i].planes[j].start = mmap(NULL,
-						bufferout.m.planes[j].length,
-						PROT_READ | PROT_WRITE, MAP_SHARED,
-						fd, (size_t)bufferout.m.planes[j].m.mem_offset);
-
-			v4l2_dbg("out buffer[%d]->planes[%d]:"
-					 "startAddr=0x%p, offset=0x%x, buf_size=%d\n",
-					 i, j,
-					 (unsigned int *)m2m_dev->out_buffers[i].planes[j].start,
-					 (unsigned int)m2m_dev->out_buffers[i].planes[j].offset,
-					 m2m_dev->out_buffers[i].planes[j].length);
-		}
-	}
-
-	free(planes);
-	return 0;
-}
-
 static int request_in_buffer(struct mxc_m2m_device *m2m_dev)
 {
 	struct v4l2_requestbuffers bufrequestin;
 	int fd = m2m_dev->fd;
 
 	memset(&bufrequestin, 0, sizeof(bufrequestin));
-	bufrequestin.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	bufrequestin.type = m2m_dev->in_type;
 	bufrequestin.memory = V4L2_MEMORY_MMAP;
-	bufrequestin.count = TEST_BUFFER_NUM_IN;
+	bufrequestin.count = g_stream_depth ? g_stream_depth : TEST_BUFFER_NUM_IN;
 	if (ioctl(fd, VIDIOC_REQBUFS, &bufrequestin) < 0) {
 		v4l2_err("VIDIOC_REQBUFS IN fail\n");
 		return -1;
 	}
 
+	/* The driver may round the count up to its minimum */
+	if (bufrequestin.count > MAX_BUFFER_NUM)
+		bufrequestin.count = MAX_BUFFER_NUM;
+	m2m_dev->in_buf_num = bufrequestin.count;
+	v4l2_info("in: %d buffers\n", m2m_dev->in_buf_num);
+
 	return 0;
 }
 
@@ -799,7 +836,7 @@ static void free_in_buffer(struct mxc_m2m_device *m2m_dev)
 	/* Free src buffer */
 	memset(&req, 0, sizeof(req));
 	req.count = 0;
-	req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	req.type = m2m_dev->in_type;
 	req.memory = V4L2_MEMORY_MMAP;
 	ret = ioctl(fd, VIDIOC_REQBUFS, &req);
 	if (ret < 0) {
@@ -814,14 +851,19 @@ static int request_out_buffer(struct mxc_m2m_device *m2m_dev)
 	int fd = m2m_dev->fd;
 
 	memset(&bufrequestout, 0, sizeof(bufrequestout));
-	bufrequestout.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	bufrequestout.type = m2m_dev->out_type;
 	bufrequestout.memory = V4L2_MEMORY_MMAP;
-	bufrequestout.count = TEST_BUFFER_NUM_OUT;
+	bufrequestout.count = g_stream_depth ? g_stream_depth : TEST_BUFFER_NUM_OUT;
 	if (ioctl(fd, VIDIOC_REQBUFS, &bufrequestout) < 0) {
 		v4l2_err("VIDIOC_REQBUFS OUT fail\n");
 		return -1;
 	}
 
+	if (bufrequestout.count > MAX_BUFFER_NUM)
+		bufrequestout.count = MAX_BUFFER_NUM;
+	m2m_dev->out_buf_num = bufrequestout.count;
+	v4l2_info("out: %d buffers\n", m2m_dev->out_buf_num);
+
 	return 0;
 }
 
@@ -834,7 +876,7 @@ static void free_out_buffer(struct mxc_m2m_device *m2m_dev)
 	/* Free out buffer */
 	memset(&req, 0, sizeof(req));
 	req.count = 0;
-	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	req.type = m2m_dev->out_type;
 	req.memory = V4L2_MEMORY_MMAP;
 	ret = ioctl(fd, VIDIOC_REQBUFS, &req);
 	if (ret < 0) {
@@ -874,137 +916,124 @@ src:
 	return ret;
 }
 
-static int mxc_m2m_queue_in_buffer(int buf_id, struct mxc_m2m_device *m2m_dev)
+static int queue_buffer(struct mxc_m2m_device *m2m_dev, __u32 type, int buf_id,
+			struct mxc_buffer *buffer, int num_planes)
 {
 	struct v4l2_buffer buf;
-	struct v4l2_plane *planes;
-	int fd = m2m_dev->fd;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	struct timespec now;
 	int j;
 
-	planes = malloc(m2m_dev->in_num_planes * sizeof(*planes));
-	if (!planes) {
-		v4l2_err("alloc %d plane fail\n", m2m_dev->in_num_planes);
-		return -ENOMEM;
-	}
-
 	memset(&buf, 0, sizeof(buf));
-	buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	memset(planes, 0, sizeof(planes));
+	buf.type = type;
 	buf.memory = V4L2_MEMORY_MMAP;
-	buf.m.planes = planes;
-	buf.length = m2m_dev->in_num_planes;
 	buf.index = buf_id;
 
-	for (j = 0; j < m2m_dev->in_num_planes; j++) {
-		buf.m.planes[j].length = m2m_dev->in_buffers[buf_id].planes[j].length;
-		buf.m.planes[j].m.mem_offset = m2m_dev->in_buffers[buf_id].planes[j].offset;
-		buf.m.planes[j].bytesused = m2m_dev->in_buffers[buf_id].planes[j].length;
+	if (m2m_dev->mplane) {
+		buf.m.planes = planes;
+		buf.length = num_planes;
+		for (j = 0; j < num_planes; j++) {
+			buf.m.planes[j].length = buffer->planes[j].length;
+			buf.m.planes[j].m.mem_offset = buffer->planes[j].offset;
+			buf.m.planes[j].bytesused = buffer->planes[j].plane_size;
+		}
+	} else {
+		buf.length = buffer->planes[0].length;
+		buf.m.offset = buffer->planes[0].offset;
+		buf.bytesused = buffer->planes[0].plane_size;
 	}
 
-	if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+	/*
+	 * m2m drivers copy the OUTPUT timestamp to the CAPTURE buffer made
+	 * from it, so the queue time comes back with the converted frame.
+	 */
+	if (V4L2_TYPE_IS_OUTPUT(type)) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		buf.timestamp.tv_sec = now.tv_sec;
+		buf.timestamp.tv_usec = now.tv_nsec / 1000;
+	}
+
+	return ioctl(m2m_dev->fd, VIDIOC_QBUF, &buf);
+}
+
+static int mxc_m2m_queue_in_buffer(int buf_id, struct mxc_m2m_device *m2m_dev)
+{
+	if (queue_buffer(m2m_dev, m2m_dev->in_type, buf_id,
+			 &m2m_dev->in_buffers[buf_id], m2m_dev->in_num_planes) < 0) {
 		v4l2_err("buffer[%d] VIDIOC_QBUF IN fail\n", buf_id);
 		return -1;
 	}
 
-	free(planes);
 	return 0;
 }
 
 static int mxc_m2m_queue_out_buffer(int buf_id, struct mxc_m2m_device *m2m_dev)
 {
-	struct v4l2_buffer buf;
-	struct v4l2_plane *planes;
-	int fd = m2m_dev->fd;
-	int j;
-
-	planes = malloc(m2m_dev->o_num_planes * sizeof(*planes));
-	if (!planes) {
-		v4l2_err("alloc %d plane fail\n", m2m_dev->o_num_planes);
-		return -ENOMEM;
+	if (queue_buffer(m2m_dev, m2m_dev->out_type, buf_id,
+			 &m2m_dev->out_buffers[buf_id], m2m_dev->o_num_planes) < 0) {
+		v4l2_err("buffer[%d] VIDIOC_QBUF OUT fail\n", buf_id);
+		return -1;
 	}
 
-	memset(&buf, 0, sizeof(buf));
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-	buf.memory = V4L2_MEMORY_MMAP;
-	buf.m.planes = planes;
-	buf.length = m2m_dev->o_num_planes;
-	buf.index = buf_id;
+	return 0;
+}
 
-	for (j = 0; j < m2m_dev->o_num_planes; j++) {
-		buf.m.planes[j].length = m2m_dev->out_buffers[buf_id].planes[j].length;
-		buf.m.planes[j].m.mem_offset = m2m_dev->out_buffers[buf_id].planes[j].offset;
-		buf.m.planes[j].bytesused = m2m_dev->out_buffers[buf_id].planes[j].length;
+/*
+ * Returns the buffer index, or -EAGAIN when a non-blocking fd has
+ * nothing done yet.
+ */
+static int dequeue_buffer(struct mxc_m2m_device *m2m_dev, __u32 type,
+			  int num_planes, struct v4l2_buffer *buf)
+{
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+
+	memset(buf, 0, sizeof(*buf));
+	buf->type = type;
+	buf->memory = V4L2_MEMORY_MMAP;
+	if (m2m_dev->mplane) {
+		buf->m.planes = planes;
+		buf->length = num_planes;
 	}
 
-	if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
-		v4l2_err("buffer[%d] VIDIOC_QBUF OUT fail\n", buf_id);
+	if (ioctl(m2m_dev->fd, VIDIOC_DQBUF, buf) < 0) {
+		if (errno == EAGAIN)
+			return -EAGAIN;
+		v4l2_err("VIDIOC_DQBUF error\n");
 		return -1;
 	}
+	buf->m.planes = NULL;
 
-	free(planes);
-	return 0;
+	return buf->index;
 }
 
 static int mxc_m2m_dequeue_in_buffer(struct mxc_m2m_device *m2m_dev)
 {
 	struct v4l2_buffer buf;
-	struct v4l2_plane *planes;
-	int fd = m2m_dev->fd;
 	int ret;
 
-	planes = malloc(m2m_dev->o_num_planes * sizeof(*planes));
-	if (!planes) {
-		v4l2_err("alloc %d plane fail\n", m2m_dev->o_num_planes);
-		return -ENOMEM;
-	}
-
-	memset(&buf, 0, sizeof(buf));
-	buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-	buf.memory = V4L2_MEMORY_MMAP;
-	buf.m.planes = planes;
-	buf.length = m2m_dev->in_num_planes;
-
-	ret = ioctl(fd, VIDIOC_DQBUF, &buf);
-	if (ret < 0) {
-		v4l2_err("VIDIOC_DQBUF error\n");
-		free(planes);
+	ret = dequeue_buffer(m2m_dev, m2m_dev->in_type,
+			     m2m_dev->in_num_planes, &buf);
+	if (ret < 0)
 		return ret;
-	}
 	m2m_dev->in_frame_num++;
 	m2m_dev->in_cur_buf_id = buf.index;
 
-	free(planes);
 	return 0;
 }
 
 static int mxc_m2m_dequeue_out_buffer(struct mxc_m2m_device *m2m_dev)
 {
 	struct v4l2_buffer buf;
-	struct v4l2_plane *planes;
-	int fd = m2m_dev->fd;
 	int ret;
 
-	planes = malloc(m2m_dev->o_num_planes * sizeof(*planes));
-	if (!planes) {
-		v4l2_err("alloc %d plane fail\n", m2m_dev->o_num_planes);
-		return -ENOMEM;
-	}
-
-	memset(&buf, 0, sizeof(buf));
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-	buf.memory = V4L2_MEMORY_MMAP;
-	buf.m.planes = planes;
-	buf.length = m2m_dev->o_num_planes;
-
-	ret = ioctl(fd, VIDIOC_DQBUF, &buf);
-	if (ret < 0) {
-		v4l2_err("VIDIOC_DQBUF error\n");
-		free(planes);
+	ret = dequeue_buffer(m2m_dev, m2m_dev->out_type,
+			     m2m_dev->o_num_planes, &buf);
+	if (ret < 0)
 		return ret;
-	}
 	m2m_dev->out_frame_num++;
 	m2m_dev->out_cur_buf_id = buf.index;
 
-	free(planes);
 	return 0;
 }
 
@@ -1026,6 +1055,35 @@ static int mxc_m2m_queue(struct mxc_m2m_device *m2m_dev)
 
 	return 0;
 }
+
+/*
+ * Streaming mode: fill and queue as many OUTPUT buffers as there are
+ * frames, and every CAPTURE buffer, so the engine starts with a full
+ * pipeline.
+ */
+static int mxc_m2m_stream_queue(struct mxc_m2m_device *m2m_dev)
+{
+	int i, ret;
+
+	m2m_dev->in_filled = 0;
+	for (i = 0; i < m2m_dev->in_buf_num && i < m2m_dev->frames; i++) {
+		ret = fill_in_buffer(i, m2m_dev);
+		if (ret < 0)
+			return ret;
+		ret = mxc_m2m_queue_in_buffer(i, m2m_dev);
+		if (ret < 0)
+			return ret;
+		m2m_dev->in_filled++;
+	}
+
+	for (i = 0; i < m2m_dev->out_buf_num; i++) {
+		ret = mxc_m2m_queue_out_buffer(i, m2m_dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
 #if 0
 static int mxc_m2m_dequeue(struct mxc_m2m_device *m2m_dev)
 {
@@ -1047,7 +1105,7 @@ static int mxc_m2m_in_streamon(struct mxc_m2m_device *m2m_dev)
 	enum v4l2_buf_type type;
 	int ret, fd = m2m_dev->fd;
 
-	type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	type = m2m_dev->in_type;
 	ret = ioctl(fd, VIDIOC_STREAMON, &type);
 	if (ret < 0) {
 		v4l2_err("in VIDIOC_STREAMON error\n");
@@ -1063,7 +1121,7 @@ static int mxc_m2m_out_streamon(struct mxc_m2m_device *m2m_dev)
 	enum v4l2_buf_type type;
 	int ret, fd = m2m_dev->fd;
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	type = m2m_dev->out_type;
 	ret = ioctl(fd, VIDIOC_STREAMON, &type);
 	if (ret < 0) {
 		v4l2_err("out VIDIOC_STREAMON error\n");
@@ -1095,7 +1153,7 @@ static int mxc_m2m_in_streamoff(struct mxc_m2m_device *m2m_dev)
 	int fd = m2m_dev->fd;
 	int ret;
 
-	type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	type = m2m_dev->in_type;
 	ret = ioctl(fd, VIDIOC_STREAMOFF, &type);
 	if (ret < 0) {
 		v4l2_err("in VIDIOC_STREAMOFF error\n");
@@ -1112,7 +1170,7 @@ static int mxc_m2m_out_streamoff(struct mxc_m2m_device *m2m_dev)
 	int fd = m2m_dev->fd;
 	int ret;
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	type = m2m_dev->out_type;
 	ret = ioctl(fd, VIDIOC_STREAMOFF, &type);
 	if (ret < 0) {
 		v4l2_err("out VIDIOC_STREAMOFF error\n");
@@ -1167,7 +1225,7 @@ static int start_convert(struct mxc_m2m_device *m2m_dev)
 			return -1;
 
 		if (!g_performance_test) {
-			ret = save_to_file(m2m_dev);
+			ret = save_to_file(m2m_dev->out_cur_buf_id, m2m_dev);
 			if (ret < 0)
 				return ret;
 		}
@@ -1191,6 +1249,329 @@ static int start_convert(struct mxc_m2m_device *m2m_dev)
 	return 0;
 }
 
+/*
+ * Streaming mode: the main thread only moves buffers between the driver
+ * and two pairs of rings, and waits in poll(). The reader thread fills
+ * OUTPUT buffers from in_free into in_ready, the writer thread saves
+ * CAPTURE buffers from out_done into out_free, so file I/O overlaps the
+ * conversion of the other buffers in flight.
+ */
+struct buf_ring {
+	int slot[MAX_BUFFER_NUM + 1];
+	int head;
+	int tail;
+	int count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct m2m_stream {
+	struct mxc_m2m_device *m2m_dev;
+	struct buf_ring in_free;
+	struct buf_ring in_ready;
+	struct buf_ring out_done;
+	struct buf_ring out_free;
+	/* the reader and writer wake the poll() loop through it */
+	int evfd;
+	volatile bool error;
+};
+
+struct latency_stat {
+	long min;
+	long max;
+	long long sum;
+	int count;
+};
+
+static void ring_init(struct buf_ring *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->cond, NULL);
+}
+
+static void ring_destroy(struct buf_ring *ring)
+{
+	pthread_mutex_destroy(&ring->lock);
+	pthread_cond_destroy(&ring->cond);
+}
+
+/* buf_id -1 tells the consumer thread to stop */
+static void ring_push(struct buf_ring *ring, int buf_id)
+{
+	pthread_mutex_lock(&ring->lock);
+	ring->slot[ring->tail] = buf_id;
+	ring->tail = (ring->tail + 1) % (MAX_BUFFER_NUM + 1);
+	ring->count++;
+	pthread_cond_signal(&ring->cond);
+	pthread_mutex_unlock(&ring->lock);
+}
+
+static int ring_pop(struct buf_ring *ring, bool wait)
+{
+	int buf_id;
+
+	pthread_mutex_lock(&ring->lock);
+	while (wait && !ring->count)
+		pthread_cond_wait(&ring->cond, &ring->lock);
+	if (!ring->count) {
+		pthread_mutex_unlock(&ring->lock);
+		return -1;
+	}
+	buf_id = ring->slot[ring->head];
+	ring->head = (ring->head + 1) % (MAX_BUFFER_NUM + 1);
+	ring->count--;
+	pthread_mutex_unlock(&ring->lock);
+
+	return buf_id;
+}
+
+static void stream_notify(struct m2m_stream *stream)
+{
+	uint64_t one = 1;
+
+	if (write(stream->evfd, &one, sizeof(one)) < 0)
+		v4l2_err("eventfd write fail\n");
+}
+
+static void *reader_thread(void *arg)
+{
+	struct m2m_stream *stream = arg;
+	int buf_id;
+
+	while ((buf_id = ring_pop(&stream->in_free, true)) >= 0) {
+		if (!g_performance_test &&
+		    fill_in_buffer(buf_id, stream->m2m_dev) < 0) {
+			stream->error = true;
+			stream_notify(stream);
+			break;
+		}
+		ring_push(&stream->in_ready, buf_id);
+		stream_notify(stream);
+	}
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct m2m_stream *stream = arg;
+	int buf_id;
+
+	while ((buf_id = ring_pop(&stream->out_done, true)) >= 0) {
+		if (!g_performance_test &&
+		    save_to_file(buf_id, stream->m2m_dev) < 0) {
+			stream->error = true;
+			stream_notify(stream);
+			break;
+		}
+		ring_push(&stream->out_free, buf_id);
+		stream_notify(stream);
+	}
+	return NULL;
+}
+
+static long timeval_diff_us(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000L +
+	       (end->tv_usec - start->tv_usec);
+}
+
+static void latency_add(struct latency_stat *stat, long us)
+{
+	if (!stat->count || us < stat->min)
+		stat->min = us;
+	if (!stat->count || us > stat->max)
+		stat->max = us;
+	stat->sum += us;
+	stat->count++;
+}
+
+static void latency_print(const char *name, struct latency_stat *stat)
+{
+	if (!stat->count) {
+		printf(">> %s: no samples <<\n", name);
+		return;
+	}
+	printf(">> %s(us): min=%ld avg=%lld max=%ld <<\n", name,
+	       stat->min, stat->sum / stat->count, stat->max);
+}
+
+/*
+ * A CAPTURE buffer carries the timestamp of the OUTPUT buffer it was
+ * converted from, so its age when dequeued is the time the frame spent
+ * queued and in the engine.
+ */
+static void capture_done(struct v4l2_buffer *buf, struct latency_stat *latency,
+			 struct latency_stat *interval, struct timeval *last)
+{
+	struct timespec ts;
+	struct timeval now;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now.tv_sec = ts.tv_sec;
+	now.tv_usec = ts.tv_nsec / 1000;
+
+	if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+	    V4L2_BUF_FLAG_TIMESTAMP_COPY) {
+		latency_add(latency, timeval_diff_us(&buf->timestamp, &now));
+		v4l2_dbg("frame %d: buffer[%d] latency=%ldus\n", latency->count,
+			 buf->index, timeval_diff_us(&buf->timestamp, &now));
+	}
+	if (last->tv_sec || last->tv_usec)
+		latency_add(interval, timeval_diff_us(last, &now));
+	*last = now;
+}
+
+static int start_stream_convert(struct mxc_m2m_device *m2m_dev)
+{
+	struct m2m_stream stream;
+	struct latency_stat latency, interval;
+	struct timeval start, end, last;
+	struct v4l2_buffer buf;
+	struct pollfd pfd[2];
+	pthread_t reader, writer;
+	int in_queued, out_queued, captured = 0;
+	int buf_id, fps, ret = 0;
+	uint64_t events;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(&latency, 0, sizeof(latency));
+	memset(&interval, 0, sizeof(interval));
+	memset(&last, 0, sizeof(last));
+	stream.m2m_dev = m2m_dev;
+	ring_init(&stream.in_free);
+	ring_init(&stream.in_ready);
+	ring_init(&stream.out_done);
+	ring_init(&stream.out_free);
+
+	stream.evfd = eventfd(0, EFD_NONBLOCK);
+	if (stream.evfd < 0) {
+		v4l2_err("eventfd fail\n");
+		return -1;
+	}
+
+	if (pthread_create(&reader, NULL, reader_thread, &stream)) {
+		v4l2_err("create reader thread fail\n");
+		ret = -1;
+		goto release;
+	}
+	if (pthread_create(&writer, NULL, writer_thread, &stream)) {
+		v4l2_err("create writer thread fail\n");
+		ring_push(&stream.in_free, -1);
+		pthread_join(reader, NULL);
+		ret = -1;
+		goto release;
+	}
+
+	/* mxc_m2m_stream_queue() queued every buffer before STREAMON */
+	in_queued = m2m_dev->in_filled;
+	out_queued = m2m_dev->out_buf_num;
+
+	gettimeofday(&start, NULL);
+	while (captured < m2m_dev->frames && !quitflag && !stream.error) {
+		while ((buf_id = ring_pop(&stream.in_ready, false)) >= 0) {
+			if (mxc_m2m_queue_in_buffer(buf_id, m2m_dev) < 0)
+				goto err;
+			in_queued++;
+		}
+		while ((buf_id = ring_pop(&stream.out_free, false)) >= 0) {
+			if (mxc_m2m_queue_out_buffer(buf_id, m2m_dev) < 0)
+				goto err;
+			out_queued++;
+		}
+
+		/* poll() reports POLLERR when neither queue holds a buffer */
+		pfd[0].fd = (in_queued || out_queued) ? m2m_dev->fd : -1;
+		pfd[0].events = (in_queued ? POLLOUT : 0) | (out_queued ? POLLIN : 0);
+		pfd[0].revents = 0;
+		pfd[1].fd = stream.evfd;
+		pfd[1].events = POLLIN;
+		pfd[1].revents = 0;
+
+		ret = poll(pfd, 2, 1000);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			v4l2_err("poll fail\n");
+			goto err;
+		}
+		if (ret == 0) {
+			v4l2_err("timeout, %d frames queued, %d buffers to capture\n",
+				 in_queued, out_queued);
+			goto err;
+		}
+
+		/* Only a wakeup, the rings tell what is to be done */
+		if ((pfd[1].revents & POLLIN) &&
+		    read(stream.evfd, &events, sizeof(events)) < 0 &&
+		    errno != EAGAIN && errno != EINTR) {
+			v4l2_err("eventfd read fail\n");
+			goto err;
+		}
+
+		if (pfd[0].revents & POLLERR) {
+			v4l2_err("m2m device error\n");
+			goto err;
+		}
+
+		/* Converted sources go back to the reader while frames remain */
+		buf_id = -EAGAIN;
+		while ((pfd[0].revents & POLLOUT) &&
+		       (buf_id = dequeue_buffer(m2m_dev, m2m_dev->in_type,
+					m2m_dev->in_num_planes, &buf)) >= 0) {
+			in_queued--;
+			m2m_dev->in_frame_num++;
+			if (m2m_dev->in_filled < m2m_dev->frames) {
+				m2m_dev->in_filled++;
+				ring_push(&stream.in_free, buf_id);
+			}
+		}
+		if (buf_id < 0 && buf_id != -EAGAIN)
+			goto err;
+
+		buf_id = -EAGAIN;
+		while ((pfd[0].revents & POLLIN) &&
+		       (buf_id = dequeue_buffer(m2m_dev, m2m_dev->out_type,
+					m2m_dev->o_num_planes, &buf)) >= 0) {
+			out_queued--;
+			m2m_dev->out_frame_num++;
+			capture_done(&buf, &latency, &interval, &last);
+			ring_push(&stream.out_done, buf_id);
+			captured++;
+		}
+		if (buf_id < 0 && buf_id != -EAGAIN)
+			goto err;
+	}
+	gettimeofday(&end, NULL);
+	ret = stream.error ? -1 : 0;
+	goto out;
+
+err:
+	gettimeofday(&end, NULL);
+	ret = -1;
+out:
+	/* The writer drains out_done before it sees the stop marker */
+	ring_push(&stream.in_free, -1);
+	ring_push(&stream.out_done, -1);
+	pthread_join(reader, NULL);
+	pthread_join(writer, NULL);
+release:
+	close(stream.evfd);
+	ring_destroy(&stream.in_free);
+	ring_destroy(&stream.in_ready);
+	ring_destroy(&stream.out_done);
+	ring_destroy(&stream.out_free);
+
+	if (captured) {
+		fps = get_fps(&start, &end, captured);
+		printf(">> %d frames, depth in/out=%d/%d, fps=%d(fps) <<\n",
+		       captured, m2m_dev->in_buf_num, m2m_dev->out_buf_num, fps);
+		latency_print("latency", &latency);
+		latency_print("frame interval", &interval);
+	}
+
+	return ret;
+}
 
 int main(int argc, char *argv[])
 {
@@ -1198,12 +1579,6 @@ int main(int argc, char *argv[])
 	struct mxc_m2m_device *m2m_dev;
 	int ret = 0;
 
-	ret = soc_version_check(soc_list);
-	if (ret == 0) {
-		v4l2_err("not supported on current soc\n");
-		return 0;
-	}
-
 	pthread_t sigtid;
 	sigemptyset(&sigset_v);
 	sigaddset(&sigset_v, SIGINT);
@@ -1214,7 +1589,7 @@ int main(int argc, char *argv[])
 	if (ret < 0)
 		return ret;
 
-	m2m_dev = malloc(sizeof(*m2m_dev));
+	m2m_dev = calloc(1, sizeof(*m2m_dev));
 	if (!m2m_dev) {
 		v4l2_err("alloc memory for m2m device fail\n");
 		return -1;
@@ -1231,8 +1606,15 @@ int main(int argc, char *argv[])
 	if (ret < 0)
 		goto close;
 
+	/* vim2m runs anywhere, the ISI/PXP paths only on these SoCs */
+	if (!m2m_dev->virtual_dev && !soc_version_check(soc_list)) {
+		v4l2_err("not supported on current soc\n");
+		ret = 0;
+		goto close;
+	}
+
 	if (show_device_cap) {
-		show_device_cap_list(m2m_dev->fd);
+		show_device_cap_list(m2m_dev);
 		goto close;
 	}
 
@@ -1248,8 +1630,12 @@ int main(int argc, char *argv[])
 	if (ret < 0)
 		goto close;
 
-	fill_in_buffer(0, m2m_dev);
-	ret = mxc_m2m_queue(m2m_dev);
+	if (g_stream_depth) {
+		ret = mxc_m2m_stream_queue(m2m_dev);
+	} else {
+		fill_in_buffer(0, m2m_dev);
+		ret = mxc_m2m_queue(m2m_dev);
+	}
 	if (ret < 0)
 		goto free_buf;
 
@@ -1257,7 +1643,10 @@ int main(int argc, char *argv[])
 	if (ret < 0)
 		goto free_buf;
 
-	start_convert(m2m_dev);
+	if (g_stream_depth)
+		start_stream_convert(m2m_dev);
+	else
+		start_convert(m2m_dev);
 
 	ret = mxc_m2m_streamoff(m2m_dev);
 	if (ret < 0)
@@ -0,0 +1,363 @@
+/*
+ *  Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * @file v4l2_recorder.c
+ *
+ * @brief Asynchronous capture frame recorder
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "v4l2_recorder.h"
+
+/* planes gathered in one writev() */
+#define RECORDER_MAX_IOV	64
+
+struct recorder_frame {
+	int index;
+	int nr_planes;
+	void *planes[RECORDER_MAX_PLANES];
+	uint32_t sizes[RECORDER_MAX_PLANES];
+	uint64_t timestamp_us;
+	uint32_t sequence;
+	uint64_t push_ns;
+};
+
+struct v4l2_recorder {
+	char name[64];
+	int fd;
+	FILE *index;
+	size_t batch;
+	recorder_release_fn release;
+	void *priv;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t drained;
+
+	/* frames pending, the ones being written included */
+	struct recorder_frame *ring;
+	int depth;
+	int head;
+	int count;
+	int releasing;
+	bool exit;
+	bool error;
+
+	/* statistics */
+	uint64_t frames;
+	uint64_t dropped;
+	uint64_t bytes;
+	uint64_t offset;
+	uint64_t writes;
+	uint64_t write_ns;
+	uint64_t write_max_ns;
+	uint64_t latency_ns;
+	uint64_t latency_max_ns;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t frame_size(const struct recorder_frame *frame)
+{
+	size_t size = 0;
+	int i;
+
+	for (i = 0; i < frame->nr_planes; i++)
+		size += frame->sizes[i];
+	return size;
+}
+
+/* writev() everything, following partial writes */
+static int write_all(int fd, struct iovec *iov, int nr_iov)
+{
+	ssize_t ret;
+
+	while (nr_iov) {
+		ret = writev(fd, iov, nr_iov);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ret == 0) {
+			errno = ENOSPC;
+			return -1;
+		}
+		while (nr_iov && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			nr_iov--;
+		}
+		if (nr_iov) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
+static void *recorder_thread(void *arg)
+{
+	struct v4l2_recorder *rec = arg;
+	struct iovec iov[RECORDER_MAX_IOV];
+	struct recorder_frame *frame;
+	int indexes[RECORDER_MAX_IOV];
+	uint64_t start, end, latency, latency_max;
+	size_t total, size;
+	int i, j, n, nr_iov, ret;
+
+	pthread_mutex_lock(&rec->lock);
+	while (1) {
+		while (!rec->count && !rec->exit)
+			pthread_cond_wait(&rec->not_empty, &rec->lock);
+		if (!rec->count)
+			break;
+
+		/* the oldest frame, and with batching those after it */
+		n = 0;
+		nr_iov = 0;
+		total = 0;
+		do {
+			frame = &rec->ring[(rec->head + n) % rec->depth];
+			size = frame_size(frame);
+			if (n && (total + size > rec->batch ||
+				  nr_iov + frame->nr_planes > RECORDER_MAX_IOV))
+				break;
+			for (j = 0; j < frame->nr_planes; j++) {
+				iov[nr_iov].iov_base = frame->planes[j];
+				iov[nr_iov].iov_len = frame->sizes[j];
+				nr_iov++;
+			}
+			total += size;
+			n++;
+		} while (rec->batch && n < rec->count && n < RECORDER_MAX_IOV);
+		pthread_mutex_unlock(&rec->lock);
+
+		start = now_ns();
+		ret = rec->error ? -1 : write_all(rec->fd, iov, nr_iov);
+		end = now_ns();
+
+		latency = 0;
+		latency_max = 0;
+		for (i = 0; i < n; i++) {
+			frame = &rec->ring[(rec->head + i) % rec->depth];
+			indexes[i] = frame->index;
+			latency += end - frame->push_ns;
+			if (end - frame->push_ns > latency_max)
+				latency_max = end - frame->push_ns;
+			if (ret == 0 && rec->index) {
+				fprintf(rec->index, "%llu %u %llu %llu %zu\n",
+					(unsigned long long)(rec->frames + i),
+					frame->sequence,
+					(unsigned long long)frame->timestamp_us,
+					(unsigned long long)rec->offset,
+					frame_size(frame));
+				rec->offset += frame_size(frame);
+			}
+		}
+
+		pthread_mutex_lock(&rec->lock);
+		if (ret < 0 && !rec->error) {
+			printf("%s: write fail (%s), dropping the frames still pending\n",
+			       rec->name, strerror(errno));
+			rec->error = true;
+		}
+		if (ret == 0) {
+			rec->frames += n;
+			rec->bytes += total;
+			rec->writes++;
+			rec->write_ns += end - start;
+			if (end - start > rec->write_max_ns)
+				rec->write_max_ns = end - start;
+			rec->latency_ns += latency;
+			if (latency_max > rec->latency_max_ns)
+				rec->latency_max_ns = latency_max;
+			rec->end_ns = end;
+		}
+		rec->head = (rec->head + n) % rec->depth;
+		rec->count -= n;
+		rec->releasing = n;
+		pthread_mutex_unlock(&rec->lock);
+
+		/* back to the driver once they are on their way to storage */
+		for (i = 0; i < n; i++)
+			rec->release(rec->priv, indexes[i]);
+
+		pthread_mutex_lock(&rec->lock);
+		rec->releasing = 0;
+		if (!rec->count)
+			pthread_cond_broadcast(&rec->drained);
+	}
+	pthread_mutex_unlock(&rec->lock);
+	return NULL;
+}
+
+struct v4l2_recorder *recorder_open(const char *name, int fd,
+				    const char *index_file, int depth,
+				    size_t batch, recorder_release_fn release,
+				    void *priv)
+{
+	struct v4l2_recorder *rec;
+
+	if (depth < 1)
+		depth = 1;
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec)
+		return NULL;
+	rec->ring = calloc(depth, sizeof(*rec->ring));
+	if (!rec->ring)
+		goto free_rec;
+
+	if (index_file) {
+		rec->index = fopen(index_file, "w");
+		if (!rec->index) {
+			printf("%s: unable to create index file %s\n", name, index_file);
+			goto free_ring;
+		}
+		fprintf(rec->index, "# frame sequence timestamp_us offset bytes\n");
+	}
+
+	snprintf(rec->name, sizeof(rec->name), "%s", name);
+	rec->fd = fd;
+	rec->depth = depth;
+	rec->batch = batch;
+	rec->release = release;
+	rec->priv = priv;
+	pthread_mutex_init(&rec->lock, NULL);
+	pthread_cond_init(&rec->not_empty, NULL);
+	pthread_cond_init(&rec->drained, NULL);
+
+	if (pthread_create(&rec->thread, NULL, recorder_thread, rec)) {
+		printf("%s: unable to start writer thread\n", name);
+		pthread_cond_destroy(&rec->drained);
+		pthread_cond_destroy(&rec->not_empty);
+		pthread_mutex_destroy(&rec->lock);
+		if (rec->index)
+			fclose(rec->index);
+		goto free_ring;
+	}
+	return rec;
+
+free_ring:
+	free(rec->ring);
+free_rec:
+	free(rec);
+	return NULL;
+}
+
+int recorder_push(struct v4l2_recorder *rec, int index, void * const *planes,
+		  const uint32_t *sizes, int nr_planes, uint64_t timestamp_us,
+		  uint32_t sequence)
+{
+	struct recorder_frame *frame;
+	int i;
+
+	if (nr_planes > RECORDER_MAX_PLANES)
+		nr_planes = RECORDER_MAX_PLANES;
+
+	pthread_mutex_lock(&rec->lock);
+	if (rec->error) {
+		pthread_mutex_unlock(&rec->lock);
+		return -1;
+	}
+	if (rec->count == rec->depth) {
+		rec->dropped++;
+		pthread_mutex_unlock(&rec->lock);
+		return 1;
+	}
+
+	frame = &rec->ring[(rec->head + rec->count) % rec->depth];
+	frame->index = index;
+	frame->nr_planes = nr_planes;
+	for (i = 0; i < nr_planes; i++) {
+		frame->planes[i] = planes[i];
+		frame->sizes[i] = sizes[i];
+	}
+	frame->timestamp_us = timestamp_us;
+	frame->sequence = sequence;
+	frame->push_ns = now_ns();
+	if (!rec->start_ns)
+		rec->start_ns = frame->push_ns;
+
+	rec->count++;
+	pthread_cond_signal(&rec->not_empty);
+	pthread_mutex_unlock(&rec->lock);
+	return 0;
+}
+
+int recorder_flush(struct v4l2_recorder *rec)
+{
+	int ret;
+
+	pthread_mutex_lock(&rec->lock);
+	while (rec->count || rec->releasing)
+		pthread_cond_wait(&rec->drained, &rec->lock);
+	ret = rec->error ? -1 : 0;
+	pthread_mutex_unlock(&rec->lock);
+	return ret;
+}
+
+void recorder_close(struct v4l2_recorder *rec)
+{
+	double secs, mbps = 0;
+
+	pthread_mutex_lock(&rec->lock);
+	rec->exit = true;
+	pthread_cond_signal(&rec->not_empty);
+	pthread_mutex_unlock(&rec->lock);
+	pthread_join(rec->thread, NULL);
+
+	secs = (rec->end_ns - rec->start_ns) / 1e9;
+	if (rec->end_ns > rec->start_ns)
+		mbps = rec->bytes / secs / (1024 * 1024);
+
+	printf("%s: %llu frames written, %llu dropped, %.1f MB/s\n",
+	       rec->name, (unsigned long long)rec->frames,
+	       (unsigned long long)rec->dropped, mbps);
+	if (rec->writes)
+		printf("%s: %llu writes, write avg %.2f ms max %.2f ms, "
+		       "frame latency avg %.2f ms max %.2f ms\n",
+		       rec->name, (unsigned long long)rec->writes,
+		       rec->write_ns / 1e6 / rec->writes, rec->write_max_ns / 1e6,
+		       rec->latency_ns / 1e6 / rec->frames,
+		       rec->latency_max_ns / 1e6);
+
+	if (rec->index)
+		fclose(rec->index);
+	pthread_cond_destroy(&rec->drained);
+	pthread_cond_destroy(&rec->not_empty);
+	pthread_mutex_destroy(&rec->lock);
+	free(rec->ring);
+	free(rec);
+}
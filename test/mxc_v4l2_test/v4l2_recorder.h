@@ -0,0 +1,65 @@
+/*
+ *  Copyright 2023 NXP
+ */
+
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * @file v4l2_recorder.h
+ *
+ * @brief Asynchronous capture frame recorder
+ *
+ */
+
+#ifndef V4L2_RECORDER_H
+#define V4L2_RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORDER_MAX_PLANES	3
+
+/*
+ * Called on the writer thread once capture buffer index has been written
+ * (or given up after a write error), to queue it back to the driver
+ */
+typedef void (*recorder_release_fn)(void *priv, int index);
+
+/*
+ * One writer thread appends the frames pushed to the file fd. It holds at
+ * most depth frames; a frame pushed while they are all pending is dropped.
+ * With batch bytes the pending frames are written together with one
+ * writev() of up to batch bytes. An index line (frame, sequence, V4L2
+ * timestamp, file offset, size) per written frame goes to index_file if
+ * given.
+ */
+struct v4l2_recorder;
+
+struct v4l2_recorder *recorder_open(const char *name, int fd,
+				    const char *index_file, int depth,
+				    size_t batch, recorder_release_fn release,
+				    void *priv);
+
+/*
+ * Queue capture buffer index for writing. Return 0 if the recorder took
+ * it, 1 if it was dropped and the caller keeps it, or -1 after a write
+ * error.
+ */
+int recorder_push(struct v4l2_recorder *rec, int index, void * const *planes,
+		  const uint32_t *sizes, int nr_planes, uint64_t timestamp_us,
+		  uint32_t sequence);
+
+/* wait until every frame pushed has been written and released */
+int recorder_flush(struct v4l2_recorder *rec);
+
+/* flush, print the statistics and free the recorder */
+void recorder_close(struct v4l2_recorder *rec);
+
+#endif
@@ -0,0 +1,1310 @@
+/*
+ * Copyright 2023 NXP
+ *
+ */
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Microbenchmarks of the pitcher framework. Nothing here touches a device:
+ * the queues, pipes, buffers, software converter and parsers are measured
+ * in isolation, and a synthetic graph (generated frames -> convert ->
+ * verify/null sink) is run through the pitcher core, so the results can be
+ * compared between builds on any linux host.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "pitcher/pitcher_def.h"
+#include "pitcher/pitcher.h"
+#include "pitcher/pipe.h"
+#include "pitcher/convert.h"
+#include "pitcher/parse.h"
+
+#define MAX_BENCH_SIZES		8
+#define MAX_BENCH_PAIRS		32
+#define MAX_BENCH_STREAMS	8
+#define BENCH_QUEUE_DEPTH	64
+#define BENCH_PATTERN_COUNT	4
+#define BENCH_GRAPH_BUFFERS	4
+#define BENCH_STREAM_FRAMES	300
+#define BENCH_STREAM_GOP	30
+#define BENCH_STREAM_PAYLOAD	4096
+#define BENCH_SCODE_INTERVAL	1024
+#define BENCH_SCODE_SIZE	(4 * 1024 * 1024)
+
+struct bench_size {
+	uint32_t width;
+	uint32_t height;
+};
+
+struct bench_pair {
+	uint32_t src;
+	uint32_t dst;
+};
+
+struct bench_file {
+	uint32_t format;
+	const char *filename;
+};
+
+struct bench_t {
+	struct bench_size sizes[MAX_BENCH_SIZES];
+	int size_cnt;
+	struct bench_pair pairs[MAX_BENCH_PAIRS];
+	int pair_cnt;
+	struct bench_file streams[MAX_BENCH_STREAMS];
+	int stream_cnt;
+	unsigned long iterations;
+	unsigned long frames;
+	unsigned long repeat;
+	const char *filter;
+	int json;
+	int verify;
+	int verbose;
+	FILE *out;
+	int failed;
+};
+
+static struct bench_t bench = {
+	.iterations = 1000000,
+	.frames = 60,
+	.repeat = 20,
+	.verify = true,
+};
+
+static const struct bench_pair default_pairs[] = {
+	{PIX_FMT_NV12, PIX_FMT_I420},
+	{PIX_FMT_I420, PIX_FMT_NV12},
+	{PIX_FMT_NV12, PIX_FMT_NV21},
+	{PIX_FMT_NV12, PIX_FMT_YUYV},
+	{PIX_FMT_YUYV, PIX_FMT_NV12},
+	{PIX_FMT_NV12_8L128, PIX_FMT_NV12},
+	{PIX_FMT_I420, PIX_FMT_P010},
+	{PIX_FMT_P010, PIX_FMT_NV12},
+};
+
+static const struct bench_size default_sizes[] = {
+	{1280, 720},
+	{1920, 1080},
+};
+
+static void bench_report(const char *name, const char *test,
+			 uint32_t width, uint32_t height,
+			 unsigned long ops, uint64_t ns, uint64_t bytes)
+{
+	double ns_per_op = ops ? (double)ns / ops : 0;
+	double mbps = ns ? (double)bytes * 1000 / ns : 0;
+
+	if (bench.json)
+		fprintf(bench.out, "{\"bench\":\"%s\",\"case\":\"%s\",\"width\":%d,\"height\":%d,\"ops\":%ld,\"total_ns\":%ld,\"ns_per_op\":%.2f,\"mb_per_s\":%.2f}\n",
+				name, test, width, height, ops, ns,
+				ns_per_op, mbps);
+	else
+		fprintf(bench.out, "%s,%s,%d,%d,%ld,%ld,%.2f,%.2f\n",
+				name, test, width, height, ops, ns,
+				ns_per_op, mbps);
+	fflush(bench.out);
+}
+
+static void bench_fail(const char *name, const char *test, int ret)
+{
+	fprintf(stderr, "[fail] %s %s : %d\n", name, test, ret);
+	bench.failed++;
+}
+
+static int bench_match(const char *name, const char *test)
+{
+	if (!bench.filter)
+		return true;
+	if (strstr(name, bench.filter) || strstr(test, bench.filter))
+		return true;
+
+	return false;
+}
+
+/* fill with 0x10..0xfe, there is no start code nor jpeg marker inside */
+static void fill_filler(uint8_t *buf, unsigned long size, uint32_t seed)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = 0x10 + (seed >> 16) % 0xef;
+	}
+}
+
+static int init_plane_size(struct pitcher_buf_ref *plane,
+			   unsigned int index, void *arg)
+{
+	struct pix_fmt_info *format = arg;
+
+	plane->size = format->size;
+	return pitcher_alloc_plane(plane, index, arg);
+}
+
+/* one contiguous plane holding the whole frame, like a mmap v4l2 buffer */
+static struct pitcher_buffer *alloc_frame(struct pix_fmt_info *format)
+{
+	struct pitcher_buffer_desc desc;
+	struct pitcher_buffer *buffer;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.plane_count = 1;
+	desc.init_plane = init_plane_size;
+	desc.uninit_plane = pitcher_free_plane;
+	desc.recycle = pitcher_auto_remove_buffer;
+	desc.arg = format;
+
+	buffer = pitcher_new_buffer(&desc);
+	if (!buffer)
+		return NULL;
+	buffer->format = format;
+	buffer->planes[0].bytesused = format->size;
+
+	return buffer;
+}
+
+static int get_format(struct pix_fmt_info *format, uint32_t fmt,
+		      struct bench_size *size)
+{
+	memset(format, 0, sizeof(*format));
+	format->format = fmt;
+	format->width = size->width;
+	format->height = size->height;
+
+	return pitcher_get_pix_fmt_info(format, 0);
+}
+
+static void generate_frame(struct pitcher_buffer *buffer, uint32_t seed)
+{
+	fill_filler(buffer->planes[0].virt, buffer->format->size, seed);
+}
+
+static void bench_queue(void)
+{
+	Queue q;
+	unsigned long item;
+	unsigned long i;
+	unsigned long j;
+	uint64_t ts;
+
+	if (!bench_match("queue", "push_pop"))
+		return;
+
+	q = pitcher_init_queue();
+	if (!q) {
+		bench_fail("queue", "push_pop", -RET_E_NO_MEMORY);
+		return;
+	}
+
+	ts = pitcher_get_monotonic_raw_time();
+	for (i = 0; i < bench.iterations; i += BENCH_QUEUE_DEPTH) {
+		for (j = 0; j < BENCH_QUEUE_DEPTH; j++)
+			pitcher_queue_push_back(q, i + j);
+		for (j = 0; j < BENCH_QUEUE_DEPTH; j++)
+			pitcher_queue_pop(q, &item);
+	}
+	ts = pitcher_get_monotonic_raw_time() - ts;
+	bench_report("queue", "push_pop", 0, 0, i, ts, 0);
+
+	pitcher_destroy_queue(q);
+}
+
+static void bench_pipe_skip(struct pitcher_buffer *buffer,
+			    uint32_t numerator, uint32_t denominator)
+{
+	struct pitcher_buffer *pbuf;
+	char test[64];
+	Pipe pipe;
+	unsigned long i;
+	unsigned long passed = 0;
+	uint64_t ts;
+
+	snprintf(test, sizeof(test), "skip_%d_%d", numerator, denominator);
+	if (!bench_match("pipe", test))
+		return;
+
+	pipe = pitcher_new_pipe();
+	if (!pipe) {
+		bench_fail("pipe", test, -RET_E_NO_MEMORY);
+		return;
+	}
+	pitcher_set_pipe_skip(pipe, numerator, denominator);
+
+	ts = pitcher_get_monotonic_raw_time();
+	for (i = 0; i < bench.iterations; i++) {
+		pitcher_pipe_push_back(pipe, buffer);
+		pbuf = pitcher_pipe_pop(pipe);
+		if (pbuf) {
+			passed++;
+			pitcher_put_buffer(pbuf);
+		}
+	}
+	ts = pitcher_get_monotonic_raw_time() - ts;
+	bench_report("pipe", test, 0, 0, i, ts, 0);
+
+	pitcher_del_pipe(pipe);
+
+	/* the first denominator - numerator buffers of every cycle pass */
+	if (passed != bench.iterations / denominator * (denominator - numerator) +
+			min(bench.iterations % denominator,
+			    (unsigned long)(denominator - numerator)))
+		bench_fail("pipe", test, -RET_E_NOT_MATCH);
+}
+
+static void bench_buffer(void)
+{
+	struct pix_fmt_info format;
+	struct bench_size size = {64, 64};
+	struct pitcher_buffer *buffer;
+	unsigned long i;
+	uint64_t ts;
+
+	get_format(&format, PIX_FMT_NV12, &size);
+	buffer = alloc_frame(&format);
+	if (!buffer) {
+		bench_fail("buffer", "alloc", -RET_E_NO_MEMORY);
+		return;
+	}
+
+	if (bench_match("buffer", "get_put")) {
+		ts = pitcher_get_monotonic_raw_time();
+		for (i = 0; i < bench.iterations; i++) {
+			pitcher_get_buffer(buffer);
+			pitcher_put_buffer(buffer);
+		}
+		ts = pitcher_get_monotonic_raw_time() - ts;
+		bench_report("buffer", "get_put", 0, 0, i, ts, 0);
+		if (pitcher_get_buffer_refcount(buffer) != 1)
+			bench_fail("buffer", "get_put", -RET_E_INVAL);
+	}
+
+	if (bench_match("buffer", "new_del")) {
+		struct pitcher_buffer *pbuf;
+		unsigned long count = max(bench.iterations / 100, 1UL);
+
+		ts = pitcher_get_monotonic_raw_time();
+		for (i = 0; i < count; i++) {
+			pbuf = alloc_frame(&format);
+			SAFE_RELEASE(pbuf, pitcher_put_buffer);
+		}
+		ts = pitcher_get_monotonic_raw_time() - ts;
+		bench_report("buffer", "new_del", size.width, size.height,
+				i, ts, 0);
+	}
+
+	bench_pipe_skip(buffer, 0, 1);
+	bench_pipe_skip(buffer, 1, 2);
+	bench_pipe_skip(buffer, 2, 3);
+
+	SAFE_RELEASE(buffer, pitcher_put_buffer);
+}
+
+static void bench_convert_pair(struct bench_pair *pair, struct bench_size *size)
+{
+	struct pix_fmt_info sformat;
+	struct pix_fmt_info dformat;
+	struct convert_ctx *ctx = NULL;
+	char test[64];
+	unsigned long i;
+	uint64_t ts;
+	int ret;
+
+	snprintf(test, sizeof(test), "%s:%s",
+			pitcher_get_format_name(pair->src),
+			pitcher_get_format_name(pair->dst));
+	if (!bench_match("convert", test))
+		return;
+
+	if (get_format(&sformat, pair->src, size) ||
+	    get_format(&dformat, pair->dst, size)) {
+		bench_fail("convert", test, -RET_E_NOT_SUPPORT);
+		return;
+	}
+
+	ctx = pitcher_create_sw_convert();
+	if (!ctx) {
+		bench_fail("convert", test, -RET_E_NO_MEMORY);
+		return;
+	}
+	ctx->src = alloc_frame(&sformat);
+	ctx->dst = alloc_frame(&dformat);
+	if (!ctx->src || !ctx->dst) {
+		bench_fail("convert", test, -RET_E_NO_MEMORY);
+		goto exit;
+	}
+	generate_frame(ctx->src, 0);
+
+	/* the first call allocates the intermediate buffers */
+	ret = ctx->convert_frame(ctx);
+	if (ret < 0) {
+		bench_fail("convert", test, ret);
+		goto exit;
+	}
+
+	ts = pitcher_get_monotonic_raw_time();
+	for (i = 0; i < bench.frames; i++)
+		ctx->convert_frame(ctx);
+	ts = pitcher_get_monotonic_raw_time() - ts;
+	bench_report("convert", test, size->width, size->height,
+			i, ts, (uint64_t)i * sformat.size);
+exit:
+	SAFE_RELEASE(ctx->src, pitcher_put_buffer);
+	SAFE_RELEASE(ctx->dst, pitcher_put_buffer);
+	ctx->free(ctx);
+}
+
+static void bench_convert(void)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < bench.size_cnt; i++) {
+		for (j = 0; j < bench.pair_cnt; j++)
+			bench_convert_pair(&bench.pairs[j], &bench.sizes[i]);
+	}
+}
+
+static void bench_copy(void)
+{
+	static const uint32_t formats[] = {
+		PIX_FMT_NV12, PIX_FMT_I420, PIX_FMT_YUYV, PIX_FMT_P010,
+	};
+	struct pix_fmt_info format;
+	struct pitcher_buffer *src;
+	struct pitcher_buffer *dst;
+	unsigned long i;
+	uint64_t ts;
+	int s;
+	int f;
+	int ret;
+
+	for (s = 0; s < bench.size_cnt; s++) {
+		for (f = 0; f < ARRAY_SIZE(formats); f++) {
+			const char *test = pitcher_get_format_name(formats[f]);
+
+			if (!bench_match("copy", test))
+				continue;
+			if (get_format(&format, formats[f], &bench.sizes[s]))
+				continue;
+
+			src = alloc_frame(&format);
+			dst = alloc_frame(&format);
+			ret = -RET_E_NO_MEMORY;
+			if (src && dst) {
+				generate_frame(src, f);
+				ret = pitcher_copy_buffer_data(src, dst);
+			}
+			if (ret == RET_OK && bench.verify &&
+			    memcmp(src->planes[0].virt, dst->planes[0].virt, format.size))
+				ret = -RET_E_NOT_MATCH;
+			if (ret < 0) {
+				bench_fail("copy", test, ret);
+				goto next;
+			}
+
+			ts = pitcher_get_monotonic_raw_time();
+			for (i = 0; i < bench.frames; i++)
+				pitcher_copy_buffer_data(src, dst);
+			ts = pitcher_get_monotonic_raw_time() - ts;
+			bench_report("copy", test,
+					bench.sizes[s].width,
+					bench.sizes[s].height,
+					i, ts, (uint64_t)i * format.size);
+next:
+			SAFE_RELEASE(src, pitcher_put_buffer);
+			SAFE_RELEASE(dst, pitcher_put_buffer);
+		}
+	}
+}
+
+/*
+ * synthetic elementary streams
+ *
+ * header once, then a key prefix every BENCH_STREAM_GOP frames and an inter
+ * prefix otherwise, each followed by filler payload and the trailer.
+ */
+struct bench_stream {
+	const char *name;
+	uint32_t format;
+	const uint8_t *header;
+	unsigned int header_size;
+	const uint8_t *key;
+	unsigned int key_size;
+	const uint8_t *inter;
+	unsigned int inter_size;
+	const uint8_t *trailer;
+	unsigned int trailer_size;
+	int ivf;
+	int intra;
+};
+
+static const uint8_t h264_header[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08,
+	0x9f, 0x95,
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x38, 0x80,
+};
+static const uint8_t h264_key[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x86};
+static const uint8_t h264_inter[] = {0x00, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x30};
+
+static const uint8_t h265_header[] = {
+	0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0c, 0x01, 0xff,
+	0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03,
+	0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x78, 0xa0, 0x03,
+	0xc0, 0x80, 0x11, 0x07, 0xcb,
+	0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xc1, 0x72,
+};
+static const uint8_t h265_key[] = {0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0x80};
+static const uint8_t h265_inter[] = {0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0x80};
+
+static const uint8_t mpeg2_header[] = {
+	0x00, 0x00, 0x01, 0xb3, 0x78, 0x04, 0x38, 0x13, 0xff, 0xff, 0xe0, 0x18,
+};
+static const uint8_t mpeg2_key[] = {
+	0x00, 0x00, 0x01, 0xb8, 0x00, 0x08, 0x00, 0x00,
+	0x00, 0x00, 0x01, 0x00, 0x00, 0x0f, 0xff, 0xf8,
+	0x00, 0x00, 0x01, 0x01,
+};
+static const uint8_t mpeg2_inter[] = {
+	0x00, 0x00, 0x01, 0x00, 0x00, 0x17, 0xff, 0xf8,
+	0x00, 0x00, 0x01, 0x01,
+};
+
+static const uint8_t mpeg4_header[] = {
+	0x00, 0x00, 0x01, 0xb0, 0x01, 0x00, 0x00, 0x01, 0xb5, 0x09,
+	0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x20, 0x00,
+};
+static const uint8_t mpeg4_key[] = {0x00, 0x00, 0x01, 0xb6, 0x10};
+static const uint8_t mpeg4_inter[] = {0x00, 0x00, 0x01, 0xb6, 0x50};
+
+static const uint8_t avs_header[] = {0x00, 0x00, 0x01, 0xb0, 0x20};
+static const uint8_t avs_key[] = {0x00, 0x00, 0x01, 0xb3, 0x00};
+static const uint8_t avs_inter[] = {0x00, 0x00, 0x01, 0xb6, 0x00};
+
+static const uint8_t jpeg_key[] = {0xff, 0xd8, 0xff, 0xda, 0x00, 0x02};
+static const uint8_t jpeg_trailer[] = {0xff, 0xd9};
+
+static const uint8_t vp8_key[] = {0x10};
+static const uint8_t vp8_inter[] = {0x11};
+
+static const struct bench_stream bench_streams[] = {
+	{"h264", PIX_FMT_H264, h264_header, sizeof(h264_header),
+		h264_key, sizeof(h264_key), h264_inter, sizeof(h264_inter)},
+	{"h265", PIX_FMT_H265, h265_header, sizeof(h265_header),
+		h265_key, sizeof(h265_key), h265_inter, sizeof(h265_inter)},
+	{"mpeg2", PIX_FMT_MPEG2, mpeg2_header, sizeof(mpeg2_header),
+		mpeg2_key, sizeof(mpeg2_key), mpeg2_inter, sizeof(mpeg2_inter)},
+	{"mpeg4", PIX_FMT_MPEG4, mpeg4_header, sizeof(mpeg4_header),
+		mpeg4_key, sizeof(mpeg4_key), mpeg4_inter, sizeof(mpeg4_inter)},
+	{"avs", PIX_FMT_AVS, avs_header, sizeof(avs_header),
+		avs_key, sizeof(avs_key), avs_inter, sizeof(avs_inter)},
+	{"jpeg", PIX_FMT_JPEG, NULL, 0,
+		jpeg_key, sizeof(jpeg_key), jpeg_key, sizeof(jpeg_key),
+		jpeg_trailer, sizeof(jpeg_trailer), false, true},
+	{"vp8", PIX_FMT_VP8, NULL, 0,
+		vp8_key, sizeof(vp8_key), vp8_inter, sizeof(vp8_inter),
+		NULL, 0, true},
+};
+
+static void put_le(uint8_t *p, uint64_t val, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; i++)
+		p[i] = (val >> (i * 8)) & 0xff;
+}
+
+static uint8_t *build_stream(const struct bench_stream *bs, unsigned long *size)
+{
+	unsigned long frame_size;
+	unsigned long total;
+	uint8_t *buf;
+	uint8_t *p;
+	int i;
+
+	frame_size = max(bs->key_size, bs->inter_size) + BENCH_STREAM_PAYLOAD +
+			bs->trailer_size;
+	total = bs->header_size + BENCH_STREAM_FRAMES * frame_size;
+	if (bs->ivf)
+		total += 32 + BENCH_STREAM_FRAMES * 12;
+
+	buf = pitcher_calloc(1, total);
+	if (!buf)
+		return NULL;
+
+	p = buf;
+	if (bs->ivf) {
+		memcpy(p, "DKIF", 4);
+		put_le(p + 6, 32, 2);
+		memcpy(p + 8, "VP80", 4);
+		put_le(p + 12, 1920, 2);
+		put_le(p + 14, 1080, 2);
+		put_le(p + 16, 30, 4);
+		put_le(p + 20, 1, 4);
+		put_le(p + 24, BENCH_STREAM_FRAMES, 4);
+		p += 32;
+	}
+	memcpy(p, bs->header, bs->header_size);
+	p += bs->header_size;
+
+	for (i = 0; i < BENCH_STREAM_FRAMES; i++) {
+		const uint8_t *prefix = bs->inter;
+		unsigned int len = bs->inter_size;
+
+		if (!(i % BENCH_STREAM_GOP)) {
+			prefix = bs->key;
+			len = bs->key_size;
+		}
+		if (bs->ivf) {
+			put_le(p, len + BENCH_STREAM_PAYLOAD, 4);
+			put_le(p + 4, i, 8);
+			p += 12;
+		}
+		memcpy(p, prefix, len);
+		p += len;
+		fill_filler(p, BENCH_STREAM_PAYLOAD, i);
+		p += BENCH_STREAM_PAYLOAD;
+		if (bs->trailer_size) {
+			memcpy(p, bs->trailer, bs->trailer_size);
+			p += bs->trailer_size;
+		}
+	}
+
+	*size = p - buf;
+	return buf;
+}
+
+static int parse_once(uint32_t format, void *virt, unsigned long size,
+		      unsigned long *frames, unsigned long *keys)
+{
+	struct pitcher_parser *p;
+	int ret;
+
+	p = pitcher_new_parser();
+	if (!p)
+		return -RET_E_NO_MEMORY;
+	p->format = format;
+	p->virt = virt;
+	p->size = size;
+	pitcher_init_parser(p);
+
+	ret = pitcher_parse(p);
+	if (ret == RET_OK && keys)
+		ret = pitcher_parser_build_index(p);
+	if (ret == RET_OK) {
+		if (frames)
+			*frames = p->index_cnt;
+		if (keys)
+			*keys = p->key_cnt;
+	}
+	SAFE_RELEASE(p, pitcher_del_parser);
+
+	return ret;
+}
+
+static void bench_parse_buffer(const char *test, uint32_t format,
+			       void *virt, unsigned long size,
+			       unsigned long expect, unsigned long expect_keys)
+{
+	unsigned long frames = 0;
+	unsigned long keys = 0;
+	unsigned long i;
+	uint64_t ts;
+	int ret;
+
+	ret = parse_once(format, virt, size, &frames, &keys);
+	if (ret == RET_OK && expect &&
+	    (frames != expect || keys != expect_keys))
+		ret = -RET_E_NOT_MATCH;
+	if (ret < 0) {
+		bench_fail("parse", test, ret);
+		return;
+	}
+
+	ts = pitcher_get_monotonic_raw_time();
+	for (i = 0; i < bench.repeat; i++)
+		parse_once(format, virt, size, NULL, NULL);
+	ts = pitcher_get_monotonic_raw_time() - ts;
+	bench_report("parse", test, 0, 0, i * frames, ts, (uint64_t)i * size);
+}
+
+static void bench_parse_file(struct bench_file *bf)
+{
+	const char *test = pitcher_get_format_name(bf->format);
+	void *virt;
+	long size;
+	int fd;
+
+	if (!bench_match("parse", test) && !bench_match("parse", bf->filename))
+		return;
+
+	size = pitcher_get_file_size(bf->filename);
+	fd = open(bf->filename, O_RDONLY);
+	if (size <= 0 || fd < 0) {
+		bench_fail("parse", bf->filename, -RET_E_OPEN);
+		SAFE_CLOSE(fd, close);
+		return;
+	}
+	virt = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (virt == MAP_FAILED) {
+		bench_fail("parse", bf->filename, -RET_E_MMAP);
+		close(fd);
+		return;
+	}
+
+	bench_parse_buffer(test, bf->format, virt, size, 0, 0);
+
+	munmap(virt, size);
+	close(fd);
+}
+
+static void bench_parse(void)
+{
+	const struct bench_stream *bs;
+	unsigned long size;
+	uint8_t *buf;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_streams); i++) {
+		bs = &bench_streams[i];
+		if (!bench_match("parse", bs->name))
+			continue;
+
+		buf = build_stream(bs, &size);
+		if (!buf) {
+			bench_fail("parse", bs->name, -RET_E_NO_MEMORY);
+			continue;
+		}
+		bench_parse_buffer(bs->name, bs->format, buf, size,
+				   BENCH_STREAM_FRAMES,
+				   bs->intra ? BENCH_STREAM_FRAMES :
+				   DIV_ROUND_UP(BENCH_STREAM_FRAMES, BENCH_STREAM_GOP));
+		SAFE_RELEASE(buf, pitcher_free);
+	}
+
+	for (i = 0; i < bench.stream_cnt; i++)
+		bench_parse_file(&bench.streams[i]);
+}
+
+/* the bare start code scanner, without any codec specific check */
+static void bench_scode(void)
+{
+	struct pitcher_parser_scode scode = {
+		.scode = 0x000001,
+		.mask = 0xffffff,
+		.num = 3,
+	};
+	struct pitcher_parser *p;
+	unsigned long frames = 0;
+	unsigned long i;
+	uint8_t *buf;
+	uint64_t ts;
+	uint64_t total = 0;
+
+	if (!bench_match("scode", "000001"))
+		return;
+
+	buf = pitcher_calloc(1, BENCH_SCODE_SIZE);
+	if (!buf) {
+		bench_fail("scode", "000001", -RET_E_NO_MEMORY);
+		return;
+	}
+	fill_filler(buf, BENCH_SCODE_SIZE, 0);
+	for (i = 0; i + 3 <= BENCH_SCODE_SIZE; i += BENCH_SCODE_INTERVAL) {
+		buf[i] = 0;
+		buf[i + 1] = 0;
+		buf[i + 2] = 1;
+	}
+
+	for (i = 0; i < bench.repeat; i++) {
+		p = pitcher_new_parser();
+		if (!p)
+			break;
+		p->virt = (char *)buf;
+		p->size = BENCH_SCODE_SIZE;
+		pitcher_init_parser(p);
+
+		ts = pitcher_get_monotonic_raw_time();
+		pitcher_parse_startcode(p, &scode);
+		total += pitcher_get_monotonic_raw_time() - ts;
+
+		if (!frames) {
+			struct pitcher_frame *frame;
+
+			list_for_each_entry(frame, &p->queue, list)
+				frames++;
+		}
+		SAFE_RELEASE(p, pitcher_del_parser);
+	}
+	if (frames != BENCH_SCODE_SIZE / BENCH_SCODE_INTERVAL)
+		bench_fail("scode", "000001", -RET_E_NOT_MATCH);
+	else
+		bench_report("scode", "000001", 0, 0, i * frames, total,
+				(uint64_t)i * BENCH_SCODE_SIZE);
+
+	SAFE_RELEASE(buf, pitcher_free);
+}
+
+/*
+ * synthetic graph: generator -> sw convert -> verify or null sink
+ *
+ * The generator cycles through BENCH_PATTERN_COUNT pregenerated frames and
+ * tags each buffer with the pattern number, the verify sink compares every
+ * output with the reference conversion of that pattern.
+ */
+struct graph_node {
+	struct graph_t *graph;
+	struct pitcher_unit_desc desc;
+	struct pix_fmt_info *format;
+	int chnno;
+	int end;
+	unsigned long count;
+};
+
+struct graph_t {
+	struct pix_fmt_info sformat;
+	struct pix_fmt_info dformat;
+	struct pitcher_buffer *patterns[BENCH_PATTERN_COUNT];
+	struct pitcher_buffer *refs[BENCH_PATTERN_COUNT];
+	struct convert_ctx *ctx;
+	struct graph_node gen;
+	struct graph_node cvt;
+	struct graph_node sink;
+	int verify;
+	unsigned long mismatch;
+};
+
+static int graph_recycle_buffer(struct pitcher_buffer *buffer,
+				void *arg, int *del)
+{
+	struct graph_node *node = arg;
+	int is_end = false;
+
+	if (pitcher_is_active(node->chnno) && !node->end)
+		pitcher_put_buffer_idle(node->chnno, buffer);
+	else
+		is_end = true;
+
+	if (del)
+		*del = is_end;
+
+	return RET_OK;
+}
+
+static struct pitcher_buffer *graph_alloc_buffer(void *arg)
+{
+	struct graph_node *node = arg;
+	struct pitcher_buffer_desc desc;
+	struct pitcher_buffer *buffer;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.plane_count = 1;
+	desc.plane_size[0] = node->format->size;
+	desc.init_plane = pitcher_alloc_plane;
+	desc.uninit_plane = pitcher_free_plane;
+	desc.recycle = graph_recycle_buffer;
+	desc.arg = node;
+
+	buffer = pitcher_new_buffer(&desc);
+	if (buffer)
+		buffer->format = node->format;
+
+	return buffer;
+}
+
+static int graph_gen_checkready(void *arg, int *is_end)
+{
+	struct graph_node *node = arg;
+
+	if (node->count >= bench.frames)
+		node->end = true;
+	if (is_end)
+		*is_end = node->end;
+	if (node->end)
+		return false;
+
+	return pitcher_poll_idle_buffer(node->chnno);
+}
+
+static int graph_gen_run(void *arg, struct pitcher_buffer *pbuf)
+{
+	struct graph_node *node = arg;
+	struct graph_t *graph = node->graph;
+	struct pitcher_buffer *buffer;
+	unsigned int idx = node->count % BENCH_PATTERN_COUNT;
+
+	buffer = pitcher_get_idle_buffer(node->chnno);
+	if (!buffer)
+		return -RET_E_NOT_READY;
+
+	memcpy(buffer->planes[0].virt, graph->patterns[idx]->planes[0].virt,
+			graph->sformat.size);
+	buffer->planes[0].bytesused = graph->sformat.size;
+	buffer->format = &graph->sformat;
+	buffer->index = idx;
+	node->count++;
+	if (node->count >= bench.frames)
+		buffer->flags |= PITCHER_BUFFER_FLAG_LAST;
+	pitcher_push_back_output(node->chnno, buffer);
+	SAFE_RELEASE(buffer, pitcher_put_buffer);
+
+	return RET_OK;
+}
+
+static int graph_cvt_checkready(void *arg, int *is_end)
+{
+	struct graph_node *node = arg;
+	int source;
+
+	if (!pitcher_chn_poll_input(node->chnno)) {
+		source = pitcher_get_source(node->chnno);
+		if (source < 0 || !pitcher_is_active(source))
+			node->end = true;
+	}
+	if (is_end)
+		*is_end = node->end;
+	if (node->end)
+		return false;
+	if (!pitcher_chn_poll_input(node->chnno))
+		return false;
+
+	return pitcher_poll_idle_buffer(node->chnno);
+}
+
+static int graph_cvt_run(void *arg, struct pitcher_buffer *pbuf)
+{
+	struct graph_node *node = arg;
+	struct graph_t *graph = node->graph;
+	struct pitcher_buffer *buffer;
+	int ret;
+
+	buffer = pitcher_get_idle_buffer(node->chnno);
+	if (!buffer)
+		return -RET_E_NOT_READY;
+
+	graph->ctx->src = pbuf;
+	graph->ctx->dst = buffer;
+	ret = graph->ctx->convert_frame(graph->ctx);
+	graph->ctx->src = NULL;
+	graph->ctx->dst = NULL;
+	if (ret < 0) {
+		pitcher_set_error(node->chnno);
+		SAFE_RELEASE(buffer, pitcher_put_buffer);
+		return ret;
+	}
+
+	buffer->planes[0].bytesused = graph->dformat.size;
+	buffer->index = pbuf->index;
+	buffer->flags |= (pbuf->flags & PITCHER_BUFFER_FLAG_LAST);
+	pitcher_push_back_output(node->chnno, buffer);
+	SAFE_RELEASE(buffer, pitcher_put_buffer);
+	node->count++;
+	if (pbuf->flags & PITCHER_BUFFER_FLAG_LAST)
+		node->end = true;
+
+	return RET_OK;
+}
+
+static int graph_sink_checkready(void *arg, int *is_end)
+{
+	struct graph_node *node = arg;
+	int source;
+
+	if (!pitcher_chn_poll_input(node->chnno)) {
+		source = pitcher_get_source(node->chnno);
+		if (source < 0 || !pitcher_is_active(source))
+			node->end = true;
+	}
+	if (is_end)
+		*is_end = node->end;
+	if (node->end)
+		return false;
+
+	return pitcher_chn_poll_input(node->chnno);
+}
+
+static int graph_sink_run(void *arg, struct pitcher_buffer *pbuf)
+{
+	struct graph_node *node = arg;
+	struct graph_t *graph = node->graph;
+	struct pitcher_buffer *ref;
+
+	if (graph->verify) {
+		ref = graph->refs[pbuf->index % BENCH_PATTERN_COUNT];
+		if (memcmp(pbuf->planes[0].virt, ref->planes[0].virt,
+			   graph->dformat.size))
+			graph->mismatch++;
+	}
+	node->count++;
+	if (pbuf->flags & PITCHER_BUFFER_FLAG_LAST)
+		node->end = true;
+
+	return RET_OK;
+}
+
+static int graph_register(PitcherContext context, struct graph_node *node,
+			  struct graph_t *graph, const char *name,
+			  struct pix_fmt_info *format,
+			  int (*check_ready)(void *arg, int *is_end),
+			  int (*runfunc)(void *arg, struct pitcher_buffer *pbuf))
+{
+	int ret;
+
+	node->graph = graph;
+	node->format = format;
+	node->desc.fd = -1;
+	if (format) {
+		node->desc.alloc_buffer = graph_alloc_buffer;
+		node->desc.buffer_count = BENCH_GRAPH_BUFFERS;
+	}
+	node->desc.check_ready = check_ready;
+	node->desc.runfunc = runfunc;
+	snprintf(node->desc.name, sizeof(node->desc.name), "%s", name);
+
+	ret = pitcher_register_chn(context, &node->desc, node);
+	if (ret < 0)
+		return ret;
+	node->chnno = ret;
+
+	return RET_OK;
+}
+
+static int graph_prepare(struct graph_t *graph)
+{
+	struct convert_ctx *ctx;
+	int ret = RET_OK;
+	int i;
+
+	ctx = pitcher_create_sw_convert();
+	if (!ctx)
+		return -RET_E_NO_MEMORY;
+
+	for (i = 0; i < BENCH_PATTERN_COUNT; i++) {
+		graph->patterns[i] = alloc_frame(&graph->sformat);
+		graph->refs[i] = alloc_frame(&graph->dformat);
+		if (!graph->patterns[i] || !graph->refs[i]) {
+			ret = -RET_E_NO_MEMORY;
+			break;
+		}
+		generate_frame(graph->patterns[i], i + 1);
+		ctx->src = graph->patterns[i];
+		ctx->dst = graph->refs[i];
+		ret = ctx->convert_frame(ctx);
+		if (ret < 0)
+			break;
+	}
+	ctx->free(ctx);
+
+	return ret;
+}
+
+static void graph_release(struct graph_t *graph)
+{
+	int i;
+
+	for (i = 0; i < BENCH_PATTERN_COUNT; i++) {
+		SAFE_RELEASE(graph->patterns[i], pitcher_put_buffer);
+		SAFE_RELEASE(graph->refs[i], pitcher_put_buffer);
+	}
+	SAFE_RELEASE(graph->ctx, graph->ctx->free);
+}
+
+static void bench_graph_pair(struct bench_pair *pair, struct bench_size *size,
+			     int verify)
+{
+	struct graph_t graph;
+	PitcherContext context = NULL;
+	char test[64];
+	uint64_t ts;
+	int ret;
+
+	snprintf(test, sizeof(test), "%s:%s:%s",
+			pitcher_get_format_name(pair->src),
+			pitcher_get_format_name(pair->dst),
+			verify ? "verify" : "null");
+	if (!bench_match("graph", test))
+		return;
+
+	memset(&graph, 0, sizeof(graph));
+	graph.verify = verify;
+	ret = get_format(&graph.sformat, pair->src, size);
+	if (ret == RET_OK)
+		ret = get_format(&graph.dformat, pair->dst, size);
+	if (ret == RET_OK)
+		ret = graph_prepare(&graph);
+	if (ret < 0)
+		goto exit;
+
+	graph.ctx = pitcher_create_sw_convert();
+	context = pitcher_init();
+	if (!graph.ctx || !context) {
+		ret = -RET_E_NO_MEMORY;
+		goto exit;
+	}
+
+	ret = graph_register(context, &graph.gen, &graph, "generator",
+			     &graph.sformat, graph_gen_checkready, graph_gen_run);
+	if (ret == RET_OK)
+		ret = graph_register(context, &graph.cvt, &graph, "convert",
+				     &graph.dformat, graph_cvt_checkready,
+				     graph_cvt_run);
+	if (ret == RET_OK)
+		ret = graph_register(context, &graph.sink, &graph, "sink",
+				     NULL, graph_sink_checkready, graph_sink_run);
+	if (ret == RET_OK)
+		ret = pitcher_connect(graph.gen.chnno, graph.cvt.chnno);
+	if (ret == RET_OK)
+		ret = pitcher_connect(graph.cvt.chnno, graph.sink.chnno);
+	if (ret < 0)
+		goto exit;
+
+	ts = pitcher_get_monotonic_raw_time();
+	ret = pitcher_start(context);
+	if (ret < 0)
+		goto exit;
+	pitcher_run(context);
+	pitcher_stop(context);
+	ts = pitcher_get_monotonic_raw_time() - ts;
+
+	if (graph.sink.count != bench.frames || graph.mismatch)
+		ret = -RET_E_NOT_MATCH;
+	else
+		bench_report("graph", test, size->width, size->height,
+				graph.sink.count, ts,
+				(uint64_t)graph.sink.count * graph.sformat.size);
+exit:
+	if (ret < 0)
+		bench_fail("graph", test, ret);
+	/* releasing the context disconnects and deletes the channels */
+	SAFE_RELEASE(context, pitcher_release);
+	graph_release(&graph);
+}
+
+static void bench_graph(void)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < bench.size_cnt; i++) {
+		for (j = 0; j < bench.pair_cnt; j++) {
+			if (bench.verify)
+				bench_graph_pair(&bench.pairs[j],
+						 &bench.sizes[i], true);
+			bench_graph_pair(&bench.pairs[j], &bench.sizes[i], false);
+		}
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*func)(void);
+	const char *desc;
+} bench_cases[] = {
+	{"queue", bench_queue, "queue push/pop, 64 items deep"},
+	{"buffer", bench_buffer, "buffer get/put, new/delete and pipe push/pop with skip"},
+	{"convert", bench_convert, "pitcher_sw_convert_frame per format pair and size"},
+	{"copy", bench_copy, "pitcher_copy_buffer_data per format and size"},
+	{"scode", bench_scode, "start code scanner on a 4M buffer"},
+	{"parse", bench_parse, "each parser on a synthetic stream, and --stream files"},
+	{"graph", bench_graph, "generator -> convert -> verify/null sink in pitcher core"},
+};
+
+static int parse_size(const char *str)
+{
+	struct bench_size *size;
+
+	if (bench.size_cnt >= MAX_BENCH_SIZES)
+		return -RET_E_INVAL;
+
+	size = &bench.sizes[bench.size_cnt];
+	if (sscanf(str, "%ux%u", &size->width, &size->height) != 2 ||
+	    !size->width || !size->height)
+		return -RET_E_INVAL;
+	bench.size_cnt++;
+
+	return RET_OK;
+}
+
+static int parse_pair(const char *str)
+{
+	struct bench_pair *pair;
+	char src[32];
+	char dst[32];
+
+	if (bench.pair_cnt >= MAX_BENCH_PAIRS)
+		return -RET_E_INVAL;
+	if (sscanf(str, "%31[^:]:%31s", src, dst) != 2)
+		return -RET_E_INVAL;
+
+	pair = &bench.pairs[bench.pair_cnt];
+	pair->src = pitcher_get_format_by_name(src);
+	pair->dst = pitcher_get_format_by_name(dst);
+	if (pair->src == PIX_FMT_NONE || pair->dst == PIX_FMT_NONE ||
+	    pair->src >= PIX_FMT_COMPRESSED || pair->dst >= PIX_FMT_COMPRESSED)
+		return -RET_E_INVAL;
+	bench.pair_cnt++;
+
+	return RET_OK;
+}
+
+static int parse_stream(const char *str)
+{
+	struct bench_file *bf;
+	char fmt[32];
+	int n = 0;
+
+	if (bench.stream_cnt >= MAX_BENCH_STREAMS)
+		return -RET_E_INVAL;
+	if (sscanf(str, "%31[^:]:%n", fmt, &n) != 1 || !n || !str[n])
+		return -RET_E_INVAL;
+
+	bf = &bench.streams[bench.stream_cnt];
+	bf->format = pitcher_get_format_by_name(fmt);
+	bf->filename = str + n;
+	if (!is_support_parser(bf->format))
+		return -RET_E_NOT_SUPPORT;
+	bench.stream_cnt++;
+
+	return RET_OK;
+}
+
+static void show_help(const char *name)
+{
+	int i;
+
+	printf("usage: %s [options]\n", name);
+	printf("  -s, --size <WxH>         frame size, may be repeated, default 1280x720 and 1920x1080\n");
+	printf("  -c, --convert <src:dst>  format pair to convert, may be repeated\n");
+	printf("  -S, --stream <fmt:file>  parse a real stream as well, may be repeated\n");
+	printf("  -n, --iterations <num>   operations of the queue/buffer/pipe cases, default %ld\n",
+			bench.iterations);
+	printf("  -F, --frames <num>       frames of the convert/copy/graph cases, default %ld\n",
+			bench.frames);
+	printf("  -r, --repeat <num>       passes of the scode/parse cases, default %ld\n",
+			bench.repeat);
+	printf("  -f, --filter <str>       only run the cases whose bench or case name contains str\n");
+	printf("  -j, --json               write json lines instead of csv\n");
+	printf("  -o, --output <file>      write the results to file instead of stdout\n");
+	printf("  -N, --no-verify          skip the output checks and the verify sink graphs\n");
+	printf("  -v, --verbose            keep the pitcher log on stdout\n");
+	printf("  -h, --help               show this help\n");
+	printf("benches:\n");
+	for (i = 0; i < ARRAY_SIZE(bench_cases); i++)
+		printf("  %-8s %s\n", bench_cases[i].name, bench_cases[i].desc);
+}
+
+int main(int argc, char *argv[])
+{
+	struct option options[] = {
+		{"size", required_argument, NULL, 's'},
+		{"convert", required_argument, NULL, 'c'},
+		{"stream", required_argument, NULL, 'S'},
+		{"iterations", required_argument, NULL, 'n'},
+		{"frames", required_argument, NULL, 'F'},
+		{"repeat", required_argument, NULL, 'r'},
+		{"filter", required_argument, NULL, 'f'},
+		{"json", no_argument, NULL, 'j'},
+		{"output", required_argument, NULL, 'o'},
+		{"no-verify", no_argument, NULL, 'N'},
+		{"verbose", no_argument, NULL, 'v'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0},
+	};
+	const char *output = NULL;
+	int ret = RET_OK;
+	int opt;
+	int i;
+
+	while ((opt = getopt_long(argc, argv, "s:c:S:n:F:r:f:jo:Nvh", options, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			ret = parse_size(optarg);
+			break;
+		case 'c':
+			ret = parse_pair(optarg);
+			break;
+		case 'S':
+			ret = parse_stream(optarg);
+			break;
+		case 'n':
+			bench.iterations = max(strtoul(optarg, NULL, 0), 1UL);
+			break;
+		case 'F':
+			bench.frames = max(strtoul(optarg, NULL, 0), 1UL);
+			break;
+		case 'r':
+			bench.repeat = max(strtoul(optarg, NULL, 0), 1UL);
+			break;
+		case 'f':
+			bench.filter = optarg;
+			break;
+		case 'j':
+			bench.json = true;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'N':
+			bench.verify = false;
+			break;
+		case 'v':
+			bench.verbose = true;
+			break;
+		case 'h':
+		default:
+			show_help(argv[0]);
+			return opt == 'h' ? 0 : -RET_E_INVAL;
+		}
+		if (ret < 0) {
+			PITCHER_ERR("invalid argument : %s\n", optarg);
+			return ret;
+		}
+	}
+
+	if (!bench.size_cnt) {
+		for (i = 0; i < ARRAY_SIZE(default_sizes); i++)
+			bench.sizes[bench.size_cnt++] = default_sizes[i];
+	}
+	if (!bench.pair_cnt) {
+		for (i = 0; i < ARRAY_SIZE(default_pairs); i++)
+			bench.pairs[bench.pair_cnt++] = default_pairs[i];
+	}
+
+	if (output)
+		bench.out = fopen(output, "w");
+	else
+		bench.out = fdopen(dup(STDOUT_FILENO), "w");
+	if (!bench.out) {
+		PITCHER_ERR("open output fail\n");
+		return -RET_E_OPEN;
+	}
+	/* the parsers and the core log on stdout, keep them out of the results */
+	if (!bench.verbose && !freopen("/dev/null", "w", stdout))
+		PITCHER_ERR("can't silence the pitcher log\n");
+
+	if (!bench.json)
+		fprintf(bench.out, "bench,case,width,height,ops,total_ns,ns_per_op,mb_per_s\n");
+	for (i = 0; i < ARRAY_SIZE(bench_cases); i++)
+		bench_cases[i].func();
+
+	fclose(bench.out);
+	fprintf(stderr, "fail : %d, memory : %ld\n",
+			bench.failed, pitcher_memory_count());
+
+	return bench.failed ? -RET_E_NOT_MATCH : RET_OK;
+}
@@ -33,6 +33,7 @@
 #include "pitcher/platform_8x.h"
 #include "pitcher/convert.h"
 #include "pitcher/dmabuf.h"
+#include "pitcher/swcodec.h"
 #include "mxc_v4l2_vpu_enc.h"
 
 #define STRING(x)		#x
@@ -78,6 +79,8 @@ struct encoder_test_t {
 	uint32_t cpbsize;
 
 	const char *devnode;
+	const char *backend;
+	struct swcodec_node_t *swc;
 };
 
 struct decoder_test_t {
@@ -90,6 +93,8 @@ struct decoder_test_t {
 
 	uint32_t sizeimage;
 	const char *devnode;
+	const char *backend;
+	struct swcodec_node_t *swc;
 
 	struct platform_t platform;
 };
@@ -136,6 +141,13 @@ struct convert_test_t {
 	struct convert_ctx *ctx;
 };
 
+enum {
+	PARSER_TRICK_NORMAL = 0,
+	PARSER_TRICK_IFRAME,
+	PARSER_TRICK_REVERSE,
+	PARSER_TRICK_IREVERSE,
+};
+
 struct parser_test_t {
 	struct test_node node;
 	struct pitcher_unit_desc desc;
@@ -149,7 +161,6 @@ struct parser_test_t {
 	int mem_type;
 	void *virt;
 	unsigned long size;
-	unsigned long offset;
 	int end;
 	int loop;
 	int show;
@@ -161,6 +172,11 @@ struct parser_test_t {
 		unsigned int pos_new;
 	} seek;
 
+	char *index;
+	int trick;
+	long pos;
+	long gop;
+
 	Parser p;
 };
 
@@ -190,7 +206,6 @@ struct mxc_vpu_test_subcmd {
 
 int flush_enc(struct v4l2_component_t *component);
 int flush_dec(struct v4l2_component_t *component);
-void scan_and_connect_sink(struct test_node *src);
 
 static uint32_t bitmask;
 static struct test_node *nodes[MAX_NODE_COUNT];
@@ -642,6 +657,8 @@ struct mxc_vpu_test_option encoder_options[] = {
 	{"seqhdr", 1, "--seqhdr <set>\n\t\t\tset encoder idr sequence header"},
 	{"cpbsize", 1, "--cpbsize <size>\n\t\t\tset encoder coded picture buffer size, the unit is b"},
 	{"quality", 1, "--quality <quality>\n\t\t\tset jpeg quality"},
+	{"backend", 1, "--backend <name>\n\t\t\tuse software codec instead of v4l2 device,\n\
+		       \r\t\t\tbuilt-in passthrough or path of a codec library"},
 	{NULL, 0, NULL},
 };
 
@@ -655,6 +672,8 @@ struct mxc_vpu_test_option decoder_options[] = {
 	{"dis_delay", 1, "--dis_delay <number>\n\t\t\tSet dec display delay"},
 	{"fmt", 1, "--fmt <fmt>\n\t\t\tassign encode pixel format, support nv12, nv21,\n\
 		    \r\t\t\ti420, dtrc, dtrc10, P010, nvx2, rfc, rfcx, nv16"},
+	{"backend", 1, "--backend <name>\n\t\t\tuse software codec instead of v4l2 device,\n\
+		       \r\t\t\tbuilt-in passthrough or path of a codec library"},
 	{NULL, 0, NULL},
 };
 
@@ -685,6 +704,8 @@ struct mxc_vpu_test_option parser_options[] = {
 	{"skip", 1, "--skip <number>\n\t\t\tset skip frame number"},
 	{"seek", 3, "--seek <input number> <decode number> <new position>\n\t\t\tseek"},
 	{"show", 0, "--show\n\t\t\tshow size and offset of per frame"},
+	{"index", 1, "--index <filename>\n\t\t\tload frame index from file, or save it after parsing"},
+	{"trick", 1, "--trick <mode>\n\t\t\tset trick mode, support normal, iframe, reverse, ireverse"},
 	{NULL, 0, NULL},
 };
 
@@ -831,6 +852,11 @@ void free_encoder_node(struct test_node *node)
 	if (!node)
 		return;
 	encoder = container_of(node, struct encoder_test_t, node);
+	if (encoder->backend) {
+		SAFE_RELEASE(encoder->swc, close_swcodec);
+		SAFE_RELEASE(encoder, pitcher_free);
+		return;
+	}
 
 	PITCHER_LOG("encoder frame count : %ld -> %ld\n",
 			encoder->output.frame_count,
@@ -912,6 +938,8 @@ int get_encoder_source_chnno(struct test_node *node)
 		return -RET_E_INVAL;
 
 	encoder = container_of(node, struct encoder_test_t, node);
+	if (encoder->backend)
+		return get_swcodec_source_chnno(encoder->swc);
 
 	return encoder->capture.chnno;
 }
@@ -924,6 +952,8 @@ int get_encoder_sink_chnno(struct test_node *node)
 		return -RET_E_INVAL;
 
 	encoder = container_of(node, struct encoder_test_t, node);
+	if (encoder->backend)
+		return get_swcodec_sink_chnno(encoder->swc);
 
 	return encoder->output.chnno;
 }
@@ -1174,6 +1204,14 @@ int init_encoder_node(struct test_node *node)
 		return -RET_E_INVAL;
 
 	encoder = container_of(node, struct encoder_test_t, node);
+	if (encoder->backend) {
+		encoder->swc = open_swcodec(node, encoder->backend,
+					    PITCHER_SWCODEC_ENCODER);
+		if (!encoder->swc)
+			return -RET_E_OPEN;
+		return RET_OK;
+	}
+
 	encoder->capture.pixelformat = encoder->node.pixelformat;
 	if (encoder->devnode) {
 		encoder->fd = open(encoder->devnode, O_RDWR | O_NONBLOCK);
@@ -1417,6 +1455,8 @@ int parse_encoder_option(struct test_node *node,
 		encoder->cpbsize = strtol(argv[0], NULL, 0);
 	} else if (!strcasecmp(option->name, "quality")) {
 		encoder->quality = strtol(argv[0], NULL, 0);
+	} else if (!strcasecmp(option->name, "backend")) {
+		encoder->backend = argv[0];
 	}
 
 	return RET_OK;
@@ -1430,6 +1470,8 @@ int get_deocder_source_chnno(struct test_node *node)
 		return -RET_E_INVAL;
 
 	decoder = container_of(node, struct decoder_test_t, node);
+	if (decoder->backend)
+		return get_swcodec_source_chnno(decoder->swc);
 
 	return decoder->capture.chnno;
 }
@@ -1442,6 +1484,8 @@ int get_deocder_sink_chnno(struct test_node *node)
 		return -RET_E_INVAL;
 
 	decoder = container_of(node, struct decoder_test_t, node);
+	if (decoder->backend)
+		return get_swcodec_sink_chnno(decoder->swc);
 
 	return decoder->output.chnno;
 }
@@ -1494,6 +1538,11 @@ void free_decoder_node(struct test_node *node)
 		return;
 
 	decoder = container_of(node, struct decoder_test_t, node);
+	if (decoder->backend) {
+		SAFE_RELEASE(decoder->swc, close_swcodec);
+		SAFE_RELEASE(decoder, pitcher_free);
+		return;
+	}
 
 	PITCHER_LOG("decoder frame count : %ld -> %ld\n",
 			decoder->output.frame_count,
@@ -1573,6 +1622,14 @@ int init_decoder_node(struct test_node *node)
 		return -RET_E_INVAL;
 
 	decoder = container_of(node, struct decoder_test_t, node);
+	if (decoder->backend) {
+		decoder->swc = open_swcodec(node, decoder->backend,
+					    PITCHER_SWCODEC_DECODER);
+		if (!decoder->swc)
+			return -RET_E_OPEN;
+		return RET_OK;
+	}
+
 	decoder->capture.pixelformat = decoder->node.pixelformat;
 	PITCHER_LOG("decode capture format: %s\n",
 			pitcher_get_format_name(decoder->capture.pixelformat));
@@ -1712,6 +1769,8 @@ int parse_decoder_option(struct test_node *node,
 		decoder->platform.dis_reorder = strtol(argv[0], NULL, 0);
 	} else if (!strcasecmp(option->name, "dis_delay")) {
 		decoder->dec_display_delay = (int)strtol(argv[0], NULL, 0);
+	} else if (!strcasecmp(option->name, "backend")) {
+		decoder->backend = argv[0];
 	}
 
 	return RET_OK;
@@ -2818,18 +2877,62 @@ int parser_checkready(void *arg, int *is_end)
 	return false;
 }
 
+static long parser_first_pos(struct parser_test_t *parser)
+{
+	struct pitcher_parser *p = parser->p;
+
+	switch (parser->trick) {
+	case PARSER_TRICK_IFRAME:
+		return pitcher_parser_next_key(p, -1);
+	case PARSER_TRICK_REVERSE:
+		parser->gop = pitcher_parser_find_key(p, p->index_cnt - 1);
+		return parser->gop;
+	case PARSER_TRICK_IREVERSE:
+		return pitcher_parser_find_key(p, p->index_cnt - 1);
+	default:
+		return 0;
+	}
+}
+
+/*
+ * reverse plays the gops from the last one to the first one, the frames
+ * in a gop are still in decoding order; ireverse only plays the key frames
+ */
+static long parser_next_pos(struct parser_test_t *parser, long pos)
+{
+	struct pitcher_parser *p = parser->p;
+	long next;
+
+	switch (parser->trick) {
+	case PARSER_TRICK_IFRAME:
+		return pitcher_parser_next_key(p, pos);
+	case PARSER_TRICK_REVERSE:
+		next = pos + 1;
+		if (next < p->index_cnt && next != pitcher_parser_next_key(p, pos))
+			return next;
+		if (parser->gop <= 0)
+			return -1;
+		parser->gop = pitcher_parser_find_key(p, parser->gop - 1);
+		return parser->gop;
+	case PARSER_TRICK_IREVERSE:
+		return pitcher_parser_find_key(p, pos - 1);
+	default:
+		next = pos + 1;
+		return next < p->index_cnt ? next : -1;
+	}
+}
+
 int parser_run(void *arg, struct pitcher_buffer *pbuf)
 {
 	struct parser_test_t *parser = arg;
 	struct pitcher_buffer *buffer;
-	struct pitcher_frame *frame;
+	struct pitcher_frame_index *frame;
 	unsigned int seek_flag = 0;
 
 	if (!parser || parser->fd < 0)
 		return -RET_E_INVAL;
 
-	frame = pitcher_parser_cur_frame(parser->p);
-
+	frame = pitcher_parser_get_index(parser->p, parser->pos);
 	if (!frame) {
 		parser->end = true;
 		return RET_OK;
@@ -2839,24 +2942,17 @@ int parser_run(void *arg, struct pitcher_buffer *pbuf)
 	if (!buffer)
 		return -RET_E_NOT_READY;
 
-	if (parser->offset < parser->size) {
-		buffer->planes[0].bytesused = frame->size;
-		buffer->planes[0].virt = parser->virt + frame->offset;
-		parser->offset += buffer->planes[0].bytesused;
-		parser->frame_count++;
-		pitcher_parser_to_next_frame(parser->p);
-
-		if (frame->flag == PITCHER_BUFFER_FLAG_LAST || parser->offset >= parser->size) {
-			if (parser->loop) {
-				parser->loop--;
-				parser->offset = 0;
-				pitcher_parser_seek_to_begin(parser->p);
-			} else {
-				parser->end = true;
-			}
+	buffer->planes[0].bytesused = frame->size;
+	buffer->planes[0].virt = parser->virt + frame->offset;
+	parser->frame_count++;
+	parser->pos = parser_next_pos(parser, parser->pos);
+	if (parser->pos < 0) {
+		if (parser->loop) {
+			parser->loop--;
+			parser->pos = parser_first_pos(parser);
+		} else {
+			parser->end = true;
 		}
-	} else {
-		parser->end = true;
 	}
 
 	if (parser->seek.enable && parser->frame_count == parser->seek.pos_seek)
@@ -2881,11 +2977,16 @@ int parser_run(void *arg, struct pitcher_buffer *pbuf)
 	SAFE_RELEASE(buffer, pitcher_put_buffer);
 
 	if (seek_flag) {
-		pitcher_parser_seek_to_begin(parser->p);
-		parser->offset = 0;
-		parser->frame_count = 0;
+		/* restart from the nearest key frame of the new position */
+		parser->pos = pitcher_parser_find_key(parser->p, parser->seek.pos_new);
+		if (parser->pos < 0)
+			parser->pos = pitcher_parser_next_key(parser->p, -1);
+		parser->gop = parser->pos;
+		parser->frame_count = parser->pos;
 		parser->seek.enable = 0;
-		parser->skip = parser->seek.pos_new;
+		parser->skip = 0;
+		parser->end = false;
+		PITCHER_LOG("seek to %ld\n", parser->pos);
 	}
 
 	return RET_OK;
@@ -3039,11 +3140,20 @@ int init_parser_node(struct test_node *node)
 
 	pitcher_init_parser(parser->p);
 
-	if (pitcher_parse(parser->p) != RET_OK) {
-		SAFE_RELEASE(parser->p, pitcher_del_parser);
-		return -RET_E_INVAL;
+	ret = -RET_E_NOT_FOUND;
+	if (parser->index)
+		ret = pitcher_parser_load_index(parser->p, parser->index);
+	if (ret != RET_OK) {
+		if (pitcher_parse(parser->p) != RET_OK ||
+		    pitcher_parser_build_index(parser->p) != RET_OK) {
+			SAFE_RELEASE(parser->p, pitcher_del_parser);
+			return -RET_E_INVAL;
+		}
+		if (parser->index &&
+		    pitcher_parser_save_index(parser->p, parser->index) == RET_OK)
+			PITCHER_LOG("save index %s\n", parser->index);
 	}
-	pitcher_parser_seek_to_begin(parser->p);
+	parser->pos = parser_first_pos(parser);
 
 	if (p->width != 0) {
 		parser->node.width = p->width;
@@ -3153,6 +3263,19 @@ int parse_parser_option(struct test_node *node,
 		parser->seek.enable = 1;
 	} else if (!strcasecmp(option->name, "show")) {
 		parser->show = true;
+	} else if (!strcasecmp(option->name, "index")) {
+		parser->index = argv[0];
+	} else if (!strcasecmp(option->name, "trick")) {
+		if (!strcasecmp(argv[0], "normal"))
+			parser->trick = PARSER_TRICK_NORMAL;
+		else if (!strcasecmp(argv[0], "iframe"))
+			parser->trick = PARSER_TRICK_IFRAME;
+		else if (!strcasecmp(argv[0], "reverse"))
+			parser->trick = PARSER_TRICK_REVERSE;
+		else if (!strcasecmp(argv[0], "ireverse"))
+			parser->trick = PARSER_TRICK_IREVERSE;
+		else
+			return -RET_E_NOT_SUPPORT;
 	}
 
 	if (parser->seek.enable) {
@@ -3538,7 +3661,7 @@ void scan_and_connect_sink(struct test_node *src)
 		int schn;
 		int ret = 0;
 
-		if (!dst)
+		if (!dst || dst->source < 0)
 			continue;
 
 		if (src != nodes[dst->source])
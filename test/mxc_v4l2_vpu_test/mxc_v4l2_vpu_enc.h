@@ -64,6 +64,14 @@ struct mxc_vpu_test_option
 int is_force_exit(void);
 int is_source_end(int chnno);
 struct test_node *get_test_node(uint32_t key);
+void scan_and_connect_sink(struct test_node *src);
+
+struct swcodec_node_t;
+struct swcodec_node_t *open_swcodec(struct test_node *node,
+				    const char *backend, int type);
+void close_swcodec(struct swcodec_node_t *swc);
+int get_swcodec_source_chnno(struct swcodec_node_t *swc);
+int get_swcodec_sink_chnno(struct swcodec_node_t *swc);
 
 #ifdef ENABLE_WAYLAND
 extern struct mxc_vpu_test_option waylandsink_options[];
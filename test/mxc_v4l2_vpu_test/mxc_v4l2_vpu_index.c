@@ -0,0 +1,468 @@
+/*
+ * Copyright 2023 NXP
+ *
+ */
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/*
+ * Build the frame index of every stream in a directory tree with the
+ * pitcher parsers. The index files have the same format as the one written
+ * by the parser node's --index option, so a test run can load them instead
+ * of parsing the streams again.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "pitcher/pitcher_def.h"
+#include "pitcher/pitcher.h"
+#include "pitcher/parse.h"
+
+#define INDEX_SUFFIX		".idx"
+#define MAX_WORKER_COUNT	64
+
+struct index_job {
+	char *filename;
+	char index[PATH_MAX];
+	uint32_t format;
+	int ret;
+	int cached;
+	uint32_t width;
+	uint32_t height;
+	uint32_t profile;
+	uint32_t level;
+	unsigned long frames;
+	unsigned long keys;
+	unsigned long size;
+};
+
+struct indexer_t {
+	struct index_job *jobs;
+	unsigned long count;
+	unsigned long alloc;
+	unsigned long next;
+	pthread_mutex_t lock;
+
+	uint32_t format;
+	const char *outdir;
+	const char *summary;
+	int force;
+	int workers;
+};
+
+static struct indexer_t indexer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.format = PIX_FMT_NONE,
+};
+
+static const struct {
+	const char *ext;
+	uint32_t format;
+} index_exts[] = {
+	{"h264", PIX_FMT_H264},
+	{"264", PIX_FMT_H264},
+	{"avc", PIX_FMT_H264},
+	{"h265", PIX_FMT_H265},
+	{"265", PIX_FMT_H265},
+	{"hevc", PIX_FMT_H265},
+	{"ivf", PIX_FMT_VP8},
+	{"m2v", PIX_FMT_MPEG2},
+	{"mpeg2", PIX_FMT_MPEG2},
+	{"m4v", PIX_FMT_MPEG4},
+	{"mpeg4", PIX_FMT_MPEG4},
+	{"cmp", PIX_FMT_MPEG4},
+	{"xvid", PIX_FMT_XVID},
+	{"divx", PIX_FMT_DIVX},
+	{"263", PIX_FMT_H263},
+	{"h263", PIX_FMT_H263},
+	{"avs", PIX_FMT_AVS},
+	{"vc1", PIX_FMT_VC1G},
+	{"rcv", PIX_FMT_VC1L},
+	{"vp6", PIX_FMT_VP6},
+	{"jpg", PIX_FMT_JPEG},
+	{"jpeg", PIX_FMT_JPEG},
+	{"mjpg", PIX_FMT_JPEG},
+	{"mjpeg", PIX_FMT_JPEG},
+};
+
+static uint32_t get_format_by_ext(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+	int i;
+
+	if (!ext || strchr(ext, '/'))
+		return PIX_FMT_NONE;
+
+	ext++;
+	for (i = 0; i < ARRAY_SIZE(index_exts); i++) {
+		if (!strcasecmp(ext, index_exts[i].ext))
+			return index_exts[i].format;
+	}
+
+	return PIX_FMT_NONE;
+}
+
+static void get_index_name(struct index_job *job)
+{
+	char *p;
+	int n;
+
+	if (!indexer.outdir) {
+		snprintf(job->index, sizeof(job->index), "%s%s",
+				job->filename, INDEX_SUFFIX);
+		return;
+	}
+
+	/* flatten the path so files in different directories don't clash */
+	n = snprintf(job->index, sizeof(job->index), "%s/", indexer.outdir);
+	if (n >= sizeof(job->index))
+		return;
+	snprintf(job->index + n, sizeof(job->index) - n, "%s%s",
+			job->filename, INDEX_SUFFIX);
+	for (p = job->index + n; *p; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+}
+
+static int add_job(const char *filename, uint32_t format)
+{
+	struct index_job *job;
+
+	if (indexer.count >= indexer.alloc) {
+		unsigned long alloc = indexer.alloc ? indexer.alloc * 2 : 256;
+
+		job = pitcher_realloc(indexer.jobs, alloc * sizeof(*job));
+		if (!job)
+			return -RET_E_NO_MEMORY;
+		indexer.jobs = job;
+		indexer.alloc = alloc;
+	}
+
+	job = &indexer.jobs[indexer.count];
+	memset(job, 0, sizeof(*job));
+	job->filename = strdup(filename);
+	if (!job->filename)
+		return -RET_E_NO_MEMORY;
+	job->format = format;
+	get_index_name(job);
+	indexer.count++;
+
+	return RET_OK;
+}
+
+static int collect_file(const char *fpath, const struct stat *sb,
+			int typeflag, struct FTW *ftwbuf)
+{
+	uint32_t format;
+
+	if (typeflag != FTW_F)
+		return 0;
+
+	format = get_format_by_ext(fpath);
+	if (format == PIX_FMT_NONE)
+		return 0;
+	if (indexer.format != PIX_FMT_NONE)
+		format = indexer.format;
+
+	return add_job(fpath, format) == RET_OK ? 0 : -1;
+}
+
+static int collect_files(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st)) {
+		PITCHER_ERR("can't access %s\n", path);
+		return -RET_E_OPEN;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		if (nftw(path, collect_file, 16, FTW_PHYS))
+			return -RET_E_NO_MEMORY;
+		return RET_OK;
+	}
+
+	/* a file given explicitly is indexed even without a known suffix */
+	if (indexer.format != PIX_FMT_NONE)
+		return add_job(path, indexer.format);
+
+	return add_job(path, get_format_by_ext(path));
+}
+
+static void probe_format(struct index_job *job, const uint8_t *virt,
+			 unsigned long size)
+{
+	if (job->format != PIX_FMT_VP8 && job->format != PIX_FMT_VP9)
+		return;
+	if (size >= 12 && !memcmp(virt + 8, "VP90", 4))
+		job->format = PIX_FMT_VP9;
+	else
+		job->format = PIX_FMT_VP8;
+}
+
+static int index_file(struct index_job *job)
+{
+	struct pitcher_parser *p;
+	void *virt;
+	long size;
+	int fd;
+	int ret;
+
+	if (job->format == PIX_FMT_NONE || !is_support_parser(job->format))
+		return -RET_E_NOT_SUPPORT;
+
+	size = pitcher_get_file_size(job->filename);
+	if (size <= 0)
+		return -RET_E_OPEN;
+
+	fd = open(job->filename, O_RDONLY);
+	if (fd < 0)
+		return -RET_E_OPEN;
+
+	virt = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (virt == MAP_FAILED) {
+		close(fd);
+		return -RET_E_MMAP;
+	}
+	probe_format(job, virt, size);
+
+	p = pitcher_new_parser();
+	if (!p) {
+		ret = -RET_E_NO_MEMORY;
+		goto exit;
+	}
+	p->filename = job->filename;
+	p->format = job->format;
+	p->virt = virt;
+	p->size = size;
+	pitcher_init_parser(p);
+
+	ret = -RET_E_NOT_FOUND;
+	if (!indexer.force)
+		ret = pitcher_parser_load_index(p, job->index);
+	if (ret == RET_OK) {
+		job->cached = true;
+	} else {
+		ret = pitcher_parse(p);
+		if (ret == RET_OK)
+			ret = pitcher_parser_build_index(p);
+		if (ret == RET_OK)
+			ret = pitcher_parser_save_index(p, job->index);
+	}
+
+	if (ret == RET_OK) {
+		job->width = p->width;
+		job->height = p->height;
+		job->profile = p->profile;
+		job->level = p->level;
+		job->frames = p->index_cnt;
+		job->keys = p->key_cnt;
+		job->size = size;
+	}
+
+	SAFE_RELEASE(p, pitcher_del_parser);
+exit:
+	munmap(virt, size);
+	close(fd);
+
+	return ret;
+}
+
+static void *index_worker(void *arg)
+{
+	unsigned long i;
+
+	while (1) {
+		pthread_mutex_lock(&indexer.lock);
+		i = indexer.next++;
+		pthread_mutex_unlock(&indexer.lock);
+		if (i >= indexer.count)
+			break;
+
+		indexer.jobs[i].ret = index_file(&indexer.jobs[i]);
+	}
+
+	return NULL;
+}
+
+static int write_summary(const char *name)
+{
+	struct index_job *job;
+	unsigned long i;
+	FILE *fp;
+
+	fp = fopen(name, "w");
+	if (!fp) {
+		PITCHER_ERR("open summary file %s fail\n", name);
+		return -RET_E_OPEN;
+	}
+
+	fprintf(fp, "file,format,width,height,profile,level,frames,keyframes,size,index,status\n");
+	for (i = 0; i < indexer.count; i++) {
+		job = &indexer.jobs[i];
+		fprintf(fp, "%s,%s,%d,%d,%d,%d,%ld,%ld,%ld,%s,%s\n",
+				job->filename,
+				pitcher_get_format_name(job->format),
+				job->width, job->height,
+				job->profile, job->level,
+				job->frames, job->keys, job->size,
+				job->ret == RET_OK ? job->index : "",
+				job->ret != RET_OK ? "fail" :
+				job->cached ? "cached" : "indexed");
+	}
+	fclose(fp);
+
+	return RET_OK;
+}
+
+static void show_result(uint64_t ts)
+{
+	struct index_job *job;
+	unsigned long indexed = 0;
+	unsigned long cached = 0;
+	unsigned long failed = 0;
+	unsigned long frames = 0;
+	unsigned long i;
+
+	for (i = 0; i < indexer.count; i++) {
+		job = &indexer.jobs[i];
+		if (job->ret != RET_OK) {
+			failed++;
+			PITCHER_LOG("[fail] %s : %d\n", job->filename, job->ret);
+			continue;
+		}
+		if (job->cached)
+			cached++;
+		else
+			indexed++;
+		frames += job->frames;
+		PITCHER_LOG("[%s] %s %s %dx%d profile %d level %d, %ld frames, %ld key frames\n",
+				job->cached ? "cached" : "indexed",
+				job->filename,
+				pitcher_get_format_name(job->format),
+				job->width, job->height,
+				job->profile, job->level,
+				job->frames, job->keys);
+	}
+
+	PITCHER_LOG("files : %ld, indexed : %ld, cached : %ld, fail : %ld, frames : %ld, workers : %d, time : %ld.%03lds\n",
+			indexer.count, indexed, cached, failed, frames,
+			indexer.workers,
+			ts / NSEC_PER_SEC, (ts % NSEC_PER_SEC) / NSEC_PER_MSEC);
+}
+
+static void show_help(const char *name)
+{
+	printf("usage: %s [options] <directory|file> ...\n", name);
+	printf("  -j, --jobs <number>      number of worker threads, default is the cpu number\n");
+	printf("  -o, --outdir <dir>       write the index files to dir instead of next to the streams\n");
+	printf("  -s, --summary <file>     write the stream metadata to file in csv\n");
+	printf("  -f, --fmt <fmt>          force the stream format instead of probing by suffix\n");
+	printf("  -F, --force              parse the streams even if a valid index exists\n");
+	printf("  -h, --help               show this help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct option options[] = {
+		{"jobs", required_argument, NULL, 'j'},
+		{"outdir", required_argument, NULL, 'o'},
+		{"summary", required_argument, NULL, 's'},
+		{"fmt", required_argument, NULL, 'f'},
+		{"force", no_argument, NULL, 'F'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0},
+	};
+	pthread_t threads[MAX_WORKER_COUNT];
+	uint64_t ts;
+	unsigned long i;
+	int ret = RET_OK;
+	int opt;
+
+	indexer.workers = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt_long(argc, argv, "j:o:s:f:Fh", options, NULL)) != -1) {
+		switch (opt) {
+		case 'j':
+			indexer.workers = strtol(optarg, NULL, 0);
+			break;
+		case 'o':
+			indexer.outdir = optarg;
+			break;
+		case 's':
+			indexer.summary = optarg;
+			break;
+		case 'f':
+			indexer.format = pitcher_get_format_by_name(optarg);
+			if (indexer.format == PIX_FMT_NONE) {
+				PITCHER_ERR("unknown format %s\n", optarg);
+				return -RET_E_INVAL;
+			}
+			break;
+		case 'F':
+			indexer.force = true;
+			break;
+		case 'h':
+		default:
+			show_help(argv[0]);
+			return opt == 'h' ? 0 : -RET_E_INVAL;
+		}
+	}
+	if (optind >= argc) {
+		show_help(argv[0]);
+		return -RET_E_INVAL;
+	}
+	indexer.workers = max(1, min(indexer.workers, MAX_WORKER_COUNT));
+
+	for (; optind < argc; optind++) {
+		ret = collect_files(argv[optind]);
+		if (ret < 0)
+			goto exit;
+	}
+	if (!indexer.count) {
+		PITCHER_LOG("no stream found\n");
+		goto exit;
+	}
+	indexer.workers = min(indexer.workers, indexer.count);
+
+	ts = pitcher_get_monotonic_raw_time();
+	for (i = 0; i < indexer.workers; i++) {
+		if (pthread_create(&threads[i], NULL, index_worker, NULL))
+			break;
+	}
+	indexer.workers = i;
+	/* index the rest in this thread if no worker could be created */
+	if (!indexer.workers)
+		index_worker(NULL);
+	for (i = 0; i < indexer.workers; i++)
+		pthread_join(threads[i], NULL);
+	ts = pitcher_get_monotonic_raw_time() - ts;
+
+	show_result(ts);
+	if (indexer.summary)
+		ret = write_summary(indexer.summary);
+exit:
+	for (i = 0; i < indexer.count; i++)
+		free(indexer.jobs[i].filename);
+	SAFE_RELEASE(indexer.jobs, pitcher_free);
+	PITCHER_LOG("memory : %ld\n", pitcher_memory_count());
+
+	return ret;
+}
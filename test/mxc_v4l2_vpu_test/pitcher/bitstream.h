@@ -18,30 +18,37 @@ extern "C"
 {
 #endif
 
+/*
+ * The reader keeps up to 64 bits left aligned in cache, the emulation
+ * prevention bytes (0x000003) are dropped while loading the cache if emul
+ * is set, so a nal can be parsed in place. Reading beyond the end returns
+ * zero bits and sets overrun.
+ */
 typedef struct {
-	uint8_t *buf;
-	uint32_t byte_alloc;
-	uint32_t buf_rdptr; /// Read offset into buf
-	uint32_t num_held_bits;
-	uint8_t held_bits;
+	const uint8_t *ptr;
+	const uint8_t *end;
+	uint64_t cache;
+	uint32_t cache_bits;
+	uint32_t zeros;
+	uint32_t emul;
+	uint32_t overrun;
 	uint32_t num_bits_read;
 } bitstream_buf;
 
-int nal_remove_emul_bytes(uint8_t *psrc, uint8_t *pdst, int nalsize, int nal_header_sz, uint32_t emul_byte);
-
-void bs_init(bitstream_buf *bs, uint8_t *buf, int size);
-void bs_read_scode(int *value, char *name, uint32_t length);
-void bs_read_code(uint32_t *value, char *name, uint32_t length);
-void bs_read_uvlc(uint32_t *value, char *name);
-void bs_read_svlc(int *value, char *name);
-void bs_read_flag(uint32_t *value, char *name);
+void bs_init(bitstream_buf *bs, const uint8_t *buf, int size, int emul);
+uint32_t bs_read(bitstream_buf *bs, uint32_t num_of_bits);
+void bs_read_scode(bitstream_buf *bs, int *value, char *name, uint32_t length);
+void bs_read_code(bitstream_buf *bs, uint32_t *value, char *name, uint32_t length);
+void bs_read_uvlc(bitstream_buf *bs, uint32_t *value, char *name);
+void bs_read_svlc(bitstream_buf *bs, int *value, char *name);
+void bs_read_flag(bitstream_buf *bs, uint32_t *value, char *name);
 uint32_t bs_consumed_bits(bitstream_buf *bs);
 
-#define READ_SCODE(pval, name, length) bs_read_scode(pval, name, length)
-#define READ_CODE(pval, name, length) bs_read_code(pval, name, length)
-#define READ_UVLC(pval, name) bs_read_uvlc(pval, name)
-#define READ_SVLC(pval, name) bs_read_svlc(pval, name)
-#define READ_FLAG(pval, name) bs_read_flag(pval, name)
+#define READ_SCODE(bs, pval, name, length) bs_read_scode(bs, pval, name, length)
+#define READ_CODE(bs, pval, name, length) bs_read_code(bs, pval, name, length)
+#define READ_UVLC(bs, pval, name) bs_read_uvlc(bs, pval, name)
+#define READ_SVLC(bs, pval, name) bs_read_svlc(bs, pval, name)
+#define READ_FLAG(bs, pval, name) bs_read_flag(bs, pval, name)
 
 #ifdef __cplusplus
 }
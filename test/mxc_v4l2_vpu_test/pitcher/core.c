@@ -138,8 +138,8 @@ static int __disconnect(unsigned long item, void *arg)
 			return 0;
 	}
 
-	pitcher_set_unit_input(dst, NULL);
-	pitcher_rm_unit_output(src, pipe);
+	pitcher_set_unit_input(dst->unit, NULL);
+	pitcher_rm_unit_output(src->unit, pipe);
 	SAFE_RELEASE(pipe, pitcher_del_pipe);
 
 	return 1;
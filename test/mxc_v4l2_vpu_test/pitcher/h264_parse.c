@@ -30,11 +30,16 @@ struct h264_parse_t {
 	uint32_t pre_frame_num;
 	uint32_t cur_frame_num;
 	uint32_t frame_cnt;		//number of frame or field
+
+	uint32_t profile_idc;
+	uint32_t level_idc;
+	uint32_t width;
+	uint32_t height;
 };
 
 #define MAX_SLICE_HDR_SZ	32   //only need to parse part of slice header now !
 
-static void scaling_list(uint32_t idx)
+static void scaling_list(bitstream_buf *bs, uint32_t idx)
 {
 
 	uint32_t last_scale = 8;
@@ -46,7 +51,7 @@ static void scaling_list(uint32_t idx)
 	size = idx < 6 ? 16 : 64;
 	for (i = 0; i < size; i++) {
 		if (next_scale) {
-			READ_SVLC(&delta, "delta_scale");
+			READ_SVLC(bs, &delta, "delta_scale");
 			next_scale = (last_scale + delta + 256)&0xFF;
 			if (!i && !next_scale) {
 				// use default
@@ -58,87 +63,102 @@ static void scaling_list(uint32_t idx)
 	}
 }
 
-static void parse_sps_info(struct h264_parse_t *info)
+static void parse_sps_info(bitstream_buf *bs, struct h264_parse_t *info)
 {
 	uint32_t value;
 	uint32_t profile_idc;
-	uint32_t chroma_format_idc;
+	uint32_t level_idc;
+	uint32_t chroma_format_idc = 1;
 	uint32_t pic_order_cnt_type;
+	uint32_t width_in_mbs;
+	uint32_t height_in_map_units;
+	uint32_t crop[4] = {0, 0, 0, 0};
+	uint32_t crop_unit_x;
+	uint32_t crop_unit_y;
 	uint32_t mb_adaptive_frame_field_flag;
 	int i;
 	int val;
 
 	PITCHER_DBG("=========== sps parse ===========\n");
-	READ_CODE(&profile_idc, "profile_idc", 8);
-	READ_FLAG(&value, "constraint_set0_flag");
-	READ_FLAG(&value, "constraint_set1_flag");
-	READ_FLAG(&value, "constraint_set2_flag");
-	READ_FLAG(&value, "constraint_set3_flag");
-	READ_FLAG(&value, "constraint_set4_flag");
-	READ_FLAG(&value, "constraint_set5_flag");
-	READ_CODE(&value, "reserved_zero_2bits", 2);
-	READ_CODE(&value, "level_idc", 8);
-	READ_UVLC(&value, "seq_parameter_set_id");
+	READ_CODE(bs, &profile_idc, "profile_idc", 8);
+	READ_FLAG(bs, &value, "constraint_set0_flag");
+	READ_FLAG(bs, &value, "constraint_set1_flag");
+	READ_FLAG(bs, &value, "constraint_set2_flag");
+	READ_FLAG(bs, &value, "constraint_set3_flag");
+	READ_FLAG(bs, &value, "constraint_set4_flag");
+	READ_FLAG(bs, &value, "constraint_set5_flag");
+	READ_CODE(bs, &value, "reserved_zero_2bits", 2);
+	READ_CODE(bs, &level_idc, "level_idc", 8);
+	READ_UVLC(bs, &value, "seq_parameter_set_id");
 	if (profile_idc >= 100) {
-		READ_UVLC(&chroma_format_idc, "chroma_format_idc");
+		READ_UVLC(bs, &chroma_format_idc, "chroma_format_idc");
 		if (chroma_format_idc == 3) {
-			READ_FLAG(&value, "separate_colour_plane_flag");
+			READ_FLAG(bs, &value, "separate_colour_plane_flag");
 		}
-		READ_UVLC(&value, "bit_depth_luma_minus8");
-		READ_UVLC(&value, "bit_depth_chroma_minus8");
-		READ_FLAG(&value, "qpprime_y_zero_transform_bypass_flag");
-		READ_FLAG(&value, "seq_scaling_matrix_present_flag");
+		READ_UVLC(bs, &value, "bit_depth_luma_minus8");
+		READ_UVLC(bs, &value, "bit_depth_chroma_minus8");
+		READ_FLAG(bs, &value, "qpprime_y_zero_transform_bypass_flag");
+		READ_FLAG(bs, &value, "seq_scaling_matrix_present_flag");
 		if (value) {
 			assert(chroma_format_idc != 3);
 			for (i = 0; i < 8; i++) {
-				READ_FLAG(&value, "seq_scaling_list_present_flag[i]");
+				READ_FLAG(bs, &value, "seq_scaling_list_present_flag[i]");
 				if (value) {
-					scaling_list(i);
+					scaling_list(bs, i);
 				}
 			}
 		}
 	}
 
-	READ_UVLC(&value, "log2_max_frame_num_minus4");
+	READ_UVLC(bs, &value, "log2_max_frame_num_minus4");
 	info->max_frame_num = 1 << (value+4);
-	READ_UVLC(&pic_order_cnt_type, "pic_order_cnt_type");
+	READ_UVLC(bs, &pic_order_cnt_type, "pic_order_cnt_type");
 	if (pic_order_cnt_type == 0) {
-		READ_UVLC(&pic_order_cnt_type, "log2_max_pic_order_cnt_lsb_minus4");
+		READ_UVLC(bs, &pic_order_cnt_type, "log2_max_pic_order_cnt_lsb_minus4");
 	} else if (pic_order_cnt_type == 1) {
-		READ_FLAG(&value, "delta_pic_order_always_zero_flag");
-		READ_SVLC(&val, "offset_for_non_ref_pic");
-		READ_SVLC(&val, "offset_for_top_to_bottom_field");
-		READ_UVLC(&value, "num_ref_frames_in_pic_order_cnt_cycle");
+		READ_FLAG(bs, &value, "delta_pic_order_always_zero_flag");
+		READ_SVLC(bs, &val, "offset_for_non_ref_pic");
+		READ_SVLC(bs, &val, "offset_for_top_to_bottom_field");
+		READ_UVLC(bs, &value, "num_ref_frames_in_pic_order_cnt_cycle");
 		for (i = 0; i < value ; i++) {
-			READ_SVLC(&val, "offset_for_ref_frame[i]");
+			READ_SVLC(bs, &val, "offset_for_ref_frame[i]");
 		}
 	}
 
-	READ_UVLC(&value, "max_num_ref_frames");
-	READ_FLAG(&value, "gaps_in_frame_num_value_allowed_flag");
-	READ_UVLC(&value, "pic_width_in_mbs_minus1");
-	READ_UVLC(&value, "pic_height_in_map_units_minus1");
-	READ_FLAG(&value, "frame_mbs_only_flag");
+	READ_UVLC(bs, &value, "max_num_ref_frames");
+	READ_FLAG(bs, &value, "gaps_in_frame_num_value_allowed_flag");
+	READ_UVLC(bs, &width_in_mbs, "pic_width_in_mbs_minus1");
+	READ_UVLC(bs, &height_in_map_units, "pic_height_in_map_units_minus1");
+	READ_FLAG(bs, &value, "frame_mbs_only_flag");
 	info->frame_mbs_only_flag = value;
 	if (info->frame_mbs_only_flag == 0) {
-		READ_FLAG(&mb_adaptive_frame_field_flag, "mb_adaptive_frame_field_flag");
+		READ_FLAG(bs, &mb_adaptive_frame_field_flag, "mb_adaptive_frame_field_flag");
 	}
 
-	READ_FLAG(&value, "direct_8x8_inference_flag");
-	READ_FLAG(&value, "frame_cropping_flag");
+	READ_FLAG(bs, &value, "direct_8x8_inference_flag");
+	READ_FLAG(bs, &value, "frame_cropping_flag");
 	if (value) {
-		READ_UVLC(&value, "frame_crop_left_offset");
-		READ_UVLC(&value, "frame_crop_right_offset");
-		READ_UVLC(&value, "frame_crop_top_offset");
-		READ_UVLC(&value, "frame_crop_bottom_offset");
+		READ_UVLC(bs, &crop[0], "frame_crop_left_offset");
+		READ_UVLC(bs, &crop[1], "frame_crop_right_offset");
+		READ_UVLC(bs, &crop[2], "frame_crop_top_offset");
+		READ_UVLC(bs, &crop[3], "frame_crop_bottom_offset");
 	}
-	READ_FLAG(&value, "vui_parameters_present_flag");
+
+	crop_unit_x = (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+	crop_unit_y = (chroma_format_idc == 1 ? 2 : 1) * (2 - info->frame_mbs_only_flag);
+	info->profile_idc = profile_idc;
+	info->level_idc = level_idc;
+	info->width = (width_in_mbs + 1) * 16 - (crop[0] + crop[1]) * crop_unit_x;
+	info->height = (height_in_map_units + 1) * 16 * (2 - info->frame_mbs_only_flag) -
+			(crop[2] + crop[3]) * crop_unit_y;
+	READ_FLAG(bs, &value, "vui_parameters_present_flag");
 	if (value) {
 		// skip vui parse !
 	}
 }
 
-static void parse_slice_header_info(struct h264_parse_t *info, uint32_t *new_frame, int idr_flag)
+static void parse_slice_header_info(bitstream_buf *bs, struct h264_parse_t *info,
+				    uint32_t *new_frame, int idr_flag)
 {
 	uint32_t value;
 	uint32_t first_mb_in_slice;
@@ -151,22 +171,22 @@ static void parse_slice_header_info(struct h264_parse_t *info, uint32_t *new_fra
 	PITCHER_DBG("====== slice header parse =======\n");
 
 	*new_frame = 0;
-	READ_UVLC(&first_mb_in_slice, "first_mb_in_slice");
+	READ_UVLC(bs, &first_mb_in_slice, "first_mb_in_slice");
 
-	READ_UVLC(&value, "slice_type");
-	READ_UVLC(&value, "pic_parameter_set_id");
+	READ_UVLC(bs, &value, "slice_type");
+	READ_UVLC(bs, &value, "pic_parameter_set_id");
 	//assert(separate_colour_plane_flag!=1);
 
 	i = 0;
 	while (info->max_frame_num >> i)
 		i++;
 	i--;
-	READ_CODE(&frame_num, "frame_num", i);
+	READ_CODE(bs, &frame_num, "frame_num", i);
 
 	if (info->frame_mbs_only_flag == 0) {
-		READ_FLAG(&field_pic_flag, "field_pic_flag");
+		READ_FLAG(bs, &field_pic_flag, "field_pic_flag");
 		if (field_pic_flag) {
-			READ_FLAG(&bottom_field_flag, "bottom_field_flag");
+			READ_FLAG(bs, &bottom_field_flag, "bottom_field_flag");
 		}
 	}
 
@@ -204,7 +224,7 @@ static void parse_slice_header_info(struct h264_parse_t *info, uint32_t *new_fra
 	}
 
 	if (idr_flag)	{	// if(IdrPicFlag)
-		READ_UVLC(&value, "idr_pic_id");
+		READ_UVLC(bs, &value, "idr_pic_id");
 	}
 
 	//skip left parse !!!!
@@ -219,45 +239,29 @@ static int h264_check_frame(uint8_t *p, uint32_t size, void *priv)
 	uint8_t type;
 	struct h264_parse_t *info = priv;
 	bitstream_buf bs;
-	uint8_t *nalbuf;
-	int val_size;
 	uint32_t new_frame = 0;
-	static uint8_t *psps;
 
 	if (size < 2)
 		return PARSER_TYPE_UNKNOWN;
 
 	type = p[0] & 0x1f;
 
-	if (psps) {
-		uint32_t sps_size = p - psps;
-
-		nalbuf = malloc(sps_size);
-		val_size = nal_remove_emul_bytes(psps, nalbuf, sps_size, 1, 0x000003);  // p hold nal header(1byte), nalbuf does't hold nal header
-		bs_init(&bs, nalbuf, val_size);
-		parse_sps_info(info);
-		assert(((bs_consumed_bits(&bs) + 7) >> 3) <= sps_size);
-		free(nalbuf);
-
-		psps = NULL;
-	}
-
 	switch (type) {
 	case 1: //Non-IDR
 	case 5: //IDR
 		if (!info->header_cnt)
 			return PARSER_TYPE_UNKNOWN;
 
-		nalbuf = malloc(MAX_SLICE_HDR_SZ);
-		val_size = nal_remove_emul_bytes(p, nalbuf, min(size, MAX_SLICE_HDR_SZ), 1, 0x000003);  // p hold nal header(1byte), nalbuf does't hold nal header
-		bs_init(&bs, nalbuf, val_size);
-		parse_slice_header_info(info, &new_frame, type == 5);
-		assert(((bs_consumed_bits(&bs) + 7) >> 3) <= MAX_SLICE_HDR_SZ);
-		free(nalbuf);
+		/* p hold nal header(1byte), the slice header is parsed in place */
+		bs_init(&bs, p + 1, min(size, MAX_SLICE_HDR_SZ) - 1, 1);
+		parse_slice_header_info(&bs, info, &new_frame, type == 5);
+		if (bs.overrun)
+			PITCHER_DBG("slice header is truncated\n");
 		return new_frame ? PARSER_TYPE_FRAME : PARSER_TYPE_UNKNOWN;
 	case 7: //SPS
 		info->header_cnt++;
-		psps = p;
+		bs_init(&bs, p + 1, size - 1, 1);
+		parse_sps_info(&bs, info);
 	case 8: //PPS
 	case 6: //SEI
 		info->config_found = 1;
@@ -267,6 +271,22 @@ static int h264_check_frame(uint8_t *p, uint32_t size, void *priv)
 	}
 }
 
+static void h264_get_info(Parser p, void *priv)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	struct h264_parse_t *info = priv;
+
+	if (!info->header_cnt)
+		return;
+
+	parser->profile = info->profile_idc;
+	parser->level = info->level_idc;
+	if (!parser->width || !parser->height) {
+		parser->width = info->width;
+		parser->height = info->height;
+	}
+}
+
 static struct pitcher_parser_scode h264_scode = {
 	.scode = 0x000001,
 	.mask = 0xffffff,
@@ -276,6 +296,7 @@ static struct pitcher_parser_scode h264_scode = {
 	.extra_mask = 0xffffffff,
 	.force_extra_on_first = 0,
 	.check_frame = h264_check_frame,
+	.get_info = h264_get_info,
 	.priv_data_size = sizeof(struct h264_parse_t),
 };
 
@@ -283,3 +304,16 @@ int h264_parse(Parser p, void *arg)
 {
 	return pitcher_parse_startcode(p, &h264_scode);
 }
+
+static int h264_is_idr(uint8_t *p, unsigned long size)
+{
+	return (p[0] & 0x1f) == 5;
+}
+
+int h264_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	if (pitcher_frame_find_startcode(p, entry, h264_is_idr))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
@@ -16,16 +16,95 @@
 #include "pitcher_def.h"
 #include "pitcher.h"
 #include "parse.h"
+#include "bitstream.h"
 
 struct h265_parse_t {
 	uint32_t header_cnt;
 	uint32_t config_found;
+
+	uint32_t profile_idc;
+	uint32_t level_idc;
+	uint32_t width;
+	uint32_t height;
 };
 
+static void parse_profile_tier_level(bitstream_buf *bs, struct h265_parse_t *info,
+				     uint32_t max_sub_layers_minus1)
+{
+	uint32_t profile_present[8];
+	uint32_t level_present[8];
+	uint32_t value;
+	int i;
+
+	READ_CODE(bs, &value, "general_profile_space", 2);
+	READ_FLAG(bs, &value, "general_tier_flag");
+	READ_CODE(bs, &info->profile_idc, "general_profile_idc", 5);
+	READ_CODE(bs, &value, "general_profile_compatibility_flags", 32);
+	/* progressive, interlaced, non_packed, frame_only and 44 reserved bits */
+	READ_CODE(bs, &value, "general_constraint_flags", 16);
+	READ_CODE(bs, &value, "general_reserved_zero_bits", 32);
+	READ_CODE(bs, &info->level_idc, "general_level_idc", 8);
+
+	for (i = 0; i < max_sub_layers_minus1; i++) {
+		READ_FLAG(bs, &profile_present[i], "sub_layer_profile_present_flag");
+		READ_FLAG(bs, &level_present[i], "sub_layer_level_present_flag");
+	}
+	if (max_sub_layers_minus1 > 0) {
+		for (i = max_sub_layers_minus1; i < 8; i++)
+			READ_CODE(bs, &value, "reserved_zero_2bits", 2);
+	}
+	for (i = 0; i < max_sub_layers_minus1; i++) {
+		if (profile_present[i]) {
+			READ_CODE(bs, &value, "sub_layer_profile_bits", 32);
+			READ_CODE(bs, &value, "sub_layer_profile_bits", 32);
+			READ_CODE(bs, &value, "sub_layer_profile_bits", 24);
+		}
+		if (level_present[i])
+			READ_CODE(bs, &value, "sub_layer_level_idc", 8);
+	}
+}
+
+static void parse_sps_info(bitstream_buf *bs, struct h265_parse_t *info)
+{
+	uint32_t value;
+	uint32_t max_sub_layers_minus1;
+	uint32_t chroma_format_idc;
+	uint32_t width;
+	uint32_t height;
+	uint32_t crop[4] = {0, 0, 0, 0};
+	uint32_t sub_width;
+	uint32_t sub_height;
+
+	PITCHER_DBG("=========== sps parse ===========\n");
+	READ_CODE(bs, &value, "sps_video_parameter_set_id", 4);
+	READ_CODE(bs, &max_sub_layers_minus1, "sps_max_sub_layers_minus1", 3);
+	READ_FLAG(bs, &value, "sps_temporal_id_nesting_flag");
+	parse_profile_tier_level(bs, info, max_sub_layers_minus1);
+	READ_UVLC(bs, &value, "sps_seq_parameter_set_id");
+	READ_UVLC(bs, &chroma_format_idc, "chroma_format_idc");
+	if (chroma_format_idc == 3)
+		READ_FLAG(bs, &value, "separate_colour_plane_flag");
+	READ_UVLC(bs, &width, "pic_width_in_luma_samples");
+	READ_UVLC(bs, &height, "pic_height_in_luma_samples");
+	READ_FLAG(bs, &value, "conformance_window_flag");
+	if (value) {
+		READ_UVLC(bs, &crop[0], "conf_win_left_offset");
+		READ_UVLC(bs, &crop[1], "conf_win_right_offset");
+		READ_UVLC(bs, &crop[2], "conf_win_top_offset");
+		READ_UVLC(bs, &crop[3], "conf_win_bottom_offset");
+	}
+
+	sub_width = (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+	sub_height = chroma_format_idc == 1 ? 2 : 1;
+	info->width = width - (crop[0] + crop[1]) * sub_width;
+	info->height = height - (crop[2] + crop[3]) * sub_height;
+}
+
 static int h265_check_frame(uint8_t *p, uint32_t size, void *priv)
 {
 	uint8_t type;
 	struct h265_parse_t *info = priv;
+	bitstream_buf bs;
 
 	if (size < 3)
 		return PARSER_TYPE_UNKNOWN;
@@ -60,6 +139,9 @@ static int h265_check_frame(uint8_t *p, uint32_t size, void *priv)
 			return PARSER_TYPE_UNKNOWN;
 	case 33: //SPS
 		info->header_cnt++;
+		/* p hold nal header(2bytes) */
+		bs_init(&bs, p + 2, size - 2, 1);
+		parse_sps_info(&bs, info);
 	case 34: //PPS
 	case 32: //VPS
 	case 39: //Prefix SEI
@@ -72,6 +154,22 @@ static int h265_check_frame(uint8_t *p, uint32_t size, void *priv)
 	}
 }
 
+static void h265_get_info(Parser p, void *priv)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	struct h265_parse_t *info = priv;
+
+	if (!info->header_cnt)
+		return;
+
+	parser->profile = info->profile_idc;
+	parser->level = info->level_idc;
+	if (!parser->width || !parser->height) {
+		parser->width = info->width;
+		parser->height = info->height;
+	}
+}
+
 static struct pitcher_parser_scode h265_scode = {
 	.scode = 0x000001,
 	.mask = 0xffffff,
@@ -81,6 +179,7 @@ static struct pitcher_parser_scode h265_scode = {
 	.extra_mask = 0xffffffff,
 	.force_extra_on_first = 0,
 	.check_frame = h265_check_frame,
+	.get_info = h265_get_info,
 	.priv_data_size = sizeof(struct h265_parse_t),
 };
 
@@ -88,3 +187,18 @@ int h265_parse(Parser p, void *arg)
 {
 	return pitcher_parse_startcode(p, &h265_scode);
 }
+
+static int h265_is_irap(uint8_t *p, unsigned long size)
+{
+	uint8_t type = (p[0] & 0x7E) >> 1;
+
+	return type >= 16 && type <= 21;
+}
+
+int h265_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	if (pitcher_frame_find_startcode(p, entry, h265_is_irap))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
@@ -27,3 +27,10 @@ int jpeg_parse(Parser p, void *arg)
 {
 	return pitcher_parse_startcode(p, &jpeg_scode);
 }
+
+int jpeg_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
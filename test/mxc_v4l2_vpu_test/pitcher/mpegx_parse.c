@@ -127,3 +127,44 @@ int divx_parse(Parser p, void *arg)
 {
 	return pitcher_parse_startcode(p, &mpeg4_scode);
 }
+
+static int mpeg4_is_i_vop(uint8_t *p, unsigned long size)
+{
+	/* vop_coding_type: 0 - I */
+	return size >= 2 && p[0] == 0xB6 && (p[1] >> 6) == 0;
+}
+
+static int mpeg2_is_i_picture(uint8_t *p, unsigned long size)
+{
+	/* picture_coding_type: 1 - I */
+	return size >= 3 && p[0] == 0x00 && ((p[2] >> 3) & 0x7) == 1;
+}
+
+static int avs_is_i_picture(uint8_t *p, unsigned long size)
+{
+	return p[0] == 0xB3;
+}
+
+int mpeg4_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	if (pitcher_frame_find_startcode(p, entry, mpeg4_is_i_vop))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
+
+int mpeg2_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	if (pitcher_frame_find_startcode(p, entry, mpeg2_is_i_picture))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
+
+int avs_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	if (pitcher_frame_find_startcode(p, entry, avs_is_i_picture))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
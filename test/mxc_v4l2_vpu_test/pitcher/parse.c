@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "pitcher_def.h"
 #include "pitcher.h"
 #include "pitcher_v4l2.h"
@@ -23,6 +24,25 @@
 struct parse_handler {
 	unsigned int format;
 	int (*handle_parse)(Parser p, void *arg);
+	int (*index_frame)(Parser p, struct pitcher_frame_index *entry);
+};
+
+#define PITCHER_INDEX_MAGIC		"PIDX"
+#define PITCHER_INDEX_VERSION		2
+
+/* sidecar index file header, followed by the pitcher_frame_index array */
+struct pitcher_index_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t profile;
+	uint32_t level;
+	uint32_t reserved;
+	uint64_t file_size;
+	int64_t mtime;
+	uint64_t count;
 };
 
 void get_kmp_next(const char *p, int64_t *next, int64_t size)
@@ -165,6 +185,8 @@ void pitcher_del_parser(Parser p)
 		list_del_init(&frame->list);
 		SAFE_RELEASE(frame, pitcher_free);
 	}
+	SAFE_RELEASE(parser->index, pitcher_free);
+	SAFE_RELEASE(parser->keys, pitcher_free);
 
 	SAFE_RELEASE(p, pitcher_free);
 }
@@ -179,6 +201,22 @@ void pitcher_parser_show(Parser p)
 	if (!parser)
 		return;
 
+	if (list_empty(&parser->queue) && parser->index) {
+		unsigned long i;
+
+		for (i = 0; i < parser->index_cnt; i++) {
+			PITCHER_LOG("[%ld] size:%d, offset:0x%lx(%ld), pts:%ld%s\n",
+					i, parser->index[i].size,
+					(unsigned long)parser->index[i].offset,
+					(unsigned long)parser->index[i].offset,
+					(long)parser->index[i].pts,
+					(parser->index[i].flags & PITCHER_FRAME_FLAG_KEY) ? ", key" : "");
+			size += parser->index[i].size;
+		}
+		PITCHER_LOG("total size: 0x%x\n", size);
+		return;
+	}
+
 	list_for_each_entry_safe(frame, tmp, &parser->queue, list) {
 
 		PITCHER_LOG("[%d] size:%ld, offset:0x%x(%d)\n", frame->idx, frame->size, frame->offset, frame->offset);
@@ -199,12 +237,15 @@ void pitcher_parser_show(Parser p)
 struct parse_handler parse_handler_table[] = {
 	{.format = PIX_FMT_H264,
 	 .handle_parse = h264_parse,
+	 .index_frame = h264_index_frame,
 	},
 	{.format = PIX_FMT_H265,
 	 .handle_parse = h265_parse,
+	 .index_frame = h265_index_frame,
 	},
 	{.format = PIX_FMT_JPEG,
 	 .handle_parse = jpeg_parse,
+	 .index_frame = jpeg_index_frame,
 	},
 	{.format = PIX_FMT_H263,
 	 .handle_parse = h263_parse,
@@ -214,21 +255,27 @@ struct parse_handler parse_handler_table[] = {
 	},
 	{.format = PIX_FMT_MPEG4,
 	 .handle_parse = mpeg4_parse,
+	 .index_frame = mpeg4_index_frame,
 	},
 	{.format = PIX_FMT_MPEG2,
 	 .handle_parse = mpeg2_parse,
+	 .index_frame = mpeg2_index_frame,
 	},
 	{.format = PIX_FMT_XVID,
 	 .handle_parse = xvid_parse,
+	 .index_frame = mpeg4_index_frame,
 	},
 	{.format = PIX_FMT_AVS,
 	 .handle_parse = avs_parse,
+	 .index_frame = avs_index_frame,
 	},
 	{.format = PIX_FMT_VP8,
 	 .handle_parse = vp8_parse,
+	 .index_frame = vp8_index_frame,
 	},
 	{.format = PIX_FMT_VP9,
 	 .handle_parse = vp9_parse,
+	 .index_frame = vp9_index_frame,
 	},
 	{.format = PIX_FMT_VC1L,
 	 .handle_parse = vc1l_parse,
@@ -241,6 +288,7 @@ struct parse_handler parse_handler_table[] = {
 	},
 	{.format = PIX_FMT_DIVX,
 	 .handle_parse = divx_parse,
+	 .index_frame = mpeg4_index_frame,
 	},
 #ifdef RV_PARSE
 	{.format = PIX_FMT_RV,
@@ -411,6 +459,8 @@ int pitcher_parse_startcode(Parser p, struct pitcher_parser_scode *psc)
 	}
 
 end:
+	if (sc.get_info && priv)
+		sc.get_info(p, priv);
 	if (priv) {
 		pitcher_free(priv);
 		priv = NULL;
@@ -419,3 +469,284 @@ end:
 	PITCHER_LOG("total frame number : %d\n", index);
 	return 0;
 }
+
+static int pitcher_parser_update_keys(struct pitcher_parser *parser)
+{
+	unsigned long count = 0;
+	unsigned long i;
+
+	SAFE_RELEASE(parser->keys, pitcher_free);
+	parser->key_cnt = 0;
+	if (!parser->index_cnt)
+		return RET_OK;
+
+	for (i = 0; i < parser->index_cnt; i++) {
+		if (parser->index[i].flags & PITCHER_FRAME_FLAG_KEY)
+			count++;
+	}
+	/* no key frame information, decoding can only start from the head */
+	if (!count) {
+		parser->index[0].flags |= PITCHER_FRAME_FLAG_KEY;
+		count = 1;
+	}
+
+	parser->keys = pitcher_calloc(count, sizeof(*parser->keys));
+	if (!parser->keys)
+		return -RET_E_NO_MEMORY;
+
+	for (i = 0; i < parser->index_cnt; i++) {
+		if (parser->index[i].flags & PITCHER_FRAME_FLAG_KEY)
+			parser->keys[parser->key_cnt++] = i;
+	}
+
+	return RET_OK;
+}
+
+int pitcher_parser_build_index(Parser p)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	struct pitcher_frame_index *index;
+	struct pitcher_frame *frame;
+	struct parse_handler *handler;
+	unsigned long i = 0;
+
+	if (!parser)
+		return -RET_E_INVAL;
+	if (!parser->frame_cnt)
+		return -RET_E_EMPTY;
+
+	index = pitcher_calloc(parser->frame_cnt, sizeof(*index));
+	if (!index)
+		return -RET_E_NO_MEMORY;
+
+	SAFE_RELEASE(parser->index, pitcher_free);
+	parser->index = index;
+	parser->index_cnt = 0;
+
+	handler = find_handler(parser->format);
+	list_for_each_entry(frame, &parser->queue, list) {
+		if (i >= parser->frame_cnt)
+			break;
+		index[i].offset = frame->offset;
+		index[i].size = frame->size;
+		index[i].pts = i;
+		if (handler && handler->index_frame)
+			handler->index_frame(p, &index[i]);
+		i++;
+	}
+	parser->index_cnt = i;
+
+	return pitcher_parser_update_keys(parser);
+}
+
+int pitcher_parser_load_index(Parser p, const char *name)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	struct pitcher_index_header header;
+	struct pitcher_frame_index *index = NULL;
+	struct stat st;
+	unsigned long i;
+	FILE *fp;
+	int ret = -RET_E_NOT_MATCH;
+
+	if (!parser || !parser->filename || !name)
+		return -RET_E_INVAL;
+
+	if (stat(parser->filename, &st))
+		return -RET_E_OPEN;
+
+	fp = fopen(name, "rb");
+	if (!fp)
+		return -RET_E_OPEN;
+
+	if (fread(&header, sizeof(header), 1, fp) != 1)
+		goto exit;
+	if (memcmp(header.magic, PITCHER_INDEX_MAGIC, sizeof(header.magic)) ||
+	    header.version != PITCHER_INDEX_VERSION ||
+	    header.format != parser->format ||
+	    header.file_size != parser->size ||
+	    header.file_size != st.st_size ||
+	    header.mtime != st.st_mtime ||
+	    !header.count)
+		goto exit;
+
+	index = pitcher_calloc(header.count, sizeof(*index));
+	if (!index) {
+		ret = -RET_E_NO_MEMORY;
+		goto exit;
+	}
+	if (fread(index, sizeof(*index), header.count, fp) != header.count)
+		goto exit;
+	for (i = 0; i < header.count; i++) {
+		/* a corrupt offset must not wrap past the bound */
+		if (index[i].size > parser->size ||
+		    index[i].offset > parser->size - index[i].size)
+			goto exit;
+	}
+
+	SAFE_RELEASE(parser->index, pitcher_free);
+	parser->index = index;
+	parser->index_cnt = header.count;
+	if (parser->number > 0 && parser->index_cnt > parser->number)
+		parser->index_cnt = parser->number;
+	index = NULL;
+	if (header.width && header.height) {
+		parser->width = header.width;
+		parser->height = header.height;
+	}
+	parser->profile = header.profile;
+	parser->level = header.level;
+
+	ret = pitcher_parser_update_keys(parser);
+	if (ret == RET_OK)
+		PITCHER_LOG("load index %s, frame number : %ld, key frame number : %ld\n",
+				name, parser->index_cnt, parser->key_cnt);
+exit:
+	SAFE_RELEASE(index, pitcher_free);
+	fclose(fp);
+
+	return ret;
+}
+
+int pitcher_parser_save_index(Parser p, const char *name)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	struct pitcher_index_header header;
+	struct stat st;
+	FILE *fp;
+	int ret = RET_OK;
+
+	if (!parser || !parser->filename || !name)
+		return -RET_E_INVAL;
+	if (!parser->index_cnt)
+		return -RET_E_EMPTY;
+	/* a partial parse can't be reused */
+	if (parser->number > 0)
+		return -RET_E_NOT_SUPPORT;
+	if (stat(parser->filename, &st))
+		return -RET_E_OPEN;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PITCHER_INDEX_MAGIC, sizeof(header.magic));
+	header.version = PITCHER_INDEX_VERSION;
+	header.format = parser->format;
+	header.width = parser->width;
+	header.height = parser->height;
+	header.profile = parser->profile;
+	header.level = parser->level;
+	header.file_size = st.st_size;
+	header.mtime = st.st_mtime;
+	header.count = parser->index_cnt;
+
+	fp = fopen(name, "wb");
+	if (!fp) {
+		PITCHER_ERR("open index file %s fail\n", name);
+		return -RET_E_OPEN;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+	    fwrite(parser->index, sizeof(*parser->index), parser->index_cnt, fp) != parser->index_cnt) {
+		PITCHER_ERR("write index file %s fail\n", name);
+		ret = -RET_E_INVAL;
+	}
+	fclose(fp);
+
+	if (ret < 0)
+		remove(name);
+
+	return ret;
+}
+
+struct pitcher_frame_index *pitcher_parser_get_index(Parser p, long pos)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+
+	if (!parser || pos < 0 || pos >= parser->index_cnt)
+		return NULL;
+
+	return &parser->index[pos];
+}
+
+/* number of key frames whose position is not greater than pos */
+static unsigned long pitcher_parser_count_keys(struct pitcher_parser *parser,
+						long pos)
+{
+	unsigned long l = 0;
+	unsigned long r = parser->key_cnt;
+	unsigned long m;
+
+	while (l < r) {
+		m = l + (r - l) / 2;
+		if (parser->keys[m] <= pos)
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	return l;
+}
+
+/* the nearest key frame at or before pos */
+long pitcher_parser_find_key(Parser p, long pos)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	unsigned long n;
+
+	if (!parser || !parser->key_cnt || pos < 0)
+		return -1;
+
+	n = pitcher_parser_count_keys(parser, pos);
+	if (!n)
+		return -1;
+
+	return parser->keys[n - 1];
+}
+
+/* the first key frame after pos */
+long pitcher_parser_next_key(Parser p, long pos)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	unsigned long n;
+
+	if (!parser || !parser->key_cnt)
+		return -1;
+	if (pos < 0)
+		return parser->keys[0];
+
+	n = pitcher_parser_count_keys(parser, pos);
+	if (n >= parser->key_cnt)
+		return -1;
+
+	return parser->keys[n];
+}
+
+/*
+ * call match() with the payload of every 0x000001 start code in the frame,
+ * return true once match() returns true
+ */
+int pitcher_frame_find_startcode(Parser p, struct pitcher_frame_index *entry,
+		int (*match)(uint8_t *, unsigned long))
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	uint8_t *buf;
+	uint8_t *end;
+	uint8_t *ptr;
+
+	if (!parser || !entry || !match)
+		return false;
+
+	buf = (uint8_t *)parser->virt + entry->offset;
+	end = buf + entry->size;
+	ptr = buf + 2;
+	while (ptr < end) {
+		ptr = memchr(ptr, 0x01, end - ptr);
+		if (!ptr)
+			break;
+		ptr++;
+		if (ptr - buf >= 3 && !ptr[-2] && !ptr[-3] && ptr < end &&
+		    match(ptr, end - ptr))
+			return true;
+	}
+
+	return false;
+}
@@ -32,6 +32,15 @@ struct pitcher_frame {
 	unsigned int flag;
 };
 
+#define PITCHER_FRAME_FLAG_KEY		(1 << 0)
+
+struct pitcher_frame_index {
+	uint64_t offset;
+	uint32_t size;
+	uint32_t flags;
+	int64_t pts;
+};
+
 struct pitcher_parser {
 	char *filename;
 	struct list_head queue;
@@ -45,6 +54,13 @@ struct pitcher_parser {
 	unsigned int idx;
 	uint32_t width;
 	uint32_t height;
+	uint32_t profile;
+	uint32_t level;
+
+	struct pitcher_frame_index *index;
+	unsigned long index_cnt;
+	unsigned long *keys;
+	unsigned long key_cnt;
 };
 
 struct pitcher_parser *pitcher_new_parser(void);
@@ -66,6 +82,15 @@ int64_t kmp_search(char *s, int64_t s_len, const char *p, int64_t p_len, int64_t
 int pitcher_parser_push_new_frame(Parser p, int64_t offset, int64_t size,
 		int idx, int end_flag);
 
+int pitcher_parser_build_index(Parser p);
+int pitcher_parser_load_index(Parser p, const char *name);
+int pitcher_parser_save_index(Parser p, const char *name);
+struct pitcher_frame_index *pitcher_parser_get_index(Parser p, long pos);
+long pitcher_parser_find_key(Parser p, long pos);
+long pitcher_parser_next_key(Parser p, long pos);
+int pitcher_frame_find_startcode(Parser p, struct pitcher_frame_index *entry,
+		int (*match)(uint8_t *, unsigned long));
+
 int h264_parse(Parser p, void *arg);
 int h265_parse(Parser p, void *arg);
 int h263_parse(Parser p, void *arg);
@@ -83,6 +108,15 @@ int vp6_parse(Parser p, void *arg);
 int divx_parse(Parser p, void *arg);
 int rv_parse(Parser p, void *arg);
 
+int h264_index_frame(Parser p, struct pitcher_frame_index *entry);
+int h265_index_frame(Parser p, struct pitcher_frame_index *entry);
+int jpeg_index_frame(Parser p, struct pitcher_frame_index *entry);
+int mpeg4_index_frame(Parser p, struct pitcher_frame_index *entry);
+int mpeg2_index_frame(Parser p, struct pitcher_frame_index *entry);
+int avs_index_frame(Parser p, struct pitcher_frame_index *entry);
+int vp8_index_frame(Parser p, struct pitcher_frame_index *entry);
+int vp9_index_frame(Parser p, struct pitcher_frame_index *entry);
+
 void vp8_insert_ivf_seqhdr(FILE *file, uint32_t width, uint32_t height,
 			   uint32_t frame_rate);
 void vp8_insert_ivf_pichdr(FILE *file, unsigned long frame_size);
@@ -103,6 +137,7 @@ struct pitcher_parser_scode {
 	uint32_t force_extra_on_first;
 
 	int (*check_frame)(uint8_t *, uint32_t, void *priv);
+	void (*get_info)(Parser p, void *priv);
 	uint32_t priv_data_size;
 };
 int pitcher_parse_startcode(Parser p, struct pitcher_parser_scode *psc);
@@ -0,0 +1,351 @@
+/*
+ * Copyright(c) 2023 NXP. All rights reserved.
+ *
+ */
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pitcher_def.h"
+#include "pitcher.h"
+#include "loadso.h"
+#include "swcodec.h"
+
+/*
+ * passthrough codec
+ *
+ * Every frame is an intra frame wrapped in jpeg markers so that the
+ * existing jpeg parser can split the stream:
+ *   SOI | APP15 "PSWC" fourcc width height | SOS | payload | EOI
+ * The payload is the raw frame, 0xFF bytes are stuffed with 0x00 as in
+ * jpeg entropy coded segments, so no marker can appear inside it.
+ */
+#define PSWC_MARKER_SOI		0xFFD8
+#define PSWC_MARKER_EOI		0xFFD9
+#define PSWC_MARKER_SOS		0xFFDA
+#define PSWC_MARKER_APP15	0xFFEF
+#define PSWC_MAGIC		"PSWC"
+#define PSWC_APP_LENGTH		(2 + 4 + 4 + 2 + 2)
+#define PSWC_HEADER_SIZE	(2 + 2 + PSWC_APP_LENGTH + 2 + 2)
+#define PSWC_TRAILER_SIZE	2
+
+struct pswc_t {
+	int type;
+	struct pix_fmt_info format;
+};
+
+static void *pswc_create(int type)
+{
+	struct pswc_t *pswc;
+
+	pswc = pitcher_calloc(1, sizeof(*pswc));
+	if (!pswc)
+		return NULL;
+
+	pswc->type = type;
+
+	return pswc;
+}
+
+static void pswc_destroy(void *priv)
+{
+	SAFE_RELEASE(priv, pitcher_free);
+}
+
+static int pswc_parse_header(uint8_t *bs, unsigned long size,
+			     struct pix_fmt_info *format)
+{
+	uint32_t fourcc;
+
+	if (size < PSWC_HEADER_SIZE)
+		return -RET_E_INVAL;
+	if (pitcher_bytestream_get_be(bs, 2) != PSWC_MARKER_SOI)
+		return -RET_E_NOT_MATCH;
+	if (pitcher_bytestream_get_be(bs + 2, 2) != PSWC_MARKER_APP15)
+		return -RET_E_NOT_MATCH;
+	if (pitcher_bytestream_get_be(bs + 4, 2) != PSWC_APP_LENGTH)
+		return -RET_E_NOT_MATCH;
+	if (memcmp(bs + 6, PSWC_MAGIC, 4))
+		return -RET_E_NOT_MATCH;
+
+	fourcc = bs[10] | (bs[11] << 8) | (bs[12] << 16) | ((uint32_t)bs[13] << 24);
+	memset(format, 0, sizeof(*format));
+	format->format = pitcher_get_format_by_fourcc(fourcc);
+	format->width = pitcher_bytestream_get_be(bs + 14, 2);
+	format->height = pitcher_bytestream_get_be(bs + 16, 2);
+	if (format->format >= PIX_FMT_COMPRESSED)
+		return -RET_E_NOT_SUPPORT;
+
+	return pitcher_get_pix_fmt_info(format, 0);
+}
+
+static int pswc_get_output_format(void *priv, struct pitcher_buffer *src,
+				  struct pix_fmt_info *format)
+{
+	struct pswc_t *pswc = priv;
+	int ret;
+
+	if (!pswc || !src || !format)
+		return -RET_E_NULL_POINTER;
+
+	if (pswc->type == PITCHER_SWCODEC_DECODER) {
+		ret = pswc_parse_header(src->planes[0].virt,
+					src->planes[0].bytesused, format);
+		if (ret < 0)
+			return ret;
+		pswc->format = *format;
+		return RET_OK;
+	}
+
+	if (!src->format || src->format->format >= PIX_FMT_COMPRESSED)
+		return -RET_E_NOT_SUPPORT;
+
+	pswc->format = *src->format;
+	memset(format, 0, sizeof(*format));
+	format->format = PIX_FMT_JPEG;
+	format->width = src->format->width;
+	format->height = src->format->height;
+	/* worst case: every payload byte is 0xFF and needs stuffing */
+	format->size = PSWC_HEADER_SIZE + src->format->size * 2 + PSWC_TRAILER_SIZE;
+
+	return pitcher_get_pix_fmt_info(format, 0);
+}
+
+static uint8_t *pswc_stuff(uint8_t *dst, const uint8_t *src, unsigned long size)
+{
+	const uint8_t *end = src + size;
+	const uint8_t *ff;
+	unsigned long len;
+
+	while (src < end) {
+		ff = memchr(src, 0xFF, end - src);
+		len = (ff ? ff + 1 : end) - src;
+		memcpy(dst, src, len);
+		dst += len;
+		src += len;
+		if (ff)
+			*dst++ = 0x00;
+	}
+
+	return dst;
+}
+
+static uint8_t *pswc_unstuff(uint8_t *dst, const uint8_t *src,
+			     unsigned long size, unsigned long limit)
+{
+	const uint8_t *end = src + size;
+	uint8_t *dend = dst + limit;
+	const uint8_t *ff;
+	unsigned long len;
+
+	while (src < end && dst < dend) {
+		ff = memchr(src, 0xFF, end - src);
+		len = (ff ? ff : end) - src;
+		len = min(len, (unsigned long)(dend - dst));
+		memcpy(dst, src, len);
+		dst += len;
+		src += len;
+		if (!ff || src != ff || ff + 1 >= end || dst == dend)
+			break;
+		if (ff[1] != 0x00)
+			break;
+		*dst++ = 0xFF;
+		src += 2;
+	}
+
+	return dst;
+}
+
+static int pswc_encode(struct pswc_t *pswc, struct pitcher_buffer *src,
+		       struct pitcher_buffer *dst)
+{
+	struct pix_fmt_info *format = src->format;
+	struct pitcher_buf_ref splane;
+	uint8_t *bs = dst->planes[0].virt;
+	uint8_t *ptr;
+	uint32_t fourcc;
+	unsigned int i;
+
+	if (!format || !format->desc)
+		return -RET_E_INVAL;
+
+	fourcc = format->desc->fourcc;
+	pitcher_bytestream_set_be(bs, PSWC_MARKER_SOI, 2);
+	pitcher_bytestream_set_be(bs + 2, PSWC_MARKER_APP15, 2);
+	pitcher_bytestream_set_be(bs + 4, PSWC_APP_LENGTH, 2);
+	memcpy(bs + 6, PSWC_MAGIC, 4);
+	bs[10] = fourcc & 0xff;
+	bs[11] = (fourcc >> 8) & 0xff;
+	bs[12] = (fourcc >> 16) & 0xff;
+	bs[13] = (fourcc >> 24) & 0xff;
+	pitcher_bytestream_set_be(bs + 14, format->width, 2);
+	pitcher_bytestream_set_be(bs + 16, format->height, 2);
+	pitcher_bytestream_set_be(bs + 18, PSWC_MARKER_SOS, 2);
+	pitcher_bytestream_set_be(bs + 20, 2, 2);
+
+	ptr = bs + PSWC_HEADER_SIZE;
+	for (i = 0; i < format->num_planes; i++) {
+		if (pitcher_get_buffer_plane(src, i, &splane))
+			return -RET_E_INVAL;
+		ptr = pswc_stuff(ptr, splane.virt, format->planes[i].size);
+	}
+	pitcher_bytestream_set_be(ptr, PSWC_MARKER_EOI, 2);
+	ptr += PSWC_TRAILER_SIZE;
+
+	dst->planes[0].bytesused = ptr - bs;
+	SET_BUFFER_TYPE(dst->flags, BUFFER_TYPE_KEYFRAME);
+
+	return RET_OK;
+}
+
+static int pswc_decode(struct pswc_t *pswc, struct pitcher_buffer *src,
+		       struct pitcher_buffer *dst)
+{
+	struct pix_fmt_info format;
+	uint8_t *bs = src->planes[0].virt;
+	unsigned long size = src->planes[0].bytesused;
+	uint8_t *end;
+	int ret;
+
+	ret = pswc_parse_header(bs, size, &format);
+	if (ret < 0)
+		return ret;
+	if (pitcher_compare_format(&format, &pswc->format))
+		return -RET_E_NOT_MATCH;
+	if (pitcher_bytestream_get_be(bs + 18, 2) != PSWC_MARKER_SOS)
+		return -RET_E_INVAL;
+
+	end = pswc_unstuff(dst->planes[0].virt, bs + PSWC_HEADER_SIZE,
+			   size - PSWC_HEADER_SIZE, dst->planes[0].size);
+	dst->planes[0].bytesused = end - (uint8_t *)dst->planes[0].virt;
+	if (dst->planes[0].bytesused < pswc->format.size)
+		return -RET_E_INVAL;
+
+	return RET_OK;
+}
+
+static int pswc_process(void *priv, struct pitcher_buffer *src,
+			struct pitcher_buffer *dst)
+{
+	struct pswc_t *pswc = priv;
+
+	if (!pswc || !src || !dst)
+		return -RET_E_NULL_POINTER;
+
+	if (pswc->type == PITCHER_SWCODEC_DECODER)
+		return pswc_decode(pswc, src, dst);
+
+	return pswc_encode(pswc, src, dst);
+}
+
+static const struct pitcher_swcodec_ops passthrough_ops = {
+	.name = "passthrough",
+	.coded_format = PIX_FMT_JPEG,
+	.create = pswc_create,
+	.destroy = pswc_destroy,
+	.get_output_format = pswc_get_output_format,
+	.process = pswc_process,
+};
+
+static const struct pitcher_swcodec_ops *builtin_swcodecs[] = {
+	&passthrough_ops,
+};
+
+static const struct pitcher_swcodec_ops *find_builtin_swcodec(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(builtin_swcodecs); i++) {
+		if (!strcasecmp(builtin_swcodecs[i]->name, name))
+			return builtin_swcodecs[i];
+	}
+
+	return NULL;
+}
+
+struct pitcher_swcodec *pitcher_open_swcodec(const char *name, int type)
+{
+	struct pitcher_swcodec *codec;
+	pitcher_swcodec_entry entry;
+
+	if (!name)
+		return NULL;
+
+	codec = pitcher_calloc(1, sizeof(*codec));
+	if (!codec)
+		return NULL;
+
+	codec->type = type;
+	codec->ops = find_builtin_swcodec(name);
+	if (!codec->ops) {
+		codec->handle = pitcher_load_object(name);
+		entry = pitcher_load_function(codec->handle,
+					      PITCHER_SWCODEC_ENTRY);
+		if (entry)
+			codec->ops = entry();
+	}
+	if (!codec->ops || !codec->ops->process ||
+	    !codec->ops->get_output_format) {
+		PITCHER_ERR("invalid software codec : %s\n", name);
+		goto error;
+	}
+
+	if (codec->ops->create) {
+		codec->priv = codec->ops->create(type);
+		if (!codec->priv) {
+			PITCHER_ERR("create software codec %s fail\n", name);
+			goto error;
+		}
+	}
+
+	PITCHER_LOG("software %s : %s\n",
+		    type == PITCHER_SWCODEC_DECODER ? "decoder" : "encoder",
+		    codec->ops->name);
+
+	return codec;
+error:
+	SAFE_RELEASE(codec->handle, pitcher_unload_object);
+	SAFE_RELEASE(codec, pitcher_free);
+	return NULL;
+}
+
+void pitcher_close_swcodec(struct pitcher_swcodec *codec)
+{
+	if (!codec)
+		return;
+
+	if (codec->priv && codec->ops->destroy)
+		codec->ops->destroy(codec->priv);
+	codec->priv = NULL;
+	SAFE_RELEASE(codec->handle, pitcher_unload_object);
+	SAFE_RELEASE(codec, pitcher_free);
+}
+
+int pitcher_swcodec_get_output_format(struct pitcher_swcodec *codec,
+				      struct pitcher_buffer *src,
+				      struct pix_fmt_info *format)
+{
+	if (!codec || !codec->ops)
+		return -RET_E_NULL_POINTER;
+
+	return codec->ops->get_output_format(codec->priv, src, format);
+}
+
+int pitcher_swcodec_process(struct pitcher_swcodec *codec,
+			    struct pitcher_buffer *src,
+			    struct pitcher_buffer *dst)
+{
+	if (!codec || !codec->ops)
+		return -RET_E_NULL_POINTER;
+
+	return codec->ops->process(codec->priv, src, dst);
+}
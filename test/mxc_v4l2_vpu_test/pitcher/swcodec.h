@@ -0,0 +1,69 @@
+/*
+ * Copyright(c) 2023 NXP. All rights reserved.
+ *
+ */
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+#ifndef _PITCHER_SWCODEC_H
+#define _PITCHER_SWCODEC_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "pitcher.h"
+
+enum {
+	PITCHER_SWCODEC_ENCODER = 0,
+	PITCHER_SWCODEC_DECODER,
+};
+
+/*
+ * A software codec backend. External backends are shared objects which
+ * export PITCHER_SWCODEC_ENTRY returning a pointer to this structure.
+ *
+ * get_output_format() is called with the first input buffer (and again
+ * whenever the stream format may change) to describe the buffers that
+ * process() writes into; for an encoder the size is the worst case
+ * bitstream size.
+ */
+struct pitcher_swcodec_ops {
+	const char *name;
+	uint32_t coded_format;
+	void *(*create)(int type);
+	void (*destroy)(void *priv);
+	int (*get_output_format)(void *priv, struct pitcher_buffer *src,
+				 struct pix_fmt_info *format);
+	int (*process)(void *priv, struct pitcher_buffer *src,
+		       struct pitcher_buffer *dst);
+};
+
+typedef const struct pitcher_swcodec_ops *(*pitcher_swcodec_entry)(void);
+#define PITCHER_SWCODEC_ENTRY	"pitcher_get_swcodec_ops"
+
+struct pitcher_swcodec {
+	int type;
+	const struct pitcher_swcodec_ops *ops;
+	void *handle;
+	void *priv;
+};
+
+struct pitcher_swcodec *pitcher_open_swcodec(const char *name, int type);
+void pitcher_close_swcodec(struct pitcher_swcodec *codec);
+int pitcher_swcodec_get_output_format(struct pitcher_swcodec *codec,
+				      struct pitcher_buffer *src,
+				      struct pix_fmt_info *format);
+int pitcher_swcodec_process(struct pitcher_swcodec *codec,
+			    struct pitcher_buffer *src,
+			    struct pitcher_buffer *dst);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
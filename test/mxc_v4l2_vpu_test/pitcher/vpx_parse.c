@@ -118,6 +118,57 @@ int vp9_parse(Parser p, void *arg)
 	return vpx_parse(p, arg);
 }
 
+/* the ivf frame header is right before the frame data */
+static void vpx_index_pts(struct pitcher_parser *parser,
+			  struct pitcher_frame_index *entry)
+{
+	uint8_t *hdr;
+	int64_t pts = 0;
+	int i;
+
+	if (entry->offset < sizeof(struct ivf_header_t) + sizeof(struct ivf_frame_header_t))
+		return;
+
+	hdr = (uint8_t *)parser->virt + entry->offset - sizeof(int64_t);
+	for (i = sizeof(int64_t) - 1; i >= 0; i--)
+		pts = (pts << 8) | hdr[i];
+	entry->pts = pts;
+}
+
+int vp8_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	uint8_t *frame = (uint8_t *)parser->virt + entry->offset;
+
+	vpx_index_pts(parser, entry);
+	/* frame tag bit 0: 0 - key frame */
+	if (entry->size && !(frame[0] & 0x1))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
+
+int vp9_index_frame(Parser p, struct pitcher_frame_index *entry)
+{
+	struct pitcher_parser *parser = (struct pitcher_parser *)p;
+	uint8_t *frame = (uint8_t *)parser->virt + entry->offset;
+	uint32_t profile;
+	int bit;
+
+	vpx_index_pts(parser, entry);
+	if (!entry->size || (frame[0] >> 6) != 0x2)
+		return RET_OK;
+
+	/* frame_marker(2) profile_low_bit(1) profile_high_bit(1) */
+	profile = ((frame[0] >> 5) & 0x1) | (((frame[0] >> 4) & 0x1) << 1);
+	bit = (profile == 3) ? 2 : 3;
+	/* show_existing_frame(1) frame_type(1), frame_type 0 - key frame */
+	if (!((frame[0] >> bit) & 0x1) && !((frame[0] >> (bit - 1)) & 0x1))
+		entry->flags |= PITCHER_FRAME_FLAG_KEY;
+
+	return RET_OK;
+}
+
 void vp8_insert_ivf_seqhdr(FILE *file, uint32_t width, uint32_t height,
 			   uint32_t frame_rate)
 {
@@ -0,0 +1,295 @@
+/*
+ * Copyright(c) 2023 NXP. All rights reserved.
+ *
+ */
+/*
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pitcher/pitcher_def.h"
+#include "pitcher/pitcher.h"
+#include "pitcher/swcodec.h"
+#include "mxc_v4l2_vpu_enc.h"
+
+#define SWCODEC_BUFFER_COUNT	4
+
+struct swcodec_node_t {
+	struct test_node *node;
+	struct pitcher_unit_desc desc;
+	struct pitcher_swcodec *codec;
+	int chnno;
+	int end;
+	int ready;
+	struct pix_fmt_info format;
+	struct v4l2_rect crop;
+
+	unsigned long frame_count;
+	unsigned long error_count;
+	uint64_t ts_b;
+	uint64_t ts_e;
+};
+
+static int swcodec_recycle_buffer(struct pitcher_buffer *buffer,
+				  void *arg, int *del)
+{
+	struct swcodec_node_t *swc = arg;
+	int is_end = false;
+
+	if (!swc)
+		return -RET_E_NULL_POINTER;
+
+	if (pitcher_is_active(swc->chnno) && !swc->end &&
+	    buffer->planes[0].size >= swc->format.size)
+		pitcher_put_buffer_idle(swc->chnno, buffer);
+	else
+		is_end = true;
+
+	if (del)
+		*del = is_end;
+
+	return RET_OK;
+}
+
+static int swcodec_alloc_buffers(struct swcodec_node_t *swc)
+{
+	struct pitcher_buffer_desc desc;
+	struct pitcher_buffer *buffer;
+	int i;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.plane_count = 1;
+	desc.plane_size[0] = swc->format.size;
+	desc.init_plane = pitcher_alloc_plane;
+	desc.uninit_plane = pitcher_free_plane;
+	desc.recycle = swcodec_recycle_buffer;
+	desc.arg = swc;
+
+	for (i = 0; i < SWCODEC_BUFFER_COUNT; i++) {
+		buffer = pitcher_new_buffer(&desc);
+		if (!buffer)
+			break;
+		pitcher_put_buffer_idle(swc->chnno, buffer);
+		SAFE_RELEASE(buffer, pitcher_put_buffer);
+	}
+
+	if (!i)
+		return -RET_E_NO_MEMORY;
+
+	return RET_OK;
+}
+
+/*
+ * The output buffers are allocated with the first input buffer, a decoder
+ * only knows its output format after the first sequence header is parsed.
+ */
+static int swcodec_setup_output(struct swcodec_node_t *swc,
+				struct pitcher_buffer *pbuf)
+{
+	int ret;
+
+	ret = pitcher_swcodec_get_output_format(swc->codec, pbuf, &swc->format);
+	if (ret < 0) {
+		PITCHER_ERR("%s get output format fail\n", swc->desc.name);
+		return ret;
+	}
+
+	ret = swcodec_alloc_buffers(swc);
+	if (ret < 0)
+		return ret;
+
+	swc->crop.left = 0;
+	swc->crop.top = 0;
+	swc->crop.width = swc->format.width;
+	swc->crop.height = swc->format.height;
+	swc->node->width = swc->format.width;
+	swc->node->height = swc->format.height;
+	swc->node->pixelformat = swc->format.format;
+	swc->ready = true;
+	PITCHER_LOG("%s output: %s %d x %d\n", swc->desc.name,
+			pitcher_get_format_name(swc->format.format),
+			swc->format.width, swc->format.height);
+
+	if (swc->codec->type == PITCHER_SWCODEC_DECODER)
+		scan_and_connect_sink(swc->node);
+
+	return RET_OK;
+}
+
+static int swcodec_start(void *arg)
+{
+	struct swcodec_node_t *swc = arg;
+
+	if (!swc)
+		return -RET_E_NULL_POINTER;
+
+	swc->end = false;
+
+	return RET_OK;
+}
+
+static int swcodec_checkready(void *arg, int *is_end)
+{
+	struct swcodec_node_t *swc = arg;
+
+	if (!swc)
+		return false;
+
+	if (is_force_exit())
+		swc->end = true;
+	if (is_source_end(swc->chnno))
+		swc->end = true;
+	if (is_end)
+		*is_end = swc->end;
+	if (swc->end)
+		return false;
+	if (!pitcher_chn_poll_input(swc->chnno))
+		return false;
+	if (swc->ready && !pitcher_poll_idle_buffer(swc->chnno))
+		return false;
+
+	return true;
+}
+
+static int swcodec_run(void *arg, struct pitcher_buffer *pbuf)
+{
+	struct swcodec_node_t *swc = arg;
+	struct pitcher_buffer *buffer;
+	int ret;
+
+	if (!swc || !pbuf)
+		return -RET_E_INVAL;
+
+	if (!pbuf->planes[0].bytesused)
+		goto exit;
+
+	if (!swc->ready) {
+		ret = swcodec_setup_output(swc, pbuf);
+		if (ret < 0) {
+			pitcher_set_error(swc->chnno);
+			return ret;
+		}
+	}
+
+	buffer = pitcher_get_idle_buffer(swc->chnno);
+	if (!buffer)
+		return -RET_E_NOT_READY;
+
+	if (!swc->ts_b)
+		swc->ts_b = pitcher_get_monotonic_raw_time();
+
+	buffer->format = &swc->format;
+	buffer->crop = &swc->crop;
+	ret = pitcher_swcodec_process(swc->codec, pbuf, buffer);
+	if (ret < 0) {
+		swc->error_count++;
+		SAFE_RELEASE(buffer, pitcher_put_buffer);
+		goto exit;
+	}
+
+	buffer->flags |= (pbuf->flags & PITCHER_BUFFER_FLAG_LAST);
+	pitcher_push_back_output(swc->chnno, buffer);
+	SAFE_RELEASE(buffer, pitcher_put_buffer);
+
+	swc->frame_count++;
+	swc->ts_e = pitcher_get_monotonic_raw_time();
+exit:
+	if (pbuf->flags & PITCHER_BUFFER_FLAG_LAST)
+		swc->end = true;
+
+	return RET_OK;
+}
+
+struct swcodec_node_t *open_swcodec(struct test_node *node,
+				    const char *backend, int type)
+{
+	struct swcodec_node_t *swc;
+	int ret;
+
+	if (!node || !backend)
+		return NULL;
+
+	swc = pitcher_calloc(1, sizeof(*swc));
+	if (!swc)
+		return NULL;
+
+	swc->node = node;
+	swc->chnno = -1;
+	swc->codec = pitcher_open_swcodec(backend, type);
+	if (!swc->codec)
+		goto error;
+
+	if (type == PITCHER_SWCODEC_ENCODER)
+		node->pixelformat = swc->codec->ops->coded_format;
+
+	swc->desc.fd = -1;
+	swc->desc.start = swcodec_start;
+	swc->desc.check_ready = swcodec_checkready;
+	swc->desc.runfunc = swcodec_run;
+	snprintf(swc->desc.name, sizeof(swc->desc.name), "sw %s.%d",
+			type == PITCHER_SWCODEC_DECODER ? "decoder" : "encoder",
+			node->key);
+
+	ret = pitcher_register_chn(node->context, &swc->desc, swc);
+	if (ret < 0) {
+		PITCHER_ERR("register %s fail\n", swc->desc.name);
+		goto error;
+	}
+	swc->chnno = ret;
+
+	return swc;
+error:
+	SAFE_RELEASE(swc->codec, pitcher_close_swcodec);
+	SAFE_RELEASE(swc, pitcher_free);
+	return NULL;
+}
+
+void close_swcodec(struct swcodec_node_t *swc)
+{
+	if (!swc)
+		return;
+
+	PITCHER_LOG("%s frame count : %ld, error : %ld\n",
+			swc->desc.name, swc->frame_count, swc->error_count);
+	if (swc->frame_count && swc->ts_e > swc->ts_b) {
+		uint64_t ts_delta = swc->ts_e - swc->ts_b;
+		uint64_t fps = swc->frame_count * 1000000000 * 1000 / ts_delta;
+
+		PITCHER_LOG("%s fps : %ld.%ld; time:%ld.%lds\n",
+				swc->desc.name, fps / 1000, fps % 1000,
+				ts_delta / 1000000000,
+				(ts_delta % 1000000000) / 1000000);
+	}
+
+	SAFE_CLOSE(swc->chnno, pitcher_unregister_chn);
+	SAFE_RELEASE(swc->codec, pitcher_close_swcodec);
+	SAFE_RELEASE(swc, pitcher_free);
+}
+
+int get_swcodec_sink_chnno(struct swcodec_node_t *swc)
+{
+	if (!swc)
+		return -RET_E_NULL_POINTER;
+
+	return swc->chnno;
+}
+
+int get_swcodec_source_chnno(struct swcodec_node_t *swc)
+{
+	if (!swc)
+		return -RET_E_NULL_POINTER;
+
+	/* decoder sinks are connected once the stream format is known */
+	if (swc->codec->type == PITCHER_SWCODEC_DECODER && !swc->ready)
+		return -1;
+
+	return swc->chnno;
+}
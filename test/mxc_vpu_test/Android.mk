@@ -11,6 +11,8 @@ LOCAL_SRC_FILES := \
        fb.c \
        loopback.c \
        transcode.c \
+       detile.c \
+       sched.c \
        android_display.cpp \
        utils.c \
        main.c
@@ -602,69 +602,163 @@ saveCropYuvImageHelper(struct decode *dec, u8 *buf, Rect cropRect)
 #endif
 }
 
+/*
+ * Tiled frames are detiled into one of two persistent buffers while a
+ * writer thread saves the other, so file I/O overlaps the next decode.
+ */
+struct tiled_writer {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd;
+	int size;
+	u8 *buf[2];
+	int len[2];	/* bytes pending in buf[i], 0 when free */
+	int next;	/* buffer the decoder fills next */
+	int quit;
+};
+
+static void *tiled_writer_thread(void *arg)
+{
+	struct tiled_writer *w = arg;
+	int cur = 0, len;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		while (!w->len[cur] && !w->quit)
+			pthread_cond_wait(&w->cond, &w->lock);
+		len = w->len[cur];
+		if (!len)
+			break;
+		pthread_mutex_unlock(&w->lock);
+
+		fwriten(w->fd, w->buf[cur], len);
+
+		pthread_mutex_lock(&w->lock);
+		w->len[cur] = 0;
+		pthread_cond_broadcast(&w->cond);
+		cur ^= 1;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+/* Waits until the writer has saved everything and stops it */
+static void tiled_writer_close(struct decode *dec)
+{
+	struct tiled_writer *w = dec->tiled_writer;
+
+	if (!w)
+		return;
+
+	pthread_mutex_lock(&w->lock);
+	w->quit = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	free(w->buf[0]);
+	free(w->buf[1]);
+	free(w);
+	dec->tiled_writer = NULL;
+}
+
+static struct tiled_writer *tiled_writer_open(int fd, int size)
+{
+	struct tiled_writer *w;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+
+	w->fd = fd;
+	w->size = size;
+	w->buf[0] = malloc(size);
+	w->buf[1] = malloc(size);
+	if (!w->buf[0] || !w->buf[1])
+		goto err;
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	if (pthread_create(&w->thread, NULL, tiled_writer_thread, w)) {
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->cond);
+		goto err;
+	}
+
+	return w;
+err:
+	free(w->buf[0]);
+	free(w->buf[1]);
+	free(w);
+	return NULL;
+}
+
+static uint32_t dec_xy2axi_addr(void *arg, int ycbcr, int y, int x, int stride,
+				uint32_t addrY, uint32_t addrCb, uint32_t addrCr)
+{
+	struct decode *dec = arg;
+
+	return vpu_GetXY2AXIAddr(dec->handle, ycbcr, y, x, stride,
+				 addrY, addrCb, addrCr);
+}
+
 /*
  *YUV image copy from on-board memory of tiled YUV to host buffer
  */
 int SaveTiledYuvImageHelper(struct decode *dec, int yuvFp,
                               int picWidth, int picHeight, int index)
 {
-	int frameSize, pix_addr, offset;
-	int y, x, nY, nCb, j;
-	Uint8 *puc, *pYuv = 0, *dstAddrCb, *dstAddrCr;
-	Uint32 addrY, addrCb, addrCr;
-	Uint8 temp_buf[8];
+	struct tiled_writer *w = dec->tiled_writer;
 	struct frame_buf *pfb = NULL;
+	int frameSize, j;
+	u8 *buf;
 
 	frameSize = picWidth * picHeight * 3 / 2;
 	pfb = dec->pfbpool[index];
 
-	pYuv = malloc(frameSize);
-	if (!pYuv) {
-		err_msg("Fail to allocate memory\n");
-		return -1;
-	}
-
 	if (dec->cmdl->rot_en && (dec->cmdl->rot_angle == 90 || dec->cmdl->rot_angle == 270)) {
                 j = picWidth;
                 picWidth = picHeight;
                 picHeight = j;
         }
 
-	puc = pYuv;
-	nY = picHeight;
-	nCb = picHeight / 2;
-	addrY = pfb->addrY;
-	addrCb = pfb->addrCb;
-	addrCr = pfb->addrCr;
-	offset = pfb->desc.virt_uaddr - pfb->desc.phy_addr;
-
-	for (y = 0; y < nY; y++) {
-		for (x = 0; x < picWidth; x += 8) {
-			pix_addr = vpu_GetXY2AXIAddr(dec->handle, 0, y, x, picWidth,
-                                        addrY, addrCb, addrCr);
-			pix_addr += offset;
-			memcpy(puc + y * picWidth + x, (Uint8 *)pix_addr, 8);
-		}
+	/* The address pattern is only walked when the layout changes */
+	if (detile_map_update(&dec->detile, picWidth, picHeight,
+			      dec->cmdl->mapType, pfb->desc.phy_addr,
+			      pfb->addrY, pfb->addrCb, pfb->addrCr,
+			      dec_xy2axi_addr, dec)) {
+		err_msg("Fail to allocate memory\n");
+		return -1;
 	}
 
-	dstAddrCb = (Uint8 *)(puc + picWidth * nY);
-	dstAddrCr = (Uint8 *)(puc + picWidth * nY * 5 / 4);
-
-	for (y = 0; y < nCb ; y++) {
-		for (x = 0; x < picWidth; x += 8) {
-			pix_addr = vpu_GetXY2AXIAddr(dec->handle, 2, y, x, picWidth,
-					addrY, addrCb, addrCr);
-			pix_addr += offset;
-			memcpy(temp_buf, (Uint8 *)pix_addr, 8);
-			for (j = 0; j < 4; j++) {
-				*dstAddrCb++ = *(temp_buf + j * 2);
-				*dstAddrCr++ = *(temp_buf + j * 2 + 1);
-			}
+	if (w && (w->fd != yuvFp || w->size != frameSize))
+		tiled_writer_close(dec);
+	if (!dec->tiled_writer) {
+		dec->tiled_writer = tiled_writer_open(yuvFp, frameSize);
+		if (!dec->tiled_writer) {
+			err_msg("Fail to allocate memory\n");
+			return -1;
 		}
 	}
+	w = dec->tiled_writer;
+
+	pthread_mutex_lock(&w->lock);
+	while (w->len[w->next])
+		pthread_cond_wait(&w->cond, &w->lock);
+	buf = w->buf[w->next];
+	pthread_mutex_unlock(&w->lock);
 
-	fwriten(yuvFp, (u8 *)pYuv, frameSize);
-	free(pYuv);
+	detile_frame(&dec->detile, (u8 *)pfb->desc.virt_uaddr, buf);
+
+	pthread_mutex_lock(&w->lock);
+	w->len[w->next] = frameSize;
+	w->next ^= 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
 
 	return 0;
 }
@@ -1058,6 +1152,7 @@ decoder_start(struct decode *dec)
 		}
 	}
 
+	sched_start(dec->cmdl);
 	gettimeofday(&total_start, NULL);
 
 	while (1) {
@@ -1587,6 +1682,7 @@ decoder_start(struct decode *dec)
 		}
 
 		frame_id++;
+		sched_frame(dec->cmdl);
 		if ((count != 0) && (frame_id >= count))
 			break;
 
@@ -2623,6 +2719,10 @@ err:
 
 	if (dec->mjpg_cached_bsbuf)
 		free(dec->mjpg_cached_bsbuf);
+	if (dec) {
+		tiled_writer_close(dec);
+		detile_map_free(&dec->detile);
+	}
 	IOFreeVirtMem(&mem_desc);
 	IOFreePhyMem(&mem_desc);
 	if (dec)
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/* 
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+   in the documentation and/or other materials provided with the distribution.
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from 
+   this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+OF SUCH DAMAGE.THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE 
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#include "detile.h"
+
+/* Chunks of 8 bytes are contiguous in the tiled layout */
+#define DETILE_CHUNK	8
+
+static int build_runs(struct detile_run **runs, int *nruns, int ycbcr,
+		      int width, int rows, uint32_t base, uint32_t addrY,
+		      uint32_t addrCb, uint32_t addrCr,
+		      detile_addr_fn addr, void *arg)
+{
+	struct detile_run *run;
+	uint32_t src;
+	int x, y, n = 0;
+
+	/* worst case one run per chunk, trimmed below */
+	run = realloc(*runs, sizeof(*run) * (width / DETILE_CHUNK) * rows);
+	if (!run)
+		return -1;
+	*runs = run;
+
+	for (y = 0; y < rows; y++) {
+		for (x = 0; x < width; x += DETILE_CHUNK) {
+			src = addr(arg, ycbcr, y, x, width, addrY, addrCb, addrCr)
+				- base;
+			if (n && run[n - 1].src + run[n - 1].len == src) {
+				run[n - 1].len += DETILE_CHUNK;
+				continue;
+			}
+			run[n].src = src;
+			run[n].len = DETILE_CHUNK;
+			n++;
+		}
+	}
+
+	run = realloc(*runs, sizeof(*run) * (n ? n : 1));
+	if (run)
+		*runs = run;
+	*nruns = n;
+	return 0;
+}
+
+int detile_map_update(struct detile_map *map, int width, int height,
+		      int map_type, uint32_t base, uint32_t addrY,
+		      uint32_t addrCb, uint32_t addrCr,
+		      detile_addr_fn addr, void *arg)
+{
+	/*
+	 * Frame buffers share one layout, so the first chunk of each plane
+	 * is enough to tell whether the cached runs still apply.
+	 */
+	if (map->luma && map->chroma && map->width == width &&
+	    map->height == height && map->map_type == map_type &&
+	    addr(arg, 0, 0, 0, width, addrY, addrCb, addrCr) - base ==
+	    map->luma[0].src &&
+	    addr(arg, 2, 0, 0, width, addrY, addrCb, addrCr) - base ==
+	    map->chroma[0].src) {
+		map->base = base;
+		return 0;
+	}
+
+	map->width = 0;
+	if (build_runs(&map->luma, &map->luma_runs, 0, width, height, base,
+		       addrY, addrCb, addrCr, addr, arg) ||
+	    build_runs(&map->chroma, &map->chroma_runs, 2, width, height / 2,
+		       base, addrY, addrCb, addrCr, addr, arg))
+		return -1;
+
+	map->width = width;
+	map->height = height;
+	map->map_type = map_type;
+	map->base = base;
+	return 0;
+}
+
+void detile_map_free(struct detile_map *map)
+{
+	free(map->luma);
+	free(map->chroma);
+	memset(map, 0, sizeof(*map));
+}
+
+static void deinterleave(const uint8_t *src, uint8_t *cb, uint8_t *cr,
+			 uint32_t len)
+{
+#ifdef __ARM_NEON
+	uint8x16x2_t q;
+	uint8x8x2_t d;
+
+	for (; len >= 32; len -= 32) {
+		q = vld2q_u8(src);
+		vst1q_u8(cb, q.val[0]);
+		vst1q_u8(cr, q.val[1]);
+		src += 32;
+		cb += 16;
+		cr += 16;
+	}
+	for (; len >= 16; len -= 16) {
+		d = vld2_u8(src);
+		vst1_u8(cb, d.val[0]);
+		vst1_u8(cr, d.val[1]);
+		src += 16;
+		cb += 8;
+		cr += 8;
+	}
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t v, even, odd;
+	uint32_t w;
+
+	/* even and odd bytes of 8 at a time, packed within a register */
+	for (; len >= 8; len -= 8) {
+		memcpy(&v, src, 8);
+		even = v & 0x00ff00ff00ff00ffULL;
+		odd = (v >> 8) & 0x00ff00ff00ff00ffULL;
+		even = (even | even >> 8) & 0x0000ffff0000ffffULL;
+		odd = (odd | odd >> 8) & 0x0000ffff0000ffffULL;
+		w = (uint32_t)(even | even >> 16);
+		memcpy(cb, &w, 4);
+		w = (uint32_t)(odd | odd >> 16);
+		memcpy(cr, &w, 4);
+		src += 8;
+		cb += 4;
+		cr += 4;
+	}
+#endif
+	for (; len >= 2; len -= 2) {
+		*cb++ = src[0];
+		*cr++ = src[1];
+		src += 2;
+	}
+}
+
+void detile_frame(const struct detile_map *map, const uint8_t *src,
+		  uint8_t *dst)
+{
+	const struct detile_run *run;
+	uint8_t *cb, *cr;
+	int i;
+
+	for (i = 0, run = map->luma; i < map->luma_runs; i++, run++) {
+		/* constant sizes let the compiler inline the common runs */
+		if (run->len == 2 * DETILE_CHUNK)
+			memcpy(dst, src + run->src, 2 * DETILE_CHUNK);
+		else if (run->len == DETILE_CHUNK)
+			memcpy(dst, src + run->src, DETILE_CHUNK);
+		else
+			memcpy(dst, src + run->src, run->len);
+		dst += run->len;
+	}
+
+	cb = dst;
+	cr = cb + map->width * map->height / 4;
+	for (i = 0, run = map->chroma; i < map->chroma_runs; i++, run++) {
+		deinterleave(src + run->src, cb, cr, run->len);
+		cb += run->len / 2;
+		cr += run->len / 2;
+	}
+}
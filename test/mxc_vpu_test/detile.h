@@ -0,0 +1,75 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/* 
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+   in the documentation and/or other materials provided with the distribution.
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from 
+   this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+OF SUCH DAMAGE.THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE 
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef DETILE_H
+#define DETILE_H
+
+#include <stdint.h>
+
+/*
+ * Address of the 8 bytes at (x, y) of plane ycbcr (0 luma, 2 interleaved
+ * chroma) of a tiled frame, with the semantics of vpu_GetXY2AXIAddr().
+ * The decoder passes a wrapper around the VPU library; anything else can
+ * be plugged in to run detile_frame() without a VPU.
+ */
+typedef uint32_t (*detile_addr_fn)(void *arg, int ycbcr, int y, int x,
+				   int stride, uint32_t addrY, uint32_t addrCb,
+				   uint32_t addrCr);
+
+/* len bytes at base + src, copied to the next len bytes of the plane */
+struct detile_run {
+	uint32_t src;
+	uint32_t len;
+};
+
+struct detile_map {
+	int width;
+	int height;
+	int map_type;
+	uint32_t base;
+	struct detile_run *luma;
+	int luma_runs;
+	struct detile_run *chroma;
+	int chroma_runs;
+};
+
+/*
+ * Make map describe the frame at base. The address pattern is only
+ * walked again when the size or map type changes, or when the frame is
+ * laid out differently relative to its base.
+ * Returns 0 on success.
+ */
+int detile_map_update(struct detile_map *map, int width, int height,
+		      int map_type, uint32_t base, uint32_t addrY,
+		      uint32_t addrCb, uint32_t addrCr,
+		      detile_addr_fn addr, void *arg);
+void detile_map_free(struct detile_map *map);
+
+/*
+ * Tiled frame at src (the virtual address of the map base) to I420 at
+ * dst, width * height * 3 / 2 bytes.
+ */
+void detile_frame(const struct detile_map *map, const uint8_t *src,
+		  uint8_t *dst);
+
+#endif
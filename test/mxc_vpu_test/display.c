@@ -89,27 +89,14 @@ void ipu_memory_free(int size, int cnt, dma_addr_t paddr[], void * vaddr[], int
 	}
 }
 
-static pthread_mutex_t ipu_mutex;
-static pthread_cond_t ipu_cond;
-static int ipu_waiting = 0;
-static int ipu_running = 0;
-static inline void wait_queue(void)
-{
-	pthread_mutex_lock(&ipu_mutex);
-	ipu_waiting = 1;
-	pthread_cond_wait(&ipu_cond, &ipu_mutex);
-	pthread_mutex_unlock(&ipu_mutex);
-}
-
-static inline void wakeup_queue(void)
-{
-	pthread_cond_signal(&ipu_cond);
-}
-
 extern int quitflag;
 extern int vpu_v4l_performance_test;
 
-static pthread_mutex_t v4l_mutex;
+/*
+ * Sleeps on the queue are not bounded by a data timeout; they only wake
+ * up this often to notice quitflag set from the signal thread.
+ */
+#define QUIT_POLL_MS	100
 
 /* The thread for display in performance test with v4l */
 void v4l_disp_loop_thread(void *arg)
@@ -117,7 +104,6 @@ void v4l_disp_loop_thread(void *arg)
 	struct decode *dec = (struct decode *)arg;
 	struct vpu_display *disp = dec->disp;
 	pthread_attr_t attr;
-	struct timespec ts;
 	int error_status = 0, ret;
 	struct v4l2_buffer buffer;
 
@@ -125,21 +111,15 @@ void v4l_disp_loop_thread(void *arg)
 	pthread_attr_setschedpolicy(&attr, SCHED_RR);
 
 	while (!error_status && !quitflag) {
-		/* Use timed wait here */
-		do {
-			clock_gettime(CLOCK_REALTIME, &ts);
-			ts.tv_nsec +=100000000; // 100ms
-			if (ts.tv_nsec >= 1000000000)
-			{
-				ts.tv_sec += ts.tv_nsec / 1000000000;
-				ts.tv_nsec %= 1000000000;
-			}
-		} while ((sem_timedwait(&disp->avaiable_dequeue_frame,
-			 &ts) != 0) && !quitflag);
+		/* Each entry of display_q asks for one buffer to be dequeued */
+		while (!queue_wait(&disp->display_q, QUIT_POLL_MS, NULL) &&
+		       !quitflag)
+			;
 
 		if (quitflag)
 			break;
 
+		dequeue_buf(&disp->display_q);
 		buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
 		buffer.memory = V4L2_MEMORY_MMAP;
 		ret = ioctl(disp->fd, VIDIOC_DQBUF, &buffer);
@@ -147,13 +127,9 @@ void v4l_disp_loop_thread(void *arg)
 			err_msg("VIDIOC_DQBUF failed\n");
 			error_status = 1;
 		}
-		queue_buf(&(disp->released_q), buffer.index);
 
-		pthread_mutex_lock(&v4l_mutex);
-		disp->queued_count--;
-		disp->dequeued_count++;
-		pthread_mutex_unlock(&v4l_mutex);
-		sem_post(&disp->avaiable_decoding_frame);
+		__atomic_sub_fetch(&disp->queued_count, 1, __ATOMIC_SEQ_CST);
+		queue_buf(&(disp->released_q), buffer.index);
 	}
 	pthread_attr_destroy(&attr);
 	return;
@@ -167,22 +143,18 @@ void ipu_disp_loop_thread(void *arg)
 	int index = -1, disp_clr_index, tmp_idx[3] = {0,0,0}, err, mode;
 	pthread_attr_t attr;
 
-	ipu_running = 1;
-
 	pthread_attr_init(&attr);
 	pthread_attr_setschedpolicy(&attr, SCHED_RR);
 
 	while(1) {
 		disp_clr_index = index;
-		index = dequeue_buf(&(disp->ipu_q));
+		/* Frames queued before ipu_display_close() are still shown */
+		while ((index = dequeue_buf(&(disp->ipu_q))) < 0 &&
+		       !__atomic_load_n(&disp->stopping, __ATOMIC_ACQUIRE))
+			queue_wait(&(disp->ipu_q), -1, &disp->stopping);
 		if (index < 0) {
-			wait_queue();
-			ipu_waiting = 0;
-			index = dequeue_buf(&(disp->ipu_q));
-			if (index < 0) {
-				info_msg("thread is going to finish\n");
-				break;
-			}
+			info_msg("thread is going to finish\n");
+			break;
 		}
 
 		if (disp->ncount == 0) {
@@ -245,7 +217,6 @@ void ipu_disp_loop_thread(void *arg)
 	mxc_ipu_lib_task_uninit(&(disp->ipu_handle));
 	pthread_attr_destroy(&attr);
 	info_msg("Disp loop thread exit\n");
-	ipu_running = 0;
 	return;
 }
 
@@ -375,12 +346,10 @@ ipu_display_open(struct decode *dec, int nframes, struct rot rotation, Rect crop
 	info_msg("Display to %d %d, top offset %d, left offset %d\n",
 			disp_width, disp_height, disp_top, disp_left);
 
-	disp->ipu_q.tail = disp->ipu_q.head = 0;
+	queue_init(&disp->ipu_q);
 	disp->stopping = 0;
 
 	dec->disp = disp;
-	pthread_mutex_init(&ipu_mutex, NULL);
-	pthread_cond_init(&ipu_cond, NULL);
 
 	/* start disp loop thread */
 	pthread_create(&(disp->ipu_disp_loop_thread), NULL, (void *)ipu_disp_loop_thread, (void *)dec);
@@ -392,16 +361,12 @@ void ipu_display_close(struct vpu_display *disp)
 {
 	int i;
 
-	disp->stopping = 1;
 	disp->deinterlaced = 0;
-	while(ipu_running && ((queue_size(&(disp->ipu_q)) > 0) || !ipu_waiting)) usleep(10000);
-	if (ipu_running) {
-		wakeup_queue();
-		info_msg("Join disp loop thread\n");
-		pthread_join(disp->ipu_disp_loop_thread, NULL);
-	}
-	pthread_mutex_destroy(&ipu_mutex);
-	pthread_cond_destroy(&ipu_cond);
+	__atomic_store_n(&disp->stopping, 1, __ATOMIC_RELEASE);
+	queue_wake(&(disp->ipu_q));
+	info_msg("Join disp loop thread\n");
+	pthread_join(disp->ipu_disp_loop_thread, NULL);
+	queue_print_stats("ipu", &(disp->ipu_q));
 	for (i=0;i<disp->nframes;i++)
 		ipu_memory_free(disp->frame_size, 1, &(disp->ipu_bufs[i].ipu_paddr),
 				&(disp->ipu_bufs[i].ipu_vaddr), disp->fd);
@@ -419,7 +384,6 @@ int ipu_put_data(struct vpu_display *disp, int index, int field, int fps)
 	    field == V4L2_FIELD_INTERLACED_BT)
 		disp->deinterlaced = 1;
 	queue_buf(&(disp->ipu_q), index);
-	wakeup_queue();
 
 	return 0;
 }
@@ -897,11 +861,10 @@ v4l_display_open(struct decode *dec, int nframes, struct rot rotation, Rect crop
 
 	if (vpu_v4l_performance_test) {
 		dec->disp = disp;
-		disp->released_q.tail = disp->released_q.head = 0;
-		sem_init(&disp->avaiable_decoding_frame, 0,
-			    dec->regfbcount - dec->minfbcount);
-		sem_init(&disp->avaiable_dequeue_frame, 0, 0);
-		pthread_mutex_init(&v4l_mutex, NULL);
+		queue_init(&disp->display_q);
+		queue_init(&disp->released_q);
+		/* frames that may be decoded before a buffer is released */
+		disp->decode_credits = dec->regfbcount - dec->minfbcount;
 		/* start v4l disp loop thread */
 		pthread_create(&(disp->disp_loop_thread), NULL,
 				    (void *)v4l_disp_loop_thread, (void *)dec);
@@ -921,9 +884,10 @@ void v4l_display_close(struct vpu_display *disp)
 	if (disp) {
 		if (vpu_v4l_performance_test) {
 			quitflag = 1;
+			queue_wake(&disp->display_q);
 			pthread_join(disp->disp_loop_thread, NULL);
-			sem_destroy(&disp->avaiable_decoding_frame);
-			sem_destroy(&disp->avaiable_dequeue_frame);
+			queue_print_stats("v4l display", &disp->display_q);
+			queue_print_stats("v4l released", &disp->released_q);
 		}
 
 		ioctl(disp->fd, VIDIOC_STREAMOFF, &type);
@@ -936,31 +900,27 @@ void v4l_display_close(struct vpu_display *disp)
 int v4l_get_buf(struct decode *dec)
 {
 	int index = -1;
-	struct timespec ts;
 	struct vpu_display *disp;
 
 	disp = dec->disp;
-	/* Block here to wait avaiable_decoding_frame */
-	if (vpu_v4l_performance_test) {
-		do {
-			clock_gettime(CLOCK_REALTIME, &ts);
-			ts.tv_nsec +=100000000; // 100ms
-			if (ts.tv_nsec >= 1000000000)
-			{
-				ts.tv_sec += ts.tv_nsec / 1000000000;
-				ts.tv_nsec %= 1000000000;
-			}
-		} while ((sem_timedwait(&disp->avaiable_decoding_frame,
-			    &ts) != 0) && !quitflag);
-	}
+	if (!vpu_v4l_performance_test)
+		return index;
 
-	if (disp->dequeued_count > 0) {
-		index = dequeue_buf(&(disp->released_q));
-		pthread_mutex_lock(&v4l_mutex);
-		disp->dequeued_count--;
-		pthread_mutex_unlock(&v4l_mutex);
+	/*
+	 * A released buffer is taken first; otherwise decoding goes on while
+	 * credits last, then blocks until the display thread releases one.
+	 */
+	index = dequeue_buf(&(disp->released_q));
+	if (index >= 0 || disp->decode_credits <= 0) {
+		while (index < 0 && !quitflag) {
+			queue_wait(&(disp->released_q), QUIT_POLL_MS, NULL);
+			index = dequeue_buf(&(disp->released_q));
+		}
+		return index;
 	}
-	return index;
+
+	disp->decode_credits--;
+	return -1;
 }
 
 int v4l_put_data(struct decode *dec, int index, int field, int fps)
@@ -1020,13 +980,8 @@ int v4l_put_data(struct decode *dec, int index, int field, int fps)
 		goto err;
 	}
 
-	if (vpu_v4l_performance_test) {
-		/* Use mutex to protect queued_count in multi-threads */
-		pthread_mutex_lock(&v4l_mutex);
-		disp->queued_count++;
-		pthread_mutex_unlock(&v4l_mutex);
-	} else
-		disp->queued_count++;
+	/* the display thread decrements it in performance test */
+	__atomic_add_fetch(&disp->queued_count, 1, __ATOMIC_SEQ_CST);
 
 	if (disp->ncount == 1) {
 		if ((v4l_rsd->buf.field == V4L2_FIELD_TOP) ||
@@ -1066,9 +1021,9 @@ int v4l_put_data(struct decode *dec, int index, int field, int fps)
 		threshold = dec->rot_buf_count - 1;
 	else
 		threshold = dec->regfbcount - dec->minfbcount;
-	if (disp->queued_count > threshold) {
+	if (__atomic_load_n(&disp->queued_count, __ATOMIC_SEQ_CST) > threshold) {
 		if (vpu_v4l_performance_test) {
-			sem_post(&disp->avaiable_dequeue_frame);
+			queue_buf(&disp->display_q, index);
 		} else {
 			v4l_rsd->buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
 			v4l_rsd->buf.memory = V4L2_MEMORY_MMAP;
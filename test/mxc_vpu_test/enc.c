@@ -688,6 +688,7 @@ encoder_start(struct encode *enc)
 		}
 	}
 
+	sched_start(enc->cmdl);
 	gettimeofday(&total_start, NULL);
 
 	/* The main encoding loop */
@@ -819,6 +820,7 @@ encoder_start(struct encode *enc)
 						virt_bsbuf_end, phy_bsbuf_start, 0);
 
 		frame_id++;
+		sched_frame(enc->cmdl);
 		if ((count != 0) && (frame_id >= count))
 			break;
 	}
@@ -46,6 +46,7 @@ char *usage = "Usage: ./mxc_vpu_test.out -D \"<decode options>\" "\
 	       "-E \"<encode options>\" "\
 	       "-L \"<loopback options>\" -C <config file> "\
 	       "-T \"<transcode options>\" "\
+	       "-S <summary file> -I <report ms> "\
 	       "-H display this help \n "
 	       "\n"\
 	       "decode options \n "\
@@ -203,6 +204,17 @@ char *usage = "Usage: ./mxc_vpu_test.out -D \"<decode options>\" "\
 	       "  -q <quantization parameter> \n "\
 	       "	default is 20 \n "\
 	       "\n"\
+	       "scheduler mode, for decode and encode instances \n "\
+	       "  -S <summary file> Hold all instances at a start barrier, \n "\
+	       "        print an aggregate report and write a JSON summary \n "\
+	       "  -I <report ms> Aggregate report interval, default is 1000 \n "\
+	       "  -P <cpus> (instance option, config key cpu=) \n "\
+	       "        pin the instance to a cpu list like 0,2-3 \n "\
+	       "  -R <priority> (instance option, config key priority=) \n "\
+	       "        run the instance with SCHED_FIFO priority \n "\
+	       "  -O <ms> (instance option, config key start_delay=) \n "\
+	       "        delay the instance start after the barrier \n "\
+	       "\n"\
 	       "config file - Use config file for specifying options \n";
 
 struct input_argument {
@@ -218,6 +230,8 @@ int quitflag;
 static struct input_argument input_arg[MAX_NUM_INSTANCE];
 static int instance;
 static int using_config_file;
+static char *summary_file;
+static int report_ms = 1000;
 
 int vpu_test_dbg_level;
 
@@ -227,10 +241,10 @@ int encdec_test(void *arg);
 int transcode_test(void *arg);
 
 /* Encode or Decode or Loopback */
-static char *mainopts = "HE:D:L:T:C:";
+static char *mainopts = "HE:D:L:T:C:S:I:";
 
 /* Options for encode and decode */
-static char *options = "i:o:x:n:p:r:f:c:w:h:g:b:d:e:m:u:t:s:l:j:k:a:v:y:q:";
+static char *options = "i:o:x:n:p:r:f:c:w:h:g:b:d:e:m:u:t:s:l:j:k:a:v:y:q:P:R:O:";
 
 int
 parse_config_file(char *file_name)
@@ -314,6 +328,12 @@ parse_main_args(int argc, char *argv[])
 				using_config_file = 1;
 			}
 
+			break;
+		case 'S':
+			summary_file = optarg;
+			break;
+		case 'I':
+			report_ms = atoi(optarg);
 			break;
 		case -1:
 			break;
@@ -462,6 +482,18 @@ parse_args(int argc, char *argv[], int i)
 		case 'q':
 			input_arg[i].cmd.quantParam = atoi(optarg);
 			break;
+		case 'P':
+			if (sched_parse_cpus(optarg, &input_arg[i].cmd.cpu_mask)) {
+				err_msg("Bad cpu list %s\n", optarg);
+				status = -1;
+			}
+			break;
+		case 'R':
+			input_arg[i].cmd.priority = atoi(optarg);
+			break;
+		case 'O':
+			input_arg[i].cmd.start_delay = atoi(optarg);
+			break;
 		case -1:
 			break;
 		default:
@@ -581,7 +613,10 @@ main(int argc, char *argv[])
 
 #endif
 
-	if (instance > 1) {
+	if (summary_file)
+		sched_setup(report_ms, summary_file);
+
+	if (instance > 1 || summary_file) {
 		for (i = 0; i < instance; i++) {
 #ifndef COMMON_INIT
 			/* sleep roughly a frame interval to test multi-thread race
@@ -599,7 +634,22 @@ main(int argc, char *argv[])
 
 			if (check_params(&input_arg[i].cmd,
 						input_arg[i].mode) == 0) {
-				if (open_files(&input_arg[i].cmd) == 0) {
+				if (open_files(&input_arg[i].cmd) != 0)
+					continue;
+
+				if (summary_file) {
+					if (input_arg[i].mode == DECODE)
+						sched_create(i, &input_arg[i].cmd,
+							"dec", decode_test,
+							&input_arg[i].tid);
+					else if (input_arg[i].mode == ENCODE)
+						sched_create(i, &input_arg[i].cmd,
+							"enc", encode_test,
+							&input_arg[i].tid);
+					else
+						warn_msg("Instance %d: only decode "
+							"and encode are scheduled\n", i);
+				} else {
 					if (input_arg[i].mode == DECODE) {
 					     pthread_create(&input_arg[i].tid,
 						   NULL,
@@ -616,6 +666,9 @@ main(int argc, char *argv[])
 			}
 
 		}
+
+		if (summary_file && sched_report())
+			ret = -1;
 	} else {
 		if (using_config_file == 0) {
 			get_arg(input_arg[0].line, &nargc, pargv);
@@ -649,7 +702,7 @@ main(int argc, char *argv[])
 		}
 	}
 
-	if (instance > 1) {
+	if (instance > 1 || summary_file) {
 		for (i = 0; i < instance; i++) {
 			if (input_arg[i].tid != 0) {
 				pthread_join(input_arg[i].tid, (void *)&ret_thr);
@@ -0,0 +1,452 @@
+/*
+ * Copyright 2023 NXP
+ */
+
+/* 
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+   in the documentation and/or other materials provided with the distribution.
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from 
+   this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+OF SUCH DAMAGE.THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE 
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "vpu_test.h"
+
+/*
+ * Scheduler mode for multi-instance runs: each instance thread is pinned
+ * and prioritized as asked, all of them are held at a start barrier
+ * once their codec is set up, and the main thread prints an aggregate
+ * report every interval and writes a JSON summary at the end.
+ */
+
+#define SCHED_HIST_US		100	/* frame time histogram bucket */
+#define SCHED_HIST_BUCKETS	4096	/* last bucket counts overflows */
+
+extern int quitflag;
+
+struct sched_instance {
+	int id;
+	const char *name;
+	struct cmd_line *cmd;
+	int (*test)(void *);
+	int started;
+	int done;
+	int ret;
+	unsigned long frames;
+	unsigned long last_frames;
+	struct timespec last;
+	struct timespec t_start;
+	struct timespec t_end;
+	unsigned int hist[SCHED_HIST_BUCKETS];
+};
+
+struct sched_sample {
+	double t;
+	double total;
+	double fps[MAX_NUM_INSTANCE];
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int expected;
+	int ready;
+	int finished;
+	int go;
+	int interval_ms;
+	const char *summary;
+	struct timespec t0;
+	struct sched_instance inst[MAX_NUM_INSTANCE];
+	struct sched_sample *samples;
+	int nsamples;
+} sched = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static double ts_diff(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+static void ts_add_ms(struct timespec *ts, int ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/* timed wait on sched.cond against CLOCK_REALTIME, lock held */
+static int sched_wait_ms(int ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts_add_ms(&ts, ms);
+	return pthread_cond_timedwait(&sched.cond, &sched.lock, &ts);
+}
+
+/* frame time in ms below which p percent of the frames fall */
+static double sched_percentile(struct sched_instance *si, double p)
+{
+	unsigned long total = 0, sum = 0, target;
+	int i;
+
+	for (i = 0; i < SCHED_HIST_BUCKETS; i++)
+		total += __atomic_load_n(&si->hist[i], __ATOMIC_RELAXED);
+	if (total == 0)
+		return 0;
+
+	target = (unsigned long)(total * p / 100);
+	if (target == 0)
+		target = 1;
+	for (i = 0; i < SCHED_HIST_BUCKETS; i++) {
+		sum += __atomic_load_n(&si->hist[i], __ATOMIC_RELAXED);
+		if (sum >= target)
+			break;
+	}
+	if (i == SCHED_HIST_BUCKETS)
+		i--;
+
+	return (i + 0.5) * SCHED_HIST_US / 1000.0;
+}
+
+void sched_setup(int interval_ms, const char *summary)
+{
+	sched.expected = 0;
+	sched.interval_ms = interval_ms > 0 ? interval_ms : 1000;
+	sched.summary = summary;
+}
+
+/*
+ * Parse a cpu list like "0,2-3" into a mask, returns -1 on a bad list.
+ */
+int sched_parse_cpus(const char *str, unsigned long *mask)
+{
+	unsigned long m = 0;
+	char *end;
+	long a, b;
+
+	while (*str) {
+		a = strtol(str, &end, 10);
+		if (end == str)
+			return -1;
+		b = a;
+		if (*end == '-') {
+			str = end + 1;
+			b = strtol(str, &end, 10);
+			if (end == str)
+				return -1;
+		}
+		if (a < 0 || b < a || b >= (long)(8 * sizeof(m)))
+			return -1;
+		for (; a <= b; a++)
+			m |= 1UL << a;
+		str = end;
+		if (*str == ',')
+			str++;
+		else if (*str != '\0' && *str != '\n' && *str != ' ')
+			return -1;
+		else
+			break;
+	}
+
+	*mask = m;
+	return 0;
+}
+
+static void *sched_thread(void *arg)
+{
+	struct sched_instance *si = arg;
+	int ret;
+
+	ret = si->test(si->cmd);
+
+	pthread_mutex_lock(&sched.lock);
+	if (!si->started) {
+		/* failed before its loop, don't hold up the others */
+		si->started = 1;
+		sched.ready++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &si->t_end);
+	si->ret = ret;
+	si->done = 1;
+	sched.finished++;
+	pthread_cond_broadcast(&sched.cond);
+	pthread_mutex_unlock(&sched.lock);
+
+	return (void *)(long)ret;
+}
+
+int sched_create(int id, struct cmd_line *cmd, const char *name,
+		 int (*test)(void *), pthread_t *tid)
+{
+	struct sched_instance *si = &sched.inst[id];
+	struct sched_param param;
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int i, err;
+
+	memset(si, 0, sizeof(*si));
+	si->id = id;
+	si->name = name;
+	si->cmd = cmd;
+	si->test = test;
+	cmd->sched = si;
+
+	pthread_attr_init(&attr);
+	if (cmd->cpu_mask) {
+		CPU_ZERO(&cpus);
+		for (i = 0; i < (int)(8 * sizeof(cmd->cpu_mask)); i++)
+			if (cmd->cpu_mask & (1UL << i))
+				CPU_SET(i, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+	if (cmd->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = cmd->priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	err = pthread_create(tid, &attr, sched_thread, si);
+	if (err == EPERM && cmd->priority > 0) {
+		warn_msg("instance %d: no permission for SCHED_FIFO %d, "
+			 "using default policy\n", id, cmd->priority);
+		cmd->priority = 0;
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		err = pthread_create(tid, &attr, sched_thread, si);
+	}
+	pthread_attr_destroy(&attr);
+
+	if (err) {
+		err_msg("instance %d: pthread_create failed %d\n", id, err);
+		/* not an instance of the run, keep it out of the report */
+		si->cmd = NULL;
+		cmd->sched = NULL;
+		*tid = 0;
+		return -1;
+	}
+
+	pthread_mutex_lock(&sched.lock);
+	sched.expected++;
+	pthread_mutex_unlock(&sched.lock);
+
+	return 0;
+}
+
+void sched_start(struct cmd_line *cmd)
+{
+	struct sched_instance *si = cmd->sched;
+
+	if (si == NULL || si->started)
+		return;
+
+	pthread_mutex_lock(&sched.lock);
+	si->started = 1;
+	sched.ready++;
+	pthread_cond_broadcast(&sched.cond);
+	while (!sched.go && !quitflag)
+		sched_wait_ms(100);
+	pthread_mutex_unlock(&sched.lock);
+
+	if (cmd->start_delay > 0)
+		usleep(cmd->start_delay * 1000);
+
+	clock_gettime(CLOCK_MONOTONIC, &si->t_start);
+	si->last = si->t_start;
+}
+
+void sched_frame(struct cmd_line *cmd)
+{
+	struct sched_instance *si = cmd->sched;
+	struct timespec now;
+	long us;
+
+	if (si == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - si->last.tv_sec) * 1000000L +
+		(now.tv_nsec - si->last.tv_nsec) / 1000;
+	si->last = now;
+
+	us /= SCHED_HIST_US;
+	if (us >= SCHED_HIST_BUCKETS)
+		us = SCHED_HIST_BUCKETS - 1;
+	__atomic_fetch_add(&si->hist[us], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&si->frames, 1, __ATOMIC_RELAXED);
+}
+
+static void sched_sample(double t, double interval)
+{
+	struct sched_sample *s;
+	struct sched_instance *si;
+	unsigned long frames;
+	char line[80 * MAX_NUM_INSTANCE];
+	int i, n;
+
+	s = realloc(sched.samples, (sched.nsamples + 1) * sizeof(*s));
+	if (s == NULL)
+		return;
+	sched.samples = s;
+	s += sched.nsamples++;
+	memset(s, 0, sizeof(*s));
+	s->t = t;
+
+	line[0] = '\0';
+	n = 0;
+	for (i = 0; i < MAX_NUM_INSTANCE; i++) {
+		si = &sched.inst[i];
+		if (si->cmd == NULL)
+			continue;
+		frames = __atomic_load_n(&si->frames, __ATOMIC_RELAXED);
+		s->fps[i] = (frames - si->last_frames) / interval;
+		si->last_frames = frames;
+		s->total += s->fps[i];
+		n += snprintf(line + n, sizeof(line) - n,
+			      " | #%d %s %.1f fps p50 %.1f p99 %.1f ms",
+			      i, si->name, s->fps[i],
+			      sched_percentile(si, 50), sched_percentile(si, 99));
+		if (n >= (int)sizeof(line))
+			break;
+	}
+
+	info_msg("[%7.1fs] total %.1f fps%s\n", t, s->total, line);
+}
+
+static int sched_write_summary(double elapsed)
+{
+	struct sched_instance *si;
+	double secs, total = 0;
+	FILE *fp;
+	int i, j, first;
+
+	fp = fopen(sched.summary, "w");
+	if (fp == NULL) {
+		err_msg("Failed to open summary file %s\n", sched.summary);
+		return -1;
+	}
+
+	fprintf(fp, "{\n  \"interval_ms\": %d,\n  \"seconds\": %.3f,\n",
+		sched.interval_ms, elapsed);
+	fprintf(fp, "  \"instances\": [");
+	first = 1;
+	for (i = 0; i < MAX_NUM_INSTANCE; i++) {
+		si = &sched.inst[i];
+		if (si->cmd == NULL)
+			continue;
+		secs = ts_diff(&si->t_end, &si->t_start);
+		if (secs <= 0)
+			secs = 0;
+		fprintf(fp, "%s\n    { \"id\": %d, \"mode\": \"%s\", "
+			"\"input\": \"%s\", \"frames\": %lu, \"seconds\": %.3f, "
+			"\"fps\": %.2f, \"p50_ms\": %.2f, \"p99_ms\": %.2f, "
+			"\"cpu_mask\": \"0x%lx\", "
+			"\"priority\": %d, \"start_delay_ms\": %d, \"ret\": %d }",
+			first ? "" : ",", i, si->name, si->cmd->input,
+			si->frames, secs, secs > 0 ? si->frames / secs : 0,
+			sched_percentile(si, 50), sched_percentile(si, 99),
+			si->cmd->cpu_mask,
+			si->cmd->priority, si->cmd->start_delay, si->ret);
+		if (secs > 0)
+			total += si->frames / secs;
+		first = 0;
+	}
+	fprintf(fp, "\n  ],\n  \"total_fps\": %.2f,\n", total);
+
+	fprintf(fp, "  \"samples\": [");
+	for (j = 0; j < sched.nsamples; j++) {
+		fprintf(fp, "%s\n    { \"t\": %.3f, \"total_fps\": %.2f, \"fps\": [",
+			j ? "," : "", sched.samples[j].t, sched.samples[j].total);
+		first = 1;
+		for (i = 0; i < MAX_NUM_INSTANCE; i++) {
+			if (sched.inst[i].cmd == NULL)
+				continue;
+			fprintf(fp, "%s%.2f", first ? "" : ", ",
+				sched.samples[j].fps[i]);
+			first = 0;
+		}
+		fprintf(fp, "] }");
+	}
+	fprintf(fp, "\n  ]\n}\n");
+
+	fclose(fp);
+	info_msg("Summary written to %s\n", sched.summary);
+	return 0;
+}
+
+/*
+ * Run from the main thread once all instances are created: release the
+ * start barrier, report every interval until all instances are done and
+ * write the summary file.
+ */
+int sched_report(void)
+{
+	struct timespec now, next;
+	double elapsed, t_last = 0;
+	int err = 0;
+
+	pthread_mutex_lock(&sched.lock);
+	while (sched.ready < sched.expected && !quitflag)
+		sched_wait_ms(100);
+	clock_gettime(CLOCK_MONOTONIC, &sched.t0);
+	sched.go = 1;
+	pthread_cond_broadcast(&sched.cond);
+	info_msg("Scheduler: %d instances started\n", sched.expected);
+
+	next = sched.t0;
+	ts_add_ms(&next, sched.interval_ms);
+	while (sched.finished < sched.expected) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (ts_diff(&now, &next) >= 0) {
+			pthread_mutex_unlock(&sched.lock);
+			elapsed = ts_diff(&now, &sched.t0);
+			sched_sample(elapsed, elapsed - t_last);
+			t_last = elapsed;
+			ts_add_ms(&next, sched.interval_ms);
+			pthread_mutex_lock(&sched.lock);
+			continue;
+		}
+		sched_wait_ms((int)(ts_diff(&next, &now) * 1000) + 1);
+	}
+	pthread_mutex_unlock(&sched.lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = ts_diff(&now, &sched.t0);
+	/* skip a last interval too short to give a meaningful rate */
+	if (elapsed - t_last > sched.interval_ms / 10000.0)
+		sched_sample(elapsed, elapsed - t_last);
+
+	if (sched.summary)
+		err = sched_write_summary(elapsed);
+
+	free(sched.samples);
+	sched.samples = NULL;
+	sched.nsamples = 0;
+
+	return err;
+}
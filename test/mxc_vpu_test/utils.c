@@ -930,6 +930,46 @@ int parse_options(char *buf, struct cmd_line *cmd, int *mode)
 		return 0;
         }
 
+	str = strstr(buf, "cpu");
+	if (str != NULL) {
+		str = strchr(buf, '=');
+		if (str != NULL) {
+			str++;
+			if (*str != '\0') {
+				if (sched_parse_cpus(str, &cmd->cpu_mask))
+					warn_msg("Bad cpu list %s\n", str);
+			}
+		}
+
+		return 0;
+	}
+
+	str = strstr(buf, "priority");
+	if (str != NULL) {
+		str = strchr(buf, '=');
+		if (str != NULL) {
+			str++;
+			if (*str != '\0') {
+				cmd->priority = strtol(str, NULL, 10);
+			}
+		}
+
+		return 0;
+	}
+
+	str = strstr(buf, "start_delay");
+	if (str != NULL) {
+		str = strchr(buf, '=');
+		if (str != NULL) {
+			str++;
+			if (*str != '\0') {
+				cmd->start_delay = strtol(str, NULL, 10);
+			}
+		}
+
+		return 0;
+	}
+
 	return 0;
 }
 
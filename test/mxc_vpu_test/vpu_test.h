@@ -33,9 +33,15 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 #include <errno.h>
 #include <stdint.h>
 #include <semaphore.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "mxc_ipu_hl_lib.h"
 #include "vpu_lib.h"
 #include "vpu_io.h"
+#include "detile.h"
 #ifdef BUILD_FOR_ANDROID
 #include "g2d.h"
 #endif
@@ -144,10 +150,22 @@ struct g2d_specific_data {
 };
 #endif
 
+/*
+ * Single producer, single consumer ring of buffer indexes. head is only
+ * written by the consumer and tail by the producer; seq changes on every
+ * queue_buf()/queue_wake() and is the futex the consumer sleeps on.
+ */
 struct buf_queue {
 	int list[MAX_BUF_NUM + 1];
 	int head;
 	int tail;
+	int seq;
+	int waiters;
+
+	/* statistics, each written by one side only */
+	int max_depth;		/* producer */
+	unsigned long waits;	/* consumer */
+	unsigned long long wait_us;
 };
 
 struct ipu_buf {
@@ -163,6 +181,7 @@ struct vpu_display {
 	time_t sec;
 	int queued_count;
 	int dequeued_count;
+	int decode_credits;
 	suseconds_t usec;
 	int frame_size;
 
@@ -239,6 +258,10 @@ struct cmd_line {
 	int fps;
 	int mapType;
 	int quantParam;
+	struct sched_instance *sched;	/* set in scheduler mode */
+	unsigned long cpu_mask;	/* cpus to pin the instance to, 0 - any */
+	int priority;		/* SCHED_FIFO priority, 0 - default policy */
+	int start_delay;	/* ms to wait after the start barrier */
 };
 
 struct decode {
@@ -288,6 +311,9 @@ struct decode {
 	int mjpegScaleDownRatioWidth;
 	int mjpegScaleDownRatioHeight;
 
+	struct detile_map detile;	/* cached tiled to linear copy runs */
+	struct tiled_writer *tiled_writer;
+
 	struct frame_buf fbpool[MAX_BUF_NUM];
 };
 
@@ -335,6 +361,14 @@ int check_params(struct cmd_line *cmd, int op);
 char*skip_unwanted(char *ptr);
 int parse_options(char *buf, struct cmd_line *cmd, int *mode);
 
+void sched_setup(int interval_ms, const char *summary);
+int sched_parse_cpus(const char *str, unsigned long *mask);
+int sched_create(int id, struct cmd_line *cmd, const char *name,
+		 int (*test)(void *), pthread_t *tid);
+int sched_report(void);
+void sched_start(struct cmd_line *cmd);
+void sched_frame(struct cmd_line *cmd);
+
 struct vpu_display *v4l_display_open(struct decode *dec, int nframes,
 					struct rot rotation, Rect rotCrop);
 int v4l_get_buf(struct decode *dec);
@@ -388,38 +422,110 @@ static inline int is_mx6x_mjpg(int fmt)
                 return false;
 }
 
+static __inline void queue_init(struct buf_queue * q)
+{
+	memset(q, 0, sizeof(*q));
+}
+
 static __inline int queue_size(struct buf_queue * q)
 {
-        if (q->tail >= q->head)
-                return (q->tail - q->head);
-        else
-                return ((q->tail + QUEUE_SIZE) - q->head);
+	int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	if (tail >= head)
+		return (tail - head);
+	else
+		return ((tail + QUEUE_SIZE) - head);
+}
+
+/* Wakes the consumer, also used without a buffer to make it recheck state */
+static __inline void queue_wake(struct buf_queue * q)
+{
+	__atomic_add_fetch(&q->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&q->waiters, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &q->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
 }
 
 static __inline int queue_buf(struct buf_queue * q, int idx)
 {
-        if (((q->tail + 1) % QUEUE_SIZE) == q->head)
-                return -1;      /* queue full */
-        q->list[q->tail] = idx;
-        q->tail = (q->tail + 1) % QUEUE_SIZE;
-        return 0;
+	int tail = q->tail;
+	int next = (tail + 1) % QUEUE_SIZE;
+	int depth;
+
+	if (next == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+		return -1;      /* queue full */
+	q->list[tail] = idx;
+	__atomic_store_n(&q->tail, next, __ATOMIC_RELEASE);
+
+	depth = queue_size(q);
+	if (depth > q->max_depth)
+		q->max_depth = depth;
+	queue_wake(q);
+	return 0;
 }
 
 static __inline int dequeue_buf(struct buf_queue * q)
 {
-        int ret;
-        if (q->tail == q->head)
-                return -1;      /* queue empty */
-        ret = q->list[q->head];
-        q->head = (q->head + 1) % QUEUE_SIZE;
-        return ret;
+	int ret;
+	int head = q->head;
+
+	if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+		return -1;      /* queue empty */
+	ret = q->list[head];
+	__atomic_store_n(&q->head, (head + 1) % QUEUE_SIZE, __ATOMIC_RELEASE);
+	return ret;
 }
 
 static __inline int peek_next_buf(struct buf_queue * q)
 {
-        if (q->tail == q->head)
-                return -1;      /* queue empty */
-        return q->list[q->head];
+	int head = q->head;
+
+	if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+		return -1;      /* queue empty */
+	return q->list[head];
+}
+
+/*
+ * Consumer side: sleep until the queue is not empty, queue_wake() is
+ * called or timeout_ms passes (-1 waits forever). Returns the queue size.
+ * A non NULL stop is checked after seq is read, so a stop flag set right
+ * before queue_wake() cannot be missed.
+ */
+static __inline int queue_wait(struct buf_queue * q, int timeout_ms,
+			       const int *stop)
+{
+	struct timespec start, end, timeout;
+	int seq, size;
+
+	seq = __atomic_load_n(&q->seq, __ATOMIC_SEQ_CST);
+	size = queue_size(q);
+	if (size)
+		return size;
+	if (stop && __atomic_load_n(stop, __ATOMIC_ACQUIRE))
+		return 0;
+
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	__atomic_add_fetch(&q->waiters, 1, __ATOMIC_SEQ_CST);
+	/* returns at once if a producer bumped seq since we read it */
+	syscall(SYS_futex, &q->seq, FUTEX_WAIT_PRIVATE, seq,
+		timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+	__atomic_sub_fetch(&q->waiters, 1, __ATOMIC_SEQ_CST);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	q->waits++;
+	q->wait_us += (end.tv_sec - start.tv_sec) * 1000000LL +
+		      (end.tv_nsec - start.tv_nsec) / 1000;
+
+	return queue_size(q);
+}
+
+static __inline void queue_print_stats(const char *name, struct buf_queue * q)
+{
+	info_msg("%s queue: max depth %d, %lu waits, %llu us waiting\n",
+		 name, q->max_depth, q->waits, q->wait_us);
 }
 
 #endif
@@ -9,21 +9,33 @@
  * http://www.gnu.org/copyleft/gpl.html
  */
 
+#define _GNU_SOURCE
 #include <fcntl.h>
 #include <termios.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 #include "common.h"
 
 struct termios ti;
 
 int init(void)
+{
+	printf("Starting tests!\r\n");
+	return init_dev("/dev/ttyRPMSG");
+}
+
+int init_dev(const char *dev)
 {
 	int fd;
 
-	printf("Starting tests!\r\n");
-	fd = open("/dev/ttyRPMSG", O_RDWR | O_NOCTTY);
+	fd = open(dev, O_RDWR | O_NOCTTY);
 	if (fd < 0) {
 		printf("error %d\r\n", fd);
 		return -1;
@@ -108,3 +120,371 @@ int tc_receive(int fd, int test_case, int step, int transfer_count,
 	}
 	return result;
 }
+
+/*
+ * Round trip benchmark against the remote echo. Every endpoint has its own
+ * thread keeping up to window messages outstanding; all endpoints run the
+ * same payload size at the same time. The tty may merge or split replies,
+ * so they are taken from the byte stream in send order and checked against
+ * the sequence pattern before their latency is counted.
+ */
+#define BENCH_MAX_SIZES		32
+#define BENCH_LAT_SHIFT		2	/* 4 buckets per power of two */
+#define BENCH_LAT_BUCKETS	(32 << BENCH_LAT_SHIFT)
+
+struct bench_stats {
+	uint64_t msgs;
+	uint64_t lat_sum;
+	uint64_t lat_max;
+	uint64_t elapsed_ns;
+	uint32_t hist[BENCH_LAT_BUCKETS];
+	int failed;
+};
+
+struct bench_endpoint {
+	const char *name;
+	const struct bench_config *cfg;
+	int fd;
+	int echo_fd;		/* pty master of the local echo, or -1 */
+	pthread_t echo_thread;
+	pthread_t thread;
+	uint64_t *sent_at;
+	unsigned char *tx, *rx;
+	int rx_size;
+	struct bench_stats stats[BENCH_MAX_SIZES];
+};
+
+static pthread_barrier_t bench_barrier;
+/* the threads start once all of them exist: 1 to run, -1 to give up */
+static pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bench_cond = PTHREAD_COND_INITIALIZER;
+static int bench_go;
+static int bench_sizes[BENCH_MAX_SIZES];
+static int bench_nr_sizes;
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* log scale bucket of a latency in us, and the lowest latency it holds */
+static int bench_lat_bucket(uint64_t us)
+{
+	int msb, b;
+
+	if (us < (1 << BENCH_LAT_SHIFT))
+		return us;
+	msb = 63 - __builtin_clzll(us);
+	b = ((msb - BENCH_LAT_SHIFT + 1) << BENCH_LAT_SHIFT) +
+	    ((us >> (msb - BENCH_LAT_SHIFT)) & ((1 << BENCH_LAT_SHIFT) - 1));
+	return b < BENCH_LAT_BUCKETS ? b : BENCH_LAT_BUCKETS - 1;
+}
+
+static uint64_t bench_bucket_lat(int b)
+{
+	int msb;
+
+	if (b < (1 << BENCH_LAT_SHIFT))
+		return b;
+	msb = (b >> BENCH_LAT_SHIFT) + BENCH_LAT_SHIFT - 1;
+	return ((uint64_t)((1 << BENCH_LAT_SHIFT) |
+			   (b & ((1 << BENCH_LAT_SHIFT) - 1)))) <<
+	       (msb - BENCH_LAT_SHIFT);
+}
+
+static uint64_t bench_percentile(const struct bench_stats *st, int pct)
+{
+	uint64_t want = (st->msgs * pct + 99) / 100, seen = 0;
+	int b;
+
+	for (b = 0; b < BENCH_LAT_BUCKETS; b++) {
+		seen += st->hist[b];
+		if (seen >= want && seen)
+			return bench_bucket_lat(b);
+	}
+	return 0;
+}
+
+static void bench_fill(unsigned char *buf, int len, uint32_t seq)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = seq + i;
+}
+
+static int bench_check(const unsigned char *buf, int len, uint32_t seq)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		if (buf[i] != (unsigned char)(seq + i))
+			return -1;
+	return 0;
+}
+
+static int bench_size(struct bench_endpoint *ep, int size,
+		      struct bench_stats *st)
+{
+	const struct bench_config *cfg = ep->cfg;
+	struct pollfd pfd = { .fd = ep->fd, .events = POLLIN };
+	uint32_t sent = 0, done = 0;
+	uint64_t start, now, us;
+	int have = 0, off, n;
+
+	start = bench_now_ns();
+	while (done < cfg->count) {
+		while (sent < cfg->count && sent - done < cfg->window) {
+			bench_fill(ep->tx, size, sent);
+			ep->sent_at[sent % cfg->window] = bench_now_ns();
+			n = write(ep->fd, ep->tx, size);
+			if (n != size) {
+				printf("%s: sending message %u of %d bytes "
+				       "failed: %s\r\n", ep->name, sent, size,
+				       n < 0 ? strerror(errno) : "short write");
+				return -1;
+			}
+			sent++;
+		}
+
+		n = poll(&pfd, 1, cfg->timeout_ms);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			printf("%s: no reply to message %u of %d bytes\r\n",
+			       ep->name, done, size);
+			return -1;
+		}
+		n = read(ep->fd, ep->rx + have, ep->rx_size - have);
+		if (n <= 0) {
+			printf("%s: receiving failed: %s\r\n", ep->name,
+			       n < 0 ? strerror(errno) : "end of file");
+			return -1;
+		}
+		have += n;
+		now = bench_now_ns();
+
+		for (off = 0; have - off >= size; off += size, done++) {
+			if (bench_check(ep->rx + off, size, done)) {
+				printf("%s: bad reply to message %u of %d "
+				       "bytes\r\n", ep->name, done, size);
+				return -1;
+			}
+			us = (now - ep->sent_at[done % cfg->window]) / 1000;
+			st->hist[bench_lat_bucket(us)]++;
+			st->lat_sum += us;
+			if (us > st->lat_max)
+				st->lat_max = us;
+			st->msgs++;
+		}
+		have -= off;
+		memmove(ep->rx, ep->rx + off, have);
+	}
+	st->elapsed_ns = bench_now_ns() - start;
+	return 0;
+}
+
+static void *bench_thread(void *arg)
+{
+	struct bench_endpoint *ep = arg;
+	int failed = 0, go, s;
+
+	pthread_mutex_lock(&bench_lock);
+	while (!bench_go)
+		pthread_cond_wait(&bench_cond, &bench_lock);
+	go = bench_go;
+	pthread_mutex_unlock(&bench_lock);
+	if (go < 0)
+		return NULL;
+
+	/* keep meeting the others at the barrier after a failure */
+	for (s = 0; s < bench_nr_sizes; s++) {
+		pthread_barrier_wait(&bench_barrier);
+		if (!failed && bench_size(ep, bench_sizes[s], &ep->stats[s]))
+			failed = 1;
+		if (failed)
+			ep->stats[s].failed = 1;
+	}
+	return NULL;
+}
+
+/* local stand-in for the remote side: echo the pty master */
+static void *bench_echo_thread(void *arg)
+{
+	struct bench_endpoint *ep = arg;
+	unsigned char buf[4096];
+	int n, w, off;
+
+	while ((n = read(ep->echo_fd, buf, sizeof(buf))) > 0) {
+		for (off = 0; off < n; off += w) {
+			w = write(ep->echo_fd, buf + off, n - off);
+			if (w <= 0)
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+static int bench_open(struct bench_endpoint *ep)
+{
+	const char *dev = ep->name;
+
+	ep->echo_fd = -1;
+	if (!strcmp(ep->name, "pty")) {
+		ep->echo_fd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (ep->echo_fd < 0 || grantpt(ep->echo_fd) ||
+		    unlockpt(ep->echo_fd) || !(dev = ptsname(ep->echo_fd))) {
+			printf("pty: cannot create: %s\r\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	ep->fd = init_dev(dev);
+	if (ep->fd < 0)
+		return -1;
+
+	if (ep->echo_fd >= 0 &&
+	    pthread_create(&ep->echo_thread, NULL, bench_echo_thread, ep)) {
+		printf("pty: cannot start the echo\r\n");
+		close(ep->fd);
+		ep->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static void bench_close(struct bench_endpoint *ep)
+{
+	if (ep->fd >= 0)
+		deinit(ep->fd);
+	if (ep->echo_fd >= 0) {
+		/* the echo sees EIO once the slave is gone */
+		if (ep->fd >= 0)
+			pthread_join(ep->echo_thread, NULL);
+		close(ep->echo_fd);
+	}
+}
+
+static void bench_print(const char *name, int size,
+			const struct bench_stats *st)
+{
+	double secs = st->elapsed_ns / 1e9;
+
+	if (st->failed) {
+		printf("%6d  %-20s  failed\r\n", size, name);
+		return;
+	}
+	printf("%6d  %-20s %9.0f %9.1f %7llu %7llu %7llu %7llu\r\n",
+	       size, name, st->msgs / secs, st->msgs * size / secs / 1024,
+	       (unsigned long long)(st->lat_sum / st->msgs),
+	       (unsigned long long)bench_percentile(st, 50),
+	       (unsigned long long)bench_percentile(st, 99),
+	       (unsigned long long)st->lat_max);
+}
+
+int tc_bench(char **devs, int nr_devs, const struct bench_config *cfg)
+{
+	struct bench_endpoint *eps;
+	struct bench_stats total;
+	int size, result = 0, started, i, s, b;
+
+	if (nr_devs < 1 || cfg->window < 1 || cfg->count < 1 ||
+	    cfg->min_size < 1 || cfg->max_size < cfg->min_size) {
+		printf("bad benchmark parameters\r\n");
+		return -1;
+	}
+
+	/* min, doubling, then max */
+	bench_nr_sizes = 0;
+	for (size = cfg->min_size; size < cfg->max_size &&
+	     bench_nr_sizes < BENCH_MAX_SIZES - 1; size *= 2)
+		bench_sizes[bench_nr_sizes++] = size;
+	bench_sizes[bench_nr_sizes++] = cfg->max_size;
+
+	eps = calloc(nr_devs, sizeof(*eps));
+	if (!eps)
+		return -1;
+
+	for (i = 0; i < nr_devs; i++) {
+		eps[i].name = devs[i];
+		eps[i].cfg = cfg;
+		eps[i].fd = -1;
+		eps[i].echo_fd = -1;
+		eps[i].rx_size = cfg->max_size + 4096;
+		eps[i].sent_at = calloc(cfg->window, sizeof(uint64_t));
+		eps[i].tx = malloc(cfg->max_size);
+		eps[i].rx = malloc(eps[i].rx_size);
+		if (!eps[i].sent_at || !eps[i].tx || !eps[i].rx ||
+		    bench_open(&eps[i])) {
+			result = -1;
+			nr_devs = i + 1;
+			goto out;
+		}
+	}
+
+	printf("%d endpoint(s), window %d, %d messages per size\r\n",
+	       nr_devs, cfg->window, cfg->count);
+	printf("%6s  %-20s %9s %9s %7s %7s %7s %7s\r\n", "bytes", "endpoint",
+	       "msg/s", "KB/s", "avg", "p50", "p99", "max us");
+
+	pthread_barrier_init(&bench_barrier, NULL, nr_devs);
+	bench_go = 0;
+	for (started = 0; started < nr_devs; started++)
+		if (pthread_create(&eps[started].thread, NULL, bench_thread,
+				   &eps[started]))
+			break;
+
+	pthread_mutex_lock(&bench_lock);
+	bench_go = started == nr_devs ? 1 : -1;
+	pthread_cond_broadcast(&bench_cond);
+	pthread_mutex_unlock(&bench_lock);
+
+	for (i = 0; i < started; i++)
+		pthread_join(eps[i].thread, NULL);
+	pthread_barrier_destroy(&bench_barrier);
+
+	if (started < nr_devs) {
+		printf("%s: cannot start the benchmark thread\r\n",
+		       eps[started].name);
+		result = -1;
+		goto out;
+	}
+
+	for (s = 0; s < bench_nr_sizes; s++) {
+		memset(&total, 0, sizeof(total));
+		for (i = 0; i < nr_devs; i++) {
+			const struct bench_stats *st = &eps[i].stats[s];
+
+			bench_print(eps[i].name, bench_sizes[s], st);
+			if (st->failed) {
+				total.failed = 1;
+				continue;
+			}
+			total.msgs += st->msgs;
+			total.lat_sum += st->lat_sum;
+			if (st->lat_max > total.lat_max)
+				total.lat_max = st->lat_max;
+			if (st->elapsed_ns > total.elapsed_ns)
+				total.elapsed_ns = st->elapsed_ns;
+			for (b = 0; b < BENCH_LAT_BUCKETS; b++)
+				total.hist[b] += st->hist[b];
+		}
+		if (total.failed)
+			result = -1;
+		else if (nr_devs > 1)
+			bench_print("all", bench_sizes[s], &total);
+	}
+
+out:
+	for (i = 0; i < nr_devs; i++) {
+		bench_close(&eps[i]);
+		free(eps[i].sent_at);
+		free(eps[i].tx);
+		free(eps[i].rx);
+	}
+	free(eps);
+	return result;
+}
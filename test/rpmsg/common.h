@@ -14,6 +14,8 @@
 
 int init(void);
 
+int init_dev(const char *dev);
+
 void deinit(int fd);
 
 int pattern_cmp(char *buffer, char pattern, int len);
@@ -23,4 +25,18 @@ int tc_send(int fd, int test_case, int step, int transfer_count, int data_len);
 int tc_receive(int fd, int test_case, int step, int transfer_count,
 	int data_len);
 
+struct bench_config {
+	int window;		/* messages outstanding per endpoint */
+	int count;		/* messages per payload size and endpoint */
+	int min_size;		/* payload sweep, doubling from min to max */
+	int max_size;
+	int timeout_ms;		/* give up waiting for a reply after this */
+};
+
+/*
+ * Round trip benchmark over the echo endpoints devs, run in parallel.
+ * "pty" stands for a local echo in place of the remote processor.
+ */
+int tc_bench(char **devs, int nr_devs, const struct bench_config *cfg);
+
 #endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2023 NXP
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+
+/* 512 byte RPMsg buffers less the 16 byte message header */
+#define RPMSG_MAX_PAYLOAD 496
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options] <endpoint>...\r\n"
+	       "  endpoint    tty of a remote echo, e.g. /dev/ttyRPMSG30,\r\n"
+	       "              or pty for a local echo\r\n"
+	       "  -w <n>      messages outstanding per endpoint (default 1)\r\n"
+	       "  -n <n>      messages per payload size (default 1000)\r\n"
+	       "  -s <bytes>  smallest payload (default 1)\r\n"
+	       "  -m <bytes>  largest payload (default %d)\r\n"
+	       "  -t <ms>     reply timeout (default 1000)\r\n",
+	       prog, RPMSG_MAX_PAYLOAD);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_config cfg = {
+		.window = 1,
+		.count = 1000,
+		.min_size = 1,
+		.max_size = RPMSG_MAX_PAYLOAD,
+		.timeout_ms = 1000,
+	};
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return -1;
+		}
+		if (!strcmp(argv[i], "-w"))
+			cfg.window = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n"))
+			cfg.count = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s"))
+			cfg.min_size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-m"))
+			cfg.max_size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-t"))
+			cfg.timeout_ms = atoi(argv[++i]);
+		else {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (i == argc) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	return tc_bench(argv + i, argc - i, &cfg);
+}